@@ -38,6 +38,7 @@
 #include "common/imageio_module.h"
 #include "common/points.h"
 #include "control/conf.h"
+#include "develop/export_pool.h"
 #include "develop/imageop.h"
 
 #include <inttypes.h>
@@ -356,11 +357,13 @@ int main(int argc, char *arg[])
   // TODO: add a callback to set the bpp without going through the config
 
   int num = 1;
+  dt_dev_export_pool_begin(darktable.export_pool);
   for(GList *iter = id_list; iter; iter = g_list_next(iter), num++)
   {
     int id = GPOINTER_TO_INT(iter->data);
     storage->store(storage, sdata, id, format, fdata, num, total, high_quality, upscale);
   }
+  dt_dev_export_pool_end(darktable.export_pool);
 
   // cleanup time
   if(storage->finalize_store) storage->finalize_store(storage, sdata);
@@ -17,6 +17,7 @@
 */
 
 #include "common/collection.h"
+#include "common/database.h"
 #include "common/debug.h"
 #include "common/image.h"
 #include "common/imageio_rawspeed.h"
@@ -24,6 +25,7 @@
 #include "common/utility.h"
 #include "control/conf.h"
 #include "control/control.h"
+#include "control/jobs.h"
 
 #include <glib.h>
 #include <memory.h>
@@ -51,14 +53,18 @@ static const char *comparators[] = {
   "!=", // DT_COLLECTION_RATING_COMP_NE,
 };
 
+/* bumped by dt_collection_invalidate(), an index built at an older value is outdated */
+static gint _dt_collection_changes = 0;
+
 /* Stores the collection query, returns 1 if changed.. */
 static int _dt_collection_store(const dt_collection_t *collection, gchar *query);
-/* Counts the number of images in the current collection */
-static uint32_t _dt_collection_compute_count(const dt_collection_t *collection);
+/* Runs the query of the collection into its id index, returns the number of images */
+static uint32_t _dt_collection_build_index(const dt_collection_t *collection);
 /* signal handlers to update the cached count when something interesting might have happened.
  * we need 2 different since there are different kinds of signals we need to listen to. */
 static void _dt_collection_recount_callback_1(gpointer instace, gpointer user_data);
 static void _dt_collection_recount_callback_2(gpointer instance, uint8_t id, gpointer user_data);
+static void _dt_collection_tag_changed_callback(gpointer instance, gpointer user_data);
 
 /* determine image offset of specified imgid for the given collection */
 static int dt_collection_image_offset_with_collection(const dt_collection_t *collection, int imgid);
@@ -66,6 +72,8 @@ static int dt_collection_image_offset_with_collection(const dt_collection_t *col
 const dt_collection_t *dt_collection_new(const dt_collection_t *clone)
 {
   dt_collection_t *collection = g_malloc0(sizeof(dt_collection_t));
+  dt_pthread_mutex_init(&collection->index_mutex, NULL);
+  collection->offsets = g_hash_table_new(NULL, NULL);
 
   /* initialize collection context*/
   if(clone) /* if clone is provided let's copy it into this context */
@@ -75,7 +83,17 @@ const dt_collection_t *dt_collection_new(const dt_collection_t *clone)
     collection->where_ext = g_strdup(clone->where_ext);
     collection->query = g_strdup(clone->query);
     collection->clone = 1;
+    dt_pthread_mutex_lock((dt_pthread_mutex_t *)&clone->index_mutex);
     collection->count = clone->count;
+    collection->index_dirty = clone->index_dirty;
+    collection->index_changes = clone->index_changes;
+    if(clone->ids)
+    {
+      collection->ids = g_memdup(clone->ids, sizeof(int32_t) * clone->count);
+      for(uint32_t i = 0; i < collection->count; i++)
+        g_hash_table_insert(collection->offsets, GINT_TO_POINTER(collection->ids[i]), GUINT_TO_POINTER(i + 1));
+    }
+    dt_pthread_mutex_unlock((dt_pthread_mutex_t *)&clone->index_mutex);
   }
   else /* else we just initialize using the reset */
     dt_collection_reset(collection);
@@ -83,7 +101,7 @@ const dt_collection_t *dt_collection_new(const dt_collection_t *clone)
   /* connect to all the signals that might indicate that the count of images matching the collection changed
    */
   dt_control_signal_connect(darktable.signals, DT_SIGNAL_TAG_CHANGED,
-                            G_CALLBACK(_dt_collection_recount_callback_1), collection);
+                            G_CALLBACK(_dt_collection_tag_changed_callback), collection);
   dt_control_signal_connect(darktable.signals, DT_SIGNAL_FILMROLLS_CHANGED,
                             G_CALLBACK(_dt_collection_recount_callback_1), collection);
   dt_control_signal_connect(darktable.signals, DT_SIGNAL_FILMROLLS_REMOVED,
@@ -103,9 +121,14 @@ void dt_collection_free(const dt_collection_t *collection)
                                (gpointer)collection);
   dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_collection_recount_callback_2),
                                (gpointer)collection);
+  dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_collection_tag_changed_callback),
+                               (gpointer)collection);
 
   g_free(collection->query);
   g_free(collection->where_ext);
+  g_free(collection->ids);
+  g_hash_table_destroy(collection->offsets);
+  dt_pthread_mutex_destroy((dt_pthread_mutex_t *)&collection->index_mutex);
   g_free((dt_collection_t *)collection);
 }
 
@@ -114,7 +137,8 @@ const dt_collection_params_t *dt_collection_params(const dt_collection_t *collec
   return &collection->params;
 }
 
-int dt_collection_update(const dt_collection_t *collection)
+/* builds and stores the query string of the collection from its params */
+static int _dt_collection_build_query(const dt_collection_t *collection)
 {
   uint32_t result;
   gchar *wq, *sq, *selq, *query;
@@ -206,9 +230,35 @@ int dt_collection_update(const dt_collection_t *collection)
   g_free(selq);
   g_free(query);
 
+  return result;
+}
+
+/* makes any query still running in the background outdated and stops it. returns the new generation */
+static gint _dt_collection_cancel_query(const dt_collection_t *collection)
+{
+  dt_collection_t *c = (dt_collection_t *)collection;
+  const gint generation = g_atomic_int_add(&c->generation, 1) + 1;
+  dt_pthread_mutex_lock(&c->index_mutex);
+  if(c->query_db) sqlite3_interrupt(c->query_db);
+  dt_pthread_mutex_unlock(&c->index_mutex);
+  return generation;
+}
+
+int dt_collection_update(const dt_collection_t *collection)
+{
+  const int result = _dt_collection_build_query(collection);
+
+  _dt_collection_cancel_query(collection);
+
   /* update the cached count. collection isn't a real const anyway, we are writing to it in
-   * _dt_collection_store, too. */
-  ((dt_collection_t *)collection)->count = _dt_collection_compute_count(collection);
+   * _dt_collection_store, too. clones (like the one of the selection) often only want the query, they
+   * build it when it's used. */
+  if(collection->clone)
+  {
+    g_atomic_int_set(&((dt_collection_t *)collection)->index_dirty, TRUE);
+    return result;
+  }
+  _dt_collection_build_index(collection);
   dt_collection_hint_message(collection);
 
   return result;
@@ -427,35 +477,84 @@ static int _dt_collection_store(const dt_collection_t *collection, gchar *query)
   return 1;
 }
 
-static uint32_t _dt_collection_compute_count(const dt_collection_t *collection)
+/* runs query on db and returns the image ids in order, or NULL if it was interrupted */
+static GArray *_dt_collection_query_ids(sqlite3 *db, const gchar *query, const uint32_t query_flags)
 {
   sqlite3_stmt *stmt = NULL;
-  uint32_t count = 1;
-  const gchar *query = dt_collection_get_query(collection);
-  gchar *count_query = NULL;
+  GArray *ids = g_array_new(FALSE, FALSE, sizeof(int32_t));
 
-  gchar *fq = g_strstr_len(query, strlen(query), "FROM");
-  if((collection->params.query_flags & COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
-    count_query = dt_util_dstrcat(NULL, "SELECT COUNT(DISTINCT main.images.id) FROM main.images %s", collection->where_ext);
-  else
-    count_query = dt_util_dstrcat(count_query, "SELECT COUNT(DISTINCT id) %s", fq);
-
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), count_query, -1, &stmt, NULL);
-  if((collection->params.query_flags & COLLECTION_QUERY_USE_LIMIT)
-     && !(collection->params.query_flags & COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, query, -1, &stmt, NULL);
+  if((query_flags & COLLECTION_QUERY_USE_LIMIT) && !(query_flags & COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
   {
     DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, 0);
     DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, -1);
   }
 
-  if(sqlite3_step(stmt) == SQLITE_ROW) count = sqlite3_column_int(stmt, 0);
+  int rc;
+  while((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+  {
+    const int32_t id = sqlite3_column_int(stmt, 0);
+    g_array_append_val(ids, id);
+  }
   sqlite3_finalize(stmt);
-  g_free(count_query);
+
+  if(rc == SQLITE_INTERRUPT)
+  {
+    g_array_free(ids, TRUE);
+    return NULL;
+  }
+  return ids;
+}
+
+/* swaps in ids, queried at the image change counter changes, as the new index. to be called with index_mutex
+ * held. takes ownership of ids */
+static void _dt_collection_set_index(dt_collection_t *collection, GArray *ids, const gint changes)
+{
+  collection->index_changes = changes;
+  g_free(collection->ids);
+  collection->count = ids->len;
+  collection->ids = (int32_t *)g_array_free(ids, FALSE);
+  g_hash_table_remove_all(collection->offsets);
+  for(uint32_t i = 0; i < collection->count; i++)
+    g_hash_table_insert(collection->offsets, GINT_TO_POINTER(collection->ids[i]), GUINT_TO_POINTER(i + 1));
+}
+
+static uint32_t _dt_collection_build_index(const dt_collection_t *collection)
+{
+  dt_collection_t *c = (dt_collection_t *)collection;
+  // changes from here on are not guaranteed to be in the result
+  g_atomic_int_set(&c->index_dirty, FALSE);
+  const gint changes = g_atomic_int_get(&_dt_collection_changes);
+  const gchar *query = dt_collection_get_query(collection);
+  GArray *ids = _dt_collection_query_ids(dt_database_get(darktable.db), query, collection->params.query_flags);
+
+  dt_pthread_mutex_lock(&c->index_mutex);
+  if(ids)
+    _dt_collection_set_index(c, ids, changes);
+  else // interrupted: the old index is better than none, try again next time
+    g_atomic_int_set(&c->index_dirty, TRUE);
+  const uint32_t count = c->count;
+  dt_pthread_mutex_unlock(&c->index_mutex);
+
   return count;
 }
 
+/* rebuilds the index if something changed under it */
+static void _dt_collection_check_index(const dt_collection_t *collection)
+{
+  if(g_atomic_int_get(&collection->index_dirty)
+     || g_atomic_int_get(&collection->index_changes) != g_atomic_int_get(&_dt_collection_changes))
+    _dt_collection_build_index(collection);
+}
+
+void dt_collection_invalidate(void)
+{
+  g_atomic_int_inc(&_dt_collection_changes);
+}
+
 uint32_t dt_collection_get_count(const dt_collection_t *collection)
 {
+  _dt_collection_check_index(collection);
   return collection->count;
 }
 
@@ -517,24 +616,23 @@ GList *dt_collection_get_all(const dt_collection_t *collection, int limit)
 
 int dt_collection_get_nth(const dt_collection_t *collection, int nth)
 {
-  if(nth < 0 || nth >= dt_collection_get_count(collection))
-    return -1;
-  const gchar *query = dt_collection_get_query(collection);
-  sqlite3_stmt *stmt = NULL;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, nth);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, 1);
-
   int result = -1;
-  if(sqlite3_step(stmt) == SQLITE_ROW)
-  {
-    result  = sqlite3_column_int(stmt, 0);
-  }
-
-  sqlite3_finalize(stmt);
-
+  _dt_collection_check_index(collection);
+  dt_pthread_mutex_lock((dt_pthread_mutex_t *)&collection->index_mutex);
+  if(nth >= 0 && nth < collection->count && collection->ids) result = collection->ids[nth];
+  dt_pthread_mutex_unlock((dt_pthread_mutex_t *)&collection->index_mutex);
   return result;
+}
 
+int32_t *dt_collection_get_ids(const dt_collection_t *collection, uint32_t *count)
+{
+  int32_t *ids = NULL;
+  _dt_collection_check_index(collection);
+  dt_pthread_mutex_lock((dt_pthread_mutex_t *)&collection->index_mutex);
+  *count = collection->ids ? collection->count : 0;
+  if(*count) ids = g_memdup(collection->ids, sizeof(int32_t) * *count);
+  dt_pthread_mutex_unlock((dt_pthread_mutex_t *)&collection->index_mutex);
+  return ids;
 }
 
 GList *dt_collection_get_selected(const dt_collection_t *collection, int limit)
@@ -1137,7 +1235,166 @@ void dt_collection_deserialize(char *buf)
   dt_collection_update_query(darktable.collection);
 }
 
-void dt_collection_update_query(const dt_collection_t *collection)
+/* things to do once the index of an updated query is in place */
+static void _dt_collection_update_query_finish(const dt_collection_t *collection)
+{
+  // remove from selected images where not in this query.
+  sqlite3_stmt *stmt = NULL;
+  GList *gone = NULL;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT imgid FROM main.selected_images", -1,
+                              &stmt, NULL);
+  dt_pthread_mutex_lock((dt_pthread_mutex_t *)&collection->index_mutex);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int imgid = sqlite3_column_int(stmt, 0);
+    if(!g_hash_table_contains(collection->offsets, GINT_TO_POINTER(imgid)))
+      gone = g_list_prepend(gone, GINT_TO_POINTER(imgid));
+  }
+  dt_pthread_mutex_unlock((dt_pthread_mutex_t *)&collection->index_mutex);
+  sqlite3_finalize(stmt);
+
+  if(gone)
+  {
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.selected_images WHERE imgid = ?1",
+                                -1, &stmt, NULL);
+    for(GList *l = gone; l; l = g_list_next(l))
+    {
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, GPOINTER_TO_INT(l->data));
+      sqlite3_step(stmt);
+      sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    g_list_free(gone);
+  }
+
+  /* raise signal of collection change, only if this is an original */
+  if(!collection->clone) dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED);
+}
+
+typedef struct dt_collection_query_job_t
+{
+  dt_collection_t *collection;
+  gchar *query;
+  uint32_t query_flags;
+  gint generation;
+} dt_collection_query_job_t;
+
+typedef struct dt_collection_query_result_t
+{
+  dt_collection_t *collection;
+  GArray *ids;
+  gint generation;
+  gint changes;
+} dt_collection_query_result_t;
+
+static gboolean _dt_collection_query_outdated(const dt_collection_t *collection, const gint generation)
+{
+  return g_atomic_int_get(&collection->generation) != generation;
+}
+
+/* puts the result of a background query in place, on the gui thread like everything else that uses the index */
+static gboolean _dt_collection_query_result_swap(gpointer data)
+{
+  dt_collection_query_result_t *result = (dt_collection_query_result_t *)data;
+  dt_collection_t *collection = result->collection;
+
+  // only the result of the latest query may become the index
+  dt_pthread_mutex_lock(&collection->index_mutex);
+  const gboolean current = !_dt_collection_query_outdated(collection, result->generation);
+  if(current)
+    _dt_collection_set_index(collection, result->ids, result->changes);
+  else
+    g_array_free(result->ids, TRUE);
+  dt_pthread_mutex_unlock(&collection->index_mutex);
+  free(result);
+
+  if(current)
+  {
+    dt_collection_hint_message(collection);
+    _dt_collection_update_query_finish(collection);
+  }
+  return FALSE;
+}
+
+static int32_t _dt_collection_query_job_run(dt_job_t *job)
+{
+  dt_collection_query_job_t *params = dt_control_job_get_params(job);
+  dt_collection_t *collection = params->collection;
+
+  if(_dt_collection_query_outdated(collection, params->generation)) return 0;
+
+  // a connection of its own, which a newer update can interrupt without hitting anybody else's statements
+  const gint changes = g_atomic_int_get(&_dt_collection_changes);
+  GArray *ids = NULL;
+  sqlite3 *db = dt_database_open_readonly(darktable.db);
+  if(db)
+  {
+    dt_pthread_mutex_lock(&collection->index_mutex);
+    collection->query_db = db;
+    dt_pthread_mutex_unlock(&collection->index_mutex);
+
+    // outside WAL mode commits on the main handle interrupt the query as well, run it again then
+    for(int attempt = 0; attempt < 3 && !ids && !_dt_collection_query_outdated(collection, params->generation);
+        attempt++)
+      ids = _dt_collection_query_ids(db, params->query, params->query_flags);
+
+    dt_pthread_mutex_lock(&collection->index_mutex);
+    collection->query_db = NULL;
+    dt_pthread_mutex_unlock(&collection->index_mutex);
+    dt_database_close_readonly(darktable.db, db);
+  }
+  // in-memory library, or the writer didn't let us finish
+  if(!ids && !_dt_collection_query_outdated(collection, params->generation))
+    ids = _dt_collection_query_ids(dt_database_get(darktable.db), params->query, params->query_flags);
+  if(!ids) return 0;
+
+  dt_collection_query_result_t *result
+      = (dt_collection_query_result_t *)malloc(sizeof(dt_collection_query_result_t));
+  if(!result)
+  {
+    g_array_free(ids, TRUE);
+    return 0;
+  }
+  result->collection = collection;
+  result->ids = ids;
+  result->generation = params->generation;
+  result->changes = changes;
+  g_main_context_invoke(NULL, _dt_collection_query_result_swap, result);
+  return 0;
+}
+
+static void _dt_collection_query_job_cleanup(void *p)
+{
+  dt_collection_query_job_t *params = (dt_collection_query_job_t *)p;
+  g_free(params->query);
+  free(params);
+}
+
+/* builds the query and starts evaluating it on a background job. returns FALSE if that couldn't be done. */
+static gboolean _dt_collection_update_async(const dt_collection_t *collection)
+{
+  dt_collection_t *c = (dt_collection_t *)collection;
+  dt_job_t *job = dt_control_job_create(&_dt_collection_query_job_run, "collection query");
+  if(!job) return FALSE;
+  dt_collection_query_job_t *params = (dt_collection_query_job_t *)calloc(1, sizeof(dt_collection_query_job_t));
+  if(!params)
+  {
+    dt_control_job_dispose(job);
+    return FALSE;
+  }
+
+  _dt_collection_build_query(collection);
+
+  params->collection = c;
+  params->query = g_strdup(collection->query);
+  params->query_flags = collection->params.query_flags;
+  params->generation = _dt_collection_cancel_query(collection);
+  dt_control_job_set_params(job, params, _dt_collection_query_job_cleanup);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_FG, job);
+  return TRUE;
+}
+
+static void _dt_collection_update_query(const dt_collection_t *collection, const gboolean async)
 {
   char confname[200];
   gchar *complete_query = NULL;
@@ -1182,33 +1439,24 @@ void dt_collection_update_query(const dt_collection_t *collection)
   dt_collection_set_filter_flags(collection,
                                  (dt_collection_get_filter_flags(collection) & ~COLLECTION_FILTER_FILM_ID));
 
-  /* update query and at last the visual */
-  dt_collection_update(collection);
-
   /* free string */
   g_free(complete_query);
 
-  // remove from selected images where not in this query.
-  sqlite3_stmt *stmt = NULL;
-  const gchar *cquery = dt_collection_get_query(collection);
-  complete_query = NULL;
-  if(cquery && cquery[0] != '\0')
-  {
-    complete_query
-        = dt_util_dstrcat(complete_query, "DELETE FROM main.selected_images WHERE imgid NOT IN (%s)", cquery);
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), complete_query, -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, 0);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, -1);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+  /* update query and at last the visual */
+  if(async && _dt_collection_update_async(collection)) return;
 
-    /* free allocated strings */
-    g_free(complete_query);
-  }
+  dt_collection_update(collection);
+  _dt_collection_update_query_finish(collection);
+}
 
+void dt_collection_update_query(const dt_collection_t *collection)
+{
+  _dt_collection_update_query(collection, FALSE);
+}
 
-  /* raise signal of collection change, only if this is an original */
-  if(!collection->clone) dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED);
+void dt_collection_update_query_async(const dt_collection_t *collection)
+{
+  _dt_collection_update_query(collection, TRUE);
 }
 
 gboolean dt_collection_hint_message_internal(void *message)
@@ -1255,39 +1503,13 @@ void dt_collection_hint_message(const dt_collection_t *collection)
 
 static int dt_collection_image_offset_with_collection(const dt_collection_t *collection, int imgid)
 {
-  const gchar *qin = dt_collection_get_query(collection);
-  int offset = 0;
-  sqlite3_stmt *stmt;
-
-  if(qin)
-  {
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), qin, -1, &stmt, NULL);
-
-    // was the limit portion of the query tacked on?
-    if(collection->params.query_flags & COLLECTION_QUERY_USE_LIMIT)
-    {
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, 0);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, -1);
-    }
-
-    gboolean found = FALSE;
-
-    while(sqlite3_step(stmt) == SQLITE_ROW)
-    {
-      int id = sqlite3_column_int(stmt, 0);
-      if(imgid == id)
-      {
-        found = TRUE;
-        break;
-      }
-      offset++;
-    }
+  _dt_collection_check_index(collection);
+  dt_pthread_mutex_lock((dt_pthread_mutex_t *)&collection->index_mutex);
+  const int offset = GPOINTER_TO_UINT(g_hash_table_lookup(collection->offsets, GINT_TO_POINTER(imgid)));
+  dt_pthread_mutex_unlock((dt_pthread_mutex_t *)&collection->index_mutex);
 
-    if(!found) offset = 0;
-
-    sqlite3_finalize(stmt);
-  }
-  return offset;
+  // not found gives 0, too
+  return MAX(offset - 1, 0);
 }
 
 int dt_collection_image_offset(int imgid)
@@ -1298,25 +1520,41 @@ int dt_collection_image_offset(int imgid)
 static void _dt_collection_recount_callback_1(gpointer instace, gpointer user_data)
 {
   dt_collection_t *collection = (dt_collection_t *)user_data;
-  int old_count = collection->count;
-  collection->count = _dt_collection_compute_count(collection);
-  if(!collection->clone)
+  // a clone rebuilds when it's used
+  if(collection->clone)
   {
-    if(old_count != collection->count) dt_collection_hint_message(collection);
-    dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED);
+    g_atomic_int_set(&collection->index_dirty, TRUE);
+    return;
   }
+  int old_count = collection->count;
+  collection->count = _dt_collection_build_index(collection);
+  if(old_count != collection->count) dt_collection_hint_message(collection);
+  dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED);
+}
+
+static void _dt_collection_tag_changed_callback(gpointer instance, gpointer user_data)
+{
+  dt_collection_t *collection = (dt_collection_t *)user_data;
+  // the signal doesn't say which images changed, but when the query doesn't look at tags none of them moved
+  if(!collection->query || !strstr(collection->query, "main.tagged_images")) return;
+  // a batch of tag edits raises one signal per edit, only the first use afterwards rebuilds
+  g_atomic_int_set(&collection->index_dirty, TRUE);
+  if(!collection->clone) dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED);
 }
 
 static void _dt_collection_recount_callback_2(gpointer instance, uint8_t id, gpointer user_data)
 {
   dt_collection_t *collection = (dt_collection_t *)user_data;
-  int old_count = collection->count;
-  collection->count = _dt_collection_compute_count(collection);
-  if(!collection->clone)
+  // a clone rebuilds when it's used
+  if(collection->clone)
   {
-    if(old_count != collection->count) dt_collection_hint_message(collection);
-    dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED);
+    g_atomic_int_set(&collection->index_dirty, TRUE);
+    return;
   }
+  int old_count = collection->count;
+  collection->count = _dt_collection_build_index(collection);
+  if(old_count != collection->count) dt_collection_hint_message(collection);
+  dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED);
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include "common/dtpthread.h"
 #include <glib.h>
 #include <inttypes.h>
 
@@ -129,6 +130,19 @@ typedef struct dt_collection_t
   gchar *query;
   gchar *where_ext;
   unsigned int count;
+  /* the ids of the collection in query order and a map from id to position + 1, built whenever the count
+   * is computed so that nth and offset lookups don't need the database. guarded by index_mutex. */
+  int32_t *ids;
+  GHashTable *offsets;
+  dt_pthread_mutex_t index_mutex;
+  /* set when the query changed or the index couldn't be built, it is rebuilt the next time it's used */
+  gint index_dirty;
+  /* the value of the image change counter the index was built at, see dt_collection_invalidate() */
+  gint index_changes;
+  /* bumped by every update, background queries of older generations are dropped */
+  gint generation;
+  /* connection of the background query running right now, an update interrupts it. guarded by index_mutex */
+  struct sqlite3 *query_db;
   dt_collection_params_t params;
   dt_collection_params_t store;
 } dt_collection_t;
@@ -182,10 +196,16 @@ gboolean dt_collection_get_sort_descending(const dt_collection_t *collection);
 /** get the part of the query for sorting the collection **/
 gchar *dt_collection_get_sort_query(const dt_collection_t *collection);
 
+/** images changed in a way that may reorder or filter collections: the index of every collection, clones
+ * included, is rebuilt the next time it's used. dt_image_cache_write_release() calls this for everything
+ * stored in the images table, other tables (labels, metadata, ...) have to call it themselves. */
+void dt_collection_invalidate(void);
 /** get the count of query */
 uint32_t dt_collection_get_count(const dt_collection_t *collection);
 /** get the nth image in the query */
 int dt_collection_get_nth(const dt_collection_t *collection, int nth);
+/** get a copy of the image ids in collection order, free with g_free() */
+int32_t *dt_collection_get_ids(const dt_collection_t *collection, uint32_t *count);
 /** get all image ids order as current selection. no more than limit many images are returned, <0 ==
  * unlimited */
 GList *dt_collection_get_all(const dt_collection_t *collection, int limit);
@@ -197,6 +217,9 @@ uint32_t dt_collection_get_selected_count(const dt_collection_t *collection);
 
 /** update query by conf vars */
 void dt_collection_update_query(const dt_collection_t *collection);
+/** same, but the query is evaluated on a background job; the index, the selection and the
+ * collection-changed signal follow when it is done. a newer update cancels a pending one. */
+void dt_collection_update_query_async(const dt_collection_t *collection);
 
 /** updates the hint message for collection */
 void dt_collection_hint_message(const dt_collection_t *collection);
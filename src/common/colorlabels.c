@@ -35,6 +35,7 @@ void dt_colorlabels_remove_labels_selection()
   DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
                         "DELETE FROM main.color_labels WHERE imgid IN (SELECT imgid FROM main.selected_images)",
                         NULL, NULL, NULL);
+  dt_collection_invalidate();
 }
 
 void dt_colorlabels_remove_labels(const int imgid)
@@ -45,6 +46,7 @@ void dt_colorlabels_remove_labels(const int imgid)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  dt_collection_invalidate();
 }
 
 void dt_colorlabels_set_label(const int imgid, const int color)
@@ -56,6 +58,7 @@ void dt_colorlabels_set_label(const int imgid, const int color)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, color);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  dt_collection_invalidate();
 }
 
 void dt_colorlabels_remove_label(const int imgid, const int color)
@@ -67,6 +70,7 @@ void dt_colorlabels_remove_label(const int imgid, const int color)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, color);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  dt_collection_invalidate();
 }
 
 void dt_colorlabels_toggle_label_selection(const int color)
@@ -104,6 +108,7 @@ void dt_colorlabels_toggle_label_selection(const int color)
   }
   sqlite3_finalize(stmt);
 
+  dt_collection_invalidate();
   dt_collection_hint_message(darktable.collection);
 }
 
@@ -136,6 +141,7 @@ void dt_colorlabels_toggle_label(const int imgid, const int color)
   }
   sqlite3_finalize(stmt);
 
+  dt_collection_invalidate();
   dt_collection_hint_message(darktable.collection);
 }
 
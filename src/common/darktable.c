@@ -34,6 +34,7 @@
 #include "common/exif.h"
 #include "common/pwstorage/pwstorage.h"
 #include "common/selection.h"
+#include "common/sidecar_writer.h"
 #include "common/system_signal_handling.h"
 #ifdef HAVE_GPHOTO2
 #include "common/camera_control.h"
@@ -41,9 +42,11 @@
 #include "bauhaus/bauhaus.h"
 #include "common/cpuid.h"
 #include "common/film.h"
+#include "common/film_monitor.h"
 #include "common/grealpath.h"
 #include "common/image.h"
 #include "common/image_cache.h"
+#include "common/image_readahead.h"
 #include "common/imageio_module.h"
 #include "common/mipmap_cache.h"
 #include "common/noiseprofiles.h"
@@ -57,6 +60,7 @@
 #include "control/jobs/control_jobs.h"
 #include "control/signal.h"
 #include "develop/blend.h"
+#include "develop/export_pool.h"
 #include "develop/imageop.h"
 #include "gui/gtk.h"
 #include "gui/guides.h"
@@ -903,6 +907,10 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   darktable.mipmap_cache = (dt_mipmap_cache_t *)calloc(1, sizeof(dt_mipmap_cache_t));
   dt_mipmap_cache_init(darktable.mipmap_cache);
 
+  darktable.sidecar_writer = dt_sidecar_writer_new();
+  darktable.export_pool = dt_dev_export_pool_new();
+  darktable.image_readahead = dt_image_readahead_new();
+
   // The GUI must be initialized before the views, because the init()
   // functions of the views depend on darktable.control->accels_* to register
   // their keyboard accelerators
@@ -1019,6 +1027,9 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
   if(init_gui) dt_ctl_switch_mode_to(mode);
 
+  // pick up images that get added to the film roll folders while we are running
+  if(init_gui) darktable.film_monitor = dt_film_monitor_new();
+
   // last but not least construct the popup that asks the user about images whose xmp files are newer than the
   // db entry
   if(init_gui && changed_xmp_files)
@@ -1045,6 +1056,9 @@ void dt_cleanup()
     dt_ctl_switch_mode_to("");
     dt_dbus_destroy(darktable.dbus);
 
+    dt_film_monitor_free(darktable.film_monitor);
+    darktable.film_monitor = NULL;
+
     dt_control_shutdown(darktable.control);
 
     dt_lib_cleanup(darktable.lib);
@@ -1061,6 +1075,13 @@ void dt_cleanup()
     free(darktable.imageio);
     free(darktable.gui);
   }
+  dt_image_readahead_free(darktable.image_readahead);
+  darktable.image_readahead = NULL;
+  dt_dev_export_pool_free(darktable.export_pool);
+  darktable.export_pool = NULL;
+  // the last edits may still be waiting to be written to the sidecars
+  dt_sidecar_writer_free(darktable.sidecar_writer);
+  darktable.sidecar_writer = NULL;
   dt_image_cache_cleanup(darktable.image_cache);
   free(darktable.image_cache);
   dt_mipmap_cache_cleanup(darktable.mipmap_cache);
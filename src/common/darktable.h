@@ -201,6 +201,10 @@ typedef struct darktable_t
   struct dt_gui_gtk_t *gui;
   struct dt_mipmap_cache_t *mipmap_cache;
   struct dt_image_cache_t *image_cache;
+  struct dt_sidecar_writer_t *sidecar_writer;
+  struct dt_film_monitor_t *film_monitor;
+  struct dt_dev_export_pool_t *export_pool;
+  struct dt_image_readahead_t *image_readahead;
   struct dt_bauhaus_t *bauhaus;
   const struct dt_database_t *db;
   const struct dt_pwstorage_t *pwstorage;
@@ -37,7 +37,7 @@
 
 // whenever _create_*_schema() gets changed you HAVE to bump this version and add an update path to
 // _upgrade_*_schema_step()!
-#define CURRENT_DATABASE_VERSION_LIBRARY 15
+#define CURRENT_DATABASE_VERSION_LIBRARY 17
 #define CURRENT_DATABASE_VERSION_DATA 1
 
 typedef struct dt_database_t
@@ -53,10 +53,63 @@ typedef struct dt_database_t
   /* ondisk DB */
   sqlite3 *handle;
 
+  /* library and data are in WAL mode, readers get their own connections */
+  gboolean wal;
+  /* read-only connections, one per thread (GThread * -> sqlite3 *) */
+  GHashTable *readers;
+  dt_pthread_mutex_t readers_mutex;
+  /* read-only connections outside WAL mode, the main handle interrupts them when it wants to write */
+  GList *interruptible;
+
+  /* the main handle has only one transaction at a time, see dt_database_start_transaction() */
+  GRecMutex transaction_mutex;
+
   gchar *error_message, *error_dbfilename;
 } dt_database_t;
 
 
+/* busy handler of the main handle outside WAL mode. the shared locks in the way are those of the read-only
+ * connections of background queries, which can be run again later: interrupt them and retry. */
+static int _database_busy_handler(void *data, int count)
+{
+  dt_database_t *db = (dt_database_t *)data;
+  dt_pthread_mutex_lock(&db->readers_mutex);
+  for(GList *l = db->interruptible; l; l = g_list_next(l)) sqlite3_interrupt((sqlite3 *)l->data);
+  dt_pthread_mutex_unlock(&db->readers_mutex);
+
+  // a lock held by somebody else doesn't go away like this, give up after a second
+  if(count >= 1000) return 0;
+  g_usleep(1000);
+  return 1;
+}
+
+/* checks the journal mode of one of the attached databases */
+static gboolean _database_is_wal(sqlite3 *handle, const char *schema)
+{
+  gboolean wal = FALSE;
+  sqlite3_stmt *stmt;
+  gchar *query = g_strdup_printf("PRAGMA %s.journal_mode", schema);
+  if(sqlite3_prepare_v2(handle, query, -1, &stmt, NULL) == SQLITE_OK)
+  {
+    if(sqlite3_step(stmt) == SQLITE_ROW)
+      wal = !g_ascii_strcasecmp((const char *)sqlite3_column_text(stmt, 0), "wal");
+    sqlite3_finalize(stmt);
+  }
+  g_free(query);
+  return wal;
+}
+
+/* a left over write-ahead log would be applied to a new database with the same name */
+static void _database_unlink_wal(const char *filename)
+{
+  gchar *wal = g_strdup_printf("%s-wal", filename);
+  gchar *shm = g_strdup_printf("%s-shm", filename);
+  g_unlink(wal);
+  g_unlink(shm);
+  g_free(wal);
+  g_free(shm);
+}
+
 /* migrates database from old place to new */
 static void _database_migrate_to_xdg_structure();
 
@@ -967,6 +1020,44 @@ static int _upgrade_library_schema_step(dt_database_t *db, int version)
 
     sqlite3_exec(db->handle, "COMMIT", NULL, NULL, NULL);
     new_version = 15;
+  }
+  else if(version == 15)
+  {
+    // 15 -> indexes for the collection queries that look up images by tag, color label or metadata value.
+    //       (imgid, tagid) and (imgid, color) are already covered by the primary key and color_labels_idx.
+    //       see tools/benchmark_library_db.py
+    sqlite3_exec(db->handle, "BEGIN TRANSACTION", NULL, NULL, NULL);
+
+    TRY_EXEC("DROP INDEX IF EXISTS main.tagged_images_tagid_index",
+             "[init] can't drop index `tagged_images_tagid_index' from database\n");
+
+    TRY_EXEC("CREATE INDEX main.tagged_images_tagid_index ON tagged_images (tagid, imgid)",
+             "[init] can't create index `tagged_images_tagid_index' in database\n");
+
+    TRY_EXEC("CREATE INDEX main.color_labels_color_index ON color_labels (color, imgid)",
+             "[init] can't create index `color_labels_color_index' in database\n");
+
+    TRY_EXEC("CREATE INDEX main.metadata_key_value_index ON meta_data (key, value)",
+             "[init] can't create index `metadata_key_value_index' in database\n");
+
+    sqlite3_exec(db->handle, "COMMIT", NULL, NULL, NULL);
+
+    // give the query planner statistics to choose between the new indexes and the old ones
+    sqlite3_exec(db->handle, "ANALYZE main", NULL, NULL, NULL);
+    new_version = 16;
+  }
+  else if(version == 16)
+  {
+    // 16 -> size and mtime of the imported files and their sidecars, so that importing a folder again only
+    //       touches the files that changed
+    sqlite3_exec(db->handle, "BEGIN TRANSACTION", NULL, NULL, NULL);
+
+    TRY_EXEC("CREATE TABLE main.film_fingerprints (film_id INTEGER, filename VARCHAR, size INTEGER, "
+             "mtime INTEGER, xmp_mtime INTEGER, PRIMARY KEY (film_id, filename))",
+             "[init] can't create table `film_fingerprints' in database\n");
+
+    sqlite3_exec(db->handle, "COMMIT", NULL, NULL, NULL);
+    new_version = 17;
   } // maybe in the future, see commented out code elsewhere
     //   else if(version == XXX)
     //   {
@@ -1107,7 +1198,8 @@ static void _create_library_schema(dt_database_t *db)
   ////////////////////////////// tagged_images
   sqlite3_exec(db->handle, "CREATE TABLE main.tagged_images (imgid INTEGER, tagid INTEGER, "
                            "PRIMARY KEY (imgid, tagid))", NULL, NULL, NULL);
-  sqlite3_exec(db->handle, "CREATE INDEX main.tagged_images_tagid_index ON tagged_images (tagid)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.tagged_images_tagid_index ON tagged_images (tagid, imgid)", NULL, NULL,
+               NULL);
   ////////////////////////////// used_tags
   sqlite3_exec(db->handle, "CREATE TABLE main.used_tags (id INTEGER, name VARCHAR NOT NULL)", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE UNIQUE INDEX main.used_tags_idx ON used_tags (id, name)", NULL, NULL, NULL);
@@ -1115,9 +1207,16 @@ static void _create_library_schema(dt_database_t *db)
   sqlite3_exec(db->handle, "CREATE TABLE main.color_labels (imgid INTEGER, color INTEGER)", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE UNIQUE INDEX main.color_labels_idx ON color_labels (imgid, color)", NULL, NULL,
                NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.color_labels_color_index ON color_labels (color, imgid)", NULL, NULL,
+               NULL);
   ////////////////////////////// meta_data
   sqlite3_exec(db->handle, "CREATE TABLE main.meta_data (id INTEGER, key INTEGER, value VARCHAR)", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE INDEX main.metadata_index ON meta_data (id, key)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE INDEX main.metadata_key_value_index ON meta_data (key, value)", NULL, NULL, NULL);
+  ////////////////////////////// film_fingerprints
+  sqlite3_exec(db->handle, "CREATE TABLE main.film_fingerprints (film_id INTEGER, filename VARCHAR, size INTEGER, "
+                           "mtime INTEGER, xmp_mtime INTEGER, PRIMARY KEY (film_id, filename))",
+               NULL, NULL, NULL);
 }
 
 /* create the current database schema and set the version in db_info accordingly */
@@ -1538,6 +1637,7 @@ start:
   dt_database_t *db = (dt_database_t *)g_malloc0(sizeof(dt_database_t));
   db->dbfilename_data = g_strdup(dbfilename_data);
   db->dbfilename_library = g_strdup(dbfilename_library);
+  g_rec_mutex_init(&db->transaction_mutex);
 
   /* having more than one instance of darktable using the same database is a bad idea */
   /* try to get locks for the databases */
@@ -1593,8 +1693,30 @@ start:
 
   // some sqlite3 config
   sqlite3_exec(db->handle, "PRAGMA synchronous = OFF", NULL, NULL, NULL);
-  sqlite3_exec(db->handle, "PRAGMA journal_mode = MEMORY", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "PRAGMA page_size = 32768", NULL, NULL, NULL);
+  // with a write-ahead log readers on other connections don't block the writer and vice versa. switching back
+  // to MEMORY also turns a library that was used in WAL mode before back into a single file.
+  if(dt_conf_get_bool("database_wal") && strcmp(dbfilename_library, ":memory:") && load_data)
+  {
+    sqlite3_exec(db->handle, "PRAGMA main.journal_mode = WAL", NULL, NULL, NULL);
+    sqlite3_exec(db->handle, "PRAGMA data.journal_mode = WAL", NULL, NULL, NULL);
+    db->wal = _database_is_wal(db->handle, "main") && _database_is_wal(db->handle, "data");
+    if(!db->wal) fprintf(stderr, "[init] couldn't switch the database to WAL mode\n");
+  }
+  if(!db->wal)
+  {
+    sqlite3_exec(db->handle, "PRAGMA main.journal_mode = MEMORY", NULL, NULL, NULL);
+    sqlite3_exec(db->handle, "PRAGMA data.journal_mode = MEMORY", NULL, NULL, NULL);
+  }
+  db->readers = g_hash_table_new(g_direct_hash, g_direct_equal);
+  dt_pthread_mutex_init(&db->readers_mutex, NULL);
+  // with WAL a checkpoint may have to wait for a read connection, do that instead of failing the write.
+  // without, a read connection keeps the main handle from committing until its query is done, so it gets
+  // interrupted (see dt_database_open_readonly()).
+  if(db->wal)
+    sqlite3_busy_timeout(db->handle, 5000);
+  else
+    sqlite3_busy_handler(db->handle, _database_busy_handler, db);
 
   /* now that we got functional databases that are locked for us we can make sure that the schema is set up */
 
@@ -1667,6 +1789,7 @@ start:
           fprintf(stderr, " ... ok\n");
         else
           fprintf(stderr, " ... failed\n");
+        _database_unlink_wal(dbfilename_data);
 
         goto start;
       }
@@ -1743,6 +1866,7 @@ start:
         fprintf(stderr, " ... ok\n");
       else
         fprintf(stderr, " ... failed\n");
+      _database_unlink_wal(dbfilename_library);
 
       goto start;
     }
@@ -1820,7 +1944,18 @@ error:
 
 void dt_database_destroy(const dt_database_t *db)
 {
+  if(db->readers)
+  {
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, db->readers);
+    while(g_hash_table_iter_next(&iter, &key, &value)) sqlite3_close((sqlite3 *)value);
+    g_hash_table_destroy(db->readers);
+    g_list_free(db->interruptible);
+    dt_pthread_mutex_destroy(&((dt_database_t *)db)->readers_mutex);
+  }
   sqlite3_close(db->handle);
+  g_rec_mutex_clear(&((dt_database_t *)db)->transaction_mutex);
   if (db->lockfile_data)
   {
     g_unlink(db->lockfile_data);
@@ -1841,6 +1976,115 @@ sqlite3 *dt_database_get(const dt_database_t *db)
   return db ? db->handle : NULL;
 }
 
+sqlite3 *dt_database_open_readonly(const struct dt_database_t *db)
+{
+  if(!db->handle || !strcmp(db->dbfilename_library, ":memory:")) return NULL;
+
+  sqlite3 *handle = NULL;
+  if(sqlite3_open_v2(db->dbfilename_library, &handle, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL)
+     != SQLITE_OK)
+  {
+    fprintf(stderr, "[database] could not open read-only connection to `%s': %s\n", db->dbfilename_library,
+            sqlite3_errmsg(handle));
+    sqlite3_close(handle);
+    return NULL;
+  }
+
+  // attached databases share the read-only flag of the connection
+  sqlite3_stmt *stmt;
+  int rc = sqlite3_prepare_v2(handle, "ATTACH DATABASE ?1 AS data", -1, &stmt, NULL);
+  sqlite3_bind_text(stmt, 1, db->dbfilename_data, -1, SQLITE_TRANSIENT);
+  if(rc != SQLITE_OK || sqlite3_step(stmt) != SQLITE_DONE)
+  {
+    fprintf(stderr, "[database] could not attach `%s' read-only\n", db->dbfilename_data);
+    sqlite3_finalize(stmt);
+    sqlite3_close(handle);
+    return NULL;
+  }
+  sqlite3_finalize(stmt);
+
+  sqlite3_busy_timeout(handle, 5000);
+
+  // without a write-ahead log the shared lock of a running query blocks every commit on the main handle
+  if(!db->wal)
+  {
+    dt_database_t *d = (dt_database_t *)db;
+    dt_pthread_mutex_lock(&d->readers_mutex);
+    d->interruptible = g_list_prepend(d->interruptible, handle);
+    dt_pthread_mutex_unlock(&d->readers_mutex);
+  }
+  return handle;
+}
+
+void dt_database_close_readonly(const struct dt_database_t *db, sqlite3 *handle)
+{
+  if(!handle) return;
+  dt_database_t *d = (dt_database_t *)db;
+  dt_pthread_mutex_lock(&d->readers_mutex);
+  d->interruptible = g_list_remove(d->interruptible, handle);
+  dt_pthread_mutex_unlock(&d->readers_mutex);
+  sqlite3_close(handle);
+}
+
+sqlite3 *dt_database_get_reader(const struct dt_database_t *db)
+{
+  if(!db) return NULL;
+  // a transaction that is open on the writer might be our own, its changes are only visible there. the
+  // check is only conservative for transactions of other threads.
+  if(!db->wal || !sqlite3_get_autocommit(db->handle)) return db->handle;
+
+  dt_database_t *d = (dt_database_t *)db;
+  GThread *self = g_thread_self();
+  dt_pthread_mutex_lock(&d->readers_mutex);
+  sqlite3 *handle = g_hash_table_lookup(d->readers, self);
+  dt_pthread_mutex_unlock(&d->readers_mutex);
+  if(handle) return handle;
+
+  handle = dt_database_open_readonly(db);
+  if(!handle) return db->handle;
+
+  dt_pthread_mutex_lock(&d->readers_mutex);
+  g_hash_table_insert(d->readers, self, handle);
+  dt_print(DT_DEBUG_SQL, "[database] opened read connection #%u\n", g_hash_table_size(d->readers));
+  dt_pthread_mutex_unlock(&d->readers_mutex);
+  return handle;
+}
+
+static void _database_transaction_exec(const dt_database_t *db, const char *sql)
+{
+  char *errmsg = NULL;
+  if(sqlite3_exec(db->handle, sql, NULL, NULL, &errmsg) != SQLITE_OK)
+  {
+    fprintf(stderr, "[database] `%s' failed: %s\n", sql, errmsg);
+    sqlite3_free(errmsg);
+  }
+}
+
+// savepoints nest, so does the mutex. the outermost savepoint begins and ends the transaction.
+void dt_database_start_transaction(const struct dt_database_t *db)
+{
+  g_rec_mutex_lock(&((dt_database_t *)db)->transaction_mutex);
+  _database_transaction_exec(db, "SAVEPOINT dt_transaction");
+}
+
+void dt_database_release_transaction(const struct dt_database_t *db)
+{
+  _database_transaction_exec(db, "RELEASE dt_transaction");
+  g_rec_mutex_unlock(&((dt_database_t *)db)->transaction_mutex);
+}
+
+void dt_database_rollback_transaction(const struct dt_database_t *db)
+{
+  _database_transaction_exec(db, "ROLLBACK TO dt_transaction");
+  _database_transaction_exec(db, "RELEASE dt_transaction");
+  g_rec_mutex_unlock(&((dt_database_t *)db)->transaction_mutex);
+}
+
+gboolean dt_database_is_wal(const struct dt_database_t *db)
+{
+  return db && db->wal;
+}
+
 const gchar *dt_database_get_path(const struct dt_database_t *db)
 {
   return db->dbfilename_library;
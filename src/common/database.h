@@ -28,6 +28,28 @@ struct dt_database_t *dt_database_init(const char *alternative, const gboolean l
 void dt_database_destroy(const struct dt_database_t *);
 /** get handle */
 struct sqlite3 *dt_database_get(const struct dt_database_t *);
+/** opens an additional read-only connection to library and data, for queries on background threads.
+ * returns NULL for an in-memory library, close it with dt_database_close_readonly(). outside WAL mode a
+ * write on the main handle interrupts the queries running on it (SQLITE_INTERRUPT), run them again. */
+struct sqlite3 *dt_database_open_readonly(const struct dt_database_t *db);
+void dt_database_close_readonly(const struct dt_database_t *db, struct sqlite3 *handle);
+/** get a read-only handle for the calling thread. in WAL mode every thread gets its own connection which
+ * doesn't wait for writers on the main handle, otherwise (or while a transaction is open on the main handle)
+ * this is the main handle. only for SELECTs that don't touch the memory database. don't close it. */
+struct sqlite3 *dt_database_get_reader(const struct dt_database_t *db);
+/** start a transaction on the main handle. there is only one for all threads, so this waits until the
+ * transactions of other threads have ended. transactions of the same thread nest. end it with either
+ * dt_database_release_transaction() or dt_database_rollback_transaction().
+ * the lock only orders threads that take it: a plain statement that another thread runs on the main handle
+ * meanwhile becomes part of the open transaction, is committed with it and undone by a rollback. writes
+ * that must not end up in somebody else's transaction have to be wrapped in one of their own. */
+void dt_database_start_transaction(const struct dt_database_t *db);
+/** commit the changes since the matching dt_database_start_transaction() */
+void dt_database_release_transaction(const struct dt_database_t *db);
+/** undo the changes since the matching dt_database_start_transaction() */
+void dt_database_rollback_transaction(const struct dt_database_t *db);
+/** TRUE if library and data are in WAL mode */
+gboolean dt_database_is_wal(const struct dt_database_t *db);
 /** Returns database path */
 const gchar *dt_database_get_path(const struct dt_database_t *db);
 /** test if database was already locked by another instance */
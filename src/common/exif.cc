@@ -57,6 +57,7 @@ extern "C" {
 #include "common/darktable.h"
 #include "common/debug.h"
 #include "common/exif.h"
+#include "common/exif_probe.h"
 #include "common/image_cache.h"
 #include "common/imageio.h"
 #include "common/imageio_jpeg.h"
@@ -1031,10 +1032,7 @@ int dt_exif_get_thumbnail(const char *path, uint8_t **buffer, size_t *size, char
   }
 }
 
-/** read the metadata of an image.
- * XMP data trumps IPTC data trumps EXIF data
- */
-int dt_exif_read(dt_image_t *img, const char *path)
+static void dt_exif_read_mtime(dt_image_t *img, const char *path)
 {
   // at least set datetime taken to something useful in case there is no exif data in this file (pfm, png,
   // ...)
@@ -1045,39 +1043,180 @@ int dt_exif_read(dt_image_t *img, const char *path)
     struct tm result;
     strftime(img->exif_datetime_taken, 20, "%Y:%m:%d %H:%M:%S", localtime_r(&statbuf.st_mtime, &result));
   }
+}
+
+// the part of dt_exif_read() after the file has been opened and parsed
+static int dt_exif_read_image(dt_image_t *img, Exiv2::Image *image)
+{
+  bool res = true;
+
+  // EXIF metadata
+  Exiv2::ExifData &exifData = image->exifData();
+  if(!exifData.empty())
+    res = dt_exif_read_exif_data(img, exifData);
+  else
+    img->exif_inited = 1;
+
+  // these get overwritten by IPTC and XMP. is that how it should work?
+  dt_exif_apply_global_overwrites(img);
+
+  // IPTC metadata.
+  Exiv2::IptcData &iptcData = image->iptcData();
+  if(!iptcData.empty()) res = dt_exif_read_iptc_data(img, iptcData) && res;
+
+  // XMP metadata
+  Exiv2::XmpData &xmpData = image->xmpData();
+  if(!xmpData.empty()) res = dt_exif_read_xmp_data(img, xmpData, -1, true) && res;
+
+  // Initialize size - don't wait for full raw to be loaded to get this
+  // information. If use_embedded_thumbnail is set, it will take a
+  // change in development history to have this information
+  img->height = image->pixelHeight();
+  img->width = image->pixelWidth();
+
+  return res ? 0 : 1;
+}
+
+/** read the metadata of an image.
+ * XMP data trumps IPTC data trumps EXIF data
+ */
+int dt_exif_read(dt_image_t *img, const char *path)
+{
+  dt_exif_read_mtime(img, path);
 
   try
   {
     std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(path));
     assert(image.get() != 0);
     image->readMetadata();
-    bool res = true;
+    return dt_exif_read_image(img, image.get());
+  }
+  catch(Exiv2::AnyError &e)
+  {
+    std::string s(e.what());
+    std::cerr << "[exiv2] " << path << ": " << s << std::endl;
+    return 1;
+  }
+}
 
-    // EXIF metadata
-    Exiv2::ExifData &exifData = image->exifData();
-    if(!exifData.empty())
-      res = dt_exif_read_exif_data(img, exifData);
+struct dt_exif_preread_t
+{
+  std::unique_ptr<Exiv2::Image> image; // the image file, NULL if it couldn't be read or was probed
+  std::unique_ptr<Exiv2::Image> xmp;   // its .xmp sidecar, NULL if there is none
+  bool probed;                         // probe holds everything we need from the image file
+  dt_exif_probe_t probe;
+};
+
+// the equivalent of dt_exif_read_image() for the fields dt_exif_probe() found
+static int dt_exif_read_probe(dt_image_t *img, const dt_exif_probe_t *probe)
+{
+  g_strlcpy(img->exif_maker, probe->maker, sizeof(img->exif_maker));
+  g_strlcpy(img->exif_model, probe->model, sizeof(img->exif_model));
+  g_strlcpy(img->exif_lens, probe->lens, sizeof(img->exif_lens));
+  dt_image_refresh_makermodel(img);
+
+  img->exif_exposure = probe->exposure;
+  img->exif_aperture = probe->aperture;
+  img->exif_iso = probe->iso;
+  img->exif_focal_length = probe->focal_length;
+  if(probe->focal_length_35mm > 0.0f && img->exif_focal_length > 0.0f)
+    img->exif_crop = probe->focal_length_35mm / img->exif_focal_length;
+  img->exif_focus_distance = probe->focus_distance;
+  if(probe->orientation) img->orientation = dt_image_orientation_to_flip_bits(probe->orientation);
+  g_strlcpy(img->exif_datetime_taken, probe->datetime_taken, sizeof(img->exif_datetime_taken));
+
+  if(probe->artist[0]) dt_metadata_set(img->id, "Xmp.dc.creator", probe->artist);
+  if(probe->copyright[0]) dt_metadata_set(img->id, "Xmp.dc.rights", probe->copyright);
+
+  if(probe->rating != -2)
+  {
+    int stars = probe->rating;
+    if(stars == 0)
+      stars = dt_conf_get_int("ui_last/import_initial_rating");
     else
-      img->exif_inited = 1;
+      stars = (stars == -1) ? 6 : stars;
+    img->flags = (img->flags & ~0x7) | (0x7 & stars);
+  }
 
-    // these get overwritten by IPTC and XMP. is that how it should work?
-    dt_exif_apply_global_overwrites(img);
+  if(probe->has_color_matrix)
+    for(int i = 0; i < 9; i++) img->d65_color_matrix[i] = probe->color_matrix[i];
 
-    // IPTC metadata.
-    Exiv2::IptcData &iptcData = image->iptcData();
-    if(!iptcData.empty()) res = dt_exif_read_iptc_data(img, iptcData) && res;
+  if(dt_image_is_ldr(img))
+  {
+    if(probe->colorspace == 0x01)
+      img->colorspace = DT_IMAGE_COLORSPACE_SRGB;
+    else if(probe->colorspace == 0x02)
+      img->colorspace = DT_IMAGE_COLORSPACE_ADOBE_RGB;
+  }
 
-    // XMP metadata
-    Exiv2::XmpData &xmpData = image->xmpData();
-    if(!xmpData.empty()) res = dt_exif_read_xmp_data(img, xmpData, -1, true) && res;
+  img->exif_inited = 1;
 
-    // Initialize size - don't wait for full raw to be loaded to get this
-    // information. If use_embedded_thumbnail is set, it will take a
-    // change in development history to have this information
-    img->height = image->pixelHeight();
-    img->width = image->pixelWidth();
+  dt_exif_apply_global_overwrites(img);
 
-    return res ? 0 : 1;
+  img->width = probe->width;
+  img->height = probe->height;
+
+  if(!std::isnan(probe->latitude)) img->latitude = probe->latitude;
+  if(!std::isnan(probe->longitude)) img->longitude = probe->longitude;
+  if(!std::isnan(probe->elevation)) img->elevation = probe->elevation;
+
+  return 0;
+}
+
+dt_exif_preread_t *dt_exif_preread(const char *path)
+{
+  dt_exif_preread_t *pre = new dt_exif_preread_t;
+  // reading only the standard tags is a lot faster than having exiv2 parse the whole file, most of all on
+  // network shares. it can't decode the maker notes though, so it's optional.
+  pre->probed = dt_conf_get_bool("import_fast_exif_probe") && !dt_exif_probe(path, &pre->probe);
+  if(!pre->probed)
+  {
+    try
+    {
+      pre->image.reset(Exiv2::ImageFactory::open(path).release());
+      pre->image->readMetadata();
+    }
+    catch(Exiv2::AnyError &e)
+    {
+      std::string s(e.what());
+      std::cerr << "[exiv2] " << path << ": " << s << std::endl;
+      pre->image.reset();
+    }
+  }
+
+  gchar *xmp_path = g_strconcat(path, ".xmp", NULL);
+  if(g_file_test(xmp_path, G_FILE_TEST_IS_REGULAR))
+  {
+    try
+    {
+      pre->xmp.reset(Exiv2::ImageFactory::open(xmp_path).release());
+      pre->xmp->readMetadata();
+    }
+    catch(Exiv2::AnyError &e)
+    {
+      pre->xmp.reset();
+    }
+  }
+  g_free(xmp_path);
+  return pre;
+}
+
+void dt_exif_preread_free(dt_exif_preread_t *pre)
+{
+  delete pre;
+}
+
+int dt_exif_read_preread(dt_image_t *img, const char *path, const dt_exif_preread_t *pre)
+{
+  if(!pre) return dt_exif_read(img, path);
+
+  dt_exif_read_mtime(img, path);
+  if(pre->probed) return dt_exif_read_probe(img, &pre->probe);
+  if(!pre->image.get()) return 1;
+
+  try
+  {
+    return dt_exif_read_image(img, pre->image.get());
   }
   catch(Exiv2::AnyError &e)
   {
@@ -1145,6 +1284,22 @@ int dt_exif_write_blob(uint8_t *blob, uint32_t size, const char *path, const int
   return 1;
 }
 
+// serializes exifData into a newly allocated blob with the "Exif\0\0" header, returns its length or 0
+static int dt_exif_encode_blob(Exiv2::ExifData &exifData, uint8_t **buf)
+{
+  Exiv2::Blob blob;
+  Exiv2::ExifParser::encode(blob, Exiv2::bigEndian, exifData);
+  const int length = blob.size();
+  *buf = (uint8_t *)malloc(length+6);
+  if (!*buf)
+  {
+    return 0;
+  }
+  memcpy(*buf, "Exif\000\000", 6);
+  memcpy(*buf + 6, &(blob[0]), length);
+  return length + 6;
+}
+
 int dt_exif_read_blob(uint8_t **buf, const char *path, const int imgid, const int sRGB, const int out_width,
                       const int out_height, const int dng_mode)
 {
@@ -1425,17 +1580,7 @@ int dt_exif_read_blob(uint8_t **buf, const char *path, const int imgid, const in
       dt_image_cache_read_release(darktable.image_cache, cimg);
     }
 
-    Exiv2::Blob blob;
-    Exiv2::ExifParser::encode(blob, Exiv2::bigEndian, exifData);
-    const int length = blob.size();
-    *buf = (uint8_t *)malloc(length+6);
-    if (!*buf)
-    {
-      return 0;
-    }
-    memcpy(*buf, "Exif\000\000", 6);
-    memcpy(*buf + 6, &(blob[0]), length);
-    return length + 6;
+    return dt_exif_encode_blob(exifData, buf);
   }
   catch(Exiv2::AnyError &e)
   {
@@ -1448,6 +1593,31 @@ int dt_exif_read_blob(uint8_t **buf, const char *path, const int imgid, const in
   }
 }
 
+int dt_exif_blob_set_dimensions(uint8_t **buf, const uint8_t *blob, const int length, const int out_width,
+                                const int out_height)
+{
+  *buf = NULL;
+  if(!blob || length <= 6) return 0;
+  try
+  {
+    Exiv2::ExifData exifData;
+    Exiv2::ExifParser::decode(exifData, blob + 6, length - 6);
+
+    if(out_width > 0) exifData["Exif.Photo.PixelXDimension"] = out_width;
+    if(out_height > 0) exifData["Exif.Photo.PixelYDimension"] = out_height;
+
+    return dt_exif_encode_blob(exifData, buf);
+  }
+  catch(Exiv2::AnyError &e)
+  {
+    std::string s(e.what());
+    std::cerr << "[exiv2] " << s << std::endl;
+    free(*buf);
+    *buf = NULL;
+    return 0;
+  }
+}
+
 // encode binary blob into text:
 char *dt_exif_xmp_encode(const unsigned char *input, const int len, int *output_len)
 {
@@ -1977,6 +2147,9 @@ skip:
 }
 
 // need a write lock on *img (non-const) to write stars (and soon color labels).
+static int dt_exif_xmp_read_image(dt_image_t *img, const char *filename, const int history_only,
+                                  Exiv2::Image *image);
+
 int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_only)
 {
   // exclude pfm to avoid stupid errors on the console
@@ -1988,6 +2161,35 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
     std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(filename));
     assert(image.get() != 0);
     image->readMetadata();
+    return dt_exif_xmp_read_image(img, filename, history_only, image.get());
+  }
+  catch(Exiv2::AnyError &e)
+  {
+    // actually nobody's interested in that if the file doesn't exist:
+    // std::string s(e.what());
+    // std::cerr << "[exiv2] " << filename << ": " << s << std::endl;
+    return 1;
+  }
+}
+
+int dt_exif_xmp_read_preread(dt_image_t *img, const char *filename, const dt_exif_preread_t *pre)
+{
+  if(!pre) return dt_exif_xmp_read(img, filename, 0);
+  if(!pre->xmp.get()) return 1;
+  try
+  {
+    return dt_exif_xmp_read_image(img, filename, 0, pre->xmp.get());
+  }
+  catch(Exiv2::AnyError &e)
+  {
+    return 1;
+  }
+}
+
+static int dt_exif_xmp_read_image(dt_image_t *img, const char *filename, const int history_only,
+                                  Exiv2::Image *image)
+{
+  {
     Exiv2::XmpData &xmpData = image->xmpData();
 
     sqlite3_stmt *stmt;
@@ -2128,7 +2330,8 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
       return 1;
     }
 
-    sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+    // nests into the transaction of the import batch, if there is one
+    dt_database_start_transaction(darktable.db);
 
     DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.history WHERE imgid = ?1", -1,
                                 &stmt, NULL);
@@ -2232,23 +2435,16 @@ end:
 
     if(all_ok)
     {
-      sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+      dt_database_release_transaction(darktable.db);
     }
     else
     {
       std::cerr << "[exif] error reading history from '" << filename << "'" << std::endl;
-      sqlite3_exec(dt_database_get(darktable.db), "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+      dt_database_rollback_transaction(darktable.db);
       return 1;
     }
 
   }
-  catch(Exiv2::AnyError &e)
-  {
-    // actually nobody's interested in that if the file doesn't exist:
-    // std::string s(e.what());
-    // std::cerr << "[exiv2] " << filename << ": " << s << std::endl;
-    return 1;
-  }
   return 0;
 }
 
@@ -2846,12 +3042,25 @@ static void dt_exif_log_handler(int log_level, const char *message)
   }
 }
 
+static dt_pthread_mutex_t xmp_parser_mutex;
+
+static void dt_exif_xmp_lock(void *data, bool lock)
+{
+  if(lock)
+    dt_pthread_mutex_lock((dt_pthread_mutex_t *)data);
+  else
+    dt_pthread_mutex_unlock((dt_pthread_mutex_t *)data);
+}
+
 void dt_exif_init()
 {
+  dt_pthread_mutex_init(&xmp_parser_mutex, NULL);
+
   // preface the exiv2 messages with "[exiv2] "
   Exiv2::LogMsg::setHandler(&dt_exif_log_handler);
 
-  Exiv2::XmpParser::initialize();
+  // imports parse files on several threads, let the xmp toolkit serialize itself
+  Exiv2::XmpParser::initialize(dt_exif_xmp_lock, &xmp_parser_mutex);
   // this has te stay with the old url (namespace already propagated outside dt)
   Exiv2::XmpProperties::registerNs("http://darktable.sf.net/", "darktable");
   Exiv2::XmpProperties::registerNs("http://ns.adobe.com/lightroom/1.0/", "lr");
@@ -2861,6 +3070,7 @@ void dt_exif_init()
 void dt_exif_cleanup()
 {
   Exiv2::XmpParser::terminate();
+  dt_pthread_mutex_destroy(&xmp_parser_mutex);
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
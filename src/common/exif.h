@@ -30,6 +30,17 @@ extern "C" {
  * struct. returns 0 on success. */
 int dt_exif_read(dt_image_t *img, const char *path);
 
+/** metadata of an image file and its .xmp sidecar, parsed ahead of time. the parsing can run on any thread,
+ * applying it touches the database and is done by dt_exif_read_preread() and dt_exif_xmp_read_preread(). */
+typedef struct dt_exif_preread_t dt_exif_preread_t;
+dt_exif_preread_t *dt_exif_preread(const char *path);
+void dt_exif_preread_free(dt_exif_preread_t *pre);
+
+/** like dt_exif_read() and dt_exif_xmp_read(img, xmp_path, 0), but using the preread metadata if pre is not
+ * NULL. */
+int dt_exif_read_preread(dt_image_t *img, const char *path, const dt_exif_preread_t *pre);
+int dt_exif_xmp_read_preread(dt_image_t *img, const char *xmp_path, const dt_exif_preread_t *pre);
+
 /** read exif data to image struct from given data blob, wherever you got it from. */
 int dt_exif_read_from_blob(dt_image_t *img, uint8_t *blob, const int size);
 
@@ -38,6 +49,11 @@ int dt_exif_read_from_blob(dt_image_t *img, uint8_t *blob, const int size);
 int dt_exif_read_blob(uint8_t **blob, const char *path, const int imgid, const int sRGB, const int out_width,
                       const int out_height, const int dng_mode);
 
+/** copy of a blob from dt_exif_read_blob() with other output dimensions, without going back to the file.
+ * return length in bytes, buf will be allocated by the function. */
+int dt_exif_blob_set_dimensions(uint8_t **buf, const uint8_t *blob, const int length, const int out_width,
+                                const int out_height);
+
 /** write blob to file exif. merges with existing exif information.*/
 int dt_exif_write_blob(uint8_t *blob, uint32_t size, const char *path, const int compressed);
 
@@ -0,0 +1,642 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2017 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/exif_probe.h"
+
+#include <glib/gstdio.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// limits against broken files
+#define DT_EXIF_PROBE_MAX_ENTRIES 1024
+#define DT_EXIF_PROBE_MAX_IFDS 16
+// size of the stdio buffer. ifd0 and the exif ifd usually are within the first few kB, so most files are
+// probed with one or two reads of that size.
+#define DT_EXIF_PROBE_BUFFER 16384
+
+// tiff tags, see the tiff 6.0, exif 2.3 and dng 1.4 specs
+#define TAG_NEW_SUBFILE_TYPE 0x00fe
+#define TAG_IMAGE_WIDTH 0x0100
+#define TAG_IMAGE_LENGTH 0x0101
+#define TAG_COMPRESSION 0x0103
+#define TAG_MAKE 0x010f
+#define TAG_MODEL 0x0110
+#define TAG_STRIP_OFFSETS 0x0111
+#define TAG_ORIENTATION 0x0112
+#define TAG_STRIP_BYTE_COUNTS 0x0117
+#define TAG_ARTIST 0x013b
+#define TAG_SUB_IFDS 0x014a
+#define TAG_JPEG_INTERCHANGE_FORMAT 0x0201
+#define TAG_JPEG_INTERCHANGE_FORMAT_LENGTH 0x0202
+#define TAG_XMP 0x02bc
+#define TAG_RATING 0x4746
+#define TAG_RATING_PERCENT 0x4749
+#define TAG_COPYRIGHT 0x8298
+#define TAG_EXPOSURE_TIME 0x829a
+#define TAG_FNUMBER 0x829d
+#define TAG_IPTC 0x83bb
+#define TAG_EXIF_IFD 0x8769
+#define TAG_GPS_IFD 0x8825
+#define TAG_ISO_SPEED_RATINGS 0x8827
+#define TAG_RECOMMENDED_EXPOSURE_INDEX 0x8832
+#define TAG_DATETIME_ORIGINAL 0x9003
+#define TAG_SHUTTER_SPEED_VALUE 0x9201
+#define TAG_APERTURE_VALUE 0x9202
+#define TAG_SUBJECT_DISTANCE 0x9206
+#define TAG_FOCAL_LENGTH 0x920a
+#define TAG_MAKER_NOTE 0x927c
+#define TAG_USER_COMMENT 0x9286
+#define TAG_COLOR_SPACE 0xa001
+#define TAG_PIXEL_X_DIMENSION 0xa002
+#define TAG_PIXEL_Y_DIMENSION 0xa003
+#define TAG_FOCAL_LENGTH_35MM 0xa405
+#define TAG_LENS_MODEL 0xa434
+#define TAG_COLOR_MATRIX1 0xc621
+#define TAG_COLOR_MATRIX2 0xc622
+#define TAG_CALIBRATION_ILLUMINANT1 0xc65a
+#define TAG_CALIBRATION_ILLUMINANT2 0xc65b
+
+// in the gps ifd
+#define TAG_GPS_LATITUDE_REF 0x0001
+#define TAG_GPS_LATITUDE 0x0002
+#define TAG_GPS_LONGITUDE_REF 0x0003
+#define TAG_GPS_LONGITUDE 0x0004
+#define TAG_GPS_ALTITUDE_REF 0x0005
+#define TAG_GPS_ALTITUDE 0x0006
+
+// in the canon maker notes
+#define TAG_CANON_OWNER_NAME 0x0009
+
+typedef struct _probe_file_t
+{
+  FILE *f;
+  int64_t size;
+  gboolean big_endian;
+} _probe_file_t;
+
+typedef struct _probe_ifd_t
+{
+  uint8_t *data;   // the raw 12 byte entries
+  int num;
+  uint32_t offset; // of the first entry in the file
+  uint32_t next;
+} _probe_ifd_t;
+
+// size in bytes of the tiff field types 1..13
+static const int _type_size[14] = { 0, 1, 1, 2, 4, 8, 1, 1, 2, 4, 8, 4, 8, 4 };
+
+static gboolean _read_at(_probe_file_t *pf, uint32_t offset, void *dst, size_t len)
+{
+  if((int64_t)offset + (int64_t)len > pf->size) return FALSE;
+  if(fseek(pf->f, offset, SEEK_SET)) return FALSE;
+  return fread(dst, 1, len, pf->f) == len;
+}
+
+static uint16_t _get16(const _probe_file_t *pf, const uint8_t *p)
+{
+  return pf->big_endian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+}
+
+static uint32_t _get32(const _probe_file_t *pf, const uint8_t *p)
+{
+  return pf->big_endian ? ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]
+                        : ((uint32_t)p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+}
+
+static gboolean _read_ifd(_probe_file_t *pf, uint32_t offset, _probe_ifd_t *ifd)
+{
+  uint8_t buf[4];
+  if(!offset || !_read_at(pf, offset, buf, 2)) return FALSE;
+  const int num = _get16(pf, buf);
+  if(num == 0 || num > DT_EXIF_PROBE_MAX_ENTRIES) return FALSE;
+  ifd->data = (uint8_t *)g_malloc(num * 12);
+  ifd->num = num;
+  ifd->offset = offset + 2;
+  if(!_read_at(pf, ifd->offset, ifd->data, num * 12))
+  {
+    g_free(ifd->data);
+    ifd->data = NULL;
+    return FALSE;
+  }
+  ifd->next = _read_at(pf, ifd->offset + num * 12, buf, 4) ? _get32(pf, buf) : 0;
+  return TRUE;
+}
+
+// finds tag in ifd and returns its type, count and the file offset of its value. entries are sorted by tag
+// in valid files, but not in all files out there, so don't rely on that.
+static gboolean _find(const _probe_file_t *pf, const _probe_ifd_t *ifd, uint16_t tag, int *type, uint32_t *count,
+                      uint32_t *offset)
+{
+  if(!ifd->data) return FALSE;
+  for(int k = 0; k < ifd->num; k++)
+  {
+    const uint8_t *e = ifd->data + 12 * k;
+    if(_get16(pf, e) != tag) continue;
+    *type = _get16(pf, e + 2);
+    *count = _get32(pf, e + 4);
+    if(*type < 1 || *type > 13 || *count == 0) return FALSE;
+    // values of up to 4 bytes are stored in the entry itself
+    if((uint64_t)_type_size[*type] * *count <= 4)
+      *offset = ifd->offset + 12 * k + 8;
+    else
+      *offset = _get32(pf, e + 8);
+    return TRUE;
+  }
+  return FALSE;
+}
+
+// reads the idx-th value of a numeric tag
+static gboolean _get_number(_probe_file_t *pf, const _probe_ifd_t *ifd, uint16_t tag, uint32_t idx, double *value)
+{
+  int type;
+  uint32_t count, offset;
+  if(!_find(pf, ifd, tag, &type, &count, &offset) || idx >= count) return FALSE;
+
+  uint8_t b[8];
+  if(!_read_at(pf, offset + idx * _type_size[type], b, _type_size[type])) return FALSE;
+  switch(type)
+  {
+    case 1: // byte
+    case 7: // undefined
+      *value = b[0];
+      return TRUE;
+    case 6: // sbyte
+      *value = (int8_t)b[0];
+      return TRUE;
+    case 3: // short
+      *value = _get16(pf, b);
+      return TRUE;
+    case 8: // sshort
+      *value = (int16_t)_get16(pf, b);
+      return TRUE;
+    case 4:  // long
+    case 13: // ifd
+      *value = _get32(pf, b);
+      return TRUE;
+    case 9: // slong
+      *value = (int32_t)_get32(pf, b);
+      return TRUE;
+    case 5: // rational
+    {
+      const uint32_t den = _get32(pf, b + 4);
+      *value = den ? (double)_get32(pf, b) / den : 0.0;
+      return TRUE;
+    }
+    case 10: // srational
+    {
+      const int32_t den = (int32_t)_get32(pf, b + 4);
+      *value = den ? (double)(int32_t)_get32(pf, b) / den : 0.0;
+      return TRUE;
+    }
+    default: // float and double aren't used by any of the tags we look at
+      return FALSE;
+  }
+}
+
+// reads the idx-th value of a rational tag as it is, for the gps values which have their own rules for 0/0
+static gboolean _get_rational(_probe_file_t *pf, const _probe_ifd_t *ifd, uint16_t tag, uint32_t idx, double *num,
+                              double *den)
+{
+  int type;
+  uint32_t count, offset;
+  uint8_t b[8];
+  if(!_find(pf, ifd, tag, &type, &count, &offset) || type != 5 || idx >= count
+     || !_read_at(pf, offset + idx * 8, b, 8))
+    return FALSE;
+  *num = _get32(pf, b);
+  *den = _get32(pf, b + 4);
+  return TRUE;
+}
+
+// reads an ascii tag, with trailing blanks removed like dt_exif_read() does. FALSE if missing or not valid utf-8.
+static gboolean _get_string(_probe_file_t *pf, const _probe_ifd_t *ifd, uint16_t tag, char *dst, size_t len)
+{
+  int type;
+  uint32_t count, offset;
+  if(!_find(pf, ifd, tag, &type, &count, &offset) || type != 2) return FALSE;
+
+  const size_t n = MIN(count, len - 1);
+  if(!_read_at(pf, offset, dst, n)) return FALSE;
+  dst[n] = '\0';
+  for(size_t k = strlen(dst); k > 0 && dst[k - 1] == ' '; k--) dst[k - 1] = '\0';
+  return g_utf8_validate(dst, -1, NULL) && dst[0];
+}
+
+static int _get_int(_probe_file_t *pf, const _probe_ifd_t *ifd, uint16_t tag, int def)
+{
+  double v;
+  return _get_number(pf, ifd, tag, 0, &v) ? (int)v : def;
+}
+
+// offsets of the sub ifds of ifd0 and of the ifd chain after it, returns how many
+static int _ifd_offsets(_probe_file_t *pf, const _probe_ifd_t *ifd0, uint32_t offsets[DT_EXIF_PROBE_MAX_IFDS])
+{
+  int n = 0;
+
+  int type;
+  uint32_t count, offset;
+  if(_find(pf, ifd0, TAG_SUB_IFDS, &type, &count, &offset))
+  {
+    for(uint32_t k = 0; k < count && n < DT_EXIF_PROBE_MAX_IFDS / 2; k++)
+    {
+      double v;
+      if(_get_number(pf, ifd0, TAG_SUB_IFDS, k, &v)) offsets[n++] = (uint32_t)v;
+    }
+  }
+  for(uint32_t next = ifd0->next; next && n < DT_EXIF_PROBE_MAX_IFDS; )
+  {
+    uint8_t buf[4];
+    offsets[n++] = next;
+    if(!_read_at(pf, next, buf, 2)) break;
+    const uint32_t after = next + 2 + 12 * _get16(pf, buf);
+    next = _read_at(pf, after, buf, 4) ? _get32(pf, buf) : 0;
+    // no loops
+    for(int k = 0; k < n; k++)
+      if(offsets[k] == next) next = 0;
+  }
+  return n;
+}
+
+// the primary image dimensions, from the ifd chain and the sub ifds of ifd0
+static void _probe_dimensions(_probe_file_t *pf, const _probe_ifd_t *ifd0, dt_exif_probe_t *p)
+{
+  uint32_t offsets[DT_EXIF_PROBE_MAX_IFDS];
+  const int n = _ifd_offsets(pf, ifd0, offsets);
+
+  // ifd0 itself, then the others
+  int64_t best = 0;
+  for(int k = -1; k < n; k++)
+  {
+    _probe_ifd_t ifd = { 0 };
+    const _probe_ifd_t *cur = ifd0;
+    if(k >= 0)
+    {
+      if(!_read_ifd(pf, offsets[k], &ifd)) continue;
+      cur = &ifd;
+    }
+    // 0 is the full resolution image, everything else are previews, masks and the like
+    if(_get_int(pf, cur, TAG_NEW_SUBFILE_TYPE, 0) == 0)
+    {
+      const int w = _get_int(pf, cur, TAG_IMAGE_WIDTH, 0);
+      const int h = _get_int(pf, cur, TAG_IMAGE_LENGTH, 0);
+      if((int64_t)w * h > best)
+      {
+        best = (int64_t)w * h;
+        p->width = w;
+        p->height = h;
+      }
+    }
+    g_free(ifd.data);
+  }
+}
+
+// degrees, minutes and seconds to decimal degrees, the same way dt_exif_read() does it. FALSE if unusable.
+static gboolean _probe_gps_coordinate(_probe_file_t *pf, const _probe_ifd_t *gps, uint16_t tag, uint16_t ref_tag,
+                                      double *result)
+{
+  char ref[2];
+  double num[3], den[3];
+  if(!_get_string(pf, gps, ref_tag, ref, sizeof(ref))) return FALSE;
+  for(int k = 0; k < 3; k++)
+    if(!_get_rational(pf, gps, tag, k, &num[k], &den[k])) return FALSE;
+  if(den[0] == 0 || den[1] == 0) return FALSE;
+  // 0/0 seconds are accepted
+  if(den[2] == 0 && num[2] != 0) return FALSE;
+  *result = num[0] / den[0] + num[1] / den[1] / 60.0 + (den[2] ? num[2] / den[2] / 3600.0 : 0.0);
+  if(ref[0] == 'S' || ref[0] == 'W') *result = -*result;
+  return TRUE;
+}
+
+// latitude, longitude and elevation. FALSE if the gps ifd can't be read at all.
+static gboolean _probe_gps(_probe_file_t *pf, uint32_t offset, dt_exif_probe_t *p)
+{
+  _probe_ifd_t gps = { 0 };
+  if(!_read_ifd(pf, offset, &gps)) return FALSE;
+
+  double v, num, den;
+  if(_probe_gps_coordinate(pf, &gps, TAG_GPS_LATITUDE, TAG_GPS_LATITUDE_REF, &v)) p->latitude = v;
+  if(_probe_gps_coordinate(pf, &gps, TAG_GPS_LONGITUDE, TAG_GPS_LONGITUDE_REF, &v)) p->longitude = v;
+  // the reference is 0 above and 1 below sea level
+  if(_get_number(pf, &gps, TAG_GPS_ALTITUDE_REF, 0, &v) && _get_rational(pf, &gps, TAG_GPS_ALTITUDE, 0, &num, &den)
+     && den != 0)
+    p->elevation = v != 0 ? -num / den : num / den;
+
+  g_free(gps.data);
+  return TRUE;
+}
+
+// the owner name canon cameras put into their maker notes, which are a plain ifd. FALSE if they can't be read.
+static gboolean _probe_canon_owner(_probe_file_t *pf, const _probe_ifd_t *exif, dt_exif_probe_t *p)
+{
+  int type;
+  uint32_t count, offset;
+  if(!_find(pf, exif, TAG_MAKER_NOTE, &type, &count, &offset)) return TRUE;
+  _probe_ifd_t notes = { 0 };
+  if(!_read_ifd(pf, offset, &notes)) return FALSE;
+  _get_string(pf, &notes, TAG_CANON_OWNER_NAME, p->artist, sizeof(p->artist));
+  g_free(notes.data);
+  return TRUE;
+}
+
+static int _probe(_probe_file_t *pf, dt_exif_probe_t *p)
+{
+  uint8_t head[8];
+  if(!_read_at(pf, 0, head, 8)) return 1;
+  if(head[0] == 'I' && head[1] == 'I')
+    pf->big_endian = FALSE;
+  else if(head[0] == 'M' && head[1] == 'M')
+    pf->big_endian = TRUE;
+  else
+    return 1;
+  // plain tiff and olympus orf. the ifd0 of a panasonic rw2 has the maker's own tags, exiv2 takes make and
+  // model from there and the rest from the exif of the embedded jpeg.
+  const uint16_t magic = _get16(pf, head + 2);
+  if(magic != 42 && magic != 0x4f52 && magic != 0x5352) return 1;
+
+  int res = 1;
+  _probe_ifd_t ifd0 = { 0 }, exif = { 0 };
+  if(!_read_ifd(pf, _get32(pf, head + 4), &ifd0)) goto end;
+
+  // embedded xmp and iptc overwrite the exif values, leave that to exiv2
+  int type;
+  uint32_t count, offset;
+  if(_find(pf, &ifd0, TAG_XMP, &type, &count, &offset) || _find(pf, &ifd0, TAG_IPTC, &type, &count, &offset))
+    goto end;
+
+  double v;
+  if(!_get_number(pf, &ifd0, TAG_EXIF_IFD, 0, &v) || !_read_ifd(pf, (uint32_t)v, &exif)) goto end;
+
+  if(!_get_string(pf, &ifd0, TAG_MAKE, p->maker, sizeof(p->maker))) goto end;
+  if(!_get_string(pf, &ifd0, TAG_MODEL, p->model, sizeof(p->model))) goto end;
+  // the lens names exiv2 decodes from the maker notes are not available here, the standard tag is required
+  if(!_get_string(pf, &exif, TAG_LENS_MODEL, p->lens, sizeof(p->lens))) goto end;
+
+  if(!_get_string(pf, &ifd0, TAG_DATETIME_ORIGINAL, p->datetime_taken, sizeof(p->datetime_taken)))
+    _get_string(pf, &exif, TAG_DATETIME_ORIGINAL, p->datetime_taken, sizeof(p->datetime_taken));
+  if(_find(pf, &ifd0, TAG_ARTIST, &type, &count, &offset))
+    _get_string(pf, &ifd0, TAG_ARTIST, p->artist, sizeof(p->artist));
+  else if(!g_strcmp0(p->maker, "Canon") && !_probe_canon_owner(pf, &exif, p))
+    goto end;
+  _get_string(pf, &ifd0, TAG_COPYRIGHT, p->copyright, sizeof(p->copyright));
+
+  // a user comment with actual text would go into the description, only skip the usual empty ones
+  if(_find(pf, &exif, TAG_USER_COMMENT, &type, &count, &offset) && count > 8)
+  {
+    uint8_t comment[64];
+    const size_t n = MIN(count - 8, sizeof(comment));
+    if(!_read_at(pf, offset + 8, comment, n)) goto end;
+    for(size_t k = 0; k < n; k++)
+      if(comment[k] != '\0' && comment[k] != ' ') goto end;
+  }
+
+  if(_get_number(pf, &exif, TAG_EXPOSURE_TIME, 0, &v))
+    p->exposure = v;
+  else if(_get_number(pf, &exif, TAG_SHUTTER_SPEED_VALUE, 0, &v))
+    p->exposure = 1.0 / v;
+  if(_get_number(pf, &exif, TAG_FNUMBER, 0, &v) || _get_number(pf, &exif, TAG_APERTURE_VALUE, 0, &v))
+    p->aperture = v;
+
+  // nikon happens to store a pair for lo and hi modes
+  const _probe_ifd_t *iso_ifd = _find(pf, &exif, TAG_ISO_SPEED_RATINGS, &type, &count, &offset) ? &exif : &ifd0;
+  if(_find(pf, iso_ifd, TAG_ISO_SPEED_RATINGS, &type, &count, &offset)
+     && _get_number(pf, iso_ifd, TAG_ISO_SPEED_RATINGS, count > 1 ? 1 : 0, &v))
+    p->iso = v;
+  if(p->iso == 65535 || p->iso == 0)
+  {
+    if((!g_strcmp0(p->maker, "SONY") || !g_strcmp0(p->maker, "Canon"))
+       && _get_number(pf, &exif, TAG_RECOMMENDED_EXPOSURE_INDEX, 0, &v))
+      p->iso = v;
+    else
+      goto end; // somewhere in the maker notes
+  }
+
+  if(!_get_number(pf, &exif, TAG_FOCAL_LENGTH, 0, &v) && !_get_number(pf, &ifd0, TAG_FOCAL_LENGTH, 0, &v)) goto end;
+  p->focal_length = v;
+  if(_get_number(pf, &exif, TAG_FOCAL_LENGTH_35MM, 0, &v)) p->focal_length_35mm = v;
+  if(_get_number(pf, &exif, TAG_SUBJECT_DISTANCE, 0, &v)) p->focus_distance = v;
+
+  p->orientation = _get_int(pf, &ifd0, TAG_ORIENTATION, 0);
+  p->colorspace = _get_int(pf, &exif, TAG_COLOR_SPACE, 0);
+  if(_get_number(pf, &ifd0, TAG_RATING, 0, &v))
+    p->rating = (int)v;
+  else if(_get_number(pf, &ifd0, TAG_RATING_PERCENT, 0, &v))
+    p->rating = (int)(v * 5. / 100);
+
+  // dng color matrix, prefer the one for D65 (illuminant 21)
+  {
+    const int ill1 = _get_int(pf, &ifd0, TAG_CALIBRATION_ILLUMINANT1, -1);
+    const int ill2 = _get_int(pf, &ifd0, TAG_CALIBRATION_ILLUMINANT2, -1);
+    uint32_t count1 = 0, count2 = 0;
+    if(!_find(pf, &ifd0, TAG_COLOR_MATRIX1, &type, &count1, &offset)) count1 = 0;
+    if(!_find(pf, &ifd0, TAG_COLOR_MATRIX2, &type, &count2, &offset)) count2 = 0;
+    uint16_t tag = 0;
+    if(ill1 == 21 && count1 == 9)
+      tag = TAG_COLOR_MATRIX1;
+    else if(ill2 == 21 && count2 == 9)
+      tag = TAG_COLOR_MATRIX2;
+    else if(count1 == 9)
+      tag = TAG_COLOR_MATRIX1;
+    else if(count2 == 9)
+      tag = TAG_COLOR_MATRIX2;
+    if(tag)
+    {
+      p->has_color_matrix = TRUE;
+      for(int k = 0; k < 9; k++)
+      {
+        if(!_get_number(pf, &ifd0, tag, k, &v)) goto end;
+        p->color_matrix[k] = v;
+      }
+    }
+  }
+
+  if(_get_number(pf, &ifd0, TAG_GPS_IFD, 0, &v) && !_probe_gps(pf, (uint32_t)v, p)) goto end;
+
+  _probe_dimensions(pf, &ifd0, p);
+  if(!p->width || !p->height)
+  {
+    p->width = _get_int(pf, &exif, TAG_PIXEL_X_DIMENSION, 0);
+    p->height = _get_int(pf, &exif, TAG_PIXEL_Y_DIMENSION, 0);
+  }
+
+  res = 0;
+
+end:
+  g_free(ifd0.data);
+  g_free(exif.data);
+  return res;
+}
+
+// checks for a jpeg that libjpeg can decode (baseline, extended or progressive, not the lossless ones raw data
+// comes in) and reads its dimensions from the frame header
+static gboolean _jpeg_dimensions(_probe_file_t *pf, uint32_t offset, uint32_t size, int *width, int *height)
+{
+  uint8_t b[9];
+  if(size < 4 || !_read_at(pf, offset, b, 2) || b[0] != 0xff || b[1] != 0xd8) return FALSE;
+  uint32_t pos = offset + 2;
+  for(int segments = 0; segments < 64 && pos + 4 <= offset + size; segments++)
+  {
+    if(!_read_at(pf, pos, b, 4) || b[0] != 0xff) return FALSE;
+    const uint8_t marker = b[1];
+    if(marker == 0xff)
+    {
+      // fill byte
+      pos++;
+      continue;
+    }
+    if(marker == 0xc0 || marker == 0xc1 || marker == 0xc2)
+    {
+      if(!_read_at(pf, pos + 4, b, 5)) return FALSE;
+      *height = (b[1] << 8) | b[2];
+      *width = (b[3] << 8) | b[4];
+      return *width > 0 && *height > 0;
+    }
+    // any other frame type, or image data before a frame header
+    if((marker >= 0xc3 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc)
+       || marker == 0xda || marker == 0xd9)
+      return FALSE;
+    pos += 2 + ((b[2] << 8) | b[3]);
+  }
+  return FALSE;
+}
+
+// a jpeg in ifd, either in the jpeg interchange format tags or as the only strip of a jpeg compressed image
+static gboolean _ifd_jpeg(_probe_file_t *pf, const _probe_ifd_t *ifd, uint32_t *offset, uint32_t *size)
+{
+  double o, l;
+  if(_get_number(pf, ifd, TAG_JPEG_INTERCHANGE_FORMAT, 0, &o)
+     && _get_number(pf, ifd, TAG_JPEG_INTERCHANGE_FORMAT_LENGTH, 0, &l))
+  {
+    *offset = (uint32_t)o;
+    *size = (uint32_t)l;
+    return TRUE;
+  }
+  const int compression = _get_int(pf, ifd, TAG_COMPRESSION, 0);
+  int type;
+  uint32_t count, at;
+  if((compression == 6 || compression == 7) && _find(pf, ifd, TAG_STRIP_OFFSETS, &type, &count, &at) && count == 1
+     && _get_number(pf, ifd, TAG_STRIP_OFFSETS, 0, &o) && _get_number(pf, ifd, TAG_STRIP_BYTE_COUNTS, 0, &l))
+  {
+    *offset = (uint32_t)o;
+    *size = (uint32_t)l;
+    return TRUE;
+  }
+  return FALSE;
+}
+
+static int _probe_preview(_probe_file_t *pf, uint8_t **jpeg, size_t *size, int *width, int *height)
+{
+  uint8_t head[8];
+  if(!_read_at(pf, 0, head, 8)) return 1;
+  if(head[0] == 'I' && head[1] == 'I')
+    pf->big_endian = FALSE;
+  else if(head[0] == 'M' && head[1] == 'M')
+    pf->big_endian = TRUE;
+  else
+    return 1;
+  const uint16_t magic = _get16(pf, head + 2);
+  if(magic != 42 && magic != 0x4f52 && magic != 0x5352 && magic != 0x55) return 1;
+
+  _probe_ifd_t ifd0 = { 0 };
+  if(!_read_ifd(pf, _get32(pf, head + 4), &ifd0)) return 1;
+  uint32_t offsets[DT_EXIF_PROBE_MAX_IFDS];
+  const int n = _ifd_offsets(pf, &ifd0, offsets);
+
+  // the largest one decides
+  uint32_t best_offset = 0, best_size = 0;
+  int64_t best = 0;
+  for(int k = -1; k < n; k++)
+  {
+    _probe_ifd_t ifd = { 0 };
+    const _probe_ifd_t *cur = &ifd0;
+    if(k >= 0)
+    {
+      if(!_read_ifd(pf, offsets[k], &ifd)) continue;
+      cur = &ifd;
+    }
+    uint32_t offset, length;
+    int w, h;
+    if(_ifd_jpeg(pf, cur, &offset, &length) && (int64_t)offset + length <= pf->size
+       && _jpeg_dimensions(pf, offset, length, &w, &h) && (int64_t)w * h > best)
+    {
+      best = (int64_t)w * h;
+      best_offset = offset;
+      best_size = length;
+      *width = w;
+      *height = h;
+    }
+    g_free(ifd.data);
+  }
+  g_free(ifd0.data);
+  if(!best) return 1;
+
+  *jpeg = (uint8_t *)g_try_malloc(best_size);
+  if(!*jpeg) return 1;
+  if(!_read_at(pf, best_offset, *jpeg, best_size))
+  {
+    g_free(*jpeg);
+    *jpeg = NULL;
+    return 1;
+  }
+  *size = best_size;
+  return 0;
+}
+
+int dt_exif_probe_preview(const char *path, uint8_t **jpeg, size_t *size, int *width, int *height)
+{
+  *jpeg = NULL;
+  FILE *f = g_fopen(path, "rb");
+  if(!f) return 1;
+  setvbuf(f, NULL, _IOFBF, DT_EXIF_PROBE_BUFFER);
+
+  _probe_file_t pf = { f, 0, FALSE };
+  int res = 1;
+  if(!fseek(f, 0, SEEK_END))
+  {
+    pf.size = ftell(f);
+    res = _probe_preview(&pf, jpeg, size, width, height);
+  }
+  fclose(f);
+  return res;
+}
+
+int dt_exif_probe(const char *path, dt_exif_probe_t *probe)
+{
+  memset(probe, 0, sizeof(dt_exif_probe_t));
+  probe->rating = -2;
+  probe->latitude = probe->longitude = probe->elevation = NAN;
+
+  FILE *f = g_fopen(path, "rb");
+  if(!f) return 1;
+  setvbuf(f, NULL, _IOFBF, DT_EXIF_PROBE_BUFFER);
+
+  _probe_file_t pf = { f, 0, FALSE };
+  int res = 1;
+  if(!fseek(f, 0, SEEK_END))
+  {
+    pf.size = ftell(f);
+    res = _probe(&pf, probe);
+  }
+  fclose(f);
+  return res;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
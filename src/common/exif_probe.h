@@ -0,0 +1,66 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2017 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the handful of exif fields import needs, read straight from the tiff structure of a raw file (cr2, nef, arw,
+ * dng, pef, orf, ...) with a few small reads instead of having exiv2 parse everything including the maker
+ * notes. */
+typedef struct dt_exif_probe_t
+{
+  char maker[64];
+  char model[64];
+  char lens[128];            // Exif.Photo.LensModel
+  char datetime_taken[20];
+  char artist[128];
+  char copyright[128];
+  float exposure, aperture, iso, focal_length, focal_length_35mm, focus_distance;
+  int orientation;           // exif value 1..8, 0 if not present
+  int rating;                // exif rating -1..5, -2 if not present
+  int colorspace;            // Exif.Photo.ColorSpace, 0 if not present
+  int width, height;         // of the largest full size image
+  double latitude, longitude, elevation; // from the gps ifd, NAN if not present
+  float color_matrix[9];     // ColorMatrix1/2 preferring the one for D65, if has_color_matrix
+  gboolean has_color_matrix;
+} dt_exif_probe_t;
+
+/** fills probe from the file. returns 0 if everything dt_exif_read() would take from the standard exif tags was
+ * found, non-zero if the file is no tiff, has xmp or iptc embedded, or misses fields that only exiv2 can get
+ * out of the maker notes. then the caller has to do a full read. */
+int dt_exif_probe(const char *path, dt_exif_probe_t *probe);
+
+/** finds the largest embedded jpeg preview in the tiff structure of a raw file that libjpeg can decode and reads
+ * just that. returns 0 and the jpeg data, to be g_free()d, with its size and dimensions. non-zero if there is none,
+ * e.g. in files that keep their previews in the maker notes. */
+int dt_exif_probe_preview(const char *path, uint8_t **jpeg, size_t *size, int *width, int *height);
+
+#ifdef __cplusplus
+}
+#endif
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,369 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2017 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/export_manifest.h"
+#include "common/darktable.h"
+#include "common/database.h"
+#include "common/debug.h"
+#include "common/dtpthread.h"
+#include "common/file_location.h"
+#include "common/image.h"
+#include "config.h"
+#include "control/conf.h"
+
+#include <glib/gstdio.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DT_EXPORT_MANIFEST_FILE ".darktable_export"
+// bumped whenever something is added to the key, so files exported before aren't taken as current
+#define DT_EXPORT_MANIFEST_KEY_VERSION 2
+
+typedef struct dt_export_manifest_entry_t
+{
+  char key[65];
+  int64_t size;
+  int64_t mtime;
+} dt_export_manifest_entry_t;
+
+typedef struct dt_export_manifest_dir_t
+{
+  GHashTable *files; // basename -> dt_export_manifest_entry_t
+} dt_export_manifest_dir_t;
+
+typedef struct dt_export_manifest_t
+{
+  dt_pthread_mutex_t mutex;
+  GHashTable *dirs; // dirname -> dt_export_manifest_dir_t
+} dt_export_manifest_t;
+
+static void _hash_int(GChecksum *chk, const int64_t v)
+{
+  g_checksum_update(chk, (const guchar *)&v, sizeof(v));
+}
+
+// with the length first, so two strings can't run into each other
+static void _hash_data(GChecksum *chk, const void *data, const int64_t len)
+{
+  _hash_int(chk, data ? len : -1);
+  if(data && len > 0) g_checksum_update(chk, (const guchar *)data, len);
+}
+
+static void _hash_string(GChecksum *chk, const char *s)
+{
+  _hash_data(chk, s, s ? strlen(s) : 0);
+}
+
+static void _hash_rows(GChecksum *chk, sqlite3_stmt *stmt)
+{
+  int rows = 0;
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    for(int k = 0; k < sqlite3_column_count(stmt); k++)
+    {
+      const void *data = sqlite3_column_blob(stmt, k);
+      _hash_data(chk, data, sqlite3_column_bytes(stmt, k));
+    }
+    rows++;
+  }
+  _hash_int(chk, rows);
+  sqlite3_finalize(stmt);
+}
+
+gchar *dt_export_manifest_key(const int imgid, dt_imageio_module_format_t *format,
+                              const dt_imageio_module_data_t *fdata, const gboolean high_quality,
+                              const gboolean upscale, const char *extra)
+{
+  GChecksum *chk = g_checksum_new(G_CHECKSUM_SHA256);
+  sqlite3_stmt *stmt;
+
+  _hash_int(chk, DT_EXPORT_MANIFEST_KEY_VERSION);
+  _hash_string(chk, darktable_package_version);
+
+  // the source file, in case it got replaced or written to by some other program
+  char filename[PATH_MAX] = { 0 };
+  gboolean from_cache = FALSE;
+  dt_image_full_path(imgid, filename, sizeof(filename), &from_cache);
+  GStatBuf st;
+  const gboolean exists = !g_stat(filename, &st);
+  _hash_int(chk, imgid);
+  _hash_string(chk, filename);
+  _hash_int(chk, exists ? st.st_size : -1);
+  _hash_int(chk, exists ? st.st_mtime : -1);
+
+  // the history that gets processed, and the drawn masks it can refer to
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT module, operation, op_params, enabled, blendop_params, blendop_version, "
+                              "multi_priority, multi_name FROM main.history WHERE imgid = ?1 AND num < "
+                              "(SELECT history_end FROM main.images WHERE id = ?1) ORDER BY num",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  _hash_rows(chk, stmt);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT formid, form, name, version, points, points_count, source FROM main.mask "
+                              "WHERE imgid = ?1 ORDER BY formid",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  _hash_rows(chk, stmt);
+
+  // the style by what's in it, it can be edited without being renamed
+  _hash_string(chk, fdata->style);
+  _hash_int(chk, fdata->style_append);
+  if(fdata->style[0])
+  {
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                "SELECT i.module, i.operation, i.op_params, i.enabled, i.blendop_params, "
+                                "i.blendop_version, i.multi_priority, i.multi_name FROM data.style_items AS i "
+                                "JOIN data.styles AS s ON s.id = i.styleid WHERE s.name = ?1 ORDER BY i.num",
+                                -1, &stmt, NULL);
+    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, fdata->style, -1, SQLITE_TRANSIENT);
+    _hash_rows(chk, stmt);
+  }
+
+  // the format. width and height in the common part are what the last export came out as, only the maximum
+  // counts. the rest is the format's own parameters.
+  _hash_string(chk, format->plugin_name);
+  _hash_int(chk, fdata->max_width);
+  _hash_int(chk, fdata->max_height);
+  const size_t params_size = format->params_size(format);
+  if(params_size > sizeof(dt_imageio_module_data_t))
+    _hash_data(chk, (const uint8_t *)fdata + sizeof(dt_imageio_module_data_t),
+               params_size - sizeof(dt_imageio_module_data_t));
+  _hash_int(chk, high_quality);
+  _hash_int(chk, upscale);
+
+  // the output profile
+  _hash_int(chk, dt_conf_get_int("plugins/lighttable/export/icctype"));
+  gchar *iccprofile = dt_conf_get_string("plugins/lighttable/export/iccprofile");
+  _hash_string(chk, iccprofile);
+  g_free(iccprofile);
+  _hash_int(chk, dt_conf_get_int("plugins/lighttable/export/iccintent"));
+
+  // what gets embedded besides the pixels, the exif and xmp data written from the database. the watermark can
+  // print most of it, too.
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT flags, datetime_taken, longitude, latitude, altitude, maker, model, lens, "
+                              "exposure, aperture, iso, focal_length, focus_distance, filename FROM main.images "
+                              "WHERE id = ?1",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  _hash_rows(chk, stmt);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT key, value FROM main.meta_data WHERE id = ?1 ORDER BY key, value", -1, &stmt,
+                              NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  _hash_rows(chk, stmt);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT color FROM main.color_labels WHERE imgid = ?1 ORDER BY color", -1, &stmt,
+                              NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  _hash_rows(chk, stmt);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT t.name FROM main.tagged_images AS ti JOIN data.tags AS t ON t.id = ti.tagid "
+                              "WHERE ti.imgid = ?1 ORDER BY t.name",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  _hash_rows(chk, stmt);
+  _hash_int(chk, dt_conf_get_int("metadata/resolution"));
+  gchar *compress = dt_conf_get_string("compress_xmp_tags");
+  _hash_string(chk, compress);
+  g_free(compress);
+
+  // the watermarks of the user, they can be edited in place. the ones that come with darktable only change
+  // with the version.
+  char configdir[PATH_MAX] = { 0 };
+  dt_loc_get_user_config_dir(configdir, sizeof(configdir));
+  gchar *watermarks = g_build_filename(configdir, "watermarks", NULL);
+  GDir *dir = g_dir_open(watermarks, 0, NULL);
+  if(dir)
+  {
+    // the order of g_dir_read_name() is whatever the file system gives
+    GList *names = NULL;
+    const gchar *name;
+    while((name = g_dir_read_name(dir))) names = g_list_prepend(names, g_strdup(name));
+    g_dir_close(dir);
+    names = g_list_sort(names, (GCompareFunc)g_strcmp0);
+    for(GList *l = names; l; l = g_list_next(l))
+    {
+      gchar *path = g_build_filename(watermarks, (const gchar *)l->data, NULL);
+      GStatBuf wst;
+      const gboolean wexists = !g_stat(path, &wst);
+      _hash_string(chk, (const gchar *)l->data);
+      _hash_int(chk, wexists ? wst.st_size : -1);
+      _hash_int(chk, wexists ? wst.st_mtime : -1);
+      g_free(path);
+    }
+    g_list_free_full(names, g_free);
+  }
+  g_free(watermarks);
+
+  _hash_string(chk, extra);
+
+  gchar *key = g_strdup(g_checksum_get_string(chk));
+  g_checksum_free(chk);
+  return key;
+}
+
+static gchar *_manifest_path(const char *dirname)
+{
+  return g_build_filename(dirname, DT_EXPORT_MANIFEST_FILE, NULL);
+}
+
+// the manifest of dirname, read on first use. later lines are newer and replace earlier ones of the same file.
+static dt_export_manifest_dir_t *_manifest_dir(dt_export_manifest_t *manifest, const char *dirname)
+{
+  dt_export_manifest_dir_t *dir = (dt_export_manifest_dir_t *)g_hash_table_lookup(manifest->dirs, dirname);
+  if(dir) return dir;
+
+  dir = (dt_export_manifest_dir_t *)calloc(1, sizeof(dt_export_manifest_dir_t));
+  dir->files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free);
+  g_hash_table_insert(manifest->dirs, g_strdup(dirname), dir);
+
+  gchar *path = _manifest_path(dirname);
+  FILE *f = g_fopen(path, "rb");
+  guint lines = 0;
+  if(f)
+  {
+    char line[PATH_MAX + 128];
+    while(fgets(line, sizeof(line), f))
+    {
+      dt_export_manifest_entry_t entry;
+      memset(&entry, 0, sizeof(entry));
+      int name = 0;
+      line[strcspn(line, "\n")] = '\0';
+      if(sscanf(line, "%64s %" SCNd64 " %" SCNd64 " %n", entry.key, &entry.size, &entry.mtime, &name) != 3
+         || !name || !line[name])
+        continue;
+      dt_export_manifest_entry_t *e = (dt_export_manifest_entry_t *)malloc(sizeof(dt_export_manifest_entry_t));
+      *e = entry;
+      g_hash_table_insert(dir->files, g_strdup(line + name), e);
+      lines++;
+    }
+    fclose(f);
+  }
+
+  // exporting the same files over and over again only appends, write out what is left once that piles up
+  if(lines > 2 * g_hash_table_size(dir->files) + 64)
+  {
+    gchar *tmp = g_strconcat(path, ".tmp", NULL);
+    f = g_fopen(tmp, "wb");
+    if(f)
+    {
+      GHashTableIter it;
+      gpointer name, value;
+      g_hash_table_iter_init(&it, dir->files);
+      while(g_hash_table_iter_next(&it, &name, &value))
+      {
+        const dt_export_manifest_entry_t *e = (dt_export_manifest_entry_t *)value;
+        fprintf(f, "%s %" PRId64 " %" PRId64 " %s\n", e->key, e->size, e->mtime, (const char *)name);
+      }
+      if(!fclose(f))
+        g_rename(tmp, path);
+      else
+        g_unlink(tmp);
+    }
+    g_free(tmp);
+  }
+  g_free(path);
+  return dir;
+}
+
+static void _manifest_dir_free(gpointer data)
+{
+  dt_export_manifest_dir_t *dir = (dt_export_manifest_dir_t *)data;
+  g_hash_table_destroy(dir->files);
+  free(dir);
+}
+
+dt_export_manifest_t *dt_export_manifest_new()
+{
+  dt_export_manifest_t *manifest = (dt_export_manifest_t *)calloc(1, sizeof(dt_export_manifest_t));
+  dt_pthread_mutex_init(&manifest->mutex, NULL);
+  manifest->dirs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, _manifest_dir_free);
+  return manifest;
+}
+
+void dt_export_manifest_free(dt_export_manifest_t *manifest)
+{
+  if(!manifest) return;
+  g_hash_table_destroy(manifest->dirs);
+  dt_pthread_mutex_destroy(&manifest->mutex);
+  free(manifest);
+}
+
+gboolean dt_export_manifest_lookup(dt_export_manifest_t *manifest, const char *filename, const char *key)
+{
+  if(!manifest || !key) return FALSE;
+
+  GStatBuf st;
+  if(g_stat(filename, &st) || !S_ISREG(st.st_mode)) return FALSE;
+
+  gchar *dirname = g_path_get_dirname(filename);
+  gchar *basename = g_path_get_basename(filename);
+  dt_pthread_mutex_lock(&manifest->mutex);
+  const dt_export_manifest_entry_t *e
+      = (dt_export_manifest_entry_t *)g_hash_table_lookup(_manifest_dir(manifest, dirname)->files, basename);
+  // a file of the same name that was written by something else doesn't count
+  const gboolean found = e && !strcmp(e->key, key) && e->size == st.st_size && e->mtime == st.st_mtime;
+  dt_pthread_mutex_unlock(&manifest->mutex);
+  g_free(basename);
+  g_free(dirname);
+  return found;
+}
+
+void dt_export_manifest_record(dt_export_manifest_t *manifest, const char *filename, const char *key)
+{
+  if(!manifest || !key) return;
+
+  GStatBuf st;
+  if(g_stat(filename, &st) || !S_ISREG(st.st_mode)) return;
+
+  gchar *dirname = g_path_get_dirname(filename);
+  gchar *basename = g_path_get_basename(filename);
+  if(!strchr(basename, '\n'))
+  {
+    dt_export_manifest_entry_t *e = (dt_export_manifest_entry_t *)malloc(sizeof(dt_export_manifest_entry_t));
+    g_strlcpy(e->key, key, sizeof(e->key));
+    e->size = st.st_size;
+    e->mtime = st.st_mtime;
+
+    dt_pthread_mutex_lock(&manifest->mutex);
+    dt_export_manifest_dir_t *dir = _manifest_dir(manifest, dirname);
+    // appended as soon as the file is there, so an export that gets cancelled or crashes can pick up from here
+    gchar *path = _manifest_path(dirname);
+    FILE *f = g_fopen(path, "ab");
+    if(f)
+    {
+      fprintf(f, "%s %" PRId64 " %" PRId64 " %s\n", e->key, e->size, e->mtime, basename);
+      fclose(f);
+    }
+    else
+      fprintf(stderr, "[export_manifest] could not write to `%s'\n", path);
+    g_free(path);
+    g_hash_table_insert(dir->files, g_strdup(basename), e);
+    dt_pthread_mutex_unlock(&manifest->mutex);
+  }
+  g_free(basename);
+  g_free(dirname);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,55 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2017 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/imageio_module.h"
+
+#include <glib.h>
+
+/* remembers what every exported file was made from, so exporting the same images with the same settings again
+ * (or rerunning an export that got cancelled half way) can skip the ones that are already there instead of
+ * rendering them all over again.
+ *
+ * the key of an export is a sha256 over everything that goes into the file: the source file, the history up
+ * to history_end with its masks, the style and what's in it, the format with its parameters, the size, the
+ * output profile, the darktable version, the metadata, tags, labels and location that are embedded or can be
+ * printed by the watermark, and the user's watermark files. the current date a watermark may print is not in
+ * it. every target directory gets a .darktable_export file with the key,
+ * size and modification time of the files written there. */
+
+struct dt_export_manifest_t;
+
+/** the key of exporting imgid with these settings. extra is anything else the storage wants in it, may be
+ * NULL. g_free() it. */
+gchar *dt_export_manifest_key(const int imgid, dt_imageio_module_format_t *format,
+                              const dt_imageio_module_data_t *fdata, const gboolean high_quality,
+                              const gboolean upscale, const char *extra);
+
+/** the manifests of the directories one export job writes to, read once and kept while the job runs */
+struct dt_export_manifest_t *dt_export_manifest_new();
+void dt_export_manifest_free(struct dt_export_manifest_t *manifest);
+
+/** TRUE if filename is still the file written for key */
+gboolean dt_export_manifest_lookup(struct dt_export_manifest_t *manifest, const char *filename, const char *key);
+/** filename has just been written for key */
+void dt_export_manifest_record(struct dt_export_manifest_t *manifest, const char *filename, const char *key);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
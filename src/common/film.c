@@ -30,6 +30,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <glib/gstdio.h>
 #include <limits.h>
 #include <math.h>
 #include <stdio.h>
@@ -407,6 +408,12 @@ void dt_film_remove(const int id)
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
 
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.film_fingerprints WHERE film_id = ?1",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.film_rolls WHERE id = ?1", -1,
                               &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
@@ -434,6 +441,105 @@ GList *dt_film_get_image_ids(const int filmid)
   return result;
 }
 
+typedef struct dt_film_fingerprint_known_t
+{
+  dt_film_fingerprint_t fp;   // as stored, size < 0 if there is none yet
+  int64_t write_timestamp;    // the last time darktable wrote one of the sidecars
+  gboolean removed;
+} dt_film_fingerprint_known_t;
+
+gboolean dt_film_fingerprint_read(const char *filename, dt_film_fingerprint_t *fp)
+{
+  GStatBuf statbuf;
+  if(g_stat(filename, &statbuf)) return FALSE;
+  fp->size = statbuf.st_size;
+  fp->mtime = statbuf.st_mtime;
+
+  gchar *xmp_filename = g_strconcat(filename, ".xmp", NULL);
+  fp->xmp_mtime = g_stat(xmp_filename, &statbuf) ? 0 : statbuf.st_mtime;
+  g_free(xmp_filename);
+  return TRUE;
+}
+
+void dt_film_fingerprint_store(const int32_t film_id, const char *filename)
+{
+  dt_film_fingerprint_t fp;
+  if(!dt_film_fingerprint_read(filename, &fp)) return;
+
+  gchar *basename = g_path_get_basename(filename);
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT OR REPLACE INTO main.film_fingerprints (film_id, filename, size, mtime, "
+                              "xmp_mtime) VALUES (?1, ?2, ?3, ?4, ?5)",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, film_id);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, basename, -1, SQLITE_TRANSIENT);
+  DT_DEBUG_SQLITE3_BIND_INT64(stmt, 3, fp.size);
+  DT_DEBUG_SQLITE3_BIND_INT64(stmt, 4, fp.mtime);
+  DT_DEBUG_SQLITE3_BIND_INT64(stmt, 5, fp.xmp_mtime);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+  g_free(basename);
+}
+
+GHashTable *dt_film_fingerprints_load(const char *folder)
+{
+  GHashTable *known = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free);
+
+  // all versions of an image share the file, any of them might have written the sidecar last
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT i.filename, fp.size, fp.mtime, fp.xmp_mtime, "
+                              "       IFNULL(MAX(i.write_timestamp), 0), MAX(i.flags & ?2) "
+                              "FROM main.images AS i "
+                              "JOIN main.film_rolls AS f ON f.id = i.film_id "
+                              "LEFT JOIN main.film_fingerprints AS fp "
+                              "  ON fp.film_id = i.film_id AND fp.filename = i.filename "
+                              "WHERE f.folder = ?1 "
+                              "GROUP BY i.filename",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, folder, -1, SQLITE_STATIC);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, DT_IMAGE_REMOVE);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    dt_film_fingerprint_known_t *k = (dt_film_fingerprint_known_t *)malloc(sizeof(dt_film_fingerprint_known_t));
+    k->fp.size = sqlite3_column_type(stmt, 1) == SQLITE_NULL ? -1 : sqlite3_column_int64(stmt, 1);
+    k->fp.mtime = sqlite3_column_int64(stmt, 2);
+    k->fp.xmp_mtime = sqlite3_column_int64(stmt, 3);
+    k->write_timestamp = sqlite3_column_int64(stmt, 4);
+    k->removed = sqlite3_column_int(stmt, 5) != 0;
+    g_hash_table_insert(known, g_strdup((const char *)sqlite3_column_text(stmt, 0)), k);
+  }
+  sqlite3_finalize(stmt);
+  return known;
+}
+
+gboolean dt_film_fingerprint_known(GHashTable *known, const char *filename)
+{
+  gchar *basename = g_path_get_basename(filename);
+  const gboolean res = g_hash_table_contains(known, basename);
+  g_free(basename);
+  return res;
+}
+
+gboolean dt_film_fingerprint_unchanged(GHashTable *known, const char *filename)
+{
+  gchar *basename = g_path_get_basename(filename);
+  const dt_film_fingerprint_known_t *k = (dt_film_fingerprint_known_t *)g_hash_table_lookup(known, basename);
+  g_free(basename);
+  if(!k || k->removed || k->fp.size < 0) return FALSE;
+
+  dt_film_fingerprint_t fp;
+  if(!dt_film_fingerprint_read(filename, &fp)) return FALSE;
+  if(fp.size != k->fp.size || fp.mtime != k->fp.mtime) return FALSE;
+
+  // our own sidecar writes don't count as a change
+  if(fp.xmp_mtime)
+    return fp.xmp_mtime <= MAX(k->fp.xmp_mtime, k->write_timestamp);
+  else
+    return k->fp.xmp_mtime == 0;
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
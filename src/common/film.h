@@ -64,6 +64,26 @@ void dt_film_remove_empty();
 /** gets all image ids in film. the returned GList has to be freed with g_list_free(). */
 GList *dt_film_get_image_ids(const int filmid);
 
+/** size and modification times of an image file and its .xmp, to tell if it changed since it was imported */
+typedef struct dt_film_fingerprint_t
+{
+  int64_t size, mtime;
+  int64_t xmp_mtime; // 0 if there is no .xmp
+} dt_film_fingerprint_t;
+
+/** stats filename and its .xmp sidecar. returns FALSE if filename can't be accessed. */
+gboolean dt_film_fingerprint_read(const char *filename, dt_film_fingerprint_t *fp);
+/** remembers the current fingerprint of filename, imported into film_id. */
+void dt_film_fingerprint_store(const int32_t film_id, const char *filename);
+/** loads what is known about the images imported from folder, for dt_film_fingerprint_unchanged(). free it
+ * with g_hash_table_destroy(). */
+GHashTable *dt_film_fingerprints_load(const char *folder);
+/** TRUE if filename is in known and neither it nor its .xmp were changed by someone else since it was
+ * imported. */
+gboolean dt_film_fingerprint_unchanged(GHashTable *known, const char *filename);
+/** TRUE if filename is in known, i.e. it is in the library already. */
+gboolean dt_film_fingerprint_known(GHashTable *known, const char *filename);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,217 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2017 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/film_monitor.h"
+#include "common/darktable.h"
+#include "common/database.h"
+#include "common/debug.h"
+#include "common/film.h"
+#include "common/image.h"
+#include "control/conf.h"
+#include "control/control.h"
+#include "control/jobs.h"
+#include "control/signal.h"
+
+#include <gio/gio.h>
+#include <sqlite3.h>
+
+// every watched folder costs an inotify watch, and there are only so many of them per user
+#define DT_FILM_MONITOR_MAX_FOLDERS 1024
+// files get imported once nothing happened in their folders for that many seconds, so copies are complete
+#define DT_FILM_MONITOR_DELAY 2
+
+typedef struct dt_film_monitor_t
+{
+  GHashTable *monitors; // folder -> GFileMonitor
+  GHashTable *pending;  // paths of the files that got added or changed
+  guint timeout;
+} dt_film_monitor_t;
+
+typedef struct dt_film_monitor_job_t
+{
+  GList *files;
+} dt_film_monitor_job_t;
+
+static int32_t _film_monitor_job_run(dt_job_t *job)
+{
+  dt_film_monitor_job_t *params = dt_control_job_get_params(job);
+  GHashTable *folders = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                              (GDestroyNotify)g_hash_table_destroy);
+  int count = 0;
+  for(GList *f = params->files; f; f = g_list_next(f))
+  {
+    const char *filename = (const char *)f->data;
+    gchar *folder = g_path_get_dirname(filename);
+    GHashTable *known = g_hash_table_lookup(folders, folder);
+    if(!known)
+    {
+      known = dt_film_fingerprints_load(folder);
+      g_hash_table_insert(folders, g_strdup(folder), known);
+    }
+
+    // only new files. the ones we have already are handled by the crawler and importing the folder again.
+    if(!dt_film_fingerprint_known(known, filename) && g_file_test(filename, G_FILE_TEST_IS_REGULAR))
+    {
+      dt_film_t film;
+      dt_film_init(&film);
+      if(dt_film_new(&film, folder) && dt_image_import(film.id, filename, FALSE))
+      {
+        dt_film_fingerprint_store(film.id, filename);
+        count++;
+      }
+      dt_film_cleanup(&film);
+    }
+    g_free(folder);
+  }
+  g_hash_table_destroy(folders);
+
+  if(count)
+  {
+    dt_print(DT_DEBUG_CONTROL, "[film_monitor] imported %d new images\n", count);
+    dt_control_queue_redraw_center();
+  }
+  return 0;
+}
+
+static void _film_monitor_job_cleanup(void *p)
+{
+  dt_film_monitor_job_t *params = (dt_film_monitor_job_t *)p;
+  g_list_free_full(params->files, g_free);
+  free(params);
+}
+
+static gboolean _film_monitor_timeout(gpointer user_data)
+{
+  dt_film_monitor_t *m = (dt_film_monitor_t *)user_data;
+  m->timeout = 0;
+
+  dt_job_t *job = dt_control_job_create(&_film_monitor_job_run, "import new images");
+  if(!job) return G_SOURCE_REMOVE;
+  dt_film_monitor_job_t *params = (dt_film_monitor_job_t *)calloc(1, sizeof(dt_film_monitor_job_t));
+  if(!params)
+  {
+    dt_control_job_dispose(job);
+    return G_SOURCE_REMOVE;
+  }
+  // hand the paths over to the job
+  GHashTableIter iter;
+  gpointer key;
+  g_hash_table_iter_init(&iter, m->pending);
+  while(g_hash_table_iter_next(&iter, &key, NULL))
+  {
+    params->files = g_list_prepend(params->files, key);
+    g_hash_table_iter_steal(&iter);
+  }
+  params->files = g_list_sort(params->files, (GCompareFunc)g_strcmp0);
+  dt_control_job_set_params(job, params, _film_monitor_job_cleanup);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG, job);
+  return G_SOURCE_REMOVE;
+}
+
+static void _film_monitor_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+                                  GFileMonitorEvent event_type, gpointer user_data)
+{
+  dt_film_monitor_t *m = (dt_film_monitor_t *)user_data;
+  if(event_type != G_FILE_MONITOR_EVENT_CREATED && event_type != G_FILE_MONITOR_EVENT_CHANGED
+     && event_type != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT)
+    return;
+
+  gchar *path = g_file_get_path(file);
+  if(!path) return;
+  gchar *basename = g_path_get_basename(path);
+  const gboolean supported = basename[0] != '.' && dt_supported_image(basename);
+  g_free(basename);
+  if(!supported)
+  {
+    g_free(path);
+    return;
+  }
+  g_hash_table_add(m->pending, path);
+
+  // wait for the folder to calm down, a file that is still being copied keeps sending events
+  if(m->timeout) g_source_remove(m->timeout);
+  m->timeout = g_timeout_add_seconds(DT_FILM_MONITOR_DELAY, _film_monitor_timeout, m);
+}
+
+static void _film_monitor_add(dt_film_monitor_t *m, const char *folder)
+{
+  if(g_hash_table_contains(m->monitors, folder)) return;
+  if(g_hash_table_size(m->monitors) >= DT_FILM_MONITOR_MAX_FOLDERS) return;
+  if(!g_file_test(folder, G_FILE_TEST_IS_DIR)) return; // on a drive that isn't connected
+
+  GFile *dir = g_file_new_for_path(folder);
+  GError *error = NULL;
+  GFileMonitor *monitor = g_file_monitor_directory(dir, G_FILE_MONITOR_NONE, NULL, &error);
+  g_object_unref(dir);
+  if(!monitor)
+  {
+    dt_print(DT_DEBUG_CONTROL, "[film_monitor] can't watch `%s': %s\n", folder, error ? error->message : "");
+    g_clear_error(&error);
+    return;
+  }
+  g_signal_connect(G_OBJECT(monitor), "changed", G_CALLBACK(_film_monitor_changed), m);
+  g_hash_table_insert(m->monitors, g_strdup(folder), monitor);
+}
+
+static void _film_monitor_filmrolls_imported(gpointer instance, guint film_id, gpointer user_data)
+{
+  dt_film_monitor_t *m = (dt_film_monitor_t *)user_data;
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT folder FROM main.film_rolls WHERE id = ?1",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, film_id);
+  if(sqlite3_step(stmt) == SQLITE_ROW) _film_monitor_add(m, (const char *)sqlite3_column_text(stmt, 0));
+  sqlite3_finalize(stmt);
+}
+
+dt_film_monitor_t *dt_film_monitor_new()
+{
+  if(!dt_conf_get_bool("library_monitor_folders")) return NULL;
+
+  dt_film_monitor_t *m = (dt_film_monitor_t *)calloc(1, sizeof(dt_film_monitor_t));
+  m->monitors = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+  m->pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT folder FROM main.film_rolls ORDER BY datetime_accessed DESC LIMIT ?1", -1,
+                              &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, DT_FILM_MONITOR_MAX_FOLDERS);
+  while(sqlite3_step(stmt) == SQLITE_ROW) _film_monitor_add(m, (const char *)sqlite3_column_text(stmt, 0));
+  sqlite3_finalize(stmt);
+
+  dt_control_signal_connect(darktable.signals, DT_SIGNAL_FILMROLLS_IMPORTED,
+                            G_CALLBACK(_film_monitor_filmrolls_imported), m);
+
+  dt_print(DT_DEBUG_CONTROL, "[film_monitor] watching %u folders\n", g_hash_table_size(m->monitors));
+  return m;
+}
+
+void dt_film_monitor_free(dt_film_monitor_t *m)
+{
+  if(!m) return;
+  dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_film_monitor_filmrolls_imported), m);
+  if(m->timeout) g_source_remove(m->timeout);
+  g_hash_table_destroy(m->monitors);
+  g_hash_table_destroy(m->pending);
+  free(m);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,36 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2017 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+
+/* watches the folders of the film rolls (inotify on linux, whatever gio has elsewhere) and imports images
+ * that get added to them in the background, so the library stays current without importing the folders
+ * again. */
+
+struct dt_film_monitor_t;
+
+/** starts watching the most recently used film rolls if enabled in the preferences, NULL otherwise. has to be
+ * called from the gui thread. */
+struct dt_film_monitor_t *dt_film_monitor_new();
+void dt_film_monitor_free(struct dt_film_monitor_t *monitor);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
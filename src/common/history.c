@@ -241,7 +241,6 @@ int dt_history_load_and_apply_on_selection(gchar *filename)
 
 int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboolean merge, GList *ops)
 {
-  sqlite3_stmt *stmt;
   if(imgid == dest_imgid) return 1;
 
   if(imgid == -1)
@@ -254,6 +253,22 @@ int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboole
   const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
   if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
 
+  const int res = dt_history_copy_and_paste_on_image_deferred(imgid, dest_imgid, merge, ops);
+  if(res) return res;
+
+  /* update xmp file */
+  dt_image_synch_xmp(dest_imgid);
+
+  dt_mipmap_cache_remove(darktable.mipmap_cache, dest_imgid);
+
+  return 0;
+}
+
+int dt_history_copy_and_paste_on_image_deferred(int32_t imgid, int32_t dest_imgid, gboolean merge, GList *ops)
+{
+  sqlite3_stmt *stmt;
+  if(imgid == dest_imgid || imgid == -1) return 1;
+
   /* if merge onto history stack, lets find history offest in destination image */
   int32_t offs = 0;
   if(merge)
@@ -382,11 +397,6 @@ int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboole
     dt_dev_modulegroups_set(darktable.develop, dt_dev_modulegroups_get(darktable.develop));
   }
 
-  /* update xmp file */
-  dt_image_synch_xmp(dest_imgid);
-
-  dt_mipmap_cache_remove(darktable.mipmap_cache, dest_imgid);
-
   return 0;
 }
 
@@ -477,6 +487,16 @@ int dt_history_copy_and_paste_on_selection(int32_t imgid, gboolean merge, GList
   if(imgid < 0) return 1;
 
   int res = 0;
+  GList *pasted = NULL;
+
+  // be sure the current history is written before pasting some other history data
+  const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
+  if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
+
+  dt_image_cache_prefetch_selection(darktable.image_cache);
+
+  // all the database work in one go, sidecars and thumbnails afterwards for all images at once
+  dt_database_start_transaction(darktable.db);
   sqlite3_stmt *stmt;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                               "SELECT imgid FROM main.selected_images WHERE imgid != ?1", -1, &stmt, NULL);
@@ -488,8 +508,15 @@ int dt_history_copy_and_paste_on_selection(int32_t imgid, gboolean merge, GList
       /* get imgid of selected image */
       int32_t dest_imgid = sqlite3_column_int(stmt, 0);
 
-      /* paste history stack onto image id */
-      dt_history_copy_and_paste_on_image(imgid, dest_imgid, merge, ops);
+      /* paste history stack onto image id, an image that failed keeps its history */
+      dt_database_start_transaction(darktable.db);
+      if(!dt_history_copy_and_paste_on_image_deferred(imgid, dest_imgid, merge, ops))
+      {
+        dt_database_release_transaction(darktable.db);
+        pasted = g_list_prepend(pasted, GINT_TO_POINTER(dest_imgid));
+      }
+      else
+        dt_database_rollback_transaction(darktable.db);
 
     } while(sqlite3_step(stmt) == SQLITE_ROW);
   }
@@ -497,6 +524,15 @@ int dt_history_copy_and_paste_on_selection(int32_t imgid, gboolean merge, GList
     res = 1;
 
   sqlite3_finalize(stmt);
+  if(pasted)
+    dt_database_release_transaction(darktable.db);
+  else
+    dt_database_rollback_transaction(darktable.db);
+
+  dt_image_write_sidecar_files(pasted);
+  dt_mipmap_cache_remove_list(darktable.mipmap_cache, pasted);
+  g_list_free(pasted);
+
   return res;
 }
 
@@ -28,6 +28,10 @@ void dt_history_item_free(gpointer data);
 /** copy history from imgid and pasts on dest_imgid, merge or overwrite... */
 int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboolean merge, GList *ops);
 
+/** the database part of the above, writing the sidecar and removing the thumbnails of dest_imgid is left to the
+ * caller. for pasting onto many images, which does that for all of them at once. */
+int dt_history_copy_and_paste_on_image_deferred(int32_t imgid, int32_t dest_imgid, gboolean merge, GList *ops);
+
 void dt_history_delete_on_image(int32_t imgid);
 
 /** copy history from imgid and pasts on selected images, merge or overwrite... */
@@ -27,6 +27,7 @@
 #include "common/imageio.h"
 #include "common/imageio_rawspeed.h"
 #include "common/mipmap_cache.h"
+#include "common/sidecar_writer.h"
 #include "common/tags.h"
 #include "control/conf.h"
 #include "control/control.h"
@@ -41,7 +42,11 @@
 #ifndef __WIN32__
 #include <glob.h>
 #endif
+#include <fcntl.h>
 #include <glib/gstdio.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 
 static void _image_local_copy_full_path(const int imgid, char *pathname, size_t pathname_len);
 
@@ -561,6 +566,7 @@ int32_t dt_image_duplicate_with_version(const int32_t imgid, const int32_t newve
       darktable.gui->expanded_group_id = img->group_id;
       dt_image_cache_read_release(darktable.image_cache, img);
     }
+    dt_collection_invalidate();
     dt_collection_update_query(darktable.collection);
   }
   return newid;
@@ -618,6 +624,7 @@ void dt_image_remove(const int32_t imgid)
   dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
 
   dt_tag_update_used_tags();
+  dt_collection_invalidate();
 }
 
 int dt_image_altered(const uint32_t imgid)
@@ -742,7 +749,8 @@ void dt_image_read_duplicates(const uint32_t id, const char *filename)
 }
 
 
-uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean override_ignore_jpegs)
+static uint32_t _image_import_internal(const int32_t film_id, const char *filename,
+                                       gboolean override_ignore_jpegs, const dt_exif_preread_t *pre)
 {
   if(!g_file_test(filename, G_FILE_TEST_IS_REGULAR) || dt_util_get_file_size(filename) == 0) return 0;
   const char *cc = filename + strlen(filename);
@@ -928,13 +936,13 @@ uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean o
   img->group_id = group_id;
 
   // read dttags and exif for database queries!
-  (void)dt_exif_read(img, filename);
+  (void)dt_exif_read_preread(img, filename, pre);
   char dtfilename[PATH_MAX] = { 0 };
   g_strlcpy(dtfilename, filename, sizeof(dtfilename));
   // dt_image_path_append_version(id, dtfilename, sizeof(dtfilename));
   g_strlcat(dtfilename, ".xmp", sizeof(dtfilename));
 
-  int res = dt_exif_xmp_read(img, dtfilename, 0);
+  int res = dt_exif_xmp_read_preread(img, dtfilename, pre);
 
   // write through to db, but not to xmp.
   dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_RELAXED);
@@ -972,6 +980,17 @@ uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean o
   return id;
 }
 
+uint32_t dt_image_import(const int32_t film_id, const char *filename, gboolean override_ignore_jpegs)
+{
+  return _image_import_internal(film_id, filename, override_ignore_jpegs, NULL);
+}
+
+uint32_t dt_image_import_preread(const int32_t film_id, const char *filename, gboolean override_ignore_jpegs,
+                                 const dt_exif_preread_t *pre)
+{
+  return _image_import_internal(film_id, filename, override_ignore_jpegs, pre);
+}
+
 void dt_image_init(dt_image_t *img)
 {
   img->width = img->height = 0;
@@ -1483,7 +1502,7 @@ int dt_image_local_copy_reset(const int32_t imgid)
 // xmp stuff
 // *******************************************************
 
-void dt_image_write_sidecar_file(int imgid)
+void dt_image_write_sidecar_file_direct(int imgid, gboolean durable)
 {
   // TODO: compute hash and don't write if not needed!
   // write .xmp file
@@ -1510,6 +1529,17 @@ void dt_image_write_sidecar_file(int imgid)
 
     if(!dt_exif_xmp_write(imgid, filename))
     {
+#ifndef _WIN32
+      if(durable)
+      {
+        const int fd = g_open(filename, O_RDONLY, 0);
+        if(fd >= 0)
+        {
+          fsync(fd);
+          close(fd);
+        }
+      }
+#endif
       // put the timestamp into db. this can't be done in exif.cc since that code gets called
       // for the copy exporter, too
       sqlite3_stmt *stmt;
@@ -1523,12 +1553,33 @@ void dt_image_write_sidecar_file(int imgid)
   }
 }
 
+void dt_image_write_sidecar_file(int imgid)
+{
+  // a queued write of the same file could race with this one and bring back older data
+  dt_sidecar_writer_settle(darktable.sidecar_writer, imgid);
+  dt_image_write_sidecar_file_direct(imgid, FALSE);
+}
+
+void dt_image_queue_sidecar_file(int imgid)
+{
+  if(!dt_conf_get_bool("write_sidecar_files")) return;
+  dt_sidecar_writer_queue(darktable.sidecar_writer, imgid);
+}
+
+void dt_image_write_sidecar_files(const GList *imgs)
+{
+  if(!dt_conf_get_bool("write_sidecar_files")) return;
+
+  // the writer spreads them over its threads, without one they are written right here
+  for(const GList *l = imgs; l; l = g_list_next(l))
+    dt_sidecar_writer_queue(darktable.sidecar_writer, GPOINTER_TO_INT(l->data));
+}
 
 void dt_image_synch_xmp(const int selected)
 {
   if(selected > 0)
   {
-    dt_image_write_sidecar_file(selected);
+    dt_image_queue_sidecar_file(selected);
   }
   else if(dt_conf_get_bool("write_sidecar_files"))
   {
@@ -1538,7 +1589,7 @@ void dt_image_synch_xmp(const int selected)
     while(sqlite3_step(stmt) == SQLITE_ROW)
     {
       const int imgid = sqlite3_column_int(stmt, 0);
-      dt_image_write_sidecar_file(imgid);
+      dt_sidecar_writer_queue(darktable.sidecar_writer, imgid);
     }
     sqlite3_finalize(stmt);
   }
@@ -213,6 +213,10 @@ void dt_image_print_exif(const dt_image_t *img, char *line, size_t line_len);
 void dt_image_read_duplicates(uint32_t id, const char *filename);
 /** imports a new image from raw/etc file and adds it to the data base and image cache. */
 uint32_t dt_image_import(int32_t film_id, const char *filename, gboolean override_ignore_jpegs);
+struct dt_exif_preread_t;
+/** same as dt_image_import(), using the metadata already parsed by dt_exif_preread() if pre is not NULL. */
+uint32_t dt_image_import_preread(int32_t film_id, const char *filename, gboolean override_ignore_jpegs,
+                                 const struct dt_exif_preread_t *pre);
 /** removes the given image from the database. */
 void dt_image_remove(const int32_t imgid);
 /** duplicates the given image in the database with the duplicate getting the supplied version number. if that
@@ -278,7 +282,14 @@ gboolean dt_image_safe_remove(const int32_t imgid);
 /* try to sync .xmp for all local copies */
 void dt_image_local_copy_synch(void);
 // xmp functions:
+/** writes the sidecar of imgid right now, dropping a queued write of it */
 void dt_image_write_sidecar_file(int imgid);
+/** writes the sidecar in the calling thread, optionally making sure it hit the disk. used by the sidecar writer */
+void dt_image_write_sidecar_file_direct(int imgid, gboolean durable);
+/** writes the sidecar of imgid in the background, repeated changes in a short time get written once */
+void dt_image_queue_sidecar_file(int imgid);
+/** queues the sidecars of all images in the list of GINT_TO_POINTER(id) with the sidecar writer */
+void dt_image_write_sidecar_files(const GList *imgs);
 void dt_image_synch_xmp(const int selected);
 void dt_image_synch_all_xmp(const gchar *pathname);
 
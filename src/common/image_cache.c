@@ -17,6 +17,7 @@
 */
 
 #include "common/image_cache.h"
+#include "common/collection.h"
 #include "common/darktable.h"
 #include "common/debug.h"
 #include "common/exif.h"
@@ -26,113 +27,163 @@
 
 #include <sqlite3.h>
 
+// the columns _image_cache_load() expects
+#define DT_IMAGE_CACHE_COLUMNS                                                                               \
+  "id, group_id, film_id, width, height, filename, maker, model, lens, exposure, "                           \
+  "aperture, iso, focal_length, datetime_taken, flags, crop, orientation, focus_distance, "                  \
+  "raw_parameters, longitude, latitude, altitude, color_matrix, colorspace, version, raw_black, "            \
+  "raw_maximum"
+
+// fills an initialized image struct from a row of DT_IMAGE_CACHE_COLUMNS
+static void _image_cache_load(dt_image_t *img, sqlite3_stmt *stmt)
+{
+  char *str;
+  img->id = sqlite3_column_int(stmt, 0);
+  img->group_id = sqlite3_column_int(stmt, 1);
+  img->film_id = sqlite3_column_int(stmt, 2);
+  img->width = sqlite3_column_int(stmt, 3);
+  img->height = sqlite3_column_int(stmt, 4);
+  img->crop_x = img->crop_y = img->crop_width = img->crop_height = 0;
+  img->filename[0] = img->exif_maker[0] = img->exif_model[0] = img->exif_lens[0]
+      = img->exif_datetime_taken[0] = '\0';
+  str = (char *)sqlite3_column_text(stmt, 5);
+  if(str) g_strlcpy(img->filename, str, sizeof(img->filename));
+  str = (char *)sqlite3_column_text(stmt, 6);
+  if(str) g_strlcpy(img->exif_maker, str, sizeof(img->exif_maker));
+  str = (char *)sqlite3_column_text(stmt, 7);
+  if(str) g_strlcpy(img->exif_model, str, sizeof(img->exif_model));
+  str = (char *)sqlite3_column_text(stmt, 8);
+  if(str) g_strlcpy(img->exif_lens, str, sizeof(img->exif_lens));
+  img->exif_exposure = sqlite3_column_double(stmt, 9);
+  img->exif_aperture = sqlite3_column_double(stmt, 10);
+  img->exif_iso = sqlite3_column_double(stmt, 11);
+  img->exif_focal_length = sqlite3_column_double(stmt, 12);
+  str = (char *)sqlite3_column_text(stmt, 13);
+  if(str) g_strlcpy(img->exif_datetime_taken, str, sizeof(img->exif_datetime_taken));
+  img->flags = sqlite3_column_int(stmt, 14);
+  img->loader = LOADER_UNKNOWN;
+  img->exif_crop = sqlite3_column_double(stmt, 15);
+  img->orientation = sqlite3_column_int(stmt, 16);
+  img->exif_focus_distance = sqlite3_column_double(stmt, 17);
+  if(img->exif_focus_distance >= 0 && img->orientation >= 0) img->exif_inited = 1;
+  uint32_t tmp = sqlite3_column_int(stmt, 18);
+  memcpy(&img->legacy_flip, &tmp, sizeof(dt_image_raw_parameters_t));
+  if(sqlite3_column_type(stmt, 19) == SQLITE_FLOAT)
+    img->longitude = sqlite3_column_double(stmt, 19);
+  else
+    img->longitude = NAN;
+  if(sqlite3_column_type(stmt, 20) == SQLITE_FLOAT)
+    img->latitude = sqlite3_column_double(stmt, 20);
+  else
+    img->latitude = NAN;
+  if(sqlite3_column_type(stmt, 21) == SQLITE_FLOAT)
+    img->elevation = sqlite3_column_double(stmt, 21);
+  else
+    img->elevation = NAN;
+  const void *color_matrix = sqlite3_column_blob(stmt, 22);
+  if(color_matrix)
+    memcpy(img->d65_color_matrix, color_matrix, sizeof(img->d65_color_matrix));
+  else
+    img->d65_color_matrix[0] = NAN;
+  g_free(img->profile);
+  img->profile = NULL;
+  img->profile_size = 0;
+  img->colorspace = sqlite3_column_int(stmt, 23);
+  img->version = sqlite3_column_int(stmt, 24);
+  img->raw_black_level = sqlite3_column_int(stmt, 25);
+  for(uint8_t i = 0; i < 4; i++) img->raw_black_level_separate[i] = 0;
+  img->raw_white_point = sqlite3_column_int(stmt, 26);
+
+  // buffer size?
+  if(img->flags & DT_IMAGE_LDR)
+  {
+    img->buf_dsc.channels = 4;
+    img->buf_dsc.datatype = TYPE_FLOAT;
+  }
+  else if(img->flags & DT_IMAGE_HDR)
+  {
+    if(img->flags & DT_IMAGE_RAW)
+    {
+      img->buf_dsc.channels = 1;
+      img->buf_dsc.datatype = TYPE_FLOAT;
+    }
+    else
+    {
+      img->buf_dsc.channels = 4;
+      img->buf_dsc.datatype = TYPE_FLOAT;
+    }
+  }
+  else
+  {
+    // raw
+    img->buf_dsc.channels = 1;
+    img->buf_dsc.datatype = TYPE_UINT16;
+  }
+}
+
+static void _image_cache_free(gpointer data)
+{
+  dt_image_t *img = (dt_image_t *)data;
+  g_free(img->profile);
+  g_free(img);
+}
+
+// an image struct parked by the prefetch, with the generation it was read from the database in
+typedef struct dt_image_cache_prefetched_t
+{
+  dt_image_t *img;
+  uint32_t generation;
+} dt_image_cache_prefetched_t;
+
+static void _image_cache_prefetched_free(gpointer data)
+{
+  dt_image_cache_prefetched_t *p = (dt_image_cache_prefetched_t *)data;
+  if(p->img) _image_cache_free(p->img);
+  g_free(p);
+}
+
 void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
 {
+  dt_image_cache_t *cache = (dt_image_cache_t *)data;
   entry->cost = sizeof(dt_image_t);
 
-  dt_image_t *img = (dt_image_t *)g_malloc(sizeof(dt_image_t));
+  // loaded already by dt_image_cache_prefetch()? only if nothing was written back since it was read.
+  dt_image_t *img = NULL;
+  dt_pthread_mutex_lock(&cache->prefetch_mutex);
+  dt_image_cache_prefetched_t *parked
+      = (dt_image_cache_prefetched_t *)g_hash_table_lookup(cache->prefetched, GINT_TO_POINTER(entry->key));
+  if(parked && parked->generation == cache->prefetch_generation)
+  {
+    img = parked->img;
+    parked->img = NULL;
+  }
+  if(parked) g_hash_table_remove(cache->prefetched, GINT_TO_POINTER(entry->key));
+  dt_pthread_mutex_unlock(&cache->prefetch_mutex);
+  if(img)
+  {
+    entry->data = img;
+    img->cache_entry = entry;
+    return;
+  }
+
+  img = (dt_image_t *)g_malloc(sizeof(dt_image_t));
   dt_image_init(img);
   entry->data = img;
   // load stuff from db and store in cache:
-  char *str;
   sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(
-      dt_database_get(darktable.db),
-      "SELECT id, group_id, film_id, width, height, filename, maker, model, lens, exposure, "
-      "aperture, iso, focal_length, datetime_taken, flags, crop, orientation, focus_distance, "
-      "raw_parameters, longitude, latitude, altitude, color_matrix, colorspace, version, raw_black, "
-      "raw_maximum FROM main.images WHERE id = ?1",
-      -1, &stmt, NULL);
+  sqlite3 *db = dt_database_get_reader(darktable.db);
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, "SELECT " DT_IMAGE_CACHE_COLUMNS " FROM main.images WHERE id = ?1", -1, &stmt,
+                              NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, entry->key);
   if(sqlite3_step(stmt) == SQLITE_ROW)
   {
-    img->id = sqlite3_column_int(stmt, 0);
-    img->group_id = sqlite3_column_int(stmt, 1);
-    img->film_id = sqlite3_column_int(stmt, 2);
-    img->width = sqlite3_column_int(stmt, 3);
-    img->height = sqlite3_column_int(stmt, 4);
-    img->crop_x = img->crop_y = img->crop_width = img->crop_height = 0;
-    img->filename[0] = img->exif_maker[0] = img->exif_model[0] = img->exif_lens[0]
-        = img->exif_datetime_taken[0] = '\0';
-    str = (char *)sqlite3_column_text(stmt, 5);
-    if(str) g_strlcpy(img->filename, str, sizeof(img->filename));
-    str = (char *)sqlite3_column_text(stmt, 6);
-    if(str) g_strlcpy(img->exif_maker, str, sizeof(img->exif_maker));
-    str = (char *)sqlite3_column_text(stmt, 7);
-    if(str) g_strlcpy(img->exif_model, str, sizeof(img->exif_model));
-    str = (char *)sqlite3_column_text(stmt, 8);
-    if(str) g_strlcpy(img->exif_lens, str, sizeof(img->exif_lens));
-    img->exif_exposure = sqlite3_column_double(stmt, 9);
-    img->exif_aperture = sqlite3_column_double(stmt, 10);
-    img->exif_iso = sqlite3_column_double(stmt, 11);
-    img->exif_focal_length = sqlite3_column_double(stmt, 12);
-    str = (char *)sqlite3_column_text(stmt, 13);
-    if(str) g_strlcpy(img->exif_datetime_taken, str, sizeof(img->exif_datetime_taken));
-    img->flags = sqlite3_column_int(stmt, 14);
-    img->loader = LOADER_UNKNOWN;
-    img->exif_crop = sqlite3_column_double(stmt, 15);
-    img->orientation = sqlite3_column_int(stmt, 16);
-    img->exif_focus_distance = sqlite3_column_double(stmt, 17);
-    if(img->exif_focus_distance >= 0 && img->orientation >= 0) img->exif_inited = 1;
-    uint32_t tmp = sqlite3_column_int(stmt, 18);
-    memcpy(&img->legacy_flip, &tmp, sizeof(dt_image_raw_parameters_t));
-    if(sqlite3_column_type(stmt, 19) == SQLITE_FLOAT)
-      img->longitude = sqlite3_column_double(stmt, 19);
-    else
-      img->longitude = NAN;
-    if(sqlite3_column_type(stmt, 20) == SQLITE_FLOAT)
-      img->latitude = sqlite3_column_double(stmt, 20);
-    else
-      img->latitude = NAN;
-    if(sqlite3_column_type(stmt, 21) == SQLITE_FLOAT)
-      img->elevation = sqlite3_column_double(stmt, 21);
-    else
-      img->elevation = NAN;
-    const void *color_matrix = sqlite3_column_blob(stmt, 22);
-    if(color_matrix)
-      memcpy(img->d65_color_matrix, color_matrix, sizeof(img->d65_color_matrix));
-    else
-      img->d65_color_matrix[0] = NAN;
-    g_free(img->profile);
-    img->profile = NULL;
-    img->profile_size = 0;
-    img->colorspace = sqlite3_column_int(stmt, 23);
-    img->version = sqlite3_column_int(stmt, 24);
-    img->raw_black_level = sqlite3_column_int(stmt, 25);
-    for(uint8_t i = 0; i < 4; i++) img->raw_black_level_separate[i] = 0;
-    img->raw_white_point = sqlite3_column_int(stmt, 26);
-
-    // buffer size?
-    if(img->flags & DT_IMAGE_LDR)
-    {
-      img->buf_dsc.channels = 4;
-      img->buf_dsc.datatype = TYPE_FLOAT;
-    }
-    else if(img->flags & DT_IMAGE_HDR)
-    {
-      if(img->flags & DT_IMAGE_RAW)
-      {
-        img->buf_dsc.channels = 1;
-        img->buf_dsc.datatype = TYPE_FLOAT;
-      }
-      else
-      {
-        img->buf_dsc.channels = 4;
-        img->buf_dsc.datatype = TYPE_FLOAT;
-      }
-    }
-    else
-    {
-      // raw
-      img->buf_dsc.channels = 1;
-      img->buf_dsc.datatype = TYPE_UINT16;
-    }
+    _image_cache_load(img, stmt);
   }
   else
   {
     img->id = -1;
     fprintf(stderr, "[image_cache_allocate] failed to open image %d from database: %s\n", entry->key,
-            sqlite3_errmsg(dt_database_get(darktable.db)));
+            sqlite3_errmsg(db));
   }
   sqlite3_finalize(stmt);
   img->cache_entry = entry; // init backref
@@ -142,9 +193,7 @@ void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
 
 void dt_image_cache_deallocate(void *data, dt_cache_entry_t *entry)
 {
-  dt_image_t *img = (dt_image_t *)entry->data;
-  g_free(img->profile);
-  g_free(img);
+  _image_cache_free(entry->data);
 }
 
 void dt_image_cache_init(dt_image_cache_t *cache)
@@ -161,12 +210,118 @@ void dt_image_cache_init(dt_image_cache_t *cache)
   dt_cache_set_allocate_callback(&cache->cache, &dt_image_cache_allocate, cache);
   dt_cache_set_cleanup_callback(&cache->cache, &dt_image_cache_deallocate, cache);
 
+  cache->prefetched = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, _image_cache_prefetched_free);
+  cache->prefetch_generation = 0;
+  dt_pthread_mutex_init(&cache->prefetch_mutex, NULL);
+
   dt_print(DT_DEBUG_CACHE, "[image_cache] has %d entries\n", num);
 }
 
 void dt_image_cache_cleanup(dt_image_cache_t *cache)
 {
   dt_cache_cleanup(&cache->cache);
+  g_hash_table_destroy(cache->prefetched);
+  dt_pthread_mutex_destroy(&cache->prefetch_mutex);
+}
+
+// runs the query, which has to select DT_IMAGE_CACHE_COLUMNS, and puts all images that aren't in the cache yet
+// into it
+static void _image_cache_prefetch_query(dt_image_cache_t *cache, const char *query)
+{
+  const double start = dt_get_wtime();
+  GArray *loaded = g_array_new(FALSE, FALSE, sizeof(int32_t));
+
+  // the images might be in the cache and written back any time before they are picked up, taken before
+  // the query so that a struct read before such a write never matches.
+  dt_pthread_mutex_lock(&cache->prefetch_mutex);
+  const uint32_t generation = cache->prefetch_generation;
+  dt_pthread_mutex_unlock(&cache->prefetch_mutex);
+
+  // build all structs without holding the cache lock, dt_image_cache_allocate() then just picks them up
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db), query, -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int32_t id = sqlite3_column_int(stmt, 0);
+    if(dt_cache_contains(&cache->cache, id)) continue;
+    dt_image_t *img = (dt_image_t *)g_malloc(sizeof(dt_image_t));
+    dt_image_init(img);
+    _image_cache_load(img, stmt);
+    dt_image_refresh_makermodel(img);
+    dt_image_cache_prefetched_t *parked = g_new(dt_image_cache_prefetched_t, 1);
+    parked->img = img;
+    parked->generation = generation;
+    dt_pthread_mutex_lock(&cache->prefetch_mutex);
+    g_hash_table_replace(cache->prefetched, GINT_TO_POINTER(id), parked);
+    dt_pthread_mutex_unlock(&cache->prefetch_mutex);
+    g_array_append_val(loaded, id);
+  }
+  sqlite3_finalize(stmt);
+
+  for(guint k = 0; k < loaded->len; k++)
+  {
+    const int32_t id = g_array_index(loaded, int32_t, k);
+    const dt_image_t *img = dt_image_cache_get(cache, id, 'r');
+    dt_image_cache_read_release(cache, img);
+  }
+
+  // whatever got loaded by someone else in the meantime
+  dt_pthread_mutex_lock(&cache->prefetch_mutex);
+  for(guint k = 0; k < loaded->len; k++)
+    g_hash_table_remove(cache->prefetched, GINT_TO_POINTER(g_array_index(loaded, int32_t, k)));
+  dt_pthread_mutex_unlock(&cache->prefetch_mutex);
+
+  dt_print(DT_DEBUG_CACHE, "[image_cache] prefetched %u images in %.3f secs\n", loaded->len,
+           dt_get_wtime() - start);
+  g_array_free(loaded, TRUE);
+}
+
+// more than half the cache would just push the first prefetched images out again
+static int _image_cache_prefetch_max(const dt_image_cache_t *cache)
+{
+  return MAX(1, cache->cache.cost_quota / sizeof(dt_image_t) / 2);
+}
+
+void dt_image_cache_prefetch(dt_image_cache_t *cache, const int32_t *ids, const int count)
+{
+  const int max = _image_cache_prefetch_max(cache);
+  GString *list = g_string_new(NULL);
+  int listed = 0;
+  for(int k = 0; k < count && listed < max; k++)
+  {
+    if(ids[k] <= 0 || dt_cache_contains(&cache->cache, ids[k])) continue;
+    g_string_append_printf(list, "%s%d", listed ? "," : "", ids[k]);
+    listed++;
+  }
+  // a single miss is as cheap through the normal path
+  if(listed > 1)
+  {
+    gchar *query = g_strdup_printf("SELECT " DT_IMAGE_CACHE_COLUMNS " FROM main.images WHERE id IN (%s)",
+                                   list->str);
+    _image_cache_prefetch_query(cache, query);
+    g_free(query);
+  }
+  g_string_free(list, TRUE);
+}
+
+void dt_image_cache_prefetch_list(dt_image_cache_t *cache, const GList *ids)
+{
+  const int max = _image_cache_prefetch_max(cache);
+  int32_t *array = (int32_t *)malloc(sizeof(int32_t) * max);
+  if(!array) return;
+  int count = 0;
+  for(const GList *l = ids; l && count < max; l = g_list_next(l)) array[count++] = GPOINTER_TO_INT(l->data);
+  dt_image_cache_prefetch(cache, array, count);
+  free(array);
+}
+
+void dt_image_cache_prefetch_selection(dt_image_cache_t *cache)
+{
+  gchar *query = g_strdup_printf("SELECT " DT_IMAGE_CACHE_COLUMNS " FROM main.images AS i "
+                                 "JOIN main.selected_images AS s ON s.imgid = i.id LIMIT %d",
+                                 _image_cache_prefetch_max(cache));
+  _image_cache_prefetch_query(cache, query);
+  g_free(query);
 }
 
 void dt_image_cache_print(dt_image_cache_t *cache)
@@ -249,13 +404,19 @@ void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_i
   int rc = sqlite3_step(stmt);
   if(rc != SQLITE_DONE) fprintf(stderr, "[image_cache_write_release] sqlite3 error %d\n", rc);
   sqlite3_finalize(stmt);
+  // structs the prefetch read before this are outdated now
+  dt_pthread_mutex_lock(&cache->prefetch_mutex);
+  cache->prefetch_generation++;
+  dt_pthread_mutex_unlock(&cache->prefetch_mutex);
+  // rating, grouping, date, location, ... collections may filter or sort by any of these
+  dt_collection_invalidate();
 
   // TODO: make this work in relaxed mode, too.
   if(mode == DT_IMAGE_CACHE_SAFE)
   {
     // rest about sidecars:
     // also synch dttags file:
-    dt_image_write_sidecar_file(img->id);
+    dt_image_queue_sidecar_file(img->id);
   }
   dt_cache_release(&cache->cache, img->cache_entry);
 }
@@ -24,6 +24,13 @@
 typedef struct dt_image_cache_t
 {
   dt_cache_t cache;
+
+  // image structs loaded by dt_image_cache_prefetch*() on their way into the cache
+  // (id -> dt_image_cache_prefetched_t *)
+  GHashTable *prefetched;
+  // bumped by every dt_image_cache_write_release(), parked structs read before that are stale
+  uint32_t prefetch_generation;
+  dt_pthread_mutex_t prefetch_mutex;
 }
 dt_image_cache_t;
 
@@ -51,6 +58,15 @@ void dt_image_cache_print(dt_image_cache_t *cache);
 // point where sql and xmp can be synched (unsafe setting).
 dt_image_t *dt_image_cache_get(dt_image_cache_t *cache, const uint32_t imgid, char mode);
 
+// loads the image structs of all these ids that aren't in the cache yet with a single query and puts them
+// into the cache, so that the following dt_image_cache_get() calls don't each go to the database.
+// at most half the cache worth of images is loaded.
+void dt_image_cache_prefetch(dt_image_cache_t *cache, const int32_t *ids, const int count);
+// same for a list of GINT_TO_POINTER(id), as used by the jobs
+void dt_image_cache_prefetch_list(dt_image_cache_t *cache, const GList *ids);
+// same for the selected images
+void dt_image_cache_prefetch_selection(dt_image_cache_t *cache);
+
 // same as read_get, but doesn't block and returns NULL if the image
 // is currently unavailable.
 dt_image_t *dt_image_cache_testget(dt_image_cache_t *cache, const uint32_t imgid, char mode);
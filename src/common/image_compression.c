@@ -21,6 +21,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 typedef union
 {
@@ -28,126 +31,204 @@ typedef union
   uint32_t i;
 } dt_image_float_int_t;
 
-void dt_image_uncompress(const uint8_t *in, float *out, const int32_t width, const int32_t height)
+size_t dt_image_compressed_size(const int32_t width, const int32_t height)
+{
+  return (size_t)16 * ((width + 3) / 4) * ((height + 3) / 4);
+}
+
+// chroma of the four 2x2 quadrants, already scaled to rgb weights and padded to 4 floats
+static inline void _uncompress_chroma(const uint8_t *const block, float chrom[4][4])
 {
-  dt_image_float_int_t L[16];
-  float chrom[4][3];
-  const float fac[3] = { 4., 2., 4. };
-  uint16_t L16[16];
-  int32_t n_zeroes, Lbias;
   uint8_t r[4], b[4];
-  const uint8_t *block = in;
-  for(int j = 0; j < height; j += 4)
+  r[0] = block[9] >> 1;
+  b[0] = ((block[9] & 0x01) << 6) | (block[10] >> 2);
+  r[1] = ((block[10] & 0x03) << 5) | (block[11] >> 3);
+  b[1] = ((block[11] & 0x07) << 4) | (block[12] >> 4);
+  r[2] = ((block[12] & 0x0f) << 3) | (block[13] >> 5);
+  b[2] = ((block[13] & 0x1f) << 2) | (block[14] >> 6);
+  r[3] = ((block[14] & 0x3f) << 1) | (block[15] >> 7);
+  b[3] = block[15] & 0x7f;
+
+  for(int q = 0; q < 4; q++)
   {
-    for(int i = 0; i < width; i += 4)
-    {
-      // luma
-      Lbias = (block[0] >> 3) << 10;
-      n_zeroes = block[0] & 0x7;
-      const int shift = 14 - n_zeroes - 4 + 1;
+    const float cr = r[q] * (1.0f / 127.0f), cb = b[q] * (1.0f / 127.0f);
+    chrom[q][0] = 4.0f * cr;
+    chrom[q][1] = 2.0f * fmaxf(1.0f - cr - cb, 0.0f);
+    chrom[q][2] = 4.0f * cb;
+    chrom[q][3] = 0.0f;
+  }
+}
 
-      for(int k = 0; k < 8; k++)
-      {
-        L16[2 * k] = ((int)(block[1 + k] >> 4) << shift) + Lbias;
-        L16[2 * k + 1] = ((int)(block[1 + k] & 0xf) << shift) + Lbias;
-      }
-      for(int k = 0; k < 16; k++)
-      {
-        L[k].i = (((int)(L16[k]) >> 10) - (15 - 127)) << (23);
-        L[k].i |= (L16[k] & 0x3ff) << 13;
-      }
-      // chroma
-      r[0] = block[9] >> 1;
-      b[0] = ((block[9] & 0x01) << 6) | (block[10] >> 2);
-      r[1] = ((block[10] & 0x03) << 5) | (block[11] >> 3);
-      b[1] = ((block[11] & 0x07) << 4) | (block[12] >> 4);
-      r[2] = ((block[12] & 0x0f) << 3) | (block[13] >> 5);
-      b[2] = ((block[13] & 0x1f) << 2) | (block[14] >> 6);
-      r[3] = ((block[14] & 0x3f) << 1) | (block[15] >> 7);
-      b[3] = block[15] & 0x7f;
-
-      for(int q = 0; q < 4; q++)
+static inline void _uncompress_block_plain(const uint8_t *const block, float *const out, const int i,
+                                           const int j, const int32_t width, const int32_t height, const int ch)
+{
+  // luma
+  const uint32_t Lbias = (block[0] >> 3) << 10;
+  const int shift = 14 - (block[0] & 0x7) - 4 + 1;
+  dt_image_float_int_t L[16];
+  for(int k = 0; k < 16; k++)
+  {
+    const uint32_t nibble = (k & 1) ? (block[1 + (k >> 1)] & 0xf) : (block[1 + (k >> 1)] >> 4);
+    const uint32_t L16 = (nibble << shift) + Lbias;
+    L[k].i = L16 ? ((((L16 >> 10) - (15 - 127)) << 23) | ((L16 & 0x3ff) << 13)) : 0;
+  }
+
+  float chrom[4][4];
+  _uncompress_chroma(block, chrom);
+
+  for(int k = 0; k < 16; k++)
+  {
+    const int ii = i + (k & 3), jj = j + (k >> 2);
+    if(ii >= width || jj >= height) continue;
+    float *const o = out + (size_t)ch * (ii + (size_t)width * jj);
+    const float *const c = chrom[((k >> 3) << 1) | ((k & 3) >> 1)];
+    for(int cc = 0; cc < 3; cc++) o[cc] = L[k].f * c[cc];
+    if(ch == 4) o[3] = 0.0f;
+  }
+}
+
+#ifdef __SSE2__
+// a whole block of rgba pixels, one pixel per vector
+static inline void _uncompress_block_sse2(const uint8_t *const block, float *const out, const int i, const int j,
+                                          const int32_t width)
+{
+  const __m128i bias = _mm_set1_epi32((block[0] >> 3) << 10);
+  const __m128i shift = _mm_cvtsi32_si128(14 - (block[0] & 0x7) - 4 + 1);
+  const __m128i exp_bias = _mm_set1_epi32(127 - 15);
+  const __m128i mant_mask = _mm_set1_epi32(0x3ff);
+
+  float chrom[4][4] __attribute__((aligned(16)));
+  _uncompress_chroma(block, chrom);
+
+  for(int y = 0; y < 4; y++)
+  {
+    const int a = block[1 + 2 * y], b = block[2 + 2 * y];
+    const __m128i L16 = _mm_add_epi32(_mm_sll_epi32(_mm_set_epi32(b & 0xf, b >> 4, a & 0xf, a >> 4), shift), bias);
+    const __m128i bits = _mm_or_si128(_mm_slli_epi32(_mm_add_epi32(_mm_srli_epi32(L16, 10), exp_bias), 23),
+                                      _mm_slli_epi32(_mm_and_si128(L16, mant_mask), 13));
+    const __m128 L = _mm_castsi128_ps(_mm_andnot_si128(_mm_cmpeq_epi32(L16, _mm_setzero_si128()), bits));
+
+    const __m128 c0 = _mm_load_ps(chrom[(y >> 1) << 1]);
+    const __m128 c1 = _mm_load_ps(chrom[((y >> 1) << 1) | 1]);
+    float *const o = out + 4 * (i + (size_t)width * (j + y));
+    _mm_storeu_ps(o, _mm_mul_ps(_mm_shuffle_ps(L, L, _MM_SHUFFLE(0, 0, 0, 0)), c0));
+    _mm_storeu_ps(o + 4, _mm_mul_ps(_mm_shuffle_ps(L, L, _MM_SHUFFLE(1, 1, 1, 1)), c0));
+    _mm_storeu_ps(o + 8, _mm_mul_ps(_mm_shuffle_ps(L, L, _MM_SHUFFLE(2, 2, 2, 2)), c1));
+    _mm_storeu_ps(o + 12, _mm_mul_ps(_mm_shuffle_ps(L, L, _MM_SHUFFLE(3, 3, 3, 3)), c1));
+  }
+}
+#endif
+
+void dt_image_uncompress(const uint8_t *in, float *out, const int32_t width, const int32_t height, const int ch)
+{
+  const int bw = (width + 3) / 4, bh = (height + 3) / 4;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for(int bj = 0; bj < bh; bj++)
+  {
+    const uint8_t *block = in + (size_t)16 * bw * bj;
+    for(int bi = 0; bi < bw; bi++, block += 16)
+    {
+#ifdef __SSE2__
+      if(ch == 4 && 4 * bi + 4 <= width && 4 * bj + 4 <= height)
       {
-        chrom[q][0] = r[q] * (1. / 127.);
-        chrom[q][2] = b[q] * (1. / 127.);
-        chrom[q][1] = 1. - chrom[q][0] - chrom[q][2];
+        _uncompress_block_sse2(block, out, 4 * bi, 4 * bj, width);
+        continue;
       }
-      for(int k = 0; k < 16; k++)
-        for(int c = 0; c < 3; c++)
-          out[3 * (i + (k & 3) + width * (j + (k >> 2))) + c] = L[k].f * fac[c]
-                                                                * chrom[((k >> 3) << 1) | ((k & 3) >> 1)][c];
-      block += 16 * sizeof(uint8_t);
+#endif
+      _uncompress_block_plain(block, out, 4 * bi, 4 * bj, width, height, ch);
     }
   }
 }
 
-void dt_image_compress(const float *in, uint8_t *out, const int32_t width, const int32_t height)
+static inline void _compress_block(const float *const in, uint8_t *const block, const int i, const int j,
+                                   const int32_t width, const int32_t height, const int ch)
 {
   dt_image_float_int_t L[16];
-  int16_t Lmin, Lmax, n_zeroes, L16[16];
-  uint8_t *block = out, r[4], b[4];
-  for(int j = 0; j < height; j += 4)
+  int L16[16];
+  int Lmin = 0x7fff, Lmax = 0;
+  uint8_t r[4], b[4];
+  for(int q = 0; q < 4; q++)
   {
-    for(int i = 0; i < width; i += 4)
+    float chrom[3] = { 0.0f, 0.0f, 0.0f };
+    for(int pj = 0; pj < 2; pj++)
     {
-      Lmin = 0x7fff;
-      for(int q = 0; q < 4; q++)
-      {
-        float chrom[3] = { 0, 0, 0 };
-        for(int pj = 0; pj < 2; pj++)
-        {
-          for(int pi = 0; pi < 2; pi++)
-          {
-            const int io = (pi + ((q & 1) << 1)), jo = (pj + (q & 2));
-            const int ii = i + io, jj = j + jo;
-
-            L[io + 4 * jo].f = (in[3 * (ii + width * jj) + 0] + 2 * in[3 * (ii + width * jj) + 1]
-                                + in[3 * (ii + width * jj) + 2]) * .25;
-            for(int k = 0; k < 3; k++) chrom[k] += L[io + 4 * jo].f * in[3 * (ii + width * jj) + k];
-            L16[io + 4 * jo] = (L[io + 4 * jo].i >> 13) & 0x3ff;
-            int e = ((L[io + 4 * jo].i >> (23)) - (127 - 15));
-            e = e > 0 ? e : 0;
-            e = e > 30 ? 30 : e;
-            L16[io + 4 * jo] |= e << 10;
-            Lmin = Lmin < L16[io + 4 * jo] ? Lmin : L16[io + 4 * jo];
-          }
-        }
-        const float norm = 1. / (chrom[0] + 2 * chrom[1] + chrom[2]);
-        r[q] = (int)(127. * (chrom[0] * norm));
-        b[q] = (int)(127. * (chrom[2] * norm));
-      }
-      // store luma
-      Lmin &= ~0x3ff;
-      block[0] = (Lmin >> 10) << 3; // Lbias
-      Lmax = 0;
-      for(int k = 0; k < 16; k++)
+      for(int pi = 0; pi < 2; pi++)
       {
-        L16[k] -= Lmin;
-        Lmax = Lmax > L16[k] ? Lmax : L16[k];
-      }
-      n_zeroes = 0;
-      for(int k = 1 << 14; (k & Lmax) == 0 && n_zeroes < 7; k >>= 1) n_zeroes++;
-      block[0] |= n_zeroes;
-      const int shift = 14 - n_zeroes - 4 + 1;
-      const int off = (1 << shift) >> 1;
-      for(int k = 0; k < 8; k++)
-      {
-        L16[2 * k] = ((int)L16[2 * k] + off) >> shift;
-        L16[2 * k] = L16[2 * k] > 0xf ? 0xf : L16[2 * k];
-        L16[2 * k + 1] = ((int)L16[2 * k + 1] + off) >> shift;
-        L16[2 * k + 1] = L16[2 * k + 1] > 0xf ? 0xf : L16[2 * k + 1];
-        block[k + 1] = L16[2 * k + 1] | (L16[2 * k] << 4);
+        const int io = (pi + ((q & 1) << 1)), jo = (pj + (q & 2));
+        const int k = io + 4 * jo;
+        // blocks sticking out of the image repeat its last column and row
+        const int ii = (i + io < width) ? i + io : width - 1;
+        const int jj = (j + jo < height) ? j + jo : height - 1;
+        const float *const px = in + (size_t)ch * (ii + (size_t)width * jj);
+        const float rgb[3] = { fmaxf(px[0], 0.0f), fmaxf(px[1], 0.0f), fmaxf(px[2], 0.0f) };
+
+        L[k].f = (rgb[0] + 2.0f * rgb[1] + rgb[2]) * 0.25f;
+        for(int c = 0; c < 3; c++) chrom[c] += L[k].f * rgb[c];
+        // unsigned half float, flushing what would be denormal to zero
+        const int e = (int)(L[k].i >> 23) - (127 - 15);
+        if(e <= 0)
+          L16[k] = 0;
+        else if(e > 30)
+          L16[k] = 0x7bff;
+        else
+          L16[k] = (e << 10) | ((L[k].i >> 13) & 0x3ff);
+        Lmin = Lmin < L16[k] ? Lmin : L16[k];
       }
-      // store chroma
-      block[9] = (r[0] << 1) | (b[0] >> 6);
-      block[10] = (b[0] << 2) | (r[1] >> 5);
-      block[11] = (r[1] << 3) | (b[1] >> 4);
-      block[12] = (b[1] << 4) | (r[2] >> 3);
-      block[13] = (r[2] << 5) | (b[2] >> 2);
-      block[14] = (b[2] << 6) | (r[3] >> 1);
-      block[15] = (r[3] << 7) | (b[3] >> 0);
-      block += 16 * sizeof(uint8_t);
     }
+    const float sum = chrom[0] + 2.0f * chrom[1] + chrom[2];
+    if(sum > 0.0f && isfinite(sum))
+    {
+      const int cr = (int)(127.0f * chrom[0] / sum + 0.5f), cb = (int)(127.0f * chrom[2] / sum + 0.5f);
+      r[q] = cr > 127 ? 127 : cr;
+      b[q] = cb > 127 ? 127 : cb;
+    }
+    else
+    {
+      // black: any chroma will do, pick neutral
+      r[q] = b[q] = 32;
+    }
+  }
+  // store luma
+  Lmin &= ~0x3ff;
+  block[0] = (Lmin >> 10) << 3; // Lbias
+  for(int k = 0; k < 16; k++)
+  {
+    L16[k] -= Lmin;
+    Lmax = Lmax > L16[k] ? Lmax : L16[k];
+  }
+  int n_zeroes = 0;
+  for(int k = 1 << 14; (k & Lmax) == 0 && n_zeroes < 7; k >>= 1) n_zeroes++;
+  block[0] |= n_zeroes;
+  const int shift = 14 - n_zeroes - 4 + 1;
+  const int off = (1 << shift) >> 1;
+  for(int k = 0; k < 16; k++)
+  {
+    L16[k] = (L16[k] + off) >> shift;
+    L16[k] = L16[k] > 0xf ? 0xf : L16[k];
+  }
+  for(int k = 0; k < 8; k++) block[k + 1] = L16[2 * k + 1] | (L16[2 * k] << 4);
+  // store chroma
+  block[9] = (r[0] << 1) | (b[0] >> 6);
+  block[10] = (b[0] << 2) | (r[1] >> 5);
+  block[11] = (r[1] << 3) | (b[1] >> 4);
+  block[12] = (b[1] << 4) | (r[2] >> 3);
+  block[13] = (r[2] << 5) | (b[2] >> 2);
+  block[14] = (b[2] << 6) | (r[3] >> 1);
+  block[15] = (r[3] << 7) | (b[3] >> 0);
+}
+
+void dt_image_compress(const float *in, uint8_t *out, const int32_t width, const int32_t height, const int ch)
+{
+  const int bw = (width + 3) / 4, bh = (height + 3) / 4;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for(int bj = 0; bj < bh; bj++)
+  {
+    uint8_t *block = out + (size_t)16 * bw * bj;
+    for(int bi = 0; bi < bw; bi++, block += 16) _compress_block(in, block, 4 * bi, 4 * bj, width, height, ch);
   }
 }
 
@@ -19,11 +19,20 @@
 #pragma once
 
 #include <inttypes.h>
+#include <stddef.h>
 
 /** K. Roimela, T. Aarnio and J. Itäranta. High Dynamic Range Texture Compression. Proceedings of SIGGRAPH
- * 2006. */
-void dt_image_compress(const float *in, uint8_t *out, const int32_t width, const int32_t height);
-void dt_image_uncompress(const uint8_t *in, float *out, const int32_t width, const int32_t height);
+ * 2006.
+ *
+ * every block of 4x4 pixels goes into 16 bytes: 4 bits of log luma per pixel and one chroma value per 2x2
+ * pixels. that is one byte per pixel instead of 16 for an rgba float buffer. negative values are clamped to
+ * zero. in and out have ch = 3 or 4 floats per pixel (the fourth one is set to zero when uncompressing), the
+ * width and height don't need to be multiples of 4. */
+
+/** bytes needed for the compressed image. */
+size_t dt_image_compressed_size(const int32_t width, const int32_t height);
+void dt_image_compress(const float *in, uint8_t *out, const int32_t width, const int32_t height, const int ch);
+void dt_image_uncompress(const uint8_t *in, float *out, const int32_t width, const int32_t height, const int ch);
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -0,0 +1,278 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2017 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/image_readahead.h"
+#include "common/darktable.h"
+#include "common/dtpthread.h"
+#include "common/image.h"
+#include "control/conf.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DT_IMAGE_READAHEAD_CHUNK (1 << 20)
+#define DT_IMAGE_READAHEAD_MAX_IMAGES 32
+
+// what one caller (the filmstrip, an export job) needs next
+typedef struct dt_image_readahead_list_t
+{
+  const void *owner;
+  GArray *imgids;
+} dt_image_readahead_list_t;
+
+typedef struct dt_image_readahead_t
+{
+  dt_pthread_mutex_t mutex;
+  pthread_cond_t work; // a new queue came in
+
+  GPtrArray *lists;  // dt_image_readahead_list_t, one per caller
+  GArray *queue;     // imgids that will be needed, the lists merged, most urgent first
+  GHashTable *done;  // imgid -> bytes read, of the queued ones that have been read already
+  int generation;    // bumped with every new queue
+  int32_t current;   // imgid being read right now, 0 if none
+  gint cancel;       // the one being read isn't needed any more
+  gboolean quit;
+
+  gboolean started;
+  pthread_t thread;
+} dt_image_readahead_t;
+
+static int _readahead_index(const dt_image_readahead_t *ra, const int32_t imgid)
+{
+  for(guint k = 0; k < ra->queue->len; k++)
+    if(g_array_index(ra->queue, int32_t, k) == imgid) return k;
+  return -1;
+}
+
+// the first queued image that hasn't been read yet, or 0. *used is what the ones before it take up.
+static int32_t _readahead_next(const dt_image_readahead_t *ra, int64_t *used, int *index)
+{
+  *used = 0;
+  for(guint k = 0; k < ra->queue->len; k++)
+  {
+    const int32_t imgid = g_array_index(ra->queue, int32_t, k);
+    gpointer size = NULL;
+    if(!g_hash_table_lookup_extended(ra->done, GINT_TO_POINTER(imgid), NULL, &size))
+    {
+      *index = k;
+      return imgid;
+    }
+    *used += GPOINTER_TO_SIZE(size);
+  }
+  return 0;
+}
+
+static void *_readahead_thread(void *data)
+{
+  dt_image_readahead_t *ra = (dt_image_readahead_t *)data;
+  uint8_t *buf = (uint8_t *)malloc(DT_IMAGE_READAHEAD_CHUNK);
+
+  dt_pthread_mutex_lock(&ra->mutex);
+  while(!ra->quit)
+  {
+    int64_t used = 0;
+    int index = -1;
+    const int32_t imgid = _readahead_next(ra, &used, &index);
+    if(!imgid)
+    {
+      dt_pthread_cond_wait(&ra->work, &ra->mutex);
+      continue;
+    }
+    const int generation = ra->generation;
+    ra->current = imgid;
+    g_atomic_int_set(&ra->cancel, 0);
+    dt_pthread_mutex_unlock(&ra->mutex);
+
+    char filename[PATH_MAX] = { 0 };
+    gboolean from_cache = TRUE;
+    dt_image_full_path(imgid, filename, sizeof(filename), &from_cache);
+    GStatBuf st;
+    const int64_t size = (filename[0] && !g_stat(filename, &st) && S_ISREG(st.st_mode)) ? st.st_size : -1;
+    const int64_t budget = dt_conf_get_int64("prefetch_memory");
+
+    dt_pthread_mutex_lock(&ra->mutex);
+    if(ra->generation != generation)
+    {
+      // the queue changed, start over
+      ra->current = 0;
+      continue;
+    }
+    if(size < 0)
+    {
+      // gone or on a drive that isn't connected, nothing to read
+      g_hash_table_insert(ra->done, GINT_TO_POINTER(imgid), GSIZE_TO_POINTER(0));
+      ra->current = 0;
+      continue;
+    }
+    if(used > 0 && used + size > budget)
+    {
+      // this one and everything after it would push the first ones out of the page cache again
+      g_array_set_size(ra->queue, index);
+      ra->current = 0;
+      continue;
+    }
+    dt_pthread_mutex_unlock(&ra->mutex);
+
+    // reading it ourselves works the same on local disks and all kinds of network shares
+    const double start = dt_get_wtime();
+    gboolean complete = FALSE, cancelled = FALSE;
+    FILE *f = g_fopen(filename, "rb");
+    if(f)
+    {
+      while(!(cancelled = g_atomic_int_get(&ra->cancel))
+            && fread(buf, 1, DT_IMAGE_READAHEAD_CHUNK, f) == DT_IMAGE_READAHEAD_CHUNK)
+        ;
+      complete = !cancelled && feof(f) && !ferror(f);
+      fclose(f);
+    }
+    if(complete)
+      dt_print(DT_DEBUG_PERF, "[image_readahead] read image %d (%.1f MB) in %.3f secs\n", imgid,
+               size / (1024.0 * 1024.0), dt_get_wtime() - start);
+
+    dt_pthread_mutex_lock(&ra->mutex);
+    ra->current = 0;
+    // don't try again if it can't be opened or a read fails, but only count what really is in the page cache
+    // now. cancelled ones are either not queued any more or get read again.
+    if(!cancelled && _readahead_index(ra, imgid) >= 0)
+      g_hash_table_insert(ra->done, GINT_TO_POINTER(imgid), GSIZE_TO_POINTER(complete ? size : 0));
+  }
+  dt_pthread_mutex_unlock(&ra->mutex);
+
+  free(buf);
+  return NULL;
+}
+
+dt_image_readahead_t *dt_image_readahead_new()
+{
+  dt_image_readahead_t *ra = (dt_image_readahead_t *)calloc(1, sizeof(dt_image_readahead_t));
+  dt_pthread_mutex_init(&ra->mutex, NULL);
+  pthread_cond_init(&ra->work, NULL);
+  ra->lists = g_ptr_array_new();
+  ra->queue = g_array_new(FALSE, FALSE, sizeof(int32_t));
+  ra->done = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+  // one thread is enough, the point is to have the reads going while the current image gets processed. more
+  // of them would only compete for the same disk.
+  if(dt_pthread_create(&ra->thread, _readahead_thread, ra))
+    fprintf(stderr, "[image_readahead] could not start worker thread\n");
+  else
+    ra->started = TRUE;
+  return ra;
+}
+
+void dt_image_readahead_free(dt_image_readahead_t *ra)
+{
+  if(!ra) return;
+
+  dt_pthread_mutex_lock(&ra->mutex);
+  ra->quit = TRUE;
+  g_atomic_int_set(&ra->cancel, 1);
+  pthread_cond_broadcast(&ra->work);
+  dt_pthread_mutex_unlock(&ra->mutex);
+
+  if(ra->started) pthread_join(ra->thread, NULL);
+
+  for(guint k = 0; k < ra->lists->len; k++)
+  {
+    dt_image_readahead_list_t *list = (dt_image_readahead_list_t *)g_ptr_array_index(ra->lists, k);
+    g_array_free(list->imgids, TRUE);
+    free(list);
+  }
+  g_ptr_array_free(ra->lists, TRUE);
+  g_array_free(ra->queue, TRUE);
+  g_hash_table_destroy(ra->done);
+  pthread_cond_destroy(&ra->work);
+  dt_pthread_mutex_destroy(&ra->mutex);
+  free(ra);
+}
+
+void dt_image_readahead_queue(dt_image_readahead_t *ra, const void *owner, const int32_t *imgids,
+                              const int count)
+{
+  if(!ra || !ra->started) return;
+
+  const int max = CLAMP(dt_conf_get_int("prefetch_images"), 0, DT_IMAGE_READAHEAD_MAX_IMAGES);
+
+  dt_pthread_mutex_lock(&ra->mutex);
+
+  // replace the list of this caller, the others stay
+  dt_image_readahead_list_t *list = NULL;
+  for(guint k = 0; k < ra->lists->len && !list; k++)
+    if(((dt_image_readahead_list_t *)g_ptr_array_index(ra->lists, k))->owner == owner)
+      list = (dt_image_readahead_list_t *)g_ptr_array_index(ra->lists, k);
+  if(!list && count > 0)
+  {
+    list = (dt_image_readahead_list_t *)calloc(1, sizeof(dt_image_readahead_list_t));
+    list->owner = owner;
+    list->imgids = g_array_new(FALSE, FALSE, sizeof(int32_t));
+    g_ptr_array_add(ra->lists, list);
+  }
+  if(list && count > 0)
+  {
+    g_array_set_size(list->imgids, 0);
+    g_array_append_vals(list->imgids, imgids, MIN(count, max));
+  }
+  else if(list)
+  {
+    g_ptr_array_remove(ra->lists, list);
+    g_array_free(list->imgids, TRUE);
+    free(list);
+  }
+
+  // merge them taking turns, so everybody's most urgent ones come first
+  g_array_set_size(ra->queue, 0);
+  for(int k = 0; k < max && (int)ra->queue->len < max; k++)
+    for(guint l = 0; l < ra->lists->len && (int)ra->queue->len < max; l++)
+    {
+      const GArray *ids = ((dt_image_readahead_list_t *)g_ptr_array_index(ra->lists, l))->imgids;
+      if(k >= (int)ids->len) continue;
+      const int32_t imgid = g_array_index(ids, int32_t, k);
+      if(imgid > 0 && _readahead_index(ra, imgid) < 0) g_array_append_val(ra->queue, imgid);
+    }
+
+  // what has been read for the last queue is still in the page cache and doesn't need to be read again
+  GHashTable *done = g_hash_table_new(g_direct_hash, g_direct_equal);
+  for(guint k = 0; k < ra->queue->len; k++)
+  {
+    const int32_t imgid = g_array_index(ra->queue, int32_t, k);
+    gpointer size = NULL;
+    if(g_hash_table_lookup_extended(ra->done, GINT_TO_POINTER(imgid), NULL, &size))
+      g_hash_table_insert(done, GINT_TO_POINTER(imgid), size);
+  }
+  g_hash_table_destroy(ra->done);
+  ra->done = done;
+
+  ra->generation++;
+  if(ra->current && _readahead_index(ra, ra->current) < 0) g_atomic_int_set(&ra->cancel, 1);
+  pthread_cond_signal(&ra->work);
+  dt_pthread_mutex_unlock(&ra->mutex);
+}
+
+void dt_image_readahead_queue_list(dt_image_readahead_t *ra, const void *owner, const GList *imgids)
+{
+  int32_t ids[DT_IMAGE_READAHEAD_MAX_IMAGES];
+  int count = 0;
+  for(const GList *l = imgids; l && count < DT_IMAGE_READAHEAD_MAX_IMAGES; l = g_list_next(l))
+    ids[count++] = GPOINTER_TO_INT(l->data);
+  dt_image_readahead_queue(ra, owner, ids, count);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
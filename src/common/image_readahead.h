@@ -0,0 +1,45 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2017 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <stdint.h>
+
+/* reads the files of the images that are going to be opened next (the following ones in the filmstrip, the
+ * rest of an export) in the background, so they are in the page cache by the time the loader wants them
+ * instead of every step waiting for the disk or the network share. how many images and how many bytes ahead
+ * are set by the prefetch_images and prefetch_memory preferences. */
+
+struct dt_image_readahead_t;
+
+/** starts the worker thread */
+struct dt_image_readahead_t *dt_image_readahead_new();
+/** stops reading and the worker */
+void dt_image_readahead_free(struct dt_image_readahead_t *ra);
+
+/** the images that owner (any pointer that identifies the caller) needs next, most urgent first. replaces
+ * what owner queued before, the lists of other callers are read in turns with it. count 0 drops the list. */
+void dt_image_readahead_queue(struct dt_image_readahead_t *ra, const void *owner, const int32_t *imgids,
+                              const int count);
+/** same, for a list of GINT_TO_POINTER(imgid) */
+void dt_image_readahead_queue_list(struct dt_image_readahead_t *ra, const void *owner, const GList *imgids);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
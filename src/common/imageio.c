@@ -47,7 +47,9 @@
 #include "control/control.h"
 #include "develop/blend.h"
 #include "develop/develop.h"
+#include "develop/export_pool.h"
 #include "develop/imageop.h"
+#include "develop/imageop_math.h"
 
 #ifdef HAVE_GRAPHICSMAGICK
 #include <magick/api.h>
@@ -537,18 +539,180 @@ int dt_imageio_export(const uint32_t imgid, const char *filename, dt_imageio_mod
                                         0, NULL, copy_metadata, storage, storage_params, num, total);
 }
 
-// internal function: to avoid exif blob reading + 8-bit byteorder flag + high-quality override
-int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
-                                 dt_imageio_module_format_t *format, dt_imageio_module_data_t *format_params,
-                                 const int32_t ignore_exif, const int32_t display_byteorder,
-                                 const gboolean high_quality, const gboolean upscale, const int32_t thumbnail_export,
-                                 const char *filter, const gboolean copy_metadata,
-                                 dt_imageio_module_storage_t *storage,
-                                 dt_imageio_module_data_t *storage_params, int num, int total)
+// converts the output of the pipe in place to what the format wants and writes it. float_output tells if the
+// pipe produced floats or, for 8-bit formats, bytes already. exif may be NULL.
+static int _export_write_image(const uint32_t imgid, const char *filename, dt_imageio_module_format_t *format,
+                               dt_imageio_module_data_t *format_params, uint8_t *outbuf,
+                               const int processed_width, const int processed_height, const int bpp,
+                               const gboolean float_output, const int32_t display_byteorder,
+                               uint8_t *exif, const int exif_len, int num, int total)
+{
+  // downconversion to low-precision formats:
+  if(bpp == 8)
+  {
+    if(display_byteorder)
+    {
+      if(float_output)
+      {
+        const float *const inbuf = (float *)outbuf;
+        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
+        {
+          // convert in place, this is unfortunately very serial..
+          const uint8_t r = CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff);
+          const uint8_t g = CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff);
+          const uint8_t b = CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff);
+          outbuf[4 * k + 0] = r;
+          outbuf[4 * k + 1] = g;
+          outbuf[4 * k + 2] = b;
+        }
+      }
+      // else processing output was 8-bit already, and no need to swap order
+    }
+    else // need to flip
+    {
+      // ldr output: char
+      if(float_output)
+      {
+        const float *const inbuf = (float *)outbuf;
+        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
+        {
+          // convert in place, this is unfortunately very serial..
+          const uint8_t r = CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff);
+          const uint8_t g = CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff);
+          const uint8_t b = CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff);
+          outbuf[4 * k + 0] = r;
+          outbuf[4 * k + 1] = g;
+          outbuf[4 * k + 2] = b;
+        }
+      }
+      else
+      { // !display_byteorder, need to swap:
+        uint8_t *const buf8 = outbuf;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) schedule(static)
+#endif
+        // just flip byte order
+        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
+        {
+          uint8_t tmp = buf8[4 * k + 0];
+          buf8[4 * k + 0] = buf8[4 * k + 2];
+          buf8[4 * k + 2] = tmp;
+        }
+      }
+    }
+  }
+  else if(bpp == 16)
+  {
+    // uint16_t per color channel
+    float *buff = (float *)outbuf;
+    uint16_t *buf16 = (uint16_t *)outbuf;
+    for(int y = 0; y < processed_height; y++)
+      for(int x = 0; x < processed_width; x++)
+      {
+        // convert in place
+        const size_t k = (size_t)processed_width * y + x;
+        for(int i = 0; i < 3; i++) buf16[4 * k + i] = CLAMP(buff[4 * k + i] * 0x10000, 0, 0xffff);
+      }
+  }
+  // else output float, no further harm done to the pixels :)
+
+  format_params->width = processed_width;
+  format_params->height = processed_height;
+
+  return format->write_image(format_params, filename, outbuf, exif, exif_len, imgid, num, total);
+}
+
+#define EXPORT_TRC_SAMPLES 0x10000
+
+// tone curves of the output profile, to resample its encoded output in linear light
+typedef struct dt_imageio_export_trc_t
+{
+  float to_linear[3][EXPORT_TRC_SAMPLES];
+  float from_linear[3][EXPORT_TRC_SAMPLES];
+} dt_imageio_export_trc_t;
+
+// NULL if the output is linear already, or if the profile is no matrix/shaper one
+static dt_imageio_export_trc_t *_export_trc_init(const uint32_t imgid)
+{
+  const dt_colorspaces_color_profile_t *profile = dt_colorspaces_get_output_profile(imgid);
+  if(!profile || !profile->profile) return NULL;
+
+  dt_imageio_export_trc_t *trc = dt_alloc_align(64, sizeof(dt_imageio_export_trc_t));
+  if(!trc) return NULL;
+  float matrix[9];
+  if(dt_colorspaces_get_matrix_from_input_profile(profile->profile, matrix, trc->to_linear[0], trc->to_linear[1],
+                                                  trc->to_linear[2], EXPORT_TRC_SAMPLES, DT_INTENT_PERCEPTUAL)
+     || dt_colorspaces_get_matrix_from_output_profile(profile->profile, matrix, trc->from_linear[0],
+                                                      trc->from_linear[1], trc->from_linear[2],
+                                                      EXPORT_TRC_SAMPLES, DT_INTENT_PERCEPTUAL)
+     || (trc->to_linear[0][0] < 0.0f && trc->to_linear[1][0] < 0.0f && trc->to_linear[2][0] < 0.0f))
+  {
+    dt_free_align(trc);
+    return NULL;
+  }
+  return trc;
+}
+
+static inline float _export_trc_lookup(const float *const lut, const float v)
+{
+  if(lut[0] < 0.0f) return v; // linear
+  const float ft = CLAMPS(v * (EXPORT_TRC_SAMPLES - 1), 0, EXPORT_TRC_SAMPLES - 1);
+  const int t = ft < EXPORT_TRC_SAMPLES - 2 ? ft : EXPORT_TRC_SAMPLES - 2;
+  const float f = ft - t;
+  return lut[t] * (1.0f - f) + lut[t + 1] * f;
+}
+
+static void _export_trc_apply(float *const buf, const size_t npixels, float lut[3][EXPORT_TRC_SAMPLES])
 {
-  dt_develop_t dev;
-  dt_dev_init(&dev, 0);
-  dt_dev_load_image(&dev, imgid);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for(size_t k = 0; k < npixels; k++)
+    for(int c = 0; c < 3; c++) buf[4 * k + c] = _export_trc_lookup(lut[c], buf[4 * k + c]);
+}
+
+// attaches the xmp and tells whoever is interested that the file is there
+static void _export_finish_file(const uint32_t imgid, const char *filename, dt_imageio_module_format_t *format,
+                                dt_imageio_module_data_t *format_params, const int32_t thumbnail_export,
+                                const gboolean copy_metadata, dt_imageio_module_storage_t *storage,
+                                dt_imageio_module_data_t *storage_params)
+{
+  /* now write xmp into that container, if possible */
+  if(copy_metadata && (format->flags(format_params) & FORMAT_FLAGS_SUPPORT_XMP))
+  {
+    dt_exif_xmp_attach(imgid, filename);
+    // no need to cancel the export if this fail
+  }
+
+  if(!thumbnail_export && strcmp(format->mime(format_params), "memory")
+    && !(format->flags(format_params) & FORMAT_FLAGS_NO_TMPFILE))
+  {
+    dt_control_signal_raise(darktable.signals, DT_SIGNAL_IMAGE_EXPORT_TMPFILE, imgid, filename, format,
+                            format_params, storage, storage_params);
+  }
+}
+
+static int _imageio_export(const uint32_t imgid, const char *filename, dt_imageio_module_format_t *format,
+                           dt_imageio_module_data_t *format_params, const int32_t ignore_exif,
+                           const int32_t display_byteorder, const gboolean high_quality, const gboolean upscale,
+                           const int32_t thumbnail_export, const char *filter, const gboolean copy_metadata,
+                           dt_imageio_module_storage_t *storage, dt_imageio_module_data_t *storage_params,
+                           const dt_imageio_export_size_t *sizes, const int num_sizes, int num, int total)
+{
+  // while an export job runs, the develop and pipe of the previous image are reused
+  dt_dev_export_context_t *ctx
+      = thumbnail_export ? NULL : dt_dev_export_pool_acquire(darktable.export_pool);
+  dt_develop_t dev_storage;
+  dt_dev_pixelpipe_t pipe_storage;
+  dt_develop_t *dev = ctx ? &ctx->dev : &dev_storage;
+  dt_dev_pixelpipe_t *pipe = ctx ? &ctx->pipe : &pipe_storage;
+  if(ctx)
+    dt_dev_export_context_load_image(ctx, imgid);
+  else
+  {
+    dt_dev_init(dev, 0);
+    dt_dev_load_image(dev, imgid);
+  }
 
   const int buf_is_downscaled
       = (thumbnail_export && dt_conf_get_bool("plugins/lighttable/low_quality_thumbnails"));
@@ -559,7 +723,7 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
   else
     dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
 
-  const dt_image_t *img = &dev.image_storage;
+  const dt_image_t *img = &dev->image_storage;
 
   if(!buf.buf || !buf.width || !buf.height)
   {
@@ -576,9 +740,12 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
 
   dt_times_t start;
   dt_get_times(&start);
-  dt_dev_pixelpipe_t pipe;
-  res = thumbnail_export ? dt_dev_pixelpipe_init_thumbnail(&pipe, wd, ht)
-                         : dt_dev_pixelpipe_init_export(&pipe, wd, ht, format->levels(format_params));
+  if(thumbnail_export)
+    res = dt_dev_pixelpipe_init_thumbnail(pipe, wd, ht);
+  else if(ctx)
+    res = dt_dev_export_context_init_pipe(ctx, wd, ht, format->levels(format_params));
+  else
+    res = dt_dev_pixelpipe_init_export(pipe, wd, ht, format->levels(format_params));
   if(!res)
   {
     dt_control_log(
@@ -601,7 +768,7 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
     }
 
     // remove everything above history_end
-    GList *history = g_list_nth(dev.history, dev.history_end);
+    GList *history = g_list_nth(dev->history, dev->history_end);
     while(history)
     {
       GList *next = g_list_next(history);
@@ -609,7 +776,7 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
       free(hist->params);
       free(hist->blend_params);
       free(history->data);
-      dev.history = g_list_delete_link(dev.history, history);
+      dev->history = g_list_delete_link(dev->history, history);
       history = next;
     }
 
@@ -619,7 +786,7 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
       dt_style_item_t *s = (dt_style_item_t *)stls->data;
       gboolean module_found = FALSE;
 
-      GList *modules = dev.iop;
+      GList *modules = dev->iop;
       while(modules)
       {
         m = (dt_iop_module_t *)modules->data;
@@ -657,8 +824,8 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
             h->params = new_params;
           }
 
-          dev.history_end++;
-          dev.history = g_list_append(dev.history, h);
+          dev->history_end++;
+          dev->history = g_list_append(dev->history, h);
           module_found = TRUE;
           g_free(s->name);
           break;
@@ -671,18 +838,19 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
     g_list_free(stls);
   }
 
-  dt_dev_pixelpipe_set_input(&pipe, &dev, (float *)buf.buf, buf.width, buf.height, buf.iscale);
-  dt_dev_pixelpipe_create_nodes(&pipe, &dev);
-  dt_dev_pixelpipe_synch_all(&pipe, &dev);
+  dt_dev_pixelpipe_set_input(pipe, dev, (float *)buf.buf, buf.width, buf.height, buf.iscale);
+  pipe->input_half = buf.half_float;
+  dt_dev_pixelpipe_create_nodes(pipe, dev);
+  dt_dev_pixelpipe_synch_all(pipe, dev);
 
   if(filter)
   {
-    if(!strncmp(filter, "pre:", 4)) dt_dev_pixelpipe_disable_after(&pipe, filter + 4);
-    if(!strncmp(filter, "post:", 5)) dt_dev_pixelpipe_disable_before(&pipe, filter + 5);
+    if(!strncmp(filter, "pre:", 4)) dt_dev_pixelpipe_disable_after(pipe, filter + 4);
+    if(!strncmp(filter, "post:", 5)) dt_dev_pixelpipe_disable_before(pipe, filter + 5);
   }
 
-  dt_dev_pixelpipe_get_dimensions(&pipe, &dev, pipe.iwidth, pipe.iheight, &pipe.processed_width,
-                                  &pipe.processed_height);
+  dt_dev_pixelpipe_get_dimensions(pipe, dev, pipe->iwidth, pipe->iheight, &pipe->processed_width,
+                                  &pipe->processed_height);
 
   dt_show_times(&start, "[export] creating pixelpipe", NULL);
 
@@ -695,7 +863,7 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
   }
   else if(icctype == DT_COLORSPACE_NONE)
   {
-    GList *modules = dev.iop;
+    GList *modules = dev->iop;
     dt_iop_module_t *colorout = NULL;
     while(modules)
     {
@@ -716,19 +884,21 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
 
   // get only once at the beginning, in case the user changes it on the way:
   const gboolean high_quality_processing
-      = ((format_params->max_width == 0 || format_params->max_width >= pipe.processed_width)
-         && (format_params->max_height == 0 || format_params->max_height >= pipe.processed_height))
+      = ((format_params->max_width == 0 || format_params->max_width >= pipe->processed_width)
+         && (format_params->max_height == 0 || format_params->max_height >= pipe->processed_height))
             ? FALSE
             : high_quality;
+  // additional sizes are downsampled from the float output
+  const gboolean float_output = high_quality_processing || num_sizes > 0;
 
   const int width = format_params->max_width;
   const int height = format_params->max_height;
-  const double scalex = width > 0 ? fminf(width / (double)pipe.processed_width, max_scale) : 1.0;
-  const double scaley = height > 0 ? fminf(height / (double)pipe.processed_height, max_scale) : 1.0;
+  const double scalex = width > 0 ? fminf(width / (double)pipe->processed_width, max_scale) : 1.0;
+  const double scaley = height > 0 ? fminf(height / (double)pipe->processed_height, max_scale) : 1.0;
   const double scale = fminf(scalex, scaley);
 
-  const int processed_width = scale * pipe.processed_width + .5f;
-  const int processed_height = scale * pipe.processed_height + .5f;
+  const int processed_width = scale * pipe->processed_width + .5f;
+  const int processed_height = scale * pipe->processed_height + .5f;
 
   const int bpp = format->bpp(format_params);
 
@@ -739,7 +909,7 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
      * if high quality processing was requested, downsampling will be done
      * at the very end of the pipe (just before border and watermark)
      */
-    dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
+    dt_dev_pixelpipe_process_no_gamma(pipe, dev, 0, 0, processed_width, processed_height, scale);
   }
   else
   {
@@ -750,7 +920,7 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
     // find the finalscale module
     dt_dev_pixelpipe_iop_t *finalscale = NULL;
     {
-      GList *nodes = g_list_last(pipe.nodes);
+      GList *nodes = g_list_last(pipe->nodes);
       while(nodes)
       {
         dt_dev_pixelpipe_iop_t *node = (dt_dev_pixelpipe_iop_t *)(nodes->data);
@@ -766,140 +936,143 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
     if(finalscale) finalscale->enabled = 0;
 
     // do the processing (8-bit with special treatment, to make sure we can use openmp further down):
-    if(bpp == 8)
-      dt_dev_pixelpipe_process(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
+    if(bpp == 8 && !float_output)
+      dt_dev_pixelpipe_process(pipe, dev, 0, 0, processed_width, processed_height, scale);
     else
-      dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
+      dt_dev_pixelpipe_process_no_gamma(pipe, dev, 0, 0, processed_width, processed_height, scale);
 
     if(finalscale) finalscale->enabled = 1;
   }
   dt_show_times(&start, thumbnail_export ? "[dev_process_thumbnail] pixel pipeline processing"
                                          : "[dev_process_export] pixel pipeline processing",
                 NULL);
+  if(pipe->tiling_roi_fits > 0)
+    dt_print(DT_DEBUG_PERF, "[dev_process_export] %d tile roi fits (%d direct, %d simplex) took %.3f secs\n",
+             pipe->tiling_roi_fits, pipe->tiling_roi_fits_direct, pipe->tiling_roi_fits_simplex,
+             pipe->tiling_roi_fit_time);
 
-  uint8_t *outbuf = pipe.backbuf;
-
-  // downconversion to low-precision formats:
-  if(bpp == 8)
-  {
-    if(display_byteorder)
-    {
-      if(high_quality_processing)
-      {
-        const float *const inbuf = (float *)outbuf;
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          // convert in place, this is unfortunately very serial..
-          const uint8_t r = CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff);
-          const uint8_t g = CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff);
-          const uint8_t b = CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff);
-          outbuf[4 * k + 0] = r;
-          outbuf[4 * k + 1] = g;
-          outbuf[4 * k + 2] = b;
-        }
-      }
-      // else processing output was 8-bit already, and no need to swap order
-    }
-    else // need to flip
-    {
-      // ldr output: char
-      if(high_quality_processing)
-      {
-        const float *const inbuf = (float *)outbuf;
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          // convert in place, this is unfortunately very serial..
-          const uint8_t r = CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff);
-          const uint8_t g = CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff);
-          const uint8_t b = CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff);
-          outbuf[4 * k + 0] = r;
-          outbuf[4 * k + 1] = g;
-          outbuf[4 * k + 2] = b;
-        }
-      }
-      else
-      { // !display_byteorder, need to swap:
-        uint8_t *const buf8 = pipe.backbuf;
-#ifdef _OPENMP
-#pragma omp parallel for default(none) schedule(static)
-#endif
-        // just flip byte order
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          uint8_t tmp = buf8[4 * k + 0];
-          buf8[4 * k + 0] = buf8[4 * k + 2];
-          buf8[4 * k + 2] = tmp;
-        }
-      }
-    }
-  }
-  else if(bpp == 16)
-  {
-    // uint16_t per color channel
-    float *buff = (float *)outbuf;
-    uint16_t *buf16 = (uint16_t *)outbuf;
-    for(int y = 0; y < processed_height; y++)
-      for(int x = 0; x < processed_width; x++)
-      {
-        // convert in place
-        const size_t k = (size_t)processed_width * y + x;
-        for(int i = 0; i < 3; i++) buf16[4 * k + i] = CLAMP(buff[4 * k + i] * 0x10000, 0, 0xffff);
-      }
-  }
-  // else output float, no further harm done to the pixels :)
-
-  format_params->width = processed_width;
-  format_params->height = processed_height;
+  uint8_t *outbuf = pipe->backbuf;
 
+  // Exif data should be 65536 bytes max, but if original size is close to that, adding new tags could make it
+  // go over that... so let it be and see what happens when we write the image
+  uint8_t *exif_profile = NULL;
+  int exif_len = 0;
   if(!ignore_exif)
   {
-    int length;
-    uint8_t *exif_profile = NULL; // Exif data should be 65536 bytes max, but if original size is close to that,
-                                  // adding new tags could make it go over that... so let it be and see what
-                                  // happens when we write the image
     char pathname[PATH_MAX] = { 0 };
     gboolean from_cache = TRUE;
     dt_image_full_path(imgid, pathname, sizeof(pathname), &from_cache);
     // last param is dng mode, it's false here
-    length = dt_exif_read_blob(&exif_profile, pathname, imgid, sRGB, processed_width, processed_height, 0);
-
-    res = format->write_image(format_params, filename, outbuf, exif_profile, length, imgid, num, total);
+    exif_len = dt_exif_read_blob(&exif_profile, pathname, imgid, sRGB, processed_width, processed_height, 0);
+  }
 
-    free(exif_profile);
+  // the additional sizes come first, the main output gets converted in place. they are averaged in linear
+  // light, the output is encoded with the tone curves of the output profile already.
+  dt_get_times(&start);
+  int sizes_res = 0;
+  dt_imageio_export_trc_t *trc = num_sizes ? _export_trc_init(imgid) : NULL;
+  float *linear = trc ? dt_alloc_align(64, sizeof(float) * 4 * processed_width * processed_height) : NULL;
+  if(linear)
+  {
+    memcpy(linear, outbuf, sizeof(float) * 4 * processed_width * processed_height);
+    _export_trc_apply(linear, (size_t)processed_width * processed_height, trc->to_linear);
   }
-  else
+  for(int k = 0; k < num_sizes && !sizes_res; k++)
   {
-    res = format->write_image(format_params, filename, outbuf, NULL, 0, imgid, num, total);
+    const double size_scalex
+        = sizes[k].max_width > 0 ? fmin(sizes[k].max_width / (double)processed_width, 1.0) : 1.0;
+    const double size_scaley
+        = sizes[k].max_height > 0 ? fmin(sizes[k].max_height / (double)processed_height, 1.0) : 1.0;
+    const double size_scale = fmin(size_scalex, size_scaley);
+    const dt_iop_roi_t roi_in = { 0, 0, processed_width, processed_height, 1.0f };
+    const dt_iop_roi_t roi_out = { 0, 0, MAX(1, (int)(size_scale * processed_width + .5f)),
+                                   MAX(1, (int)(size_scale * processed_height + .5f)), size_scale };
+
+    float *sizebuf = dt_alloc_align(64, sizeof(float) * 4 * roi_out.width * roi_out.height);
+    if(!sizebuf)
+    {
+      fprintf(stderr, "[dev_process_export] could not allocate %dx%d for `%s'\n", roi_out.width, roi_out.height,
+              sizes[k].filename);
+      sizes_res = 1;
+      break;
+    }
+    dt_iop_clip_and_zoom(sizebuf, linear ? linear : (const float *)outbuf, &roi_out, &roi_in, roi_out.width,
+                         roi_in.width);
+    if(linear) _export_trc_apply(sizebuf, (size_t)roi_out.width * roi_out.height, trc->from_linear);
+
+    uint8_t *size_exif = NULL;
+    const int size_exif_len
+        = dt_exif_blob_set_dimensions(&size_exif, exif_profile, exif_len, roi_out.width, roi_out.height);
+    sizes_res = _export_write_image(imgid, sizes[k].filename, format, format_params, (uint8_t *)sizebuf,
+                                    roi_out.width, roi_out.height, bpp, TRUE, display_byteorder, size_exif,
+                                    size_exif_len, num, total);
+    free(size_exif);
+    dt_free_align(sizebuf);
+    if(!sizes_res)
+      _export_finish_file(imgid, sizes[k].filename, format, format_params, thumbnail_export, copy_metadata,
+                          storage, storage_params);
   }
+  dt_free_align(linear);
+  dt_free_align(trc);
+  if(num_sizes) dt_show_times(&start, "[dev_process_export] writing additional sizes", NULL);
 
-  dt_dev_pixelpipe_cleanup(&pipe);
-  dt_dev_cleanup(&dev);
-  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  res = _export_write_image(imgid, filename, format, format_params, outbuf, processed_width, processed_height, bpp,
+                            float_output, display_byteorder, exif_profile, exif_len, num, total);
+  free(exif_profile);
+  if(!res) res = sizes_res;
 
-  /* now write xmp into that container, if possible */
-  if(copy_metadata && (format->flags(format_params) & FORMAT_FLAGS_SUPPORT_XMP))
+  if(ctx)
+    dt_dev_export_pool_release(darktable.export_pool, ctx, TRUE);
+  else
   {
-    dt_exif_xmp_attach(imgid, filename);
-    // no need to cancel the export if this fail
+    dt_dev_pixelpipe_cleanup(pipe);
+    dt_dev_cleanup(dev);
   }
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
 
-  if(!thumbnail_export && strcmp(format->mime(format_params), "memory")
-    && !(format->flags(format_params) & FORMAT_FLAGS_NO_TMPFILE))
-  {
-    dt_control_signal_raise(darktable.signals, DT_SIGNAL_IMAGE_EXPORT_TMPFILE, imgid, filename, format,
-                            format_params, storage, storage_params);
-  }
+  _export_finish_file(imgid, filename, format, format_params, thumbnail_export, copy_metadata, storage,
+                      storage_params);
 
   return res;
 
 error:
-  dt_dev_pixelpipe_cleanup(&pipe);
+  if(!ctx) dt_dev_pixelpipe_cleanup(pipe);
 error_early:
-  dt_dev_cleanup(&dev);
+  if(ctx)
+    dt_dev_export_pool_release(darktable.export_pool, ctx, FALSE);
+  else
+    dt_dev_cleanup(dev);
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
   return 1;
 }
 
+// internal function: to avoid exif blob reading + 8-bit byteorder flag + high-quality override
+int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
+                                 dt_imageio_module_format_t *format, dt_imageio_module_data_t *format_params,
+                                 const int32_t ignore_exif, const int32_t display_byteorder,
+                                 const gboolean high_quality, const gboolean upscale, const int32_t thumbnail_export,
+                                 const char *filter, const gboolean copy_metadata,
+                                 dt_imageio_module_storage_t *storage,
+                                 dt_imageio_module_data_t *storage_params, int num, int total)
+{
+  return _imageio_export(imgid, filename, format, format_params, ignore_exif, display_byteorder, high_quality,
+                         upscale, thumbnail_export, filter, copy_metadata, storage, storage_params, NULL, 0, num,
+                         total);
+}
+
+int dt_imageio_export_sizes(const uint32_t imgid, const char *filename, dt_imageio_module_format_t *format,
+                            dt_imageio_module_data_t *format_params, const dt_imageio_export_size_t *sizes,
+                            const int num_sizes, const gboolean high_quality, const gboolean upscale,
+                            const gboolean copy_metadata, dt_imageio_module_storage_t *storage,
+                            dt_imageio_module_data_t *storage_params, int num, int total)
+{
+  if(strcmp(format->mime(format_params), "x-copy") == 0)
+    return format->write_image(format_params, filename, NULL, NULL, 0, imgid, num, total);
+  else
+    return _imageio_export(imgid, filename, format, format_params, 0, 0, high_quality, upscale, 0, NULL,
+                           copy_metadata, storage, storage_params, sizes, num_sizes, num, total);
+}
+
 
 // fallback read method in case file could not be opened yet.
 // use GraphicsMagick (if supported) to read exotic LDRs
@@ -70,6 +70,21 @@ int dt_imageio_export(const uint32_t imgid, const char *filename, struct dt_imag
                       const gboolean copy_metadata, dt_imageio_module_storage_t *storage,
                       dt_imageio_module_data_t *storage_params, int num, int total);
 
+/** an additional output of dt_imageio_export_sizes(), fitted into max_width x max_height (0 for no limit) */
+typedef struct dt_imageio_export_size_t
+{
+  const char *filename;
+  int max_width, max_height;
+} dt_imageio_export_size_t;
+
+/** like dt_imageio_export(), but also writes the image at the given sizes. the pipe runs only once, at the size
+ * requested by format_params, and the other sizes are downsampled from its output. they can't be larger. */
+int dt_imageio_export_sizes(const uint32_t imgid, const char *filename, struct dt_imageio_module_format_t *format,
+                            struct dt_imageio_module_data_t *format_params, const dt_imageio_export_size_t *sizes,
+                            const int num_sizes, const gboolean high_quality, const gboolean upscale,
+                            const gboolean copy_metadata, dt_imageio_module_storage_t *storage,
+                            dt_imageio_module_data_t *storage_params, int num, int total);
+
 int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
                                  struct dt_imageio_module_format_t *format,
                                  struct dt_imageio_module_data_t *format_params, const int32_t ignore_exif,
@@ -24,6 +24,16 @@
 
 #include <memory>
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+#if defined(__linux__)
+#include <sys/vfs.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+#include <sys/mount.h>
+#include <sys/param.h>
+#endif
+
 #define __STDC_LIMIT_MACROS
 
 extern "C" {
@@ -102,6 +112,61 @@ void dt_rawspeed_lookup_makermodel(const char *maker, const char *model,
   }
 }
 
+// a mapped file that goes away under us (network share dropped, file truncated by somebody else) kills us
+// with SIGBUS on the next page fault, where a read would just fail. only map from local disks.
+static gboolean dt_rawspeed_can_map(const char *filename)
+{
+#if defined(__linux__)
+  struct statfs s;
+  if(statfs(filename, &s)) return FALSE;
+  switch((unsigned long)s.f_type)
+  {
+    case 0xEF53UL:     // ext2/3/4
+    case 0x58465342UL: // xfs
+    case 0x9123683EUL: // btrfs
+    case 0xF2F52010UL: // f2fs
+    case 0x2FC12FC1UL: // zfs
+    case 0x3153464AUL: // jfs
+    case 0x52654973UL: // reiserfs
+    case 0x01021994UL: // tmpfs
+      return TRUE;
+    default:
+      return FALSE;
+  }
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+  struct statfs s;
+  return !statfs(filename, &s) && (s.f_flags & MNT_LOCAL);
+#else
+  return FALSE;
+#endif
+}
+
+// maps the file read-only. rawspeed only ever reads from its input, so there is no need for a heap copy of
+// the whole file, and the pages can simply be dropped again by the kernel under memory pressure.
+static std::unique_ptr<const Buffer> dt_rawspeed_map_file(const char *filename, GMappedFile **mapped)
+{
+  *mapped = NULL;
+  if(!dt_rawspeed_can_map(filename)) return nullptr;
+
+  *mapped = g_mapped_file_new(filename, FALSE, NULL);
+  if(!*mapped) return nullptr;
+
+  const uchar8 *data = (const uchar8 *)g_mapped_file_get_contents(*mapped);
+  const size_t size = g_mapped_file_get_length(*mapped);
+  if(!data || size == 0 || size > UINT32_MAX)
+  {
+    g_mapped_file_unref(*mapped);
+    *mapped = NULL;
+    return nullptr;
+  }
+#if !defined(_WIN32) && defined(POSIX_MADV_WILLNEED)
+  // the decoders jump around in the file, get all of it read in while we parse the headers
+  posix_madvise((void *)data, size, POSIX_MADV_WILLNEED);
+#endif
+  // doesn't take ownership of the data
+  return std::unique_ptr<const Buffer>(new Buffer(data, size));
+}
+
 uint32_t dt_rawspeed_crop_dcraw_filters(uint32_t filters, uint32_t crop_x, uint32_t crop_y)
 {
   if(!filters || filters == 9u) return filters;
@@ -118,14 +183,26 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
   snprintf(filen, sizeof(filen), "%s", filename);
   FileReader f(filen);
 
+  // goes away last, the buffer and the decoder point into it
+  std::unique_ptr<GMappedFile, decltype(&g_mapped_file_unref)> mapped(NULL, &g_mapped_file_unref);
   std::unique_ptr<RawDecoder> d;
   std::unique_ptr<const Buffer> m;
 
+  const double start = dt_get_wtime();
+  double loaded = start, decoded = start;
+  gboolean was_mapped = FALSE;
+
   try
   {
     dt_rawspeed_load_meta();
 
-    m = f.readFile();
+    GMappedFile *mf = NULL;
+    m = dt_rawspeed_map_file(filen, &mf);
+    mapped.reset(mf);
+    was_mapped = mf != NULL;
+    // can't or shouldn't be mapped, read it the old way
+    if(!m) m = f.readFile();
+    loaded = dt_get_wtime();
 
     RawParser t(m.get());
     d = t.getDecoder(meta);
@@ -137,6 +214,8 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
     d->decodeRaw();
     d->decodeMetaData(meta);
     RawImage r = d->mRaw;
+    // with the file mapped this includes most of the reading, the pages come in as the decoder touches them
+    decoded = dt_get_wtime();
 
     const auto errors = r->getErrors();
     for(const auto &error : errors) fprintf(stderr, "[rawspeed] (%s) %s\n", img->filename, error.c_str());
@@ -220,6 +299,7 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
     /* free auto pointers on spot */
     d.reset();
     m.reset();
+    mapped.reset();
 
     // Grab the WB
     for(int i = 0; i < 4; i++) img->wb_coeffs[i] = r->metadata.wbCoeffs[i];
@@ -318,24 +398,22 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
     if(!buf) return DT_IMAGEIO_CACHE_FULL;
 
     /*
-     * since we do not want to crop black borders at this stage,
-     * and we do not want to rotate image, we can just use memcpy,
-     * as it is faster than dt_imageio_flip_buffers, but only if
-     * buffer sizes are equal,
-     * (from Klaus: r->pitch may differ from DT pitch (line to line spacing))
-     * else fallback to generic dt_imageio_flip_buffers()
+     * rawspeed allocates the image itself, there is no way to have it decode into the cache buffer. the
+     * black borders can't be cropped here either: the user may move the crop in rawprepare, so the cache
+     * keeps the uncropped sensor data. what's left is making the copy fast: no rotation, so plain memcpy
+     * of the rows, split over the threads (from Klaus: r->pitch may differ from DT pitch (line to line
+     * spacing)).
      */
-    const size_t bufSize_mipmap = (size_t)img->width * img->height * r->getBpp();
-    const size_t bufSize_rawspeed = (size_t)r->pitch * dimUncropped.y;
-    if(bufSize_mipmap == bufSize_rawspeed)
-    {
-      memcpy(buf, r->getDataUncropped(0, 0), bufSize_mipmap);
-    }
-    else
-    {
-      dt_imageio_flip_buffers((char *)buf, (char *)r->getDataUncropped(0, 0), r->getBpp(), dimUncropped.x,
-                              dimUncropped.y, dimUncropped.x, dimUncropped.y, r->pitch, ORIENTATION_NONE);
-    }
+    const size_t row = (size_t)dimUncropped.x * r->getBpp();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for(int j = 0; j < dimUncropped.y; j++)
+      memcpy((char *)buf + row * j, r->getDataUncropped(0, j), row);
+
+    const double end = dt_get_wtime();
+    dt_print(DT_DEBUG_PERF, "[rawspeed] %s: %s %.3f secs, decode %.3f secs, copy to cache %.3f secs\n",
+             img->filename, was_mapped ? "map" : "read", loaded - start, decoded - loaded, end - decoded);
   }
   catch(const std::exception &exc)
   {
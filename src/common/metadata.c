@@ -17,6 +17,7 @@
 */
 
 #include "common/metadata.h"
+#include "common/collection.h"
 #include "common/debug.h"
 
 #include <stdlib.h>
@@ -92,13 +93,13 @@ static GList *dt_metadata_get_xmp(int id, const char *key, uint32_t *count)
     {
       if(id == -1)
       {
-        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT flags FROM main.images WHERE id IN "
+        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db), "SELECT flags FROM main.images WHERE id IN "
                                                                    "(SELECT imgid FROM main.selected_images)",
                                     -1, &stmt, NULL);
       }
       else // single image under mouse cursor
       {
-        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT flags FROM main.images WHERE id = ?1",
+        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db), "SELECT flags FROM main.images WHERE id = ?1",
                                     -1, &stmt, NULL);
         DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
       }
@@ -115,7 +116,7 @@ static GList *dt_metadata_get_xmp(int id, const char *key, uint32_t *count)
     {
       if(id == -1)
       {
-        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db),
                                     "SELECT name FROM data.tags t JOIN main.tagged_images i ON "
                                     "i.tagid = t.id WHERE imgid IN "
                                     "(SELECT imgid FROM main.selected_images)",
@@ -123,7 +124,7 @@ static GList *dt_metadata_get_xmp(int id, const char *key, uint32_t *count)
       }
       else // single image under mouse cursor
       {
-        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db),
                                     "SELECT name FROM data.tags t JOIN main.tagged_images i ON "
                                     "i.tagid = t.id WHERE imgid = ?1",
                                     -1, &stmt, NULL);
@@ -140,14 +141,14 @@ static GList *dt_metadata_get_xmp(int id, const char *key, uint32_t *count)
     {
       if(id == -1)
       {
-        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db),
                                     "SELECT color FROM main.color_labels WHERE imgid IN "
                                     "(SELECT imgid FROM main.selected_images)",
                                     -1, &stmt, NULL);
       }
       else // single image under mouse cursor
       {
-        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db),
                                     "SELECT color FROM main.color_labels WHERE imgid=?1 ORDER BY color",
                                     -1, &stmt, NULL);
         DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
@@ -166,7 +167,7 @@ static GList *dt_metadata_get_xmp(int id, const char *key, uint32_t *count)
   // So we got this far -- it has to be a generic key-value entry from meta_data
   if(id == -1)
   {
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db),
                                 "SELECT value FROM main.meta_data WHERE id IN "
                                 "(SELECT imgid FROM main.selected_images) AND key = ?1 ORDER BY value",
                                 -1, &stmt, NULL);
@@ -174,7 +175,7 @@ static GList *dt_metadata_get_xmp(int id, const char *key, uint32_t *count)
   }
   else // single image under mouse cursor
   {
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db),
                                 "SELECT value FROM main.meta_data WHERE id = ?1 AND key = ?2 ORDER BY value", -1,
                                 &stmt, NULL);
     DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
@@ -212,13 +213,13 @@ static GList *dt_metadata_get_exif(int id, const char *key, uint32_t *count)
   {
     if(id == -1)
     {
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT exposure FROM main.images WHERE id IN "
+      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db), "SELECT exposure FROM main.images WHERE id IN "
                                                                  "(SELECT imgid FROM main.selected_images)",
                                   -1, &stmt, NULL);
     }
     else // single image under mouse cursor
     {
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT exposure FROM main.images WHERE id = ?1",
+      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db), "SELECT exposure FROM main.images WHERE id = ?1",
                                   -1, &stmt, NULL);
       DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
     }
@@ -227,13 +228,13 @@ static GList *dt_metadata_get_exif(int id, const char *key, uint32_t *count)
   {
     if(id == -1)
     {
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT aperture FROM main.images WHERE id IN "
+      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db), "SELECT aperture FROM main.images WHERE id IN "
                                                                  "(SELECT imgid FROM main.selected_images)",
                                   -1, &stmt, NULL);
     }
     else // single image under mouse cursor
     {
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT aperture FROM main.images WHERE id = ?1",
+      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db), "SELECT aperture FROM main.images WHERE id = ?1",
                                   -1, &stmt, NULL);
       DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
     }
@@ -242,13 +243,13 @@ static GList *dt_metadata_get_exif(int id, const char *key, uint32_t *count)
   {
     if(id == -1)
     {
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db),
                                   "SELECT iso FROM main.images WHERE id IN "
                                   "(SELECT imgid FROM main.selected_images)", -1, &stmt, NULL);
     }
     else // single image under mouse cursor
     {
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT iso FROM main.images WHERE id = ?1", -1,
+      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db), "SELECT iso FROM main.images WHERE id = ?1", -1,
                                   &stmt, NULL);
       DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
     }
@@ -257,14 +258,14 @@ static GList *dt_metadata_get_exif(int id, const char *key, uint32_t *count)
   {
     if(id == -1)
     {
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db),
                                   "SELECT focal_length FROM main.images WHERE id IN "
                                   "(SELECT imgid FROM main.selected_images)",
                                   -1, &stmt, NULL);
     }
     else // single image under mouse cursor
     {
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db),
                                   "SELECT focal_length FROM main.images WHERE id = ?1", -1, &stmt, NULL);
       DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
     }
@@ -277,14 +278,14 @@ static GList *dt_metadata_get_exif(int id, const char *key, uint32_t *count)
     {
       if(id == -1)
       {
-        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db),
                                     "SELECT datetime_taken FROM main.images WHERE id IN "
                                     "(SELECT imgid FROM main.selected_images)",
                                     -1, &stmt, NULL);
       }
       else // single image under mouse cursor
       {
-        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db),
                                     "SELECT datetime_taken FROM main.images WHERE id = ?1", -1, &stmt, NULL);
         DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
       }
@@ -293,13 +294,13 @@ static GList *dt_metadata_get_exif(int id, const char *key, uint32_t *count)
     {
       if(id == -1)
       {
-        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT maker FROM main.images WHERE id IN "
+        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db), "SELECT maker FROM main.images WHERE id IN "
                                                                    "(SELECT imgid FROM main.selected_images)",
                                     -1, &stmt, NULL);
       }
       else // single image under mouse cursor
       {
-        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT maker FROM main.images WHERE id = ?1",
+        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db), "SELECT maker FROM main.images WHERE id = ?1",
                                     -1, &stmt, NULL);
         DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
       }
@@ -308,13 +309,13 @@ static GList *dt_metadata_get_exif(int id, const char *key, uint32_t *count)
     {
       if(id == -1)
       {
-        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT model FROM main.images WHERE id IN "
+        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db), "SELECT model FROM main.images WHERE id IN "
                                                                    "(SELECT imgid FROM main.selected_images)",
                                     -1, &stmt, NULL);
       }
       else // single image under mouse cursor
       {
-        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT model FROM main.images WHERE id = ?1",
+        DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db), "SELECT model FROM main.images WHERE id = ?1",
                                     -1, &stmt, NULL);
         DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
       }
@@ -358,13 +359,13 @@ static GList *dt_metadata_get_dt(int id, const char *key, uint32_t *count)
   {
     if(id == -1)
     {
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT lens FROM main.images WHERE id IN "
+      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db), "SELECT lens FROM main.images WHERE id IN "
                                                                  "(SELECT imgid FROM main.selected_images)",
                                   -1, &stmt, NULL);
     }
     else // single image under mouse cursor
     {
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT lens FROM main.images WHERE id = ?1", -1,
+      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db), "SELECT lens FROM main.images WHERE id = ?1", -1,
                                   &stmt, NULL);
       DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
     }
@@ -412,6 +413,7 @@ void dt_metadata_set(int id, const char *key, const char *value)
     dt_metadata_set_exif(id, key, c);
 
   g_free(v);
+  dt_collection_invalidate();
 }
 
 GList *dt_metadata_get(int id, const char *key, uint32_t *count)
@@ -440,6 +442,7 @@ void dt_metadata_clear(int id)
     sqlite3_step(stmt);
     sqlite3_finalize(stmt);
   }
+  dt_collection_invalidate();
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -20,8 +20,10 @@
 #include "common/darktable.h"
 #include "common/debug.h"
 #include "common/exif.h"
+#include "common/exif_probe.h"
 #include "common/grealpath.h"
 #include "common/image_cache.h"
+#include "common/image_compression.h"
 #include "common/imageio.h"
 #include "common/imageio_jpeg.h"
 #include "common/imageio_module.h"
@@ -58,7 +60,9 @@ typedef enum dt_mipmap_buffer_dsc_flags
 {
   DT_MIPMAP_BUFFER_DSC_FLAG_NONE = 0,
   DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE = 1 << 0,
-  DT_MIPMAP_BUFFER_DSC_FLAG_INVALIDATE = 1 << 1
+  DT_MIPMAP_BUFFER_DSC_FLAG_INVALIDATE = 1 << 1,
+  DT_MIPMAP_BUFFER_DSC_FLAG_HALF = 1 << 2, // float pixels stored as half floats
+  DT_MIPMAP_BUFFER_DSC_FLAG_RGBA = 1 << 3  // mip_f with rgba pixels, not a raw mosaic
 } dt_mipmap_buffer_dsc_flags;
 
 // the embedded Exif data to tag thumbnails as sRGB or AdobeRGB
@@ -131,6 +135,7 @@ static inline void dead_image_f(dt_mipmap_buffer_t *buf)
   dsc->width = dsc->height = 8;
   dsc->iscale = 1.0f;
   dsc->color_space = DT_COLORSPACE_DISPLAY;
+  dsc->flags &= ~(DT_MIPMAP_BUFFER_DSC_FLAG_HALF | DT_MIPMAP_BUFFER_DSC_FLAG_RGBA);
   assert(dsc->size > 64 * 4 * sizeof(float));
 
   if(darktable.codepath.OPENMP_SIMD)
@@ -235,7 +240,7 @@ exit:
 }
 
 static void _init_f(dt_mipmap_buffer_t *mipmap_buf, float *buf, uint32_t *width, uint32_t *height, float *iscale,
-                    const uint32_t imgid);
+                    dt_mipmap_buffer_dsc_flags *flags, const uint32_t imgid);
 static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *iscale,
                     dt_colorspaces_color_profile_type_t *color_space, const uint32_t imgid,
                     const dt_mipmap_size_t size);
@@ -428,6 +433,241 @@ static void dt_mipmap_cache_unlink_ondisk_thumbnail(void *data, uint32_t imgid,
   }
 }
 
+// compressed copies of evicted rgba mip_f buffers, at one byte per pixel. the raw mosaics don't fit the codec.
+// getting one back takes a fraction of the time loading and downscaling the full image again would.
+typedef struct dt_mipmap_cache_compressed_entry_t
+{
+  uint32_t imgid;
+  uint32_t width, height;
+  float iscale;
+  size_t size;
+  uint8_t *data;
+} dt_mipmap_cache_compressed_entry_t;
+
+typedef struct dt_mipmap_cache_compressed_t
+{
+  dt_pthread_mutex_t mutex;
+  GHashTable *entries; // imgid -> dt_mipmap_cache_compressed_entry_t
+  GQueue lru;          // the same entries, most recently stored first
+  size_t used, quota;  // in bytes
+  GHashTable *pending; // imgid -> the dt_mipmap_cache_compress_job_t that is going to store it
+} dt_mipmap_cache_compressed_t;
+
+// an evicted mip_f buffer on its way into the compressed cache. the eviction happens under the lock of the
+// mip_f cache, compressing it there would stall everyone waiting for a mip_f.
+typedef struct dt_mipmap_cache_compress_job_t
+{
+  dt_mipmap_cache_compressed_t *c;
+  uint32_t imgid;
+  struct dt_mipmap_buffer_dsc *dsc; // the evicted buffer, owned by the job
+} dt_mipmap_cache_compress_job_t;
+
+static void _compressed_entry_free(dt_mipmap_cache_compressed_entry_t *e)
+{
+  free(e->data);
+  free(e);
+}
+
+// takes e out, the caller holds the lock
+static void _compressed_unlink(dt_mipmap_cache_compressed_t *c, dt_mipmap_cache_compressed_entry_t *e)
+{
+  g_hash_table_remove(c->entries, GINT_TO_POINTER(e->imgid));
+  g_queue_remove(&c->lru, e);
+  c->used -= e->size;
+}
+
+// drops the compressed copy of imgid and one that is about to be stored, the image changed
+static void _compressed_drop(dt_mipmap_cache_compressed_t *c, const uint32_t imgid)
+{
+  if(!c) return;
+
+  dt_pthread_mutex_lock(&c->mutex);
+  g_hash_table_remove(c->pending, GINT_TO_POINTER(imgid));
+  dt_mipmap_cache_compressed_entry_t *e
+      = (dt_mipmap_cache_compressed_entry_t *)g_hash_table_lookup(c->entries, GINT_TO_POINTER(imgid));
+  if(e)
+  {
+    _compressed_unlink(c, e);
+    _compressed_entry_free(e);
+  }
+  dt_pthread_mutex_unlock(&c->mutex);
+}
+
+static void _compressed_job_free(void *data)
+{
+  dt_mipmap_cache_compress_job_t *params = (dt_mipmap_cache_compress_job_t *)data;
+  dt_free_align(params->dsc);
+  free(params);
+}
+
+static int32_t _compressed_store_job_run(dt_job_t *job)
+{
+  dt_mipmap_cache_compress_job_t *params = (dt_mipmap_cache_compress_job_t *)dt_control_job_get_params(job);
+  dt_mipmap_cache_compressed_t *c = params->c;
+  const uint32_t imgid = params->imgid;
+  const struct dt_mipmap_buffer_dsc *dsc = params->dsc;
+  const size_t size = dt_image_compressed_size(dsc->width, dsc->height);
+
+  dt_mipmap_cache_compressed_entry_t *e
+      = (dt_mipmap_cache_compressed_entry_t *)malloc(sizeof(dt_mipmap_cache_compressed_entry_t));
+  uint8_t *data = (uint8_t *)malloc(size);
+  const float *in = (const float *)(dsc + 1);
+  float *tmp = NULL;
+  if(e && data && (dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_HALF))
+  {
+    const size_t stride = (size_t)4 * dsc->width;
+    in = tmp = dt_alloc_align(64, sizeof(float) * stride * dsc->height);
+    if(tmp)
+    {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+      for(int j = 0; j < (int)dsc->height; j++)
+        dt_iop_image_half_to_float(tmp + j * stride, (const uint16_t *)(dsc + 1) + j * stride, stride);
+    }
+  }
+  if(!e || !data || !in)
+  {
+    free(data);
+    free(e);
+    dt_pthread_mutex_lock(&c->mutex);
+    if(g_hash_table_lookup(c->pending, GINT_TO_POINTER(imgid)) == params)
+      g_hash_table_remove(c->pending, GINT_TO_POINTER(imgid));
+    dt_pthread_mutex_unlock(&c->mutex);
+    return 1;
+  }
+
+  const double start = dt_get_wtime();
+  dt_image_compress(in, data, dsc->width, dsc->height, 4);
+  dt_free_align(tmp);
+  dt_print(DT_DEBUG_CACHE, "[mipmap_cache] compressed mip_f of image %u in %.3f secs\n", imgid,
+           dt_get_wtime() - start);
+
+  e->imgid = imgid;
+  e->width = dsc->width;
+  e->height = dsc->height;
+  e->iscale = dsc->iscale;
+  e->size = size;
+  e->data = data;
+
+  dt_pthread_mutex_lock(&c->mutex);
+  // the image changed, got its mip_f back or got evicted again in the meantime
+  if(g_hash_table_lookup(c->pending, GINT_TO_POINTER(imgid)) != params)
+  {
+    dt_pthread_mutex_unlock(&c->mutex);
+    _compressed_entry_free(e);
+    return 0;
+  }
+  g_hash_table_remove(c->pending, GINT_TO_POINTER(imgid));
+  dt_mipmap_cache_compressed_entry_t *old
+      = (dt_mipmap_cache_compressed_entry_t *)g_hash_table_lookup(c->entries, GINT_TO_POINTER(imgid));
+  if(old)
+  {
+    _compressed_unlink(c, old);
+    _compressed_entry_free(old);
+  }
+  g_hash_table_insert(c->entries, GINT_TO_POINTER(imgid), e);
+  g_queue_push_head(&c->lru, e);
+  c->used += size;
+  while(c->used > c->quota)
+  {
+    dt_mipmap_cache_compressed_entry_t *oldest = (dt_mipmap_cache_compressed_entry_t *)g_queue_peek_tail(&c->lru);
+    _compressed_unlink(c, oldest);
+    _compressed_entry_free(oldest);
+  }
+  dt_pthread_mutex_unlock(&c->mutex);
+  return 0;
+}
+
+// hands the evicted mip_f buffer of entry to a background job which compresses it, entry->data is the job's
+// from now on. called with the mip_f cache locked.
+static void _compressed_store(dt_mipmap_cache_compressed_t *c, const uint32_t imgid, dt_cache_entry_t *entry)
+{
+  struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
+  // nobody would pick it up when shutting down
+  if(dt_image_compressed_size(dsc->width, dsc->height) > c->quota || !dt_control_running()) return;
+
+  dt_mipmap_cache_compress_job_t *params
+      = (dt_mipmap_cache_compress_job_t *)malloc(sizeof(dt_mipmap_cache_compress_job_t));
+  dt_job_t *job = dt_control_job_create(&_compressed_store_job_run, "compress mip_f of image %u", imgid);
+  if(!params || !job)
+  {
+    free(params);
+    if(job) dt_control_job_dispose(job);
+    return;
+  }
+  params->c = c;
+  params->imgid = imgid;
+  params->dsc = dsc;
+  entry->data = NULL;
+  dt_control_job_set_params(job, params, _compressed_job_free);
+
+  dt_pthread_mutex_lock(&c->mutex);
+  g_hash_table_insert(c->pending, GINT_TO_POINTER(imgid), params);
+  dt_pthread_mutex_unlock(&c->mutex);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+}
+
+// fills a mip_f buffer from the compressed copy, if there is one. it is dropped, mip_f has the image again.
+static gboolean _compressed_fetch(dt_mipmap_cache_t *cache, const uint32_t imgid, float *out, uint32_t *width,
+                                  uint32_t *height, float *iscale, dt_mipmap_buffer_dsc_flags *flags)
+{
+  dt_mipmap_cache_compressed_t *c = cache->compressed;
+  if(!c) return FALSE;
+
+  dt_pthread_mutex_lock(&c->mutex);
+  dt_mipmap_cache_compressed_entry_t *e
+      = (dt_mipmap_cache_compressed_entry_t *)g_hash_table_lookup(c->entries, GINT_TO_POINTER(imgid));
+  if(e) _compressed_unlink(c, e);
+  // one still being compressed is too late, mip_f gets it the usual way
+  g_hash_table_remove(c->pending, GINT_TO_POINTER(imgid));
+  dt_pthread_mutex_unlock(&c->mutex);
+  if(!e) return FALSE;
+
+  gboolean ok = TRUE;
+  if(cache->half_f)
+  {
+    const size_t stride = (size_t)4 * e->width;
+    float *tmp = dt_alloc_align(64, sizeof(float) * stride * e->height);
+    if(tmp)
+    {
+      dt_image_uncompress(e->data, tmp, e->width, e->height, 4);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+      for(int j = 0; j < (int)e->height; j++)
+        dt_iop_image_float_to_half((uint16_t *)out + j * stride, tmp + j * stride, stride);
+      dt_free_align(tmp);
+      *flags |= DT_MIPMAP_BUFFER_DSC_FLAG_HALF;
+    }
+    else
+      ok = FALSE;
+  }
+  else
+    dt_image_uncompress(e->data, out, e->width, e->height, 4);
+
+  if(ok)
+  {
+    *width = e->width;
+    *height = e->height;
+    *iscale = e->iscale;
+    *flags |= DT_MIPMAP_BUFFER_DSC_FLAG_RGBA;
+  }
+  _compressed_entry_free(e);
+  return ok;
+}
+
+static void _compressed_cleanup(dt_mipmap_cache_compressed_t *c)
+{
+  if(!c) return;
+  g_queue_foreach(&c->lru, (GFunc)_compressed_entry_free, NULL);
+  g_queue_clear(&c->lru);
+  g_hash_table_destroy(c->entries);
+  g_hash_table_destroy(c->pending);
+  dt_pthread_mutex_destroy(&c->mutex);
+  free(c);
+}
+
 void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
 {
   dt_mipmap_cache_t *cache = (dt_mipmap_cache_t *)data;
@@ -496,6 +736,14 @@ write_error:
       }
     }
   }
+  else if(mip == DT_MIPMAP_F && cache->compressed)
+  {
+    struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
+    // don't keep skulls or buffers that never got filled:
+    if((void *)dsc != (void *)dt_mipmap_cache_static_dead_image && (dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_RGBA)
+       && !(dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE) && dsc->width > 8 && dsc->height > 8)
+      _compressed_store(cache->compressed, get_imgid(entry->key), entry);
+  }
   dt_free_align(entry->data);
 }
 
@@ -576,17 +824,35 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
   dt_cache_set_cleanup_callback(&cache->mip_full.cache, dt_mipmap_cache_deallocate_dynamic, cache);
   cache->buffer_size[DT_MIPMAP_FULL] = 0;
 
-  // same for mipf:
-  dt_cache_init(&cache->mip_f.cache, 0, max_mem_bufs);
+  // same for mipf. with half floats a buffer takes half the memory, so twice as many fit in the same space.
+  // the 16-bit raw mosaics at twice the width and height need as much as before.
+  cache->half_f = dt_conf_get_bool("cache_mipf_half");
+  dt_cache_init(&cache->mip_f.cache, 0, cache->half_f ? 2 * max_mem_bufs : max_mem_bufs);
   dt_cache_set_allocate_callback(&cache->mip_f.cache, dt_mipmap_cache_allocate_dynamic, cache);
   dt_cache_set_cleanup_callback(&cache->mip_f.cache, dt_mipmap_cache_deallocate_dynamic, cache);
   cache->buffer_size[DT_MIPMAP_F] = sizeof(struct dt_mipmap_buffer_dsc)
-                                        + 4 * sizeof(float) * cache->max_width[DT_MIPMAP_F]
-                                          * cache->max_height[DT_MIPMAP_F];
+                                        + (cache->half_f ? 4 * sizeof(uint16_t) : 4 * sizeof(float))
+                                          * cache->max_width[DT_MIPMAP_F] * cache->max_height[DT_MIPMAP_F];
+
+  // evicted mip_f buffers can be kept around compressed, at 1/16 of their size
+  const int64_t compressed_memory = dt_conf_get_int64("cache_mipf_compressed");
+  cache->compressed = NULL;
+  if(compressed_memory > 0)
+  {
+    cache->compressed = (dt_mipmap_cache_compressed_t *)calloc(1, sizeof(dt_mipmap_cache_compressed_t));
+    dt_pthread_mutex_init(&cache->compressed->mutex, NULL);
+    cache->compressed->entries = g_hash_table_new(g_direct_hash, g_direct_equal);
+    cache->compressed->pending = g_hash_table_new(g_direct_hash, g_direct_equal);
+    g_queue_init(&cache->compressed->lru);
+    cache->compressed->quota = MIN(compressed_memory, ((int64_t)8) << 30);
+  }
 }
 
 void dt_mipmap_cache_cleanup(dt_mipmap_cache_t *cache)
 {
+  // first, so that the mip_f buffers don't get compressed on their way out
+  _compressed_cleanup(cache->compressed);
+  cache->compressed = NULL;
   dt_cache_cleanup(&cache->mip_thumbs.cache);
   dt_cache_cleanup(&cache->mip_full.cache);
   dt_cache_cleanup(&cache->mip_f.cache);
@@ -604,6 +870,14 @@ void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
   printf("[mipmap_cache] full  fill %d/%d slots (%.2f%%)\n",
          (uint32_t)cache->mip_full.cache.cost, (uint32_t)cache->mip_full.cache.cost_quota,
          100.0f * (float)cache->mip_full.cache.cost / (float)cache->mip_full.cache.cost_quota);
+  if(cache->compressed)
+  {
+    dt_pthread_mutex_lock(&cache->compressed->mutex);
+    printf("[mipmap_cache] compressed float fill %.2f/%.2f MB (%u images)\n",
+           cache->compressed->used / (1024.0 * 1024.0), cache->compressed->quota / (1024.0 * 1024.0),
+           g_queue_get_length(&cache->compressed->lru));
+    dt_pthread_mutex_unlock(&cache->compressed->mutex);
+  }
 
   uint64_t sum = 0;
   uint64_t sum_fetches = 0;
@@ -682,6 +956,7 @@ void dt_mipmap_cache_get_with_caller(
       buf->height = dsc->height;
       buf->iscale = dsc->iscale;
       buf->color_space = dsc->color_space;
+      buf->half_float = (dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_HALF) != 0;
       buf->imgid = imgid;
       buf->size = mip;
 
@@ -697,6 +972,7 @@ void dt_mipmap_cache_get_with_caller(
       buf->iscale = 0.0f;
       buf->imgid = 0;
       buf->color_space = DT_COLORSPACE_NONE;
+      buf->half_float = FALSE;
       buf->size = DT_MIPMAP_NONE;
       buf->buf = NULL;
     }
@@ -760,6 +1036,7 @@ void dt_mipmap_cache_get_with_caller(
         buf->width = buf->height = 0;
         buf->iscale = 0.0f;
         buf->color_space = DT_COLORSPACE_NONE; // TODO: does the full buffer need to know this?
+        buf->half_float = FALSE;
         dt_imageio_retval_t ret = dt_imageio_open(&buffered_image, filename, buf); // TODO: color_space?
         // might have been reallocated:
         ASAN_UNPOISON_MEMORY_REGION(entry->data, dt_mipmap_buffer_dsc_size);
@@ -792,7 +1069,7 @@ void dt_mipmap_cache_get_with_caller(
       else if(mip == DT_MIPMAP_F)
       {
         ASAN_UNPOISON_MEMORY_REGION(dsc + 1, dsc->size - sizeof(struct dt_mipmap_buffer_dsc));
-        _init_f(buf, (float *)(dsc + 1), &dsc->width, &dsc->height, &dsc->iscale, imgid);
+        _init_f(buf, (float *)(dsc + 1), &dsc->width, &dsc->height, &dsc->iscale, &dsc->flags, imgid);
       }
       else
       {
@@ -843,6 +1120,7 @@ void dt_mipmap_cache_get_with_caller(
     buf->height = dsc->height;
     buf->iscale = dsc->iscale;
     buf->color_space = dsc->color_space;
+    buf->half_float = (dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_HALF) != 0;
     buf->imgid = imgid;
     buf->size = mip;
 
@@ -855,7 +1133,10 @@ void dt_mipmap_cache_get_with_caller(
       if(mip < DT_MIPMAP_F)
         dead_image_8(buf);
       else if(mip == DT_MIPMAP_F)
+      {
         dead_image_f(buf);
+        buf->half_float = FALSE;
+      }
       else
         buf->buf = NULL; // full images with NULL buffer have to be handled, indicates `missing image', but still return locked slot
     }
@@ -911,6 +1192,7 @@ void dt_mipmap_cache_get_with_caller(
     buf->width = buf->height = 0;
     buf->iscale = 0.0f;
     buf->color_space = DT_COLORSPACE_NONE;
+    buf->half_float = FALSE;
   }
 }
 
@@ -956,30 +1238,41 @@ dt_mipmap_size_t dt_mipmap_cache_get_matching_size(const dt_mipmap_cache_t *cach
   return best;
 }
 
+static void _mipmap_cache_remove(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t k)
+{
+  const uint32_t key = get_key(imgid, k);
+  dt_cache_entry_t *entry = dt_cache_testget(&_get_cache(cache, k)->cache, key, 'w');
+  if(entry)
+  {
+    ASAN_UNPOISON_MEMORY_REGION(entry->data, dt_mipmap_buffer_dsc_size);
+    struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
+    dsc->flags |= DT_MIPMAP_BUFFER_DSC_FLAG_INVALIDATE;
+    dt_cache_release(&_get_cache(cache, k)->cache, entry);
+
+    // due to DT_MIPMAP_BUFFER_DSC_FLAG_INVALIDATE, removes thumbnail from disc
+    dt_cache_remove(&_get_cache(cache, k)->cache, key);
+  }
+  else
+  {
+    // ugly, but avoids alloc'ing thumb if it is not there.
+    dt_mipmap_cache_unlink_ondisk_thumbnail((&_get_cache(cache, k)->cache)->cleanup_data, imgid, k);
+  }
+}
+
 void dt_mipmap_cache_remove(dt_mipmap_cache_t *cache, const uint32_t imgid)
 {
   // get rid of all ldr thumbnails:
 
-  for(dt_mipmap_size_t k = DT_MIPMAP_0; k < DT_MIPMAP_F; k++)
-  {
-    const uint32_t key = get_key(imgid, k);
-    dt_cache_entry_t *entry = dt_cache_testget(&_get_cache(cache, k)->cache, key, 'w');
-    if(entry)
-    {
-      ASAN_UNPOISON_MEMORY_REGION(entry->data, dt_mipmap_buffer_dsc_size);
-      struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
-      dsc->flags |= DT_MIPMAP_BUFFER_DSC_FLAG_INVALIDATE;
-      dt_cache_release(&_get_cache(cache, k)->cache, entry);
+  for(dt_mipmap_size_t k = DT_MIPMAP_0; k < DT_MIPMAP_F; k++) _mipmap_cache_remove(cache, imgid, k);
+  _compressed_drop(cache->compressed, imgid);
+}
 
-      // due to DT_MIPMAP_BUFFER_DSC_FLAG_INVALIDATE, removes thumbnail from disc
-      dt_cache_remove(&_get_cache(cache, k)->cache, key);
-    }
-    else
-    {
-      // ugly, but avoids alloc'ing thumb if it is not there.
-      dt_mipmap_cache_unlink_ondisk_thumbnail((&_get_cache(cache, k)->cache)->cleanup_data, imgid, k);
-    }
-  }
+void dt_mipmap_cache_remove_list(dt_mipmap_cache_t *cache, const GList *imgs)
+{
+  // one size after the other, so that we stay in the same cache and on-disk directory
+  for(dt_mipmap_size_t k = DT_MIPMAP_0; k < DT_MIPMAP_F; k++)
+    for(const GList *l = imgs; l; l = g_list_next(l)) _mipmap_cache_remove(cache, GPOINTER_TO_INT(l->data), k);
+  for(const GList *l = imgs; l; l = g_list_next(l)) _compressed_drop(cache->compressed, GPOINTER_TO_INT(l->data));
 }
 
 void dt_mimap_cache_evict(dt_mipmap_cache_t *cache, const uint32_t imgid)
@@ -991,12 +1284,17 @@ void dt_mimap_cache_evict(dt_mipmap_cache_t *cache, const uint32_t imgid)
     // write thumbnail to disc if not existing there
     dt_cache_remove(&_get_cache(cache, k)->cache, key);
   }
+  _compressed_drop(cache->compressed, imgid);
 }
 
 static void _init_f(dt_mipmap_buffer_t *mipmap_buf, float *out, uint32_t *width, uint32_t *height, float *iscale,
-                    const uint32_t imgid)
+                    dt_mipmap_buffer_dsc_flags *flags, const uint32_t imgid)
 {
   const uint32_t wd = *width, ht = *height;
+  *flags &= ~(DT_MIPMAP_BUFFER_DSC_FLAG_HALF | DT_MIPMAP_BUFFER_DSC_FLAG_RGBA);
+
+  mipmap_buf->color_space = DT_COLORSPACE_NONE; // TODO: do we need that information in this buffer?
+  if(_compressed_fetch(darktable.mipmap_cache, imgid, out, width, height, iscale, flags)) return;
 
   /* do not even try to process file if it isn't available */
   char filename[PATH_MAX] = { 0 };
@@ -1044,13 +1342,27 @@ static void _init_f(dt_mipmap_buffer_t *mipmap_buf, float *out, uint32_t *width,
 
   assert(!buffer_is_broken(&buf));
 
-  mipmap_buf->color_space = DT_COLORSPACE_NONE; // TODO: do we need that information in this buffer?
+  // float pixels (rgba, or the mosaic of floating point raws) are downscaled as usual and then stored as
+  // half floats if mip_f is set up for that. uint16 mosaics are left alone, they are as small already.
+  const gboolean half = darktable.mipmap_cache->half_f
+                        && (!image->buf_dsc.filters || image->buf_dsc.datatype == TYPE_FLOAT);
+  const int channels = image->buf_dsc.filters ? 1 : 4;
+  float *const zoomed
+      = half ? dt_alloc_align(64, sizeof(float) * channels * roi_out.width * roi_out.height) : out;
+  if(!zoomed)
+  {
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    dt_image_cache_read_release(darktable.image_cache, image);
+    *width = *height = 0;
+    *iscale = 0.0f;
+    return;
+  }
 
   if(image->buf_dsc.filters)
   {
     if(image->buf_dsc.filters != 9u && image->buf_dsc.datatype == TYPE_FLOAT)
     {
-      dt_iop_clip_and_zoom_mosaic_half_size_f((float *const)out, (const float *const)buf.buf, &roi_out, &roi_in,
+      dt_iop_clip_and_zoom_mosaic_half_size_f(zoomed, (const float *const)buf.buf, &roi_out, &roi_in,
                                               roi_out.width, roi_in.width, image->buf_dsc.filters);
     }
     else if(image->buf_dsc.filters != 9u && image->buf_dsc.datatype == TYPE_UINT16)
@@ -1065,7 +1377,7 @@ static void _init_f(dt_mipmap_buffer_t *mipmap_buf, float *out, uint32_t *width,
     }
     else if(image->buf_dsc.filters == 9u && image->buf_dsc.datatype == TYPE_FLOAT)
     {
-      dt_iop_clip_and_zoom_mosaic_third_size_xtrans_f(out, (const float *)buf.buf, &roi_out, &roi_in,
+      dt_iop_clip_and_zoom_mosaic_third_size_xtrans_f(zoomed, (const float *)buf.buf, &roi_out, &roi_in,
                                                       roi_out.width, roi_in.width, image->buf_dsc.xtrans);
     }
     else
@@ -1076,9 +1388,22 @@ static void _init_f(dt_mipmap_buffer_t *mipmap_buf, float *out, uint32_t *width,
   else
   {
     // downsample
-    dt_iop_clip_and_zoom(out, (const float *)buf.buf, &roi_out, &roi_in, roi_out.width, roi_in.width);
+    dt_iop_clip_and_zoom(zoomed, (const float *)buf.buf, &roi_out, &roi_in, roi_out.width, roi_in.width);
   }
 
+  if(half)
+  {
+    const size_t stride = (size_t)channels * roi_out.width;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for(int j = 0; j < roi_out.height; j++)
+      dt_iop_image_float_to_half((uint16_t *)out + j * stride, zoomed + j * stride, stride);
+    dt_free_align(zoomed);
+    *flags |= DT_MIPMAP_BUFFER_DSC_FLAG_HALF;
+  }
+  if(!image->buf_dsc.filters) *flags |= DT_MIPMAP_BUFFER_DSC_FLAG_RGBA;
+
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
 
   *width = roi_out.width;
@@ -1278,6 +1603,95 @@ void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint3
   }
 }
 
+int dt_mipmap_cache_write_embedded_thumbnails(const dt_mipmap_cache_t *cache, const uint32_t imgid,
+                                              const char *filename, const dt_image_orientation_t orientation)
+{
+  if(!cache->cachedir[0]) return 1;
+
+  // which sizes are still missing. a preview doesn't get blown up to more than one size beyond its own,
+  // what's larger gets made from the image once someone wants it.
+  uint8_t *jpeg = NULL;
+  size_t jpeg_size = 0;
+  int pw = 0, ph = 0;
+  if(dt_exif_probe_preview(filename, &jpeg, &jpeg_size, &pw, &ph)) return 1;
+  const gboolean swap = orientation != ORIENTATION_NULL && (orientation & ORIENTATION_SWAP_XY);
+  const int ow = swap ? ph : pw, oh = swap ? pw : ph;
+  dt_mipmap_size_t top = DT_MIPMAP_0;
+  while(top < DT_MIPMAP_F - 1 && (ow >= cache->max_width[top] || oh >= cache->max_height[top])) top++;
+
+  char path[PATH_MAX] = { 0 };
+  gboolean missing = FALSE;
+  for(dt_mipmap_size_t k = DT_MIPMAP_0; k <= top && !missing; k++)
+  {
+    snprintf(path, sizeof(path), "%s.d/%d/%u.jpg", cache->cachedir, k, imgid);
+    missing = !g_file_test(path, G_FILE_TEST_EXISTS);
+  }
+  if(!missing)
+  {
+    g_free(jpeg);
+    return 0;
+  }
+
+  dt_imageio_jpeg_t jpg;
+  uint8_t *rgba = NULL;
+  if(dt_imageio_jpeg_decompress_header(jpeg, jpeg_size, &jpg)
+     || !(rgba = (uint8_t *)malloc((size_t)4 * jpg.width * jpg.height)) || dt_imageio_jpeg_decompress(&jpg, rgba))
+  {
+    free(rgba);
+    g_free(jpeg);
+    return 1;
+  }
+  g_free(jpeg);
+
+  // largest first, each of the others is scaled down from the one before
+  const int cache_quality = MIN(100, MAX(10, dt_conf_get_int("database_cache_quality")));
+  const uint8_t *in = rgba;
+  uint32_t iw = jpg.width, ih = jpg.height;
+  dt_image_orientation_t in_orientation = orientation;
+  uint8_t *prev = NULL;
+  int res = 0;
+  for(int k = top; k >= DT_MIPMAP_0; k--)
+  {
+    uint8_t *out = (uint8_t *)malloc((size_t)4 * cache->max_width[k] * cache->max_height[k]);
+    if(!out)
+    {
+      res = 1;
+      break;
+    }
+    uint32_t width, height;
+    dt_iop_flip_and_zoom_8(in, iw, ih, out, cache->max_width[k], cache->max_height[k], in_orientation, &width,
+                           &height);
+
+    snprintf(path, sizeof(path), "%s.d/%d", cache->cachedir, k);
+    if(!g_mkdir_with_parents(path, 0750))
+    {
+      // via a temporary file, the cache reads and deletes files it can't decode
+      char tmp[PATH_MAX] = { 0 };
+      snprintf(path, sizeof(path), "%s.d/%d/%u.jpg", cache->cachedir, k, imgid);
+      snprintf(tmp, sizeof(tmp), "%s.d/%d/%u.jpg.tmp", cache->cachedir, k, imgid);
+      if(!g_file_test(path, G_FILE_TEST_EXISTS))
+      {
+        // embedded previews are taken as srgb, like _init_8() does
+        if(!dt_imageio_jpeg_write(tmp, out, width, height, cache_quality, dt_mipmap_cache_exif_data_srgb,
+                                  dt_mipmap_cache_exif_data_srgb_length))
+          g_rename(tmp, path);
+        else
+          g_unlink(tmp);
+      }
+    }
+
+    free(prev);
+    prev = out;
+    in = out;
+    iw = width;
+    ih = height;
+    in_orientation = ORIENTATION_NONE;
+  }
+  free(prev);
+  free(rgba);
+  return res;
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
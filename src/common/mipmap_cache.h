@@ -68,6 +68,7 @@ typedef struct dt_mipmap_buffer_t
   float iscale;
   uint8_t *buf;
   dt_colorspaces_color_profile_type_t color_space;
+  gboolean half_float; // float pixels are stored as ieee half floats (uint16_t), see cache_mipf_half
   dt_cache_entry_t *cache_entry;
 } dt_mipmap_buffer_t;
 
@@ -93,11 +94,15 @@ typedef struct dt_mipmap_cache_t
   uint32_t max_width[DT_MIPMAP_NONE], max_height[DT_MIPMAP_NONE];
   // size of an element inside buf
   size_t buffer_size[DT_MIPMAP_NONE];
+  // mip_f keeps float images as half floats, to hold twice as many in the same memory
+  gboolean half_f;
 
   // one cache per mipmap level
   dt_mipmap_cache_one_t mip_thumbs;
   dt_mipmap_cache_one_t mip_f;
   dt_mipmap_cache_one_t mip_full;
+  // compressed copies of evicted mip_f buffers, NULL if cache_mipf_compressed is off
+  struct dt_mipmap_cache_compressed_t *compressed;
   char cachedir[PATH_MAX]; // cached sha1sum filename for faster access
 } dt_mipmap_cache_t;
 
@@ -141,6 +146,8 @@ void dt_mipmap_cache_release_with_caller(dt_mipmap_cache_t *cache, dt_mipmap_buf
 
 // remove thumbnails, so they will be regenerated:
 void dt_mipmap_cache_remove(dt_mipmap_cache_t *cache, const uint32_t imgid);
+// same for all images in a list of GINT_TO_POINTER(id)
+void dt_mipmap_cache_remove_list(dt_mipmap_cache_t *cache, const GList *imgs);
 
 // evict thumbnails from cache. They will be written to disc if not existing
 void dt_mimap_cache_evict(dt_mipmap_cache_t *cache, const uint32_t imgid);
@@ -163,6 +170,12 @@ dt_colorspaces_color_profile_type_t dt_mipmap_cache_get_colorspace();
 // only copies over the jpg backend on disk, doesn't directly affect the in-memory cache.
 void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid);
 
+// writes the jpg backend on disk for all sizes the embedded preview of a raw file covers, taking only the preview
+// out of the file. returns 0 if the thumbnails are there now. the caller has to make sure that the image is not
+// altered and that the embedded thumbnails are to be used at all.
+int dt_mipmap_cache_write_embedded_thumbnails(const dt_mipmap_cache_t *cache, const uint32_t imgid,
+                                              const char *filename, const dt_image_orientation_t orientation);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,248 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2017 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/sidecar_writer.h"
+#include "common/darktable.h"
+#include "common/dtpthread.h"
+#include "common/image.h"
+
+#include <time.h>
+
+// a queued image is written once it wasn't touched for this long ..
+#define DT_SIDECAR_WRITER_DELAY (500 * G_TIME_SPAN_MILLISECOND)
+// .. but not later than this after it got dirty first
+#define DT_SIDECAR_WRITER_MAX_DELAY (5 * G_TIME_SPAN_SECOND)
+#define DT_SIDECAR_WRITER_MAX_THREADS 4
+
+typedef struct dt_sidecar_writer_entry_t
+{
+  int imgid;
+  gint64 first, due; // monotonic time
+  GSequenceIter *iter;
+} dt_sidecar_writer_entry_t;
+
+typedef struct dt_sidecar_writer_t
+{
+  dt_pthread_mutex_t mutex;
+  pthread_cond_t work;  // something got queued or is due now
+  pthread_cond_t done;  // a write finished
+
+  GSequence *queue;     // dt_sidecar_writer_entry_t, the one due first at the front
+  GHashTable *dirty;    // imgid -> its entry in queue
+  GHashTable *running;  // imgids being written right now
+  gboolean flushing;    // write everything now, don't wait for due times
+  gboolean durable;     // fsync what gets written
+  gboolean quit;
+
+  int num_threads;
+  pthread_t *threads;
+} dt_sidecar_writer_t;
+
+static inline gint64 _sidecar_writer_due(const dt_sidecar_writer_entry_t *e)
+{
+  return MIN(e->due, e->first + DT_SIDECAR_WRITER_MAX_DELAY);
+}
+
+static gint _sidecar_writer_compare(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  const gint64 da = _sidecar_writer_due((const dt_sidecar_writer_entry_t *)a),
+               db = _sidecar_writer_due((const dt_sidecar_writer_entry_t *)b);
+  return (da > db) - (da < db);
+}
+
+static void _sidecar_writer_remove(dt_sidecar_writer_t *w, dt_sidecar_writer_entry_t *e)
+{
+  g_hash_table_remove(w->dirty, GINT_TO_POINTER(e->imgid));
+  g_sequence_remove(e->iter);
+}
+
+// picks the dirty image that is due first, which isn't being written at the moment. returns NULL if there is
+// none and sets *wakeup to the time the next one is due (or 0). only the images being written by other
+// threads are skipped, so this looks at a handful of entries at most.
+static dt_sidecar_writer_entry_t *_sidecar_writer_next(dt_sidecar_writer_t *w, gint64 now, gint64 *wakeup)
+{
+  *wakeup = 0;
+  for(GSequenceIter *iter = g_sequence_get_begin_iter(w->queue); !g_sequence_iter_is_end(iter);
+      iter = g_sequence_iter_next(iter))
+  {
+    dt_sidecar_writer_entry_t *e = (dt_sidecar_writer_entry_t *)g_sequence_get(iter);
+    if(g_hash_table_contains(w->running, GINT_TO_POINTER(e->imgid))) continue;
+    const gint64 due = _sidecar_writer_due(e);
+    if(w->flushing || due <= now) return e;
+    *wakeup = due;
+    break;
+  }
+  return NULL;
+}
+
+static void *_sidecar_writer_thread(void *data)
+{
+  dt_sidecar_writer_t *w = (dt_sidecar_writer_t *)data;
+  dt_pthread_mutex_lock(&w->mutex);
+  while(TRUE)
+  {
+    gint64 wakeup = 0;
+    dt_sidecar_writer_entry_t *e = _sidecar_writer_next(w, g_get_monotonic_time(), &wakeup);
+    if(e)
+    {
+      const int imgid = e->imgid;
+      _sidecar_writer_remove(w, e);
+      g_hash_table_add(w->running, GINT_TO_POINTER(imgid));
+      const gboolean durable = w->durable;
+      dt_pthread_mutex_unlock(&w->mutex);
+
+      dt_image_write_sidecar_file_direct(imgid, durable);
+
+      dt_pthread_mutex_lock(&w->mutex);
+      g_hash_table_remove(w->running, GINT_TO_POINTER(imgid));
+      pthread_cond_broadcast(&w->done);
+      continue;
+    }
+    if(w->quit && g_hash_table_size(w->dirty) == 0) break;
+
+    if(wakeup)
+    {
+      // the monotonic clock of glib and CLOCK_REALTIME of the condition variable don't share an epoch
+      const gint64 wait = wakeup - g_get_monotonic_time();
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      const gint64 ns = ts.tv_nsec + MAX(wait, 0) * 1000;
+      ts.tv_sec += ns / 1000000000;
+      ts.tv_nsec = ns % 1000000000;
+      dt_pthread_cond_timedwait(&w->work, &w->mutex, &ts);
+    }
+    else
+      dt_pthread_cond_wait(&w->work, &w->mutex);
+  }
+  dt_pthread_mutex_unlock(&w->mutex);
+  return NULL;
+}
+
+dt_sidecar_writer_t *dt_sidecar_writer_new()
+{
+  dt_sidecar_writer_t *w = (dt_sidecar_writer_t *)calloc(1, sizeof(dt_sidecar_writer_t));
+  dt_pthread_mutex_init(&w->mutex, NULL);
+  pthread_cond_init(&w->work, NULL);
+  pthread_cond_init(&w->done, NULL);
+  w->queue = g_sequence_new(free);
+  w->dirty = g_hash_table_new(g_direct_hash, g_direct_equal);
+  w->running = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+  // the writes are bound by file io (often on network storage) more than by the cpu, but a few in parallel
+  // are enough to hide the latency
+  w->num_threads = CLAMP(dt_get_num_threads(), 1, DT_SIDECAR_WRITER_MAX_THREADS);
+  w->threads = (pthread_t *)calloc(w->num_threads, sizeof(pthread_t));
+  for(int k = 0; k < w->num_threads; k++)
+  {
+    if(dt_pthread_create(&w->threads[k], _sidecar_writer_thread, w))
+    {
+      fprintf(stderr, "[sidecar_writer] could not start worker thread\n");
+      w->num_threads = k;
+      break;
+    }
+  }
+  dt_print(DT_DEBUG_PERF, "[sidecar_writer] writing sidecars with %d threads\n", w->num_threads);
+  return w;
+}
+
+void dt_sidecar_writer_free(dt_sidecar_writer_t *w)
+{
+  if(!w) return;
+
+  dt_pthread_mutex_lock(&w->mutex);
+  w->flushing = TRUE;
+  w->durable = TRUE;
+  w->quit = TRUE;
+  pthread_cond_broadcast(&w->work);
+  dt_pthread_mutex_unlock(&w->mutex);
+
+  for(int k = 0; k < w->num_threads; k++) pthread_join(w->threads[k], NULL);
+
+  // without workers there is nobody else to write what is left
+  for(GSequenceIter *iter = g_sequence_get_begin_iter(w->queue); !g_sequence_iter_is_end(iter);
+      iter = g_sequence_iter_next(iter))
+    dt_image_write_sidecar_file_direct(((dt_sidecar_writer_entry_t *)g_sequence_get(iter))->imgid, TRUE);
+
+  g_hash_table_destroy(w->dirty);
+  g_sequence_free(w->queue);
+  g_hash_table_destroy(w->running);
+  pthread_cond_destroy(&w->work);
+  pthread_cond_destroy(&w->done);
+  dt_pthread_mutex_destroy(&w->mutex);
+  free(w->threads);
+  free(w);
+}
+
+void dt_sidecar_writer_queue(dt_sidecar_writer_t *w, const int imgid)
+{
+  if(imgid <= 0) return;
+  if(!w || w->num_threads == 0)
+  {
+    dt_image_write_sidecar_file_direct(imgid, FALSE);
+    return;
+  }
+
+  const gint64 now = g_get_monotonic_time();
+  dt_pthread_mutex_lock(&w->mutex);
+  dt_sidecar_writer_entry_t *e
+      = (dt_sidecar_writer_entry_t *)g_hash_table_lookup(w->dirty, GINT_TO_POINTER(imgid));
+  if(!e)
+  {
+    e = (dt_sidecar_writer_entry_t *)malloc(sizeof(dt_sidecar_writer_entry_t));
+    e->imgid = imgid;
+    e->first = now;
+    e->due = now + DT_SIDECAR_WRITER_DELAY;
+    e->iter = g_sequence_insert_sorted(w->queue, e, _sidecar_writer_compare, NULL);
+    g_hash_table_insert(w->dirty, GINT_TO_POINTER(imgid), e);
+  }
+  else
+  {
+    e->due = now + DT_SIDECAR_WRITER_DELAY;
+    g_sequence_sort_changed(e->iter, _sidecar_writer_compare, NULL);
+  }
+  pthread_cond_signal(&w->work);
+  dt_pthread_mutex_unlock(&w->mutex);
+}
+
+void dt_sidecar_writer_flush(dt_sidecar_writer_t *w)
+{
+  if(!w || w->num_threads == 0) return;
+
+  dt_pthread_mutex_lock(&w->mutex);
+  w->flushing = TRUE;
+  pthread_cond_broadcast(&w->work);
+  while(g_hash_table_size(w->dirty) || g_hash_table_size(w->running)) dt_pthread_cond_wait(&w->done, &w->mutex);
+  w->flushing = FALSE;
+  dt_pthread_mutex_unlock(&w->mutex);
+}
+
+void dt_sidecar_writer_settle(dt_sidecar_writer_t *w, const int imgid)
+{
+  if(!w) return;
+
+  dt_pthread_mutex_lock(&w->mutex);
+  dt_sidecar_writer_entry_t *e
+      = (dt_sidecar_writer_entry_t *)g_hash_table_lookup(w->dirty, GINT_TO_POINTER(imgid));
+  if(e) _sidecar_writer_remove(w, e);
+  while(g_hash_table_contains(w->running, GINT_TO_POINTER(imgid))) dt_pthread_cond_wait(&w->done, &w->mutex);
+  dt_pthread_mutex_unlock(&w->mutex);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
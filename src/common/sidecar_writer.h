@@ -0,0 +1,43 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2017 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+
+/* writes xmp sidecar files in the background. an image that is queued several times within a short time
+ * (holding down a rating key, tagging one image after the other, ...) gets written only once, after it
+ * stayed untouched for a moment. */
+
+struct dt_sidecar_writer_t;
+
+/** starts the worker threads */
+struct dt_sidecar_writer_t *dt_sidecar_writer_new();
+/** writes everything that is still queued, makes sure it is on disk and stops the workers */
+void dt_sidecar_writer_free(struct dt_sidecar_writer_t *writer);
+
+/** marks the sidecar of imgid as dirty, it will be written soon */
+void dt_sidecar_writer_queue(struct dt_sidecar_writer_t *writer, const int imgid);
+/** writes everything that is queued right away and waits for it */
+void dt_sidecar_writer_flush(struct dt_sidecar_writer_t *writer);
+/** drops a queued write of imgid and waits for one that is running, for callers that write it themselves */
+void dt_sidecar_writer_settle(struct dt_sidecar_writer_t *writer, const int imgid);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
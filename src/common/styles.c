@@ -467,24 +467,17 @@ gboolean dt_styles_create_from_image(const char *name, const char *description,
   return FALSE;
 }
 
-void dt_styles_apply_to_selection(const char *name, gboolean duplicate)
+void dt_styles_create_from_selection()
 {
   gboolean selected = FALSE;
-
-  /* write current history changes so nothing gets lost, do that only in the darkroom as there is nothing to
-     be
-     save when in the lighttable (and it would write over current history stack) */
-  const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
-  if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
-
-  /* for each selected image apply style */
+  /* for each selected create style */
   sqlite3_stmt *stmt;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT imgid FROM main.selected_images",
                               -1, &stmt, NULL);
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
     int imgid = sqlite3_column_int(stmt, 0);
-    dt_styles_apply_to_image(name, duplicate, imgid);
+    dt_gui_styles_dialog_new(imgid);
     selected = TRUE;
   }
   sqlite3_finalize(stmt);
@@ -492,118 +485,187 @@ void dt_styles_apply_to_selection(const char *name, gboolean duplicate)
   if(!selected) dt_control_log(_("no image selected!"));
 }
 
-void dt_styles_create_from_selection()
+/* the tags every image a style is applied to gets */
+static void _styles_get_tags(const char *name, guint *tagid, guint *changed_tagid)
+{
+  gchar ntag[512] = { 0 };
+  g_snprintf(ntag, sizeof(ntag), "darktable|style|%s", name);
+  if(!dt_tag_new(ntag, tagid)) *tagid = 0;
+  if(!dt_tag_new("darktable|changed", changed_tagid)) *changed_tagid = 0;
+}
+
+/* the history part of applying style id to imgid, returns the image the style ended up on. tagging, writing the
+   sidecar and removing the thumbnails is left to the caller */
+static int32_t _styles_apply_to_image(int id, gboolean duplicate, int32_t imgid)
 {
-  gboolean selected = FALSE;
-  /* for each selected create style */
   sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT imgid FROM main.selected_images",
-                              -1, &stmt, NULL);
-  while(sqlite3_step(stmt) == SQLITE_ROW)
+  int32_t newimgid;
+
+  /* check if we should make a duplicate before applying style */
+  if(duplicate)
   {
-    int imgid = sqlite3_column_int(stmt, 0);
-    dt_gui_styles_dialog_new(imgid);
-    selected = TRUE;
+    newimgid = dt_image_duplicate(imgid);
+    if(newimgid != -1)
+      dt_history_copy_and_paste_on_image_deferred(imgid, newimgid, FALSE, NULL);
   }
+  else
+    newimgid = imgid;
+
+  /* merge onto history stack, let's find history offest in destination image */
+  /* first trim the stack to get rid of whatever is above the selected entry */
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "DELETE FROM main.history WHERE imgid = ?1 AND num >= (SELECT history_end "
+                              "FROM main.images WHERE id = imgid)", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newimgid);
+  sqlite3_step(stmt);
   sqlite3_finalize(stmt);
 
-  if(!selected) dt_control_log(_("no image selected!"));
+  /* in sqlite ROWID starts at 1, while our num column starts at 0 */
+  int32_t offs = -1;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT IFNULL(MAX(num), -1) FROM main.history WHERE imgid = ?1", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newimgid);
+  if(sqlite3_step(stmt) == SQLITE_ROW) offs = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+
+  /* delete all items from the temp styles_items, this table is used only to get a ROWNUM of the results */
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.style_items", NULL, NULL, NULL);
+
+  /* copy history items from styles onto temp table */
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "INSERT INTO memory.style_items SELECT * FROM "
+                                                             "data.style_items WHERE styleid=?1 ORDER BY "
+                                                             "multi_priority DESC",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+
+  /* copy the style items into the history */
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT INTO main.history "
+                              "(imgid,num,module,operation,op_params,enabled,blendop_params,blendop_"
+                              "version,multi_priority,multi_name) SELECT "
+                              "?1,?2+rowid,module,operation,op_params,enabled,blendop_params,blendop_"
+                              "version,multi_priority,multi_name FROM memory.style_items",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newimgid);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, offs);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+
+  /* always make the whole stack active */
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "UPDATE main.images SET history_end = (SELECT MAX(num) + 1 FROM main.history "
+                              "WHERE imgid = ?1) WHERE id = ?1",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newimgid);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+
+  /* if current image in develop reload history */
+  if(dt_dev_is_current_image(darktable.develop, newimgid))
+  {
+    dt_dev_reload_history_items(darktable.develop);
+    dt_dev_modulegroups_set(darktable.develop, dt_dev_modulegroups_get(darktable.develop));
+  }
+
+  return newimgid;
 }
 
 void dt_styles_apply_to_image(const char *name, gboolean duplicate, int32_t imgid)
 {
   int id = 0;
-  sqlite3_stmt *stmt;
-  int32_t newimgid;
 
   if((id = dt_styles_get_id_by_name(name)) != 0)
   {
-    /* check if we should make a duplicate before applying style */
-    if(duplicate)
-    {
-      newimgid = dt_image_duplicate(imgid);
-      if(newimgid != -1) dt_history_copy_and_paste_on_image(imgid, newimgid, FALSE, NULL);
-    }
-    else
-      newimgid = imgid;
+    guint tagid = 0, changed_tagid = 0;
+    _styles_get_tags(name, &tagid, &changed_tagid);
 
-    /* merge onto history stack, let's find history offest in destination image */
-    /* first trim the stack to get rid of whatever is above the selected entry */
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "DELETE FROM main.history WHERE imgid = ?1 AND num >= (SELECT history_end "
-                                "FROM main.images WHERE id = imgid)", -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newimgid);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    const int32_t newimgid = _styles_apply_to_image(id, duplicate, imgid);
 
-    /* in sqlite ROWID starts at 1, while our num column starts at 0 */
-    int32_t offs = -1;
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "SELECT IFNULL(MAX(num), -1) FROM main.history WHERE imgid = ?1", -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newimgid);
-    if(sqlite3_step(stmt) == SQLITE_ROW) offs = sqlite3_column_int(stmt, 0);
-    sqlite3_finalize(stmt);
+    /* add tag */
+    if(tagid) dt_tag_attach(tagid, newimgid);
+    if(changed_tagid) dt_tag_attach(changed_tagid, newimgid);
 
-    /* delete all items from the temp styles_items, this table is used only to get a ROWNUM of the results */
-    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.style_items", NULL, NULL, NULL);
+    /* update xmp file */
+    dt_image_synch_xmp(newimgid);
 
-    /* copy history items from styles onto temp table */
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "INSERT INTO memory.style_items SELECT * FROM "
-                                                               "data.style_items WHERE styleid=?1 ORDER BY "
-                                                               "multi_priority DESC",
-                                -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    /* remove old obsolete thumbnails */
+    dt_mipmap_cache_remove(darktable.mipmap_cache, newimgid);
 
-    /* copy the style items into the history */
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "INSERT INTO main.history "
-                                "(imgid,num,module,operation,op_params,enabled,blendop_params,blendop_"
-                                "version,multi_priority,multi_name) SELECT "
-                                "?1,?2+rowid,module,operation,op_params,enabled,blendop_params,blendop_"
-                                "version,multi_priority,multi_name FROM memory.style_items",
-                                -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newimgid);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, offs);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    /* if we have created a duplicate, reset collected images */
+    if(duplicate) dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED);
 
-    /* always make the whole stack active */
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "UPDATE main.images SET history_end = (SELECT MAX(num) + 1 FROM main.history "
-                                "WHERE imgid = ?1) WHERE id = ?1",
-                                -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newimgid);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    /* redraw center view to update visible mipmaps */
+    dt_control_queue_redraw_center();
+  }
+}
 
-    /* add tag */
-    guint tagid = 0;
-    gchar ntag[512] = { 0 };
-    g_snprintf(ntag, sizeof(ntag), "darktable|style|%s", name);
-    if(dt_tag_new(ntag, &tagid)) dt_tag_attach(tagid, newimgid);
-    if(dt_tag_new("darktable|changed", &tagid)) dt_tag_attach(tagid, newimgid);
-
-    /* if current image in develop reload history */
-    if(dt_dev_is_current_image(darktable.develop, newimgid))
+void dt_styles_apply_to_selection(const char *name, gboolean duplicate)
+{
+  gboolean selected = FALSE;
+  GList *changed = NULL;
+
+  /* write current history changes so nothing gets lost, do that only in the darkroom as there is nothing to
+     be
+     save when in the lighttable (and it would write over current history stack) */
+  const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
+  if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
+
+  const int id = dt_styles_get_id_by_name(name);
+  guint tagid = 0, changed_tagid = 0;
+  if(id != 0) _styles_get_tags(name, &tagid, &changed_tagid);
+
+  dt_image_cache_prefetch_selection(darktable.image_cache);
+
+  /* for each selected image apply style, all the database work in one go. sidecars and thumbnails are
+     done afterwards for all images at once */
+  dt_database_start_transaction(darktable.db);
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT imgid FROM main.selected_images",
+                              -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    int imgid = sqlite3_column_int(stmt, 0);
+    if(id != 0)
     {
-      dt_dev_reload_history_items(darktable.develop);
-      dt_dev_modulegroups_set(darktable.develop, dt_dev_modulegroups_get(darktable.develop));
+      // undo what was done for an image that couldn't be duplicated
+      dt_database_start_transaction(darktable.db);
+      const int32_t newimgid = _styles_apply_to_image(id, duplicate, imgid);
+      if(newimgid != -1)
+      {
+        dt_database_release_transaction(darktable.db);
+        changed = g_list_prepend(changed, GINT_TO_POINTER(newimgid));
+      }
+      else
+        dt_database_rollback_transaction(darktable.db);
     }
+    selected = TRUE;
+  }
+  sqlite3_finalize(stmt);
 
-    /* update xmp file */
-    dt_image_synch_xmp(newimgid);
+  /* add tags */
+  if(tagid) dt_tag_attach_images(tagid, changed);
+  if(changed_tagid) dt_tag_attach_images(changed_tagid, changed);
+  if(changed)
+    dt_database_release_transaction(darktable.db);
+  else
+    dt_database_rollback_transaction(darktable.db);
 
-    /* remove old obsolete thumbnails */
-    dt_mipmap_cache_remove(darktable.mipmap_cache, newimgid);
+  if(changed)
+  {
+    dt_image_write_sidecar_files(changed);
+    dt_mipmap_cache_remove_list(darktable.mipmap_cache, changed);
+    g_list_free(changed);
 
-    /* if we have created a duplicate, reset collected images */
+    /* if we have created duplicates, reset collected images */
     if(duplicate) dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED);
 
     /* redraw center view to update visible mipmaps */
     dt_control_queue_redraw_center();
   }
+
+  if(!selected) dt_control_log(_("no image selected!"));
 }
 
 void dt_styles_delete_by_name(const char *name)
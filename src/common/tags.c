@@ -119,7 +119,7 @@ gchar *dt_tag_get_name(const guint tagid)
   int rt;
   char *name = NULL;
   sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT name FROM data.tags WHERE id= ?1", -1, &stmt,
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db), "SELECT name FROM data.tags WHERE id= ?1", -1, &stmt,
                               NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, tagid);
   rt = sqlite3_step(stmt);
@@ -223,6 +223,28 @@ void dt_tag_attach(guint tagid, gint imgid)
   dt_collection_update_query(darktable.collection);
 }
 
+void dt_tag_attach_images(guint tagid, const GList *imgs)
+{
+  if(!imgs) return;
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT OR REPLACE INTO main.tagged_images (imgid, tagid) VALUES (?1, ?2)", -1,
+                              &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, tagid);
+  for(const GList *l = imgs; l; l = g_list_next(l))
+  {
+    if(GPOINTER_TO_INT(l->data) <= 0) continue;
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, GPOINTER_TO_INT(l->data));
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+  }
+  sqlite3_finalize(stmt);
+
+  dt_tag_update_used_tags();
+
+  dt_collection_update_query(darktable.collection);
+}
+
 void dt_tag_attach_list(GList *tags, gint imgid)
 {
   GList *child = NULL;
@@ -316,20 +338,20 @@ uint32_t dt_tag_get_attached(gint imgid, GList **result, gboolean ignore_dt_tags
                                    "JOIN data.tags T on T.id = I.tagid "
                                    "WHERE I.imgid = %d %s ORDER BY T.name",
              imgid, ignore_dt_tags ? "AND NOT T.name LIKE \"darktable|%\"" : "");
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db), query, -1, &stmt, NULL);
   }
   else
   {
     if(ignore_dt_tags)
       DT_DEBUG_SQLITE3_PREPARE_V2(
-          dt_database_get(darktable.db),
+          dt_database_get_reader(darktable.db),
           "SELECT DISTINCT T.id, T.name "
           "FROM main.tagged_images AS I, data.tags AS T "
           "WHERE I.imgid IN (SELECT imgid FROM main.selected_images) "
           "AND T.id = I.tagid AND NOT T.name LIKE \"darktable|%\" ORDER BY T.name",
           -1, &stmt, NULL);
     else
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db),
                                   "SELECT DISTINCT T.id, T.name "
                                   "FROM main.tagged_images AS I, data.tags AS T "
                                   "WHERE I.imgid IN (SELECT imgid FROM main.selected_images) "
@@ -426,14 +448,14 @@ GList *dt_tag_get_images_from_selection(gint imgid, gint tagid)
 
   if(imgid > 0)
   {
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT imgid FROM main.tagged_images WHERE "
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db), "SELECT imgid FROM main.tagged_images WHERE "
                                 "imgid = ?1 AND tagid = ?2", -1, &stmt, NULL);
     DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
     DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, tagid);
   }
   else
   {
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT imgid FROM main.tagged_images WHERE "
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get_reader(darktable.db), "SELECT imgid FROM main.tagged_images WHERE "
                                 "tagid = ?1 AND imgid IN (SELECT imgid FROM main.selected_images)", -1, &stmt,
                                 NULL);
     DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, tagid);
@@ -51,21 +51,44 @@ typedef struct dt_control_crawler_result_t
 } dt_control_crawler_result_t;
 
 
+// the names of all files in folder. reading the directory once per film roll is a lot cheaper than looking
+// for the sidecar, .txt and .wav of every image on their own, most of all on network shares.
+static GHashTable *_crawler_list_folder(const char *folder)
+{
+  GHashTable *entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  GDir *dir = g_dir_open(folder, 0, NULL);
+  if(!dir) return entries;
+  const gchar *name;
+  while((name = g_dir_read_name(dir)) != NULL) g_hash_table_add(entries, g_strdup(name));
+  g_dir_close(dir);
+  return entries;
+}
+
+static gboolean _crawler_has_file(GHashTable *entries, const char *path)
+{
+  gchar *name = g_path_get_basename(path);
+  const gboolean res = g_hash_table_contains(entries, name);
+  g_free(name);
+  return res;
+}
+
 GList *dt_control_crawler_run()
 {
   sqlite3_stmt *stmt, *inner_stmt;
   GList *result = NULL;
   gboolean look_for_xmp = dt_conf_get_bool("write_sidecar_files");
+  GHashTable *entries = NULL;
+  int entries_film_id = -1;
 
   sqlite3_prepare_v2(dt_database_get(darktable.db),
-                     "SELECT i.id, write_timestamp, version, folder || '/' || filename, flags "
+                     "SELECT i.id, write_timestamp, version, folder || '/' || filename, flags, f.id, folder "
                      "FROM main.images i, main.film_rolls f ON i.film_id = f.id ORDER BY f.id, filename",
                      -1, &stmt, NULL);
   sqlite3_prepare_v2(dt_database_get(darktable.db), "UPDATE main.images SET flags = ?1 WHERE id = ?2", -1,
                      &inner_stmt, NULL);
 
   // let's wrap this into a transaction, it might make it a little faster.
-  sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+  dt_database_start_transaction(darktable.db);
 
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
@@ -74,6 +97,14 @@ GList *dt_control_crawler_run()
     const int version = sqlite3_column_int(stmt, 2);
     gchar *image_path = (gchar *)sqlite3_column_text(stmt, 3);
     int flags = sqlite3_column_int(stmt, 4);
+    const int film_id = sqlite3_column_int(stmt, 5);
+
+    if(film_id != entries_film_id)
+    {
+      if(entries) g_hash_table_destroy(entries);
+      entries = _crawler_list_folder((const char *)sqlite3_column_text(stmt, 6));
+      entries_film_id = film_id;
+    }
 
     // no need to look for xmp files if none get written anyway.
     if(look_for_xmp)
@@ -91,7 +122,8 @@ GList *dt_control_crawler_run()
       xmp_path[len] = '\0';
 
       struct stat statbuf;
-      if(stat(xmp_path, &statbuf) == -1) continue; // TODO: shall we report these?
+      if(!_crawler_has_file(entries, xmp_path) || stat(xmp_path, &statbuf) == -1)
+        continue; // TODO: shall we report these?
 
       // step 1: check if the xmp is newer than our db entry
       // FIXME: allow for a few seconds difference?
@@ -124,27 +156,27 @@ GList *dt_control_crawler_run()
     extra_path[len] = 't';
     extra_path[len + 1] = 'x';
     extra_path[len + 2] = 't';
-    gboolean has_txt = g_file_test(extra_path, G_FILE_TEST_EXISTS);
+    gboolean has_txt = _crawler_has_file(entries, extra_path);
 
     if(!has_txt)
     {
       extra_path[len] = 'T';
       extra_path[len + 1] = 'X';
       extra_path[len + 2] = 'T';
-      has_txt = g_file_test(extra_path, G_FILE_TEST_EXISTS);
+      has_txt = _crawler_has_file(entries, extra_path);
     }
 
     extra_path[len] = 'w';
     extra_path[len + 1] = 'a';
     extra_path[len + 2] = 'v';
-    gboolean has_wav = g_file_test(extra_path, G_FILE_TEST_EXISTS);
+    gboolean has_wav = _crawler_has_file(entries, extra_path);
 
     if(!has_wav)
     {
       extra_path[len] = 'W';
       extra_path[len + 1] = 'A';
       extra_path[len + 2] = 'V';
-      has_wav = g_file_test(extra_path, G_FILE_TEST_EXISTS);
+      has_wav = _crawler_has_file(entries, extra_path);
     }
 
     // TODO: decide if we want to remove the flag for images that lost their extra file. currently we do (the
@@ -170,10 +202,11 @@ GList *dt_control_crawler_run()
     g_free(extra_path);
   }
 
-  sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+  dt_database_release_transaction(darktable.db);
 
   sqlite3_finalize(stmt);
   sqlite3_finalize(inner_stmt);
+  if(entries) g_hash_table_destroy(entries);
 
   return result;
 }
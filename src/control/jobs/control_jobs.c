@@ -26,12 +26,14 @@
 #include "common/history.h"
 #include "common/image.h"
 #include "common/image_cache.h"
+#include "common/image_readahead.h"
 #include "common/imageio.h"
 #include "common/imageio_dng.h"
 #include "common/imageio_module.h"
 #include "common/mipmap_cache.h"
 #include "common/tags.h"
 #include "control/conf.h"
+#include "develop/export_pool.h"
 #include "develop/imageop_math.h"
 
 #include "gui/gtk.h"
@@ -1210,6 +1212,8 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
   guint tagid = 0, etagid = 0;
   dt_tag_new("darktable|changed", &tagid);
   dt_tag_new("darktable|exported", &etagid);
+  dt_image_cache_prefetch_list(darktable.image_cache, t);
+  dt_dev_export_pool_begin(darktable.export_pool);
 
   while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
   {
@@ -1221,6 +1225,8 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
       t = g_list_delete_link(t, t);
       num = total - g_list_length(t);
     }
+    // have the next files read while this one is processed
+    dt_image_readahead_queue_list(darktable.image_readahead, job, t);
 
     // remove 'changed' tag from image
     dt_tag_detach(tagid, imgid);
@@ -1253,6 +1259,8 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
     dt_control_job_set_progress(job, fraction);
   }
   params->index = NULL;
+  dt_dev_export_pool_end(darktable.export_pool);
+  dt_image_readahead_queue(darktable.image_readahead, job, NULL, 0);
 
   if(mstorage->finalize_store) mstorage->finalize_store(mstorage, sdata);
 
@@ -17,9 +17,17 @@
 */
 #include "control/jobs/film_jobs.h"
 #include "common/darktable.h"
+#include "common/database.h"
+#include "common/exif.h"
 #include "common/film.h"
+#include "control/conf.h"
+#include "control/jobs/image_jobs.h"
+#include <sqlite3.h>
 #include <stdlib.h>
 
+// number of files whose metadata is parsed in parallel and then written to the database in one transaction
+#define DT_FILM_IMPORT_BATCH 64
+
 typedef struct dt_film_import1_t
 {
   dt_film_t *film;
@@ -133,6 +141,43 @@ int _film_filename_cmp(gchar *a, gchar *b)
   return ret;
 }
 
+/* drops the files that didn't change since they were imported, so importing a folder again only stats
+   most of them. files that are in the library already but changed are kept and added to *imported. */
+static GList *_film_import_skip_unchanged(GList *images, GHashTable *imported)
+{
+  GHashTable *folders = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                              (GDestroyNotify)g_hash_table_destroy);
+  guint skipped = 0;
+  GList *image = images;
+  while(image)
+  {
+    GList *next = g_list_next(image);
+    gchar *filename = (gchar *)image->data;
+    gchar *folder = g_path_get_dirname(filename);
+    GHashTable *known = g_hash_table_lookup(folders, folder);
+    if(!known)
+    {
+      known = dt_film_fingerprints_load(folder);
+      g_hash_table_insert(folders, folder, known);
+    }
+    else
+      g_free(folder);
+
+    if(dt_film_fingerprint_unchanged(known, filename))
+    {
+      images = g_list_delete_link(images, image);
+      g_free(filename);
+      skipped++;
+    }
+    else if(dt_film_fingerprint_known(known, filename))
+      g_hash_table_add(imported, filename);
+    image = next;
+  }
+  g_hash_table_destroy(folders);
+  dt_print(DT_DEBUG_CONTROL, "[film_import] skipping %u unchanged files\n", skipped);
+  return images;
+}
+
 static void dt_film_import1(dt_job_t *job, dt_film_t *film)
 {
   gboolean recursive = dt_conf_get_bool("ui_last/import_recursive");
@@ -192,6 +237,10 @@ static void dt_film_import1(dt_job_t *job, dt_film_t *film)
   /* we got ourself a list of images, lets sort and start import */
   images = g_list_sort(images, (GCompareFunc)_film_filename_cmp);
 
+  /* the files already in the library don't need their metadata parsed, they only get their sidecars synched */
+  GHashTable *imported = g_hash_table_new(g_str_hash, g_str_equal);
+  images = _film_import_skip_unchanged(images, imported);
+
   /* let's start import of images */
   gchar message[512] = { 0 };
   double fraction = 0;
@@ -200,12 +249,33 @@ static void dt_film_import1(dt_job_t *job, dt_film_t *film)
   dt_control_job_set_progress_message(job, message);
 
 
+  /* the expensive part of an import is opening and parsing the files with exiv2, which needs no database.
+     do that for a batch of files on all cores, then import the batch in order from this thread inside
+     one transaction. */
+  gchar **files = (gchar **)malloc(sizeof(gchar *) * total);
+  dt_exif_preread_t **pre = (dt_exif_preread_t **)calloc(DT_FILM_IMPORT_BATCH, sizeof(dt_exif_preread_t *));
+  guint k = 0;
+  for(GList *image = g_list_first(images); image; image = g_list_next(image)) files[k++] = image->data;
+
   /* loop thru the images and import to current film roll */
+  GList *new_imgs = NULL;
   dt_film_t *cfr = film;
-  GList *image = g_list_first(images);
-  do
+  for(guint i = 0; i < total; i++)
   {
-    gchar *cdn = g_path_get_dirname((const gchar *)image->data);
+    const guint b = i % DT_FILM_IMPORT_BATCH;
+    if(b == 0)
+    {
+      const int batch = MIN(DT_FILM_IMPORT_BATCH, total - i);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+      for(int j = 0; j < batch; j++)
+        pre[j] = g_hash_table_contains(imported, files[i + j]) ? NULL : dt_exif_preread(files[i + j]);
+
+      dt_database_start_transaction(darktable.db);
+    }
+
+    gchar *cdn = g_path_get_dirname(files[i]);
 
     /* check if we need to initialize a new filmroll */
     if(!cfr || g_strcmp0(cfr->dirname, cdn) != 0)
@@ -253,14 +323,31 @@ static void dt_film_import1(dt_job_t *job, dt_film_t *film)
     g_free(cdn);
 
     /* import image */
-    dt_image_import(cfr->id, (const gchar *)image->data, FALSE);
+    const uint32_t imgid = dt_image_import_preread(cfr->id, files[i], FALSE, pre[b]);
+    if(imgid) dt_film_fingerprint_store(cfr->id, files[i]);
+    if(imgid && !g_hash_table_contains(imported, files[i]))
+      new_imgs = g_list_prepend(new_imgs, GINT_TO_POINTER(imgid));
+    dt_exif_preread_free(pre[b]);
+    pre[b] = NULL;
+
+    if(b == DT_FILM_IMPORT_BATCH - 1 || i == total - 1)
+      dt_database_release_transaction(darktable.db);
 
     fraction += 1.0 / total;
     dt_control_job_set_progress(job, fraction);
+  }
 
+  free(pre);
+  free(files);
+  g_hash_table_destroy(imported);
 
-  } while((image = g_list_next(image)) != NULL);
-
+  /* the new images have no thumbnails yet, make them from the embedded previews before the lighttable asks */
+  if(new_imgs && dt_conf_get_bool("import_embedded_thumbnails"))
+  {
+    new_imgs = g_list_reverse(new_imgs);
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG, dt_image_thumbnails_job_create(new_imgs));
+  }
+  g_list_free(new_imgs);
   g_list_free_full(images, g_free);
 
   // only redraw at the end, to not spam the cpu with exposure events
@@ -19,6 +19,12 @@
 #include "control/jobs/image_jobs.h"
 #include "common/darktable.h"
 #include "common/image_cache.h"
+#include "control/conf.h"
+
+#include <strings.h>
+
+// images whose previews are extracted in parallel between two progress updates
+#define DT_IMAGE_THUMBNAILS_BATCH 32
 
 typedef struct dt_image_load_t
 {
@@ -108,6 +114,85 @@ dt_job_t *dt_image_import_job_create(uint32_t filmid, const char *filename)
   return job;
 }
 
+typedef struct dt_image_thumbnails_t
+{
+  uint32_t imgid;
+  char filename[PATH_MAX];
+  dt_image_orientation_t orientation;
+} dt_image_thumbnails_t;
+
+static int32_t dt_image_thumbnails_job_run(dt_job_t *job)
+{
+  GList *imgs = dt_control_job_get_params(job);
+  if(!darktable.mipmap_cache->cachedir[0] || !dt_conf_get_bool("cache_disk_backend")
+     || dt_conf_get_bool("never_use_embedded_thumb"))
+    return 0;
+
+  // all the database work first, the same checks _init_8() makes before it takes the embedded preview
+  const guint count = g_list_length(imgs);
+  dt_image_thumbnails_t *todo = (dt_image_thumbnails_t *)calloc(count, sizeof(dt_image_thumbnails_t));
+  int total = 0;
+  for(const GList *l = imgs; l; l = g_list_next(l))
+  {
+    const uint32_t imgid = GPOINTER_TO_INT(l->data);
+    if(dt_image_altered(imgid)) continue;
+    const dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+    if(!img) continue;
+    const gboolean incompatible = !strncmp(img->exif_maker, "Phase One", 9);
+    dt_image_cache_read_release(darktable.image_cache, img);
+    if(incompatible) continue;
+
+    dt_image_thumbnails_t *t = todo + total;
+    gboolean from_cache = FALSE;
+    dt_image_full_path(imgid, t->filename, sizeof(t->filename), &from_cache);
+    const char *ext = strrchr(t->filename, '.');
+    // plain jpegs are as quick to load on demand
+    if(!t->filename[0] || !ext || !strcasecmp(ext, ".jpg") || !strcasecmp(ext, ".jpeg")) continue;
+    t->imgid = imgid;
+    t->orientation = dt_image_get_orientation(imgid);
+    total++;
+  }
+
+  // then the files, on all cores
+  const double start = dt_get_wtime();
+  int written = 0;
+  for(int i = 0; i < total && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED;
+      i += DT_IMAGE_THUMBNAILS_BATCH)
+  {
+    const int batch = MIN(DT_IMAGE_THUMBNAILS_BATCH, total - i);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+ : written)
+#endif
+    for(int j = 0; j < batch; j++)
+    {
+      const dt_image_thumbnails_t *t = todo + i + j;
+      if(!dt_mipmap_cache_write_embedded_thumbnails(darktable.mipmap_cache, t->imgid, t->filename, t->orientation))
+        written++;
+    }
+    dt_control_job_set_progress(job, (double)(i + batch) / total);
+  }
+  dt_print(DT_DEBUG_PERF, "[image_thumbnails] thumbnails for %d of %d images in %.3f secs\n",
+           written, total, dt_get_wtime() - start);
+  free(todo);
+
+  if(written) dt_control_queue_redraw_center();
+  return 0;
+}
+
+static void dt_image_thumbnails_job_cleanup(void *p)
+{
+  g_list_free((GList *)p);
+}
+
+dt_job_t *dt_image_thumbnails_job_create(const GList *imgs)
+{
+  dt_job_t *job = dt_control_job_create(&dt_image_thumbnails_job_run, "thumbnails from embedded previews");
+  if(!job) return NULL;
+  dt_control_job_add_progress(job, _("creating thumbnails"), TRUE);
+  dt_control_job_set_params(job, g_list_copy((GList *)imgs), dt_image_thumbnails_job_cleanup);
+  return job;
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -27,6 +27,10 @@ dt_job_t *dt_image_load_job_create(int32_t imgid, dt_mipmap_size_t mip);
 
 dt_job_t *dt_image_import_job_create(uint32_t filmid, const char *filename);
 
+/** writes the disk cache thumbnails of the images from their embedded previews, for the ones it has any. the
+ * list holds GINT_TO_POINTER(imgid). */
+dt_job_t *dt_image_thumbnails_job_create(const GList *imgs);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -237,6 +237,7 @@ void dt_dev_process_preview_job(dt_develop_t *dev)
   }
   // init pixel pipeline for preview.
   dt_dev_pixelpipe_set_input(dev->preview_pipe, dev, (float *)buf.buf, buf.width, buf.height, buf.iscale);
+  dev->preview_pipe->input_half = buf.half_float;
 
   if(dev->preview_loading)
   {
@@ -505,6 +506,64 @@ void dt_dev_load_image(dt_develop_t *dev, const uint32_t imgid)
   dev->first_load = 0;
 }
 
+int dt_dev_rebind_image(dt_develop_t *dev, const uint32_t imgid)
+{
+  // the darkroom has its own way with the gui, and without modules there is nothing to reuse
+  if(dev->gui_attached || !dev->iop) return 1;
+
+  while(dev->history)
+  {
+    dt_dev_free_history_item(((dt_dev_history_item_t *)dev->history->data));
+    dev->history = g_list_delete_link(dev->history, dev->history);
+  }
+  dev->history_end = 0;
+
+  _dt_dev_load_raw(dev, imgid);
+  dev->image_status = dev->preview_status = DT_DEV_PIXELPIPE_DIRTY;
+  dev->first_load = 1;
+
+  // keep the base instance of every module (multi_priority 0, or the lowest one left if that got deleted) and
+  // take it back to the defaults of the new image. all other instances go, the history of the new image creates
+  // them again if it needs them.
+  GList *modules = dev->iop;
+  while(modules)
+  {
+    GList *next = g_list_next(modules);
+    dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+    gboolean base = TRUE, before = TRUE;
+    for(GList *m = dev->iop; m && base; m = g_list_next(m))
+    {
+      const dt_iop_module_t *mod = (dt_iop_module_t *)m->data;
+      if(mod == module)
+        before = FALSE;
+      else if(!strcmp(mod->op, module->op))
+        // on equal multi_priority the first one in the list stays
+        base = before ? mod->multi_priority > module->multi_priority
+                      : mod->multi_priority >= module->multi_priority;
+    }
+
+    if(base)
+    {
+      module->multi_priority = 0;
+      module->multi_name[0] = '\0';
+      dt_iop_reload_defaults(module);
+    }
+    else
+    {
+      dev->iop = g_list_delete_link(dev->iop, modules);
+      dt_iop_cleanup_module(module);
+      free(module);
+    }
+    modules = next;
+  }
+
+  dt_masks_read_forms(dev);
+  dt_dev_read_history(dev);
+
+  dev->first_load = 0;
+  return 0;
+}
+
 void dt_dev_configure(dt_develop_t *dev, int wd, int ht)
 {
   // fixed border on every side
@@ -949,7 +1008,7 @@ static void auto_apply_presets(dt_develop_t *dev)
                                     "UPDATE memory.history SET num=?1 WHERE rowid=?2", -1, &stmt, NULL);
 
         // let's wrap this into a transaction, it might make it a little faster.
-        sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+        dt_database_start_transaction(darktable.db);
         do
         {
           DT_DEBUG_SQLITE3_CLEAR_BINDINGS(stmt);
@@ -963,7 +1022,7 @@ static void auto_apply_presets(dt_develop_t *dev)
           r = g_list_next(r);
         } while((sqlite3_step(stmt) == SQLITE_DONE) && r);
 
-        sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+        dt_database_release_transaction(darktable.db);
 
         g_list_free(rowids);
         sqlite3_finalize(stmt);
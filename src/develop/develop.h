@@ -263,6 +263,10 @@ void dt_dev_process_preview(dt_develop_t *dev);
 
 void dt_dev_load_image(dt_develop_t *dev, const uint32_t imgid);
 void dt_dev_reload_image(dt_develop_t *dev, const uint32_t imgid);
+/** moves a develop without gui that already went through dt_dev_load_image() on to another image, reusing the
+ * loaded modules. returns non-zero if it can't, then it has to be cleaned up and loaded from scratch. the
+ * nodes of pipes created for the old image have to be cleaned up before. */
+int dt_dev_rebind_image(dt_develop_t *dev, const uint32_t imgid);
 /** checks if provided imgid is the image currently in develop */
 int dt_dev_is_current_image(dt_develop_t *dev, uint32_t imgid);
 void dt_dev_add_history_item(dt_develop_t *dev, struct dt_iop_module_t *module, gboolean enable);
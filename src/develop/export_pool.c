@@ -0,0 +1,151 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2017 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/export_pool.h"
+#include "common/darktable.h"
+#include "common/dtpthread.h"
+
+#include <stdlib.h>
+
+// idle contexts kept around. exports run one image after the other, a storage exporting more than one file
+// per image (like the gallery with its thumbnails) is the most that needs a second one.
+#define DT_DEV_EXPORT_POOL_SIZE 2
+
+typedef struct dt_dev_export_pool_t
+{
+  dt_pthread_mutex_t mutex;
+  int users;   // export jobs running
+  GList *idle; // dt_dev_export_context_t waiting for the next image
+} dt_dev_export_pool_t;
+
+static void _export_context_destroy(dt_dev_export_context_t *ctx)
+{
+  if(ctx->pipe_ready) dt_dev_pixelpipe_cleanup(&ctx->pipe);
+  dt_dev_cleanup(&ctx->dev);
+  free(ctx);
+}
+
+dt_dev_export_pool_t *dt_dev_export_pool_new()
+{
+  dt_dev_export_pool_t *pool = (dt_dev_export_pool_t *)calloc(1, sizeof(dt_dev_export_pool_t));
+  dt_pthread_mutex_init(&pool->mutex, NULL);
+  return pool;
+}
+
+void dt_dev_export_pool_free(dt_dev_export_pool_t *pool)
+{
+  if(!pool) return;
+  g_list_free_full(pool->idle, (GDestroyNotify)_export_context_destroy);
+  dt_pthread_mutex_destroy(&pool->mutex);
+  free(pool);
+}
+
+void dt_dev_export_pool_begin(dt_dev_export_pool_t *pool)
+{
+  dt_pthread_mutex_lock(&pool->mutex);
+  pool->users++;
+  dt_pthread_mutex_unlock(&pool->mutex);
+}
+
+void dt_dev_export_pool_end(dt_dev_export_pool_t *pool)
+{
+  GList *idle = NULL;
+  dt_pthread_mutex_lock(&pool->mutex);
+  if(--pool->users == 0)
+  {
+    // don't sit on full size buffers once nothing gets exported any more
+    idle = pool->idle;
+    pool->idle = NULL;
+  }
+  dt_pthread_mutex_unlock(&pool->mutex);
+  g_list_free_full(idle, (GDestroyNotify)_export_context_destroy);
+}
+
+dt_dev_export_context_t *dt_dev_export_pool_acquire(dt_dev_export_pool_t *pool)
+{
+  if(!pool) return NULL;
+  dt_dev_export_context_t *ctx = NULL;
+  dt_pthread_mutex_lock(&pool->mutex);
+  if(pool->users > 0)
+  {
+    if(pool->idle)
+    {
+      ctx = (dt_dev_export_context_t *)pool->idle->data;
+      pool->idle = g_list_delete_link(pool->idle, pool->idle);
+    }
+    else
+    {
+      ctx = (dt_dev_export_context_t *)calloc(1, sizeof(dt_dev_export_context_t));
+      dt_dev_init(&ctx->dev, 0);
+    }
+  }
+  dt_pthread_mutex_unlock(&pool->mutex);
+  return ctx;
+}
+
+void dt_dev_export_pool_release(dt_dev_export_pool_t *pool, dt_dev_export_context_t *ctx,
+                                const gboolean reusable)
+{
+  if(!ctx) return;
+  if(reusable)
+  {
+    // the nodes belong to the modules of this image
+    if(ctx->pipe_ready) dt_dev_pixelpipe_cleanup_nodes(&ctx->pipe);
+
+    dt_pthread_mutex_lock(&pool->mutex);
+    const gboolean keep = pool->users > 0 && g_list_length(pool->idle) < DT_DEV_EXPORT_POOL_SIZE;
+    if(keep) pool->idle = g_list_prepend(pool->idle, ctx);
+    dt_pthread_mutex_unlock(&pool->mutex);
+    if(keep) return;
+  }
+  _export_context_destroy(ctx);
+}
+
+void dt_dev_export_context_load_image(dt_dev_export_context_t *ctx, const uint32_t imgid)
+{
+  if(ctx->loaded && !dt_dev_rebind_image(&ctx->dev, imgid))
+  {
+    dt_print(DT_DEBUG_DEV, "[export_pool] reusing the modules for image %u\n", imgid);
+    return;
+  }
+
+  if(ctx->loaded)
+  {
+    dt_dev_cleanup(&ctx->dev);
+    dt_dev_init(&ctx->dev, 0);
+  }
+  dt_dev_load_image(&ctx->dev, imgid);
+  ctx->loaded = TRUE;
+}
+
+int dt_dev_export_context_init_pipe(dt_dev_export_context_t *ctx, int32_t width, int32_t height, int levels)
+{
+  if(ctx->pipe_ready)
+  {
+    // the cache lines grow on demand if this image is larger than the last one
+    dt_dev_pixelpipe_reset(&ctx->pipe);
+    ctx->pipe.levels = levels;
+    return 1;
+  }
+  ctx->pipe_ready = dt_dev_pixelpipe_init_export(&ctx->pipe, width, height, levels);
+  return ctx->pipe_ready;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,62 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2017 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "develop/develop.h"
+#include "develop/pixelpipe_hb.h"
+
+#include <glib.h>
+
+/* exporting an image needs a develop with all the modules loaded and an export pipe with two full size cache
+ * lines. while an export job is running, the ones of the previous image get handed on to the next image
+ * instead of being set up from scratch every time. */
+
+typedef struct dt_dev_export_context_t
+{
+  dt_develop_t dev;
+  dt_dev_pixelpipe_t pipe;
+  gboolean loaded;     // dev has been through dt_dev_load_image()
+  gboolean pipe_ready; // pipe has been initialized and owns its cache lines
+} dt_dev_export_context_t;
+
+struct dt_dev_export_pool_t;
+
+struct dt_dev_export_pool_t *dt_dev_export_pool_new();
+void dt_dev_export_pool_free(struct dt_dev_export_pool_t *pool);
+
+/** an export job starts. contexts are kept for reuse until the last running one ends. */
+void dt_dev_export_pool_begin(struct dt_dev_export_pool_t *pool);
+/** the export job is done, frees the idle contexts if it was the last one. */
+void dt_dev_export_pool_end(struct dt_dev_export_pool_t *pool);
+
+/** returns a context for exporting one image, NULL if no export job is running. */
+dt_dev_export_context_t *dt_dev_export_pool_acquire(struct dt_dev_export_pool_t *pool);
+/** hands the context back. if it's not reusable (something went wrong half way) it is destroyed. */
+void dt_dev_export_pool_release(struct dt_dev_export_pool_t *pool, dt_dev_export_context_t *ctx,
+                                const gboolean reusable);
+
+/** loads imgid into the develop of the context, rebinding the modules of the previous image if there was one. */
+void dt_dev_export_context_load_image(dt_dev_export_context_t *ctx, const uint32_t imgid);
+/** sets up the export pipe of the context for an image of the given size, same return value as
+ * dt_dev_pixelpipe_init_export(). */
+int dt_dev_export_context_init_pipe(dt_dev_export_context_t *ctx, int32_t width, int32_t height, int levels);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -93,6 +93,13 @@ static void dt_iop_modify_roi_out(struct dt_iop_module_t *self, struct dt_dev_pi
   *roi_out = *roi_in;
 }
 
+static int dt_iop_modify_roi_out_for_input(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                           const dt_iop_roi_t *roi_in, dt_iop_roi_t *roi_out)
+{
+  *roi_out = *roi_in;
+  return 1;
+}
+
 gint sort_plugins(gconstpointer a, gconstpointer b)
 {
   const dt_iop_module_t *am = (const dt_iop_module_t *)a;
@@ -313,6 +320,10 @@ int dt_iop_load_module_so(void *m, const char *libname, const char *op)
     module->modify_roi_in = dt_iop_modify_roi_in;
   if(!g_module_symbol(module->module, "modify_roi_out", (gpointer) & (module->modify_roi_out)))
     module->modify_roi_out = dt_iop_modify_roi_out;
+  if(!g_module_symbol(module->module, "modify_roi_out_for_input",
+                      (gpointer) & (module->modify_roi_out_for_input)))
+    module->modify_roi_out_for_input
+        = (module->modify_roi_in == dt_iop_modify_roi_in) ? dt_iop_modify_roi_out_for_input : NULL;
   if(!g_module_symbol(module->module, "legacy_params", (gpointer) & (module->legacy_params)))
     module->legacy_params = NULL;
 
@@ -421,6 +432,7 @@ static int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t
   module->distort_backtransform = so->distort_backtransform;
   module->modify_roi_in = so->modify_roi_in;
   module->modify_roi_out = so->modify_roi_out;
+  module->modify_roi_out_for_input = so->modify_roi_out_for_input;
   module->legacy_params = so->legacy_params;
 
   module->connect_key_accels = so->connect_key_accels;
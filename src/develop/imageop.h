@@ -91,7 +91,13 @@ typedef enum dt_iop_flags_t
   IOP_FLAGS_PREVIEW_NON_OPENCL
   = 1 << 8, // Preview pixelpipe of this module must not run on GPU but always on CPU
   IOP_FLAGS_NO_HISTORY_STACK = 1 << 9, // This iop will never show up in the history stack
-  IOP_FLAGS_NO_MASKS = 1 << 10         // The module doesn't support masks (used with SUPPORT_BLENDING)
+  IOP_FLAGS_NO_MASKS = 1 << 10,        // The module doesn't support masks (used with SUPPORT_BLENDING)
+  IOP_FLAGS_POINTWISE
+  = 1 << 11, // process() only maps each pixel to itself: roi_in == roi_out, no neighbourhood, no global stats.
+             // the pixelpipe may run it on row bands, fused with neighbouring point-wise modules.
+  IOP_FLAGS_TILING_CONCURRENT
+  = 1 << 12 // process() may run on several tiles of the same piece at once: it doesn't write to piece->data,
+            // pipe->dsc or any other shared state.
 } dt_iop_flags_t;
 
 /** status of a module*/
@@ -204,6 +210,8 @@ typedef struct dt_iop_module_so_t
                         const struct dt_iop_roi_t *roi_out, struct dt_iop_roi_t *roi_in);
   void (*modify_roi_out)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                          struct dt_iop_roi_t *roi_out, const struct dt_iop_roi_t *roi_in);
+  int (*modify_roi_out_for_input)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                  const struct dt_iop_roi_t *roi_in, struct dt_iop_roi_t *roi_out);
   int (*legacy_params)(struct dt_iop_module_t *self, const void *const old_params, const int old_version,
                        void *new_params, const int new_version);
 
@@ -396,6 +404,8 @@ typedef struct dt_iop_module_t
                         const struct dt_iop_roi_t *roi_out, struct dt_iop_roi_t *roi_in);
   void (*modify_roi_out)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                          struct dt_iop_roi_t *roi_out, const struct dt_iop_roi_t *roi_in);
+  int (*modify_roi_out_for_input)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                  const struct dt_iop_roi_t *roi_in, struct dt_iop_roi_t *roi_out);
   int (*legacy_params)(struct dt_iop_module_t *self, const void *const old_params, const int old_version,
                        void *new_params, const int new_version);
 
@@ -26,74 +26,208 @@
 #endif
 #include <glib.h> // for MIN, MAX, CLAMP, inline
 #include <math.h> // for round, floorf, fmaxf
+#include <string.h> // for memset
 #ifdef __SSE__
 #include <xmmintrin.h> // for _mm_set_ps, _mm_mul_ps, _mm_set...
 #endif
+#ifdef __F16C__
+#include <immintrin.h> // for _mm_cvtps_ph, _mm_cvtph_ps
+#endif
 #include "common/darktable.h"        // for darktable, darktable_t, dt_code...
 #include "common/imageio.h"          // for FILTERS_ARE_4BAYER
 #include "common/interpolation.h"    // for dt_interpolation_new, dt_interp...
 #include "develop/imageop.h"         // for dt_iop_roi_t
 
-void dt_iop_flip_and_zoom_8(const uint8_t *in, int32_t iw, int32_t ih, uint8_t *out, int32_t ow, int32_t oh,
-                            const dt_image_orientation_t orientation, uint32_t *width, uint32_t *height)
+// first and one past the last input pixel of box k, when n boxes cover len pixels. boxes don't get empty
+// when upscaling, they repeat the pixel instead.
+static inline int32_t _box_begin(const int32_t k, const int32_t len, const int32_t n)
 {
-  // init strides:
-  const uint32_t iwd = (orientation & ORIENTATION_SWAP_XY) ? ih : iw;
-  const uint32_t iht = (orientation & ORIENTATION_SWAP_XY) ? iw : ih;
-  // DO NOT UPSCALE !!!
-  const float scale = fmaxf(1.0, fmaxf(iwd / (float)ow, iht / (float)oh));
-  const uint32_t wd = *width = MIN(ow, iwd / scale);
-  const uint32_t ht = *height = MIN(oh, iht / scale);
-  const int bpp = 4; // bytes per pixel
-  int32_t ii = 0, jj = 0;
-  int32_t si = 1, sj = iw;
-  if(orientation & ORIENTATION_FLIP_X)
+  return ((int64_t)k * len) / n;
+}
+
+static inline int32_t _box_end(const int32_t k, const int32_t len, const int32_t n)
+{
+  return MAX(_box_begin(k, len, n) + 1, ((int64_t)(k + 1) * len) / n);
+}
+
+// the first input column of each of the n boxes over len columns, and len after them. computed once per call,
+// the divisions would otherwise take more time than the sums.
+static int32_t *_box_columns(const int32_t len, const int32_t n)
+{
+  int32_t *const columns = (int32_t *)malloc(sizeof(int32_t) * (n + 1));
+  if(!columns) return NULL;
+  for(int32_t k = 0; k <= n; k++) columns[k] = _box_begin(k, len, n);
+  return columns;
+}
+
+// where box (c, r) of the cw x ch boxes laid out on the input goes in the output after the orientation
+static inline uint8_t *_zoom_8_dest(uint8_t *const out, const int32_t out_stride, const int32_t cw,
+                                    const int32_t ch, const int32_t c, const int32_t r,
+                                    const dt_image_orientation_t orientation)
+{
+  const int32_t x = (orientation & ORIENTATION_FLIP_Y) ? cw - 1 - c : c;
+  const int32_t y = (orientation & ORIENTATION_FLIP_X) ? ch - 1 - r : r;
+  if(orientation & ORIENTATION_SWAP_XY) return out + (size_t)4 * ((size_t)out_stride * x + y);
+  return out + (size_t)4 * ((size_t)out_stride * y + x);
+}
+
+// averages the rw x rh rgba pixels at in (in_stride pixels per row) down to cw x ch boxes, every output pixel
+// is the mean of all the input pixels its box covers. each row of boxes first sums up the input rows it
+// covers into one row of counters, then the counters of every box, so the input is read exactly once.
+static void _zoom_8_plain(const uint8_t *const in, const int32_t in_stride, const int32_t rw, const int32_t rh,
+                          uint8_t *const out, const int32_t out_stride, const int32_t cw, const int32_t ch,
+                          const dt_image_orientation_t orientation)
+{
+  uint32_t *const acc_all = (uint32_t *)dt_alloc_align(64, sizeof(uint32_t) * 4 * rw * dt_get_num_threads());
+  int32_t *const columns = _box_columns(rw, cw);
+  if(!acc_all || !columns)
   {
-    jj = ih - jj - 1;
-    sj = -sj;
+    dt_free_align(acc_all);
+    free(columns);
+    return;
   }
-  if(orientation & ORIENTATION_FLIP_Y)
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) schedule(static)
+#endif
+  for(int32_t r = 0; r < ch; r++)
   {
-    ii = iw - ii - 1;
-    si = -si;
+    uint32_t *const acc = acc_all + (size_t)4 * rw * dt_get_thread_num();
+    const int32_t y0 = _box_begin(r, rh, ch), y1 = _box_end(r, rh, ch);
+
+    memset(acc, 0, sizeof(uint32_t) * 4 * rw);
+    for(int32_t y = y0; y < y1; y++)
+    {
+      const uint8_t *const row = in + (size_t)4 * in_stride * y;
+      for(int32_t k = 0; k < 4 * rw; k++) acc[k] += row[k];
+    }
+
+    for(int32_t c = 0; c < cw; c++)
+    {
+      const int32_t x0 = columns[c], x1 = MAX(x0 + 1, columns[c + 1]);
+      uint32_t sum[4] = { 0, 0, 0, 0 };
+      for(int32_t x = x0; x < x1; x++)
+        for(int k = 0; k < 4; k++) sum[k] += acc[4 * x + k];
+
+      const uint32_t n = (uint32_t)(x1 - x0) * (y1 - y0);
+      uint8_t *const o = _zoom_8_dest(out, out_stride, cw, ch, c, r, orientation);
+      for(int k = 0; k < 4; k++) o[k] = (sum[k] + n / 2) / n;
+    }
   }
-  if(orientation & ORIENTATION_SWAP_XY)
+
+  free(columns);
+  dt_free_align(acc_all);
+}
+
+#if defined(__SSE__)
+static void _zoom_8_sse2(const uint8_t *const in, const int32_t in_stride, const int32_t rw, const int32_t rh,
+                         uint8_t *const out, const int32_t out_stride, const int32_t cw, const int32_t ch,
+                         const dt_image_orientation_t orientation)
+{
+  // one pixel per __m128i, 16 byte aligned for every thread since a pixel takes 16 bytes
+  uint32_t *const acc_all = (uint32_t *)dt_alloc_align(64, sizeof(uint32_t) * 4 * rw * dt_get_num_threads());
+  int32_t *const columns = _box_columns(rw, cw);
+  if(!acc_all || !columns)
   {
-    int t = sj;
-    sj = si;
-    si = t;
+    dt_free_align(acc_all);
+    free(columns);
+    return;
   }
-  const int32_t half_pixel = .5f * scale;
-  const int32_t offm = half_pixel * bpp * MIN(MIN(0, si), MIN(sj, si + sj));
-  const int32_t offM = half_pixel * bpp * MAX(MAX(0, si), MAX(sj, si + sj));
+
 #ifdef _OPENMP
-#pragma omp parallel for schedule(static) default(none) shared(in, out, jj, ii, sj, si, iw, ih)
+#pragma omp parallel for default(none) schedule(static)
 #endif
-  for(uint32_t j = 0; j < ht; j++)
+  for(int32_t r = 0; r < ch; r++)
   {
-    uint8_t *out2 = out + bpp * wd * j;
-    const uint8_t *in2 = in + bpp * (iw * jj + ii + sj * (int32_t)(scale * j));
-    float stepi = 0.0f;
-    for(uint32_t i = 0; i < wd; i++)
+    uint32_t *const acc = acc_all + (size_t)4 * rw * dt_get_thread_num();
+    const int32_t y0 = _box_begin(r, rh, ch), y1 = _box_end(r, rh, ch);
+    const __m128i zero = _mm_setzero_si128();
+
+    // the rows of the box summed up four pixels at a time, in 16 bit in registers. those hold 257 rows of 8
+    // bits, more than that (scaling down by more than 257) goes in batches.
+    int32_t x = 0;
+    for(; x + 4 <= rw; x += 4)
     {
-      const uint8_t *in3 = in2 + ((int32_t)stepi) * si * bpp;
-      // this should always be within the bounds of in[], due to the way
-      // wd/ht are constructed by always just rounding down. half_pixel should never
-      // add up to one pixel difference.
-      // we have this check with the hope the branch predictor will get rid of it:
-      if(in3 + offm >= in && in3 + offM < in + bpp * iw * ih)
+      __m128i a0 = zero, a1 = zero, a2 = zero, a3 = zero;
+      for(int32_t yb = y0; yb < y1; yb += 257)
       {
-        for(int k = 0; k < 3; k++)
-          out2[k] = // in3[k];
-              CLAMP(((int32_t)in3[bpp * half_pixel * sj + k] + (int32_t)in3[bpp * half_pixel * (si + sj) + k]
-                     + (int32_t)in3[bpp * half_pixel * si + k] + (int32_t)in3[k])
-                        / 4,
-                    0, 255);
+        const int32_t ye = MIN(y1, yb + 257);
+        const uint8_t *p = in + (size_t)4 * ((size_t)in_stride * yb + x);
+        __m128i lo = zero, hi = zero;
+        for(int32_t y = yb; y < ye; y++, p += (size_t)4 * in_stride)
+        {
+          const __m128i v = _mm_loadu_si128((const __m128i *)p);
+          lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+          hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+        }
+        a0 = _mm_add_epi32(a0, _mm_unpacklo_epi16(lo, zero));
+        a1 = _mm_add_epi32(a1, _mm_unpackhi_epi16(lo, zero));
+        a2 = _mm_add_epi32(a2, _mm_unpacklo_epi16(hi, zero));
+        a3 = _mm_add_epi32(a3, _mm_unpackhi_epi16(hi, zero));
       }
-      out2 += bpp;
-      stepi += scale;
+      __m128i *const a = (__m128i *)(acc + 4 * x);
+      a[0] = a0;
+      a[1] = a1;
+      a[2] = a2;
+      a[3] = a3;
+    }
+    for(int32_t k = 4 * x; k < 4 * rw; k++)
+    {
+      acc[k] = 0;
+      for(int32_t y = y0; y < y1; y++) acc[k] += in[(size_t)4 * in_stride * y + k];
+    }
+
+    for(int32_t c = 0; c < cw; c++)
+    {
+      const int32_t x0 = columns[c], x1 = MAX(x0 + 1, columns[c + 1]);
+      __m128i sum = _mm_setzero_si128();
+      for(int32_t x = x0; x < x1; x++) sum = _mm_add_epi32(sum, _mm_load_si128((const __m128i *)(acc + 4 * x)));
+
+      // divided in integers to round exactly like the plain path, a float reciprocal is off by one at times
+      const uint32_t n = (uint32_t)(x1 - x0) * (y1 - y0);
+      uint32_t s[4] __attribute__((aligned(16)));
+      _mm_store_si128((__m128i *)s, sum);
+      uint8_t *const o = _zoom_8_dest(out, out_stride, cw, ch, c, r, orientation);
+      for(int k = 0; k < 4; k++) o[k] = (s[k] + n / 2) / n;
     }
   }
+
+  free(columns);
+  dt_free_align(acc_all);
+}
+#endif
+
+static void _zoom_8(const uint8_t *const in, const int32_t in_stride, const int32_t rw, const int32_t rh,
+                    uint8_t *const out, const int32_t out_stride, const int32_t cw, const int32_t ch,
+                    const dt_image_orientation_t orientation)
+{
+  if(darktable.codepath.OPENMP_SIMD)
+    return _zoom_8_plain(in, in_stride, rw, rh, out, out_stride, cw, ch, orientation);
+#if defined(__SSE__)
+  else if(darktable.codepath.SSE2)
+    return _zoom_8_sse2(in, in_stride, rw, rh, out, out_stride, cw, ch, orientation);
+#endif
+  else
+    dt_unreachable_codepath();
+}
+
+void dt_iop_flip_and_zoom_8(const uint8_t *in, int32_t iw, int32_t ih, uint8_t *out, int32_t ow, int32_t oh,
+                            const dt_image_orientation_t orientation, uint32_t *width, uint32_t *height)
+{
+  // init strides:
+  const uint32_t iwd = (orientation & ORIENTATION_SWAP_XY) ? ih : iw;
+  const uint32_t iht = (orientation & ORIENTATION_SWAP_XY) ? iw : ih;
+  // DO NOT UPSCALE !!!
+  const float scale = fmaxf(1.0, fmaxf(iwd / (float)ow, iht / (float)oh));
+  const uint32_t wd = *width = MIN(ow, iwd / scale);
+  const uint32_t ht = *height = MIN(oh, iht / scale);
+  if(!wd || !ht) return;
+
+  // the boxes are laid out on the input, the orientation only changes where they are written to
+  if(orientation & ORIENTATION_SWAP_XY)
+    _zoom_8(in, iw, iw, ih, out, wd, ht, wd, orientation);
+  else
+    _zoom_8(in, iw, iw, ih, out, wd, wd, ht, orientation);
 }
 
 void dt_iop_clip_and_zoom_8(const uint8_t *i, int32_t ix, int32_t iy, int32_t iw, int32_t ih, int32_t ibw,
@@ -113,26 +247,13 @@ void dt_iop_clip_and_zoom_8(const uint8_t *i, int32_t ix, int32_t iy, int32_t iw
   assert(ox2 + ow2 <= obw);
   assert(oy2 + oh2 <= obh);
   assert(ix2 >= 0 && iy2 >= 0 && ox2 >= 0 && oy2 >= 0);
-  float x = ix2, y = iy2;
-  for(int s = 0; s < oh2; s++)
-  {
-    int idx = ox2 + obw * (oy2 + s);
-    for(int t = 0; t < ow2; t++)
-    {
-      for(int k = 0; k < 3; k++)
-        o[4 * idx + k] = // i[3*(ibw* (int)y +             (int)x             ) + k)];
-            CLAMP(((int32_t)i[(4 * (ibw * (int32_t)y + (int32_t)(x + .5f * scalex)) + k)]
-                   + (int32_t)i[(4 * (ibw * (int32_t)(y + .5f * scaley) + (int32_t)(x + .5f * scalex)) + k)]
-                   + (int32_t)i[(4 * (ibw * (int32_t)(y + .5f * scaley) + (int32_t)(x)) + k)]
-                   + (int32_t)i[(4 * (ibw * (int32_t)y + (int32_t)(x)) + k)])
-                      / 4,
-                  0, 255);
-      x += scalex;
-      idx++;
-    }
-    y += scaley;
-    x = ix2;
-  }
+  if(ow2 <= 0 || oh2 <= 0) return;
+
+  // the part of the input the clipped output covers
+  const int32_t rw = MIN(ibw - ix2, MAX(1, (int32_t)(ow2 * scalex + .5f)));
+  const int32_t rh = MIN(ibh - iy2, MAX(1, (int32_t)(oh2 * scaley + .5f)));
+  _zoom_8(i + (size_t)4 * ((size_t)ibw * iy2 + ix2), ibw, rw, rh, o + (size_t)4 * ((size_t)obw * oy2 + ox2), obw,
+          ow2, oh2, ORIENTATION_NONE);
 }
 
 // apply clip and zoom on parts of a supplied full image.
@@ -1743,6 +1864,74 @@ void dt_iop_clip_and_zoom_demosaic_third_size_xtrans_f(float *out, const float *
   }
 }
 
+static inline uint16_t _float_to_half(const float f)
+{
+  union { float f; uint32_t u; } v = { f };
+  const uint32_t sign = v.u & 0x80000000u;
+  v.u ^= sign;
+  uint16_t h;
+  if(v.u >= (143u << 23))
+  {
+    // too large for a half, or inf/nan already
+    h = (v.u > (255u << 23)) ? 0x7e00u : 0x7c00u;
+  }
+  else if(v.u < (113u << 23))
+  {
+    // denormal half: let the fpu do the shifting and rounding
+    const union { uint32_t u; float f; } denorm = { 126u << 23 };
+    v.f += denorm.f;
+    h = v.u - denorm.u;
+  }
+  else
+  {
+    // rebias the exponent and round the mantissa to nearest even
+    const uint32_t odd = (v.u >> 13) & 1u;
+    v.u += ((uint32_t)(15 - 127) << 23) + 0xfffu + odd;
+    h = v.u >> 13;
+  }
+  return h | (sign >> 16);
+}
+
+static inline float _half_to_float(const uint16_t h)
+{
+  const union { uint32_t u; float f; } magic = { 113u << 23 };
+  union { uint32_t u; float f; } o = { (uint32_t)(h & 0x7fffu) << 13 };
+  const uint32_t exp = o.u & (0x7c00u << 13);
+  o.u += (127u - 15u) << 23;
+  if(exp == (0x7c00u << 13))
+  {
+    // inf/nan
+    o.u += (128u - 16u) << 23;
+  }
+  else if(exp == 0)
+  {
+    // zero/denormal
+    o.u += 1u << 23;
+    o.f -= magic.f;
+  }
+  o.u |= (uint32_t)(h & 0x8000u) << 16;
+  return o.f;
+}
+
+void dt_iop_image_float_to_half(uint16_t *const out, const float *const in, const size_t n)
+{
+  size_t k = 0;
+#ifdef __F16C__
+  for(; k + 4 <= n; k += 4)
+    _mm_storel_epi64((__m128i *)(out + k), _mm_cvtps_ph(_mm_loadu_ps(in + k), _MM_FROUND_TO_NEAREST_INT));
+#endif
+  for(; k < n; k++) out[k] = _float_to_half(in[k]);
+}
+
+void dt_iop_image_half_to_float(float *const out, const uint16_t *const in, const size_t n)
+{
+  size_t k = 0;
+#ifdef __F16C__
+  for(; k + 4 <= n; k += 4) _mm_storeu_ps(out + k, _mm_cvtph_ps(_mm_loadl_epi64((const __m128i *)(in + k))));
+#endif
+  for(; k < n; k++) out[k] = _half_to_float(in[k]);
+}
+
 void dt_iop_RGB_to_YCbCr(const float *rgb, float *yuv)
 {
   yuv[0] = 0.299 * rgb[0] + 0.587 * rgb[1] + 0.114 * rgb[2];
@@ -29,7 +29,8 @@
 #include <stddef.h>          // for size_t, NULL
 #include <stdint.h>          // for uint8_t, uint16_t, uint32_t
 
-/** flip according to orientation bits, also zoom to given size. */
+/** flip according to orientation bits, also zoom to given size. every output pixel is the mean of the input
+ * pixels it covers. */
 void dt_iop_flip_and_zoom_8(const uint8_t *in, int32_t iw, int32_t ih, uint8_t *out, int32_t ow, int32_t oh,
                             const dt_image_orientation_t orientation, uint32_t *width, uint32_t *height);
 
@@ -91,11 +92,16 @@ void dt_iop_clip_and_zoom_demosaic_third_size_xtrans_f(float *out, const float *
                                                        const int32_t out_stride, const int32_t in_stride,
                                                        const uint8_t (*const xtrans)[6]);
 
-/** as dt_iop_clip_and_zoom, but for rgba 8-bit channels. */
+/** as dt_iop_clip_and_zoom, but for rgba 8-bit channels, averaging the input pixels of every output pixel. */
 void dt_iop_clip_and_zoom_8(const uint8_t *i, int32_t ix, int32_t iy, int32_t iw, int32_t ih, int32_t ibw,
                             int32_t ibh, uint8_t *o, int32_t ox, int32_t oy, int32_t ow, int32_t oh,
                             int32_t obw, int32_t obh);
 
+/** converts n floats to ieee half floats (rounded to nearest even) and back, as stored in the half float
+ * mip_f buffers. uses the f16c instructions if the build targets them. */
+void dt_iop_image_float_to_half(uint16_t *const out, const float *const in, const size_t n);
+void dt_iop_image_half_to_float(float *const out, const uint16_t *const in, const size_t n);
+
 void dt_iop_YCbCr_to_RGB(const float *yuv, float *rgb);
 void dt_iop_RGB_to_YCbCr(const float *rgb, float *yuv);
 
@@ -144,6 +144,8 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->shutdown = 0;
   pipe->opencl_error = 0;
   pipe->tiling = 0;
+  pipe->tiling_roi_fits = pipe->tiling_roi_fits_direct = pipe->tiling_roi_fits_simplex = 0;
+  pipe->tiling_roi_fit_time = 0.0;
   pipe->mask_display = DT_DEV_PIXELPIPE_DISPLAY_NONE;
   pipe->input_timestamp = 0;
   pipe->levels = IMAGEIO_RGB | IMAGEIO_INT8;
@@ -152,6 +154,26 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   return 1;
 }
 
+void dt_dev_pixelpipe_reset(dt_dev_pixelpipe_t *pipe)
+{
+  g_assert(pipe->nodes == NULL);
+  dt_dev_pixelpipe_cache_flush(&(pipe->cache));
+  pipe->devid = -1;
+  pipe->changed = DT_DEV_PIPE_UNCHANGED;
+  pipe->processed_width = pipe->backbuf_width = pipe->iwidth = 0;
+  pipe->processed_height = pipe->backbuf_height = pipe->iheight = 0;
+  pipe->cache_obsolete = 0;
+  pipe->backbuf = NULL;
+  pipe->processing = 0;
+  pipe->shutdown = 0;
+  pipe->opencl_error = 0;
+  pipe->tiling = 0;
+  pipe->tiling_roi_fits = pipe->tiling_roi_fits_direct = pipe->tiling_roi_fits_simplex = 0;
+  pipe->tiling_roi_fit_time = 0.0;
+  pipe->mask_display = DT_DEV_PIXELPIPE_DISPLAY_NONE;
+  pipe->input_timestamp = 0;
+}
+
 void dt_dev_pixelpipe_set_input(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, float *input, int width, int height,
                                 float iscale)
 {
@@ -159,6 +181,7 @@ void dt_dev_pixelpipe_set_input(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, flo
   pipe->iheight = height;
   pipe->iscale = iscale;
   pipe->input = input;
+  pipe->input_half = FALSE;
   pipe->image = dev->image_storage;
   get_output_format(NULL, pipe, NULL, dev, &pipe->dsc);
 }
@@ -560,6 +583,195 @@ error:
 #endif
 
 
+// bytes of one row band per thread when running point-wise modules fused
+#define DT_DEV_PIXELPIPE_FUSED_BAND_BYTES (256 * 1024)
+
+static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
+                                        void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
+                                        const dt_iop_roi_t *roi_out, GList *modules, GList *pieces, int pos);
+
+static int _pixelpipe_piece_skipped(dt_develop_t *dev, dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece)
+{
+  return !piece->enabled
+         || (dev->gui_module && dev->gui_module->operation_tags_filter() & module->operation_tags());
+}
+
+// can this piece run on row bands of its input, together with its point-wise neighbours?
+static int _pixelpipe_piece_fusable(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, dt_iop_module_t *module,
+                                    dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *roi_out)
+{
+  if(!(module->flags() & IOP_FLAGS_POINTWISE)) return 0;
+
+  // the focussed module keeps its input in the cache and may pick colors
+  if(dev->gui_attached && module == dev->gui_module) return 0;
+
+  // histograms and blending need the full input/output buffers of the module
+  if(piece->request_histogram & DT_REQUEST_ON) return 0;
+  const dt_develop_blend_params_t *const d = (dt_develop_blend_params_t *)piece->blendop_data;
+  if(d && (d->mask_mode & DEVELOP_MASK_ENABLED)) return 0;
+
+  dt_iop_roi_t roi_in = *roi_out;
+  module->modify_roi_in(module, piece, roi_out, &roi_in);
+  return !memcmp(&roi_in, roi_out, sizeof(dt_iop_roi_t));
+}
+
+/* find the group of consecutive point-wise modules ending with the one in modules/pieces. returns the
+ * number of modules in the group and the list nodes and position of the first one. */
+static int _pixelpipe_fused_group(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const dt_iop_roi_t *roi_out,
+                                  GList *modules, GList *pieces, int pos, GList **first_module,
+                                  GList **first_piece, int *first_pos)
+{
+  if(pipe->mask_display || (darktable.unmuted & DT_DEBUG_NAN)) return 1;
+#ifdef HAVE_OPENCL
+  // buffers stay on the device there, nothing to gain
+  if(dt_opencl_is_inited() && pipe->opencl_enabled && pipe->devid >= 0) return 1;
+#endif
+
+  dt_pthread_mutex_lock(&pipe->busy_mutex);
+  int count = 0;
+  while(modules)
+  {
+    dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
+    if(count == 0 || !_pixelpipe_piece_skipped(dev, module, piece))
+    {
+      if(!_pixelpipe_piece_fusable(pipe, dev, module, piece, roi_out)) break;
+      // an intermediate result which is still cached is a better starting point
+      if(count > 0
+         && dt_dev_pixelpipe_cache_available(&(pipe->cache),
+                                             dt_dev_pixelpipe_cache_hash(pipe->image.id, roi_out, pipe, pos)))
+        break;
+      *first_module = modules;
+      *first_piece = pieces;
+      *first_pos = pos;
+      count++;
+    }
+    modules = g_list_previous(modules);
+    pieces = g_list_previous(pieces);
+    pos--;
+  }
+  dt_pthread_mutex_unlock(&pipe->busy_mutex);
+  return count;
+}
+
+/* run a group of point-wise modules found by _pixelpipe_fused_group() over row bands small enough to
+ * stay in the caches, from the input of the first module straight into the output of the last one.
+ * only the output of the last module is stored in the pixelpipe cache. */
+static int _pixelpipe_process_fused(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
+                                    dt_iop_buffer_dsc_t **out_format, const dt_iop_roi_t *roi_out,
+                                    GList *modules, GList *first_module, GList *first_piece, int first_pos,
+                                    const int count, const uint64_t hash, const size_t bufsize)
+{
+  void *input = NULL;
+  void *cl_mem_input = NULL;
+  dt_iop_buffer_dsc_t _input_format = { 0 };
+  dt_iop_buffer_dsc_t *input_format = &_input_format;
+
+  if(dt_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &input_format, roi_out,
+                                  g_list_previous(first_module), g_list_previous(first_piece), first_pos - 1))
+    return 1;
+
+  dt_iop_module_t *group[count];
+  dt_dev_pixelpipe_iop_t *group_pieces[count];
+  dt_iop_buffer_dsc_t group_dsc[count];
+  size_t group_bpp[count + 1];
+  int n = 0;
+  for(GList *m = first_module, *p = first_piece; n < count; m = g_list_next(m), p = g_list_next(p))
+  {
+    if(m != modules && _pixelpipe_piece_skipped(dev, (dt_iop_module_t *)m->data, (dt_dev_pixelpipe_iop_t *)p->data))
+      continue;
+    group[n] = (dt_iop_module_t *)m->data;
+    group_pieces[n] = (dt_dev_pixelpipe_iop_t *)p->data;
+    n++;
+  }
+
+  dt_pthread_mutex_lock(&pipe->busy_mutex);
+  if(pipe->shutdown)
+  {
+    dt_pthread_mutex_unlock(&pipe->busy_mutex);
+    return 1;
+  }
+
+  (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format);
+
+  dt_times_t start;
+  dt_get_times(&start);
+
+  const int width = roi_out->width;
+  const int band = CLAMPS((int)(DT_DEV_PIXELPIPE_FUSED_BAND_BYTES * dt_get_num_threads()
+                                / (4 * sizeof(float) * width)),
+                          1, roi_out->height);
+  // point-wise modules keep the buffer layout, a band is never larger than a band of 4 floats per pixel.
+  void *buf[2] = { dt_alloc_align(64, 4 * sizeof(float) * width * band),
+                   dt_alloc_align(64, 4 * sizeof(float) * width * band) };
+  if(!buf[0] || !buf[1])
+  {
+    dt_print(DT_DEBUG_MEMORY, "[dev_pixelpipe] couldn't allocate band buffers for fused modules\n");
+    dt_free_align(buf[0]);
+    dt_free_align(buf[1]);
+    dt_pthread_mutex_unlock(&pipe->busy_mutex);
+    return 1;
+  }
+
+  group_bpp[0] = dt_iop_buffer_dsc_to_bpp(input_format);
+  for(int row = 0; row < roi_out->height; row += band)
+  {
+    if(pipe->shutdown)
+    {
+      dt_free_align(buf[0]);
+      dt_free_align(buf[1]);
+      dt_pthread_mutex_unlock(&pipe->busy_mutex);
+      return 1;
+    }
+
+    dt_iop_roi_t roi = *roi_out;
+    roi.y += row;
+    roi.height = MIN(band, roi_out->height - row);
+
+    const void *in = (const char *)input + group_bpp[0] * row * width;
+    for(int k = 0; k < n; k++)
+    {
+      dt_iop_module_t *module = group[k];
+      dt_dev_pixelpipe_iop_t *piece = group_pieces[k];
+
+      if(row == 0)
+      {
+        piece->dsc_in = k ? group_pieces[k - 1]->dsc_out : *input_format;
+        piece->dsc_out = piece->dsc_in;
+        module->output_format(module, pipe, piece, &piece->dsc_out);
+        group_bpp[k + 1] = dt_iop_buffer_dsc_to_bpp(&piece->dsc_out);
+        group_dsc[k] = pipe->dsc = piece->dsc_out;
+      }
+      else
+      {
+        // modules may update pipe->dsc in process(), do that only once per module
+        pipe->dsc = group_dsc[k];
+      }
+
+      void *out = (k == n - 1) ? (char *)*output + group_bpp[n] * row * width : buf[k & 1];
+      module->process(module, piece, in, out, &roi, &roi);
+      in = out;
+
+      if(row == 0) piece->dsc_out = pipe->dsc;
+    }
+  }
+  dt_free_align(buf[0]);
+  dt_free_align(buf[1]);
+
+  pipe->dsc = group_pieces[n - 1]->dsc_out;
+  **out_format = pipe->dsc;
+
+  gchar *first_label = dt_history_item_get_name(group[0]);
+  gchar *last_label = dt_history_item_get_name(group[n - 1]);
+  dt_show_times(&start, "[dev_pixelpipe]", "processed %d modules `%s'..`%s' fused on CPU in bands of %d rows [%s]",
+                n, first_label, last_label, band, _pipe_type_to_str(pipe->type));
+  g_free(first_label);
+  g_free(last_label);
+
+  dt_pthread_mutex_unlock(&pipe->busy_mutex);
+  return 0;
+}
+
 // recursive helper for process:
 static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
                                         void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
@@ -635,8 +847,9 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     dt_get_times(&start);
     // we're looking for the full buffer
     {
-      if(roi_out->scale == 1.0 && roi_out->x == 0 && roi_out->y == 0 && pipe->iwidth == roi_out->width
-         && pipe->iheight == roi_out->height)
+      // half float input has to be converted, it can't be passed on as is
+      if(!pipe->input_half && roi_out->scale == 1.0 && roi_out->x == 0 && roi_out->y == 0
+         && pipe->iwidth == roi_out->width && pipe->iheight == roi_out->height)
       {
         *output = pipe->input;
       }
@@ -654,13 +867,27 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
           const int cp_width = MIN(roi_out->width, pipe->iwidth - in_x);
           const int cp_height = MIN(roi_out->height, pipe->iheight - in_y);
 
+          if(pipe->input_half)
+          {
+            const size_t ch = bpp / sizeof(float);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) default(none) shared(pipe, roi_out, roi_in, output)
+#endif
+            for(int j = 0; j < cp_height; j++)
+              dt_iop_image_half_to_float((float *)*output + ch * j * roi_out->width,
+                                         (const uint16_t *)pipe->input + ch * (in_x + (in_y + j) * pipe->iwidth),
+                                         ch * cp_width);
+          }
+          else
+          {
 #ifdef _OPENMP
 #pragma omp parallel for schedule(static) default(none) shared(pipe, roi_out, roi_in, output)
 #endif
-          for(int j = 0; j < cp_height; j++)
-            memcpy(((char *)*output) + (size_t)bpp * j * roi_out->width,
-                   ((char *)pipe->input) + (size_t)bpp * (in_x + (in_y + j) * pipe->iwidth),
-                   (size_t)bpp * cp_width);
+            for(int j = 0; j < cp_height; j++)
+              memcpy(((char *)*output) + (size_t)bpp * j * roi_out->width,
+                     ((char *)pipe->input) + (size_t)bpp * (in_x + (in_y + j) * pipe->iwidth),
+                     (size_t)bpp * cp_width);
+          }
         }
         else
         {
@@ -669,7 +896,23 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
           roi_in.width = pipe->iwidth;
           roi_in.height = pipe->iheight;
           roi_in.scale = 1.0f;
-          dt_iop_clip_and_zoom(*output, pipe->input, roi_out, &roi_in, roi_out->width, pipe->iwidth);
+          float *input = pipe->input;
+          if(pipe->input_half)
+          {
+            // scaled (rgba only), widen the whole input first
+            const size_t stride = (size_t)4 * pipe->iwidth;
+            input = dt_alloc_align(64, sizeof(float) * stride * pipe->iheight);
+            if(input)
+            {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) default(none) shared(pipe, input)
+#endif
+              for(int j = 0; j < pipe->iheight; j++)
+                dt_iop_image_half_to_float(input + j * stride, (const uint16_t *)pipe->input + j * stride, stride);
+            }
+          }
+          if(input) dt_iop_clip_and_zoom(*output, input, roi_out, &roi_in, roi_out->width, pipe->iwidth);
+          if(input != pipe->input) dt_free_align(input);
         }
       }
       // else found in cache.
@@ -682,6 +925,19 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
   {
     // 3b) recurse and obtain output array in &input
 
+    // consecutive point-wise modules are processed together over row bands
+    GList *fused_module = NULL, *fused_piece = NULL;
+    int fused_pos = pos;
+    const int fused = _pixelpipe_fused_group(pipe, dev, roi_out, modules, pieces, pos, &fused_module,
+                                             &fused_piece, &fused_pos);
+    if(fused > 1)
+    {
+      if(_pixelpipe_process_fused(pipe, dev, output, out_format, roi_out, modules, fused_module, fused_piece,
+                                  fused_pos, fused, hash, bufsize))
+        return 1;
+      goto post_process_collect_info;
+    }
+
     // get region of interest which is needed in input
     dt_pthread_mutex_lock(&pipe->busy_mutex);
     if(pipe->shutdown)
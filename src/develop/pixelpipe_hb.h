@@ -84,6 +84,8 @@ typedef struct dt_dev_pixelpipe_t
   int cache_obsolete;
   // input buffer
   float *input;
+  // input holds ieee half floats instead of floats (a half float mip_f buffer)
+  gboolean input_half;
   // width and height of input buffer
   int iwidth, iheight;
   // input actually just downscaled buffer? iscale*iwidth = actual width
@@ -126,6 +128,10 @@ typedef struct dt_dev_pixelpipe_t
   int devid;
   // image struct as it was when the pixelpipe was initialized. copied to avoid race conditions.
   dt_image_t image;
+  // tiling roi fitting statistics for -d perf: number of fits, how many were answered
+  // directly by the module, how many needed the simplex search and the total time spent.
+  int tiling_roi_fits, tiling_roi_fits_direct, tiling_roi_fits_simplex;
+  double tiling_roi_fit_time;
 } dt_dev_pixelpipe_t;
 
 struct dt_develop_t;
@@ -144,6 +150,9 @@ int dt_dev_pixelpipe_init_thumbnail(dt_dev_pixelpipe_t *pipe, int32_t width, int
 int dt_dev_pixelpipe_init_dummy(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height);
 // inits the pixelpipe with given cacheline size and number of entries.
 int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries);
+// takes a pipe that already processed an image back to the state after init, keeping the allocated cache
+// lines. the nodes have to be cleaned up before.
+void dt_dev_pixelpipe_reset(dt_dev_pixelpipe_t *pipe);
 // constructs a new input buffer from given RGB float array.
 void dt_dev_pixelpipe_set_input(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, float *input, int width,
                                 int height, float iscale);
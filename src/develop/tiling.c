@@ -536,11 +536,18 @@ static int _nm_fit_output_to_input_roi(struct dt_iop_module_t *self, struct dt_d
 
 
 
+static inline int _roi_matches(const dt_iop_roi_t *a, const dt_iop_roi_t *b, int delta)
+{
+  return abs(a->x - b->x) <= delta && abs(a->y - b->y) <= delta && abs(a->width - b->width) <= delta
+         && abs(a->height - b->height) <= delta;
+}
+
+
 /* find a matching oroi_full by probing start value of oroi and get corresponding input roi into iroi_probe.
    We search in two steps. first by a simplicistic iterative search which will succeed in most cases.
    If this does not converge, we do a downhill simplex (nelder-mead) fitting */
-static int _fit_output_to_input_roi(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
-                                    const dt_iop_roi_t *iroi, dt_iop_roi_t *oroi, int delta, int iter)
+static int _search_output_to_input_roi(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                       const dt_iop_roi_t *iroi, dt_iop_roi_t *oroi, int delta, int iter)
 {
   dt_iop_roi_t iroi_probe = *iroi;
   dt_iop_roi_t save_oroi = *oroi;
@@ -548,9 +555,7 @@ static int _fit_output_to_input_roi(struct dt_iop_module_t *self, struct dt_dev_
   // try to go the easy way. this works in many cases where output is
   // just like input, only scaled down
   self->modify_roi_in(self, piece, oroi, &iroi_probe);
-  while((abs((int)iroi_probe.x - (int)iroi->x) > delta || abs((int)iroi_probe.y - (int)iroi->y) > delta
-         || abs((int)iroi_probe.width - (int)iroi->width) > delta
-         || abs((int)iroi_probe.height - (int)iroi->height) > delta) && iter > 0)
+  while(!_roi_matches(&iroi_probe, iroi, delta) && iter > 0)
   {
     //_print_roi(&iroi_probe, "tile iroi_probe");
     //_print_roi(oroi, "tile oroi old");
@@ -574,11 +579,45 @@ static int _fit_output_to_input_roi(struct dt_iop_module_t *self, struct dt_dev_
   // try simplex downhill fitting now.
   // it's crucial that we have a good starting point in oroi, else this
   // will not converge as well.
+  piece->pipe->tiling_roi_fits_simplex++;
   int fit = _nm_fit_output_to_input_roi(self, piece, iroi, oroi, delta);
   return fit;
 }
 
 
+/* find the oroi whose input roi matches iroi within delta. modules knowing the inverse of their
+   modify_roi_in() answer directly; the answer is verified, as rounding in both directions may differ,
+   and otherwise serves as starting point for the search above. */
+static int _fit_output_to_input_roi(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                    const dt_iop_roi_t *iroi, dt_iop_roi_t *oroi, int delta, int iter)
+{
+  const double start = dt_get_wtime();
+  dt_dev_pixelpipe_t *pipe = piece->pipe;
+  int fit = FALSE;
+
+  pipe->tiling_roi_fits++;
+
+  dt_iop_roi_t oroi_direct = *oroi;
+  if(self->modify_roi_out_for_input && self->modify_roi_out_for_input(self, piece, iroi, &oroi_direct))
+  {
+    dt_iop_roi_t iroi_probe = *iroi;
+    self->modify_roi_in(self, piece, &oroi_direct, &iroi_probe);
+    fit = _roi_matches(&iroi_probe, iroi, delta);
+    // a guess that doesn't fit must not replace the starting point of the search
+    if(fit)
+    {
+      *oroi = oroi_direct;
+      pipe->tiling_roi_fits_direct++;
+    }
+  }
+
+  if(!fit) fit = _search_output_to_input_roi(self, piece, iroi, oroi, delta, iter);
+
+  pipe->tiling_roi_fit_time += dt_get_wtime() - start;
+  return fit;
+}
+
+
 /* simple tiling algorithm for roi_in == roi_out, i.e. for pixel to pixel modules/operations */
 static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                                         const void *const ivoid, void *const ovoid,
@@ -1159,6 +1198,197 @@ fallback:
 
 
 
+/* tiling algorithm for roi_in == roi_out which processes several tiles at the same time, each of them
+   with a single-threaded process() of the module. every thread owns an input and an output tile buffer, so
+   copying tiles in and out overlaps with the processing of the other tiles. the number of tiles in flight is
+   chosen from the number of cores and the host memory limit. only used for modules which allow their
+   process() to run concurrently on the same piece. returns FALSE if the caller should tile sequentially. */
+static int _default_process_tiling_ptp_concurrent(struct dt_iop_module_t *self,
+                                                  struct dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+                                                  void *const ovoid, const dt_iop_roi_t *const roi_in,
+                                                  const dt_iop_roi_t *const roi_out, const int in_bpp)
+{
+#ifdef _OPENMP
+  const int threads = dt_get_num_threads();
+  if(threads < 2 || !(self->flags() & IOP_FLAGS_TILING_CONCURRENT) || !dt_conf_get_bool("tiling_concurrent"))
+    return FALSE;
+  // we can't get more threads from inside a parallel region anyways
+  if(omp_in_parallel()) return FALSE;
+
+  dt_iop_buffer_dsc_t dsc;
+  self->output_format(self, piece->pipe, piece, &dsc);
+  const int out_bpp = dt_iop_buffer_dsc_to_bpp(&dsc);
+
+  const int ipitch = roi_in->width * in_bpp;
+  const int opitch = roi_out->width * out_bpp;
+  const int max_bpp = _max(in_bpp, out_bpp);
+
+  /* get tiling requirements of module */
+  dt_develop_tiling_t tiling = { 0 };
+  self->tiling_callback(self, piece, roi_in, roi_out, &tiling);
+
+  /* leave the decision whether tiling makes sense at all to the sequential variant */
+  if(tiling.factor < 2.2f && tiling.overhead < 0.2f * roi_in->width * roi_in->height * max_bpp) return FALSE;
+
+  const float iobuffers = (float)roi_out->width * roi_out->height * out_bpp
+                          + (float)roi_in->width * roi_in->height * in_bpp;
+  float available = dt_conf_get_float("host_memory_limit") * 1024.0f * 1024.0f;
+  available = fmax(available - iobuffers, 0);
+
+  const float factor = fmax(tiling.factor, 1.0f);
+  const float maxbuf = fmax(tiling.maxbuf, 1.0f);
+  const float singlebuffer_limit = fmax(dt_conf_get_float("singlebuffer_limit") * 1024.0f * 1024.0f,
+                                        2.0f * 1024.0f * 1024.0f);
+
+  const unsigned int xyalign = _lcm(tiling.xalign, tiling.yalign);
+  assert(xyalign != 0);
+  const int overlap = tiling.overlap % xyalign != 0 ? (tiling.overlap / xyalign + 1) * xyalign
+                                                    : tiling.overlap;
+
+  /* find the largest number of tiles in flight for which every tile gets its share of memory and still has
+     a reasonably effective size. there should also be at least as many tiles as threads working on them. */
+  int slots = 0, width = 0, height = 0, tile_wd = 0, tile_ht = 0, tiles_x = 0, tiles_y = 0;
+  for(int n = threads; n >= 2; n /= 2)
+  {
+    const float singlebuffer = fmax(available / (factor * n), singlebuffer_limit);
+    const float area = fmin(singlebuffer / (max_bpp * maxbuf), (float)roi_in->width * roi_in->height / n);
+
+    width = roi_in->width;
+    height = roi_in->height;
+    if((float)width * height > area)
+    {
+      const float scale = area / ((float)width * height);
+      if(width < height && scale >= 0.333f)
+        height = floorf(height * scale);
+      else if(height <= width && scale >= 0.333f)
+        width = floorf(width * scale);
+      else
+      {
+        width = floorf(width * sqrtf(scale));
+        height = floorf(height * sqrtf(scale));
+      }
+    }
+
+    if(width < roi_in->width) width = (width / xyalign) * xyalign;
+    if(height < roi_in->height) height = (height / xyalign) * xyalign;
+
+    /* tiles would mostly consist of overlap, try with fewer but larger tiles */
+    if(width <= 4 * overlap || height <= 4 * overlap || width < 16 || height < 16) continue;
+
+    tile_wd = width - 2 * overlap;
+    tile_ht = height - 2 * overlap;
+    tiles_x = width < roi_in->width ? ceilf(roi_in->width / (float)tile_wd) : 1;
+    tiles_y = height < roi_in->height ? ceilf(roi_in->height / (float)tile_ht) : 1;
+
+    if(!dt_tiling_piece_fits_host_memory(width, height, max_bpp, factor * n, tiling.overhead * n + iobuffers))
+      continue;
+
+    slots = MIN(n, tiles_x * tiles_y);
+    break;
+  }
+
+  if(slots < 2 || tiles_x * tiles_y > dt_conf_get_int("maximum_number_tiles")) return FALSE;
+
+  /* reserve input and output buffers for each tile in flight */
+  void **input = calloc(slots, sizeof(void *));
+  void **output = calloc(slots, sizeof(void *));
+  int success = input && output;
+  for(int k = 0; k < slots && success; k++)
+  {
+    input[k] = dt_alloc_align(64, (size_t)width * height * in_bpp);
+    output[k] = dt_alloc_align(64, (size_t)width * height * out_bpp);
+    success = input[k] && output[k];
+  }
+  if(!success)
+  {
+    dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp_concurrent] could not alloc tile buffers for module "
+                           "'%s'\n",
+             self->op);
+    goto cleanup;
+  }
+
+  dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp_concurrent] use tiling on module '%s' for image with full "
+                         "size %d x %d\n",
+           self->op, roi_in->width, roi_in->height);
+  dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp_concurrent] (%d x %d) tiles with max dimensions %d x %d and "
+                         "overlap %d, %d at a time\n",
+           tiles_x, tiles_y, width, height, overlap, slots);
+
+  dt_times_t start;
+  dt_get_times(&start);
+
+  /* modules which run concurrently don't touch pipe->dsc in process(), keep processed_maximum as it is */
+  piece->pipe->tiling = 1;
+
+  const int tiles = tiles_x * tiles_y;
+#pragma omp parallel for num_threads(slots) schedule(dynamic)
+  for(int t = 0; t < tiles; t++)
+  {
+    const int slot = omp_get_thread_num();
+    const size_t tx = t % tiles_x;
+    const size_t ty = t / tiles_x;
+
+    const size_t wd = tx * tile_wd + width > roi_in->width ? roi_in->width - tx * tile_wd : width;
+    const size_t ht = ty * tile_ht + height > roi_in->height ? roi_in->height - ty * tile_ht : height;
+
+    /* no need to process end-tiles that are smaller than the total overlap area */
+    if((wd <= 2 * overlap && tx > 0) || (ht <= 2 * overlap && ty > 0)) continue;
+
+    /* origin and region of effective part of tile, which we want to store later */
+    size_t origin[] = { 0, 0, 0 };
+    size_t region[] = { wd, ht, 1 };
+
+    dt_iop_roi_t iroi = { roi_in->x + tx * tile_wd, roi_in->y + ty * tile_ht, wd, ht, roi_in->scale };
+    dt_iop_roi_t oroi = { roi_out->x + tx * tile_wd, roi_out->y + ty * tile_ht, wd, ht, roi_out->scale };
+
+    /* offsets of tile into ivoid and ovoid */
+    const size_t ioffs = (ty * tile_ht) * ipitch + (tx * tile_wd) * in_bpp;
+    size_t ooffs = (ty * tile_ht) * opitch + (tx * tile_wd) * out_bpp;
+
+    for(size_t j = 0; j < ht; j++)
+      memcpy((char *)input[slot] + j * wd * in_bpp, (char *)ivoid + ioffs + j * ipitch, (size_t)wd * in_bpp);
+
+    /* nested parallel regions of the module run with a single thread */
+    self->process(self, piece, input[slot], output[slot], &iroi, &oroi);
+
+    if(tx > 0)
+    {
+      origin[0] += overlap;
+      region[0] -= overlap;
+      ooffs += overlap * out_bpp;
+    }
+    if(ty > 0)
+    {
+      origin[1] += overlap;
+      region[1] -= overlap;
+      ooffs += overlap * opitch;
+    }
+
+    for(size_t j = 0; j < region[1]; j++)
+      memcpy((char *)ovoid + ooffs + j * opitch,
+             (char *)output[slot] + ((j + origin[1]) * wd + origin[0]) * out_bpp, (size_t)region[0] * out_bpp);
+  }
+
+  piece->pipe->tiling = 0;
+
+  dt_show_times(&start, "[default_process_tiling_ptp_concurrent]", "processed %d tiles of module '%s', %d at a time",
+                tiles, self->op, slots);
+
+cleanup:
+  for(int k = 0; k < slots; k++)
+  {
+    if(input && input[k]) dt_free_align(input[k]);
+    if(output && output[k]) dt_free_align(output[k]);
+  }
+  free(input);
+  free(output);
+  return success;
+#else
+  return FALSE;
+#endif
+}
+
+
 /* if a module does not implement process_tiling() by itself, this function is called instead.
    _default_process_tiling_ptp() is able to handle standard cases where pixels do not change their places.
    _default_process_tiling_roi() takes care of all other cases where image gets distorted and for module
@@ -1170,7 +1400,7 @@ void default_process_tiling(struct dt_iop_module_t *self, struct dt_dev_pixelpip
 {
   if(memcmp(roi_in, roi_out, sizeof(struct dt_iop_roi_t)) || (self->flags() & IOP_FLAGS_TILING_FULL_ROI))
     _default_process_tiling_roi(self, piece, ivoid, ovoid, roi_in, roi_out, in_bpp);
-  else
+  else if(!_default_process_tiling_ptp_concurrent(self, piece, ivoid, ovoid, roi_in, roi_out, in_bpp))
     _default_process_tiling_ptp(self, piece, ivoid, ovoid, roi_in, roi_out, in_bpp);
   return;
 }
@@ -39,7 +39,7 @@
 #undef HAVE_STDLIB_H
 #undef HAVE_STDDEF_H
 
-DT_MODULE(2)
+DT_MODULE(3)
 
 typedef struct dt_imageio_jpeg_t
 {
@@ -48,6 +48,7 @@ typedef struct dt_imageio_jpeg_t
   char style[128];
   gboolean style_append;
   int quality;
+  int optimize;
   struct jpeg_source_mgr src;
   struct jpeg_destination_mgr dest;
   struct jpeg_decompress_struct dinfo;
@@ -58,6 +59,7 @@ typedef struct dt_imageio_jpeg_t
 typedef struct dt_imageio_jpeg_gui_data_t
 {
   GtkWidget *quality;
+  GtkWidget *optimize;
 } dt_imageio_jpeg_gui_data_t;
 
 
@@ -312,6 +314,8 @@ read_icc_profile (j_decompress_ptr cinfo,
 #undef MAX_DATA_BYTES_IN_MARKER
 #undef MAX_SEQ_NO
 
+// lines in an MCU row with 2x2 chroma subsampling
+#define DT_JPEG_BLOCK_ROWS 16
 
 int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const void *in_tmp, void *exif,
                 int exif_len, int imgid, int num, int total)
@@ -345,7 +349,8 @@ int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const v
   if(jpg->quality < 80) jpg->cinfo.smoothing_factor = 20;
   if(jpg->quality < 60) jpg->cinfo.smoothing_factor = 40;
   if(jpg->quality < 40) jpg->cinfo.smoothing_factor = 60;
-  jpg->cinfo.optimize_coding = 1;
+  // optimized huffman tables take a second pass over the coefficients for a few percent smaller files
+  jpg->cinfo.optimize_coding = jpg->optimize ? TRUE : FALSE;
 
   // according to specs density_unit = 0, X_density = 1, Y_density = 1 should be fine and valid since it
   // describes an image with unknown unit and square pixels.
@@ -381,16 +386,21 @@ int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const v
     }
   }
 
-  uint8_t *row = malloc((size_t)3 * jpg->width * sizeof(uint8_t));
-  const uint8_t *buf;
+  // hand the rows over a whole MCU row at a time, that's what libjpeg works on internally anyways and it
+  // saves it from collecting them one by one
+  uint8_t *row = malloc((size_t)3 * jpg->width * DT_JPEG_BLOCK_ROWS * sizeof(uint8_t));
+  JSAMPROW rows[DT_JPEG_BLOCK_ROWS];
+  for(int j = 0; j < DT_JPEG_BLOCK_ROWS; j++) rows[j] = row + (size_t)3 * jpg->width * j;
   while(jpg->cinfo.next_scanline < jpg->cinfo.image_height)
   {
-    JSAMPROW tmp[1];
-    buf = in + (size_t)jpg->cinfo.next_scanline * jpg->cinfo.image_width * 4;
-    for(int i = 0; i < jpg->width; i++)
-      for(int k = 0; k < 3; k++) row[3 * i + k] = buf[4 * i + k];
-    tmp[0] = row;
-    jpeg_write_scanlines(&(jpg->cinfo), tmp, 1);
+    const int lines = MIN(DT_JPEG_BLOCK_ROWS, (int)(jpg->cinfo.image_height - jpg->cinfo.next_scanline));
+    for(int j = 0; j < lines; j++)
+    {
+      const uint8_t *buf = in + (size_t)(jpg->cinfo.next_scanline + j) * jpg->cinfo.image_width * 4;
+      for(int i = 0; i < jpg->width; i++)
+        for(int k = 0; k < 3; k++) rows[j][3 * i + k] = buf[4 * i + k];
+    }
+    jpeg_write_scanlines(&(jpg->cinfo), rows, lines);
   }
   jpeg_finish_compress(&(jpg->cinfo));
   free(row);
@@ -468,14 +478,14 @@ int read_image(dt_imageio_module_data_t *jpg_tmp, uint8_t *out)
 
 size_t params_size(dt_imageio_module_format_t *self)
 {
-  return sizeof(dt_imageio_module_data_t) + sizeof(int);
+  return sizeof(dt_imageio_module_data_t) + 2 * sizeof(int);
 }
 
 void *legacy_params(dt_imageio_module_format_t *self, const void *const old_params,
                     const size_t old_params_size, const int old_version, const int new_version,
                     size_t *new_size)
 {
-  if(old_version == 1 && new_version == 2)
+  if(old_version == 1 && new_version == 3)
   {
     typedef struct dt_imageio_jpeg_v1_t
     {
@@ -500,6 +510,42 @@ void *legacy_params(dt_imageio_module_format_t *self, const void *const old_para
     g_strlcpy(n->style, o->style, sizeof(o->style));
     n->style_append = 0;
     n->quality = o->quality;
+    n->optimize = 1; // what was always used before
+    n->src = o->src;
+    n->dest = o->dest;
+    n->dinfo = o->dinfo;
+    n->cinfo = o->cinfo;
+    n->f = o->f;
+    *new_size = self->params_size(self);
+    return n;
+  }
+  if(old_version == 2 && new_version == 3)
+  {
+    typedef struct dt_imageio_jpeg_v2_t
+    {
+      int max_width, max_height;
+      int width, height;
+      char style[128];
+      gboolean style_append;
+      int quality;
+      struct jpeg_source_mgr src;
+      struct jpeg_destination_mgr dest;
+      struct jpeg_decompress_struct dinfo;
+      struct jpeg_compress_struct cinfo;
+      FILE *f;
+    } dt_imageio_jpeg_v2_t;
+
+    const dt_imageio_jpeg_v2_t *o = (dt_imageio_jpeg_v2_t *)old_params;
+    dt_imageio_jpeg_t *n = (dt_imageio_jpeg_t *)malloc(sizeof(dt_imageio_jpeg_t));
+
+    n->max_width = o->max_width;
+    n->max_height = o->max_height;
+    n->width = o->width;
+    n->height = o->height;
+    g_strlcpy(n->style, o->style, sizeof(o->style));
+    n->style_append = o->style_append;
+    n->quality = o->quality;
+    n->optimize = 1; // what was always used before
     n->src = o->src;
     n->dest = o->dest;
     n->dinfo = o->dinfo;
@@ -517,6 +563,7 @@ void *get_params(dt_imageio_module_format_t *self)
   dt_imageio_jpeg_t *d = (dt_imageio_jpeg_t *)calloc(1, sizeof(dt_imageio_jpeg_t));
   d->quality = dt_conf_get_int("plugins/imageio/format/jpeg/quality");
   if(d->quality <= 0 || d->quality > 100) d->quality = 100;
+  d->optimize = dt_conf_get_bool("plugins/imageio/format/jpeg/optimize");
   return d;
 }
 
@@ -531,6 +578,7 @@ int set_params(dt_imageio_module_format_t *self, const void *params, const int s
   const dt_imageio_jpeg_t *d = (dt_imageio_jpeg_t *)params;
   dt_imageio_jpeg_gui_data_t *g = (dt_imageio_jpeg_gui_data_t *)self->gui_data;
   dt_bauhaus_slider_set(g->quality, d->quality);
+  dt_bauhaus_combobox_set(g->optimize, d->optimize ? 1 : 0);
   return 0;
 }
 
@@ -563,6 +611,7 @@ void init(dt_imageio_module_format_t *self)
 {
 #ifdef USE_LUA
   dt_lua_register_module_member(darktable.lua_state.state, self, dt_imageio_jpeg_t, quality, int);
+  dt_lua_register_module_member(darktable.lua_state.state, self, dt_imageio_jpeg_t, optimize, int);
 #endif
 }
 void cleanup(dt_imageio_module_format_t *self)
@@ -584,12 +633,17 @@ static void quality_changed(GtkWidget *slider, gpointer user_data)
   dt_conf_set_int("plugins/imageio/format/jpeg/quality", quality);
 }
 
+static void optimize_changed(GtkWidget *widget, gpointer user_data)
+{
+  dt_conf_set_bool("plugins/imageio/format/jpeg/optimize", dt_bauhaus_combobox_get(widget) == 1);
+}
+
 void gui_init(dt_imageio_module_format_t *self)
 {
   dt_imageio_jpeg_gui_data_t *g = (dt_imageio_jpeg_gui_data_t *)malloc(sizeof(dt_imageio_jpeg_gui_data_t));
   self->gui_data = g;
   // construct gui with jpeg specific options:
-  GtkWidget *box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 20);
+  GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, DT_PIXEL_APPLY_DPI(5));
   self->widget = box;
   // quality slider
   g->quality = dt_bauhaus_slider_new_with_range(NULL, 5, 100, 1, 95, 0);
@@ -597,6 +651,14 @@ void gui_init(dt_imageio_module_format_t *self)
   dt_bauhaus_slider_set_default(g->quality, 95);
   gtk_box_pack_start(GTK_BOX(box), GTK_WIDGET(g->quality), TRUE, TRUE, 0);
   g_signal_connect(G_OBJECT(g->quality), "value-changed", G_CALLBACK(quality_changed), NULL);
+  // the encoding effort: optimized huffman tables need a second pass, standard ones are faster to write
+  g->optimize = dt_bauhaus_combobox_new(NULL);
+  dt_bauhaus_widget_set_label(g->optimize, NULL, _("huffman tables"));
+  dt_bauhaus_combobox_add(g->optimize, _("standard (faster)"));
+  dt_bauhaus_combobox_add(g->optimize, _("optimized (smaller)"));
+  dt_bauhaus_combobox_set(g->optimize, dt_conf_get_bool("plugins/imageio/format/jpeg/optimize") ? 1 : 0);
+  gtk_box_pack_start(GTK_BOX(box), g->optimize, TRUE, TRUE, 0);
+  g_signal_connect(G_OBJECT(g->optimize), "value-changed", G_CALLBACK(optimize_changed), NULL);
   // TODO: add more options: subsample dreggn
 }
 
@@ -609,6 +671,7 @@ void gui_reset(dt_imageio_module_format_t *self)
 {
   dt_imageio_jpeg_gui_data_t *g = (dt_imageio_jpeg_gui_data_t *)self->gui_data;
   dt_bauhaus_slider_set(g->quality, dt_conf_get_int("plugins/imageio/format/jpeg/quality"));
+  dt_bauhaus_combobox_set(g->optimize, dt_conf_get_bool("plugins/imageio/format/jpeg/optimize") ? 1 : 0);
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -36,7 +36,7 @@
 #include "control/conf.h"
 #include "imageio/format/imageio_format_api.h"
 
-DT_MODULE(2)
+DT_MODULE(3)
 
 typedef struct dt_imageio_png_t
 {
@@ -45,6 +45,7 @@ typedef struct dt_imageio_png_t
   char style[128];
   gboolean style_append;
   int bpp;
+  int compression;
   FILE *f;
   png_structp png_ptr;
   png_infop info_ptr;
@@ -53,6 +54,7 @@ typedef struct dt_imageio_png_t
 typedef struct dt_imageio_png_gui_t
 {
   GtkWidget *bit_depth;
+  GtkWidget *compression;
 } dt_imageio_png_gui_t;
 
 /* Write EXIF data to PNG file.
@@ -120,6 +122,244 @@ static void PNGwriteRawProfile(png_struct *ping, png_info *ping_info, char *prof
   png_free(ping, text);
 }
 
+// the image data gets deflated in pieces of about that many bytes in parallel, pigz style: every piece but
+// the last ends on a byte boundary with a sync flush and the next one is primed with the 32k before it, so
+// the concatenation is one valid zlib stream.
+#define DT_PNG_PIECE_SIZE (256 << 10)
+#define DT_PNG_WINDOW_SIZE (32 << 10)
+
+// packs one row into 3 channels, 16 bit samples big endian like png wants them
+static void _png_pack_row(const void *ivoid, const int width, const int bpp, const int y, uint8_t *out)
+{
+  if(bpp > 8)
+  {
+    const uint16_t *in = (const uint16_t *)ivoid + (size_t)4 * y * width;
+    for(int x = 0; x < width; x++, in += 4, out += 6)
+      for(int c = 0; c < 3; c++)
+      {
+        out[2 * c] = in[c] >> 8;
+        out[2 * c + 1] = in[c] & 0xff;
+      }
+  }
+  else
+  {
+    const uint8_t *in = (const uint8_t *)ivoid + (size_t)4 * y * width;
+    for(int x = 0; x < width; x++, in += 4, out += 3) memcpy(out, in, 3);
+  }
+}
+
+static inline uint8_t _png_paeth(const int a, const int b, const int c)
+{
+  const int p = a + b - c;
+  const int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+  if(pa <= pb && pa <= pc) return a;
+  if(pb <= pc) return b;
+  return c;
+}
+
+// applies png filter type to row (prior is the row above, NULL for the first one) and returns the sum of
+// the absolute values of the result, which is what libpng picks the filter by.
+static size_t _png_filter_row(const int type, const uint8_t *row, const uint8_t *prior, const size_t rowbytes,
+                              const int bytespp, uint8_t *out)
+{
+  size_t sum = 0;
+  for(size_t i = 0; i < rowbytes; i++)
+  {
+    const int a = i >= (size_t)bytespp ? row[i - bytespp] : 0;
+    const int b = prior ? prior[i] : 0;
+    const int c = prior && i >= (size_t)bytespp ? prior[i - bytespp] : 0;
+    uint8_t v = row[i];
+    switch(type)
+    {
+      case PNG_FILTER_VALUE_SUB:
+        v -= a;
+        break;
+      case PNG_FILTER_VALUE_UP:
+        v -= b;
+        break;
+      case PNG_FILTER_VALUE_AVG:
+        v -= (a + b) >> 1;
+        break;
+      case PNG_FILTER_VALUE_PAETH:
+        v -= _png_paeth(a, b, c);
+        break;
+      default:
+        break;
+    }
+    out[i] = v;
+    sum += abs((int8_t)v);
+  }
+  return sum;
+}
+
+// filters the rows [y, y + rows) into out, one filter type byte in front of every row
+static void _png_filter_rows(const void *ivoid, const int width, const int bpp, const int level, const int y,
+                             const int rows, uint8_t *out)
+{
+  const int bytespp = 3 * bpp / 8;
+  const size_t rowbytes = (size_t)width * bytespp;
+  uint8_t *cur = malloc(rowbytes), *prior = malloc(rowbytes), *candidate = malloc(rowbytes);
+  if(y > 0) _png_pack_row(ivoid, width, bpp, y - 1, prior);
+  for(int j = 0; j < rows; j++, out += rowbytes + 1)
+  {
+    _png_pack_row(ivoid, width, bpp, y + j, cur);
+    const uint8_t *above = (y + j > 0) ? prior : NULL;
+    out[0] = PNG_FILTER_VALUE_NONE;
+    size_t best = _png_filter_row(PNG_FILTER_VALUE_NONE, cur, above, rowbytes, bytespp, out + 1);
+    // not worth the time if it doesn't get compressed anyways
+    for(int type = PNG_FILTER_VALUE_SUB; level > 0 && type <= PNG_FILTER_VALUE_PAETH; type++)
+    {
+      const size_t sum = _png_filter_row(type, cur, above, rowbytes, bytespp, candidate);
+      if(sum < best)
+      {
+        best = sum;
+        out[0] = type;
+        memcpy(out + 1, candidate, rowbytes);
+      }
+    }
+    uint8_t *t = prior;
+    prior = cur;
+    cur = t;
+  }
+  free(cur);
+  free(prior);
+  free(candidate);
+}
+
+static void _png_write_data(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+  FILE *f = (FILE *)png_get_io_ptr(png_ptr);
+  if(fwrite(data, 1, length, f) != length) png_error(png_ptr, "write error");
+}
+
+static void _png_flush_data(png_structp png_ptr)
+{
+  fflush((FILE *)png_get_io_ptr(png_ptr));
+}
+
+static void _png_write_idat(png_structp png_ptr, const uint8_t *header, const size_t header_len,
+                            const uint8_t *data, const size_t len, const uint8_t *trailer, const size_t trailer_len)
+{
+  png_write_chunk_start(png_ptr, (png_bytep) "IDAT", header_len + len + trailer_len);
+  if(header_len) png_write_chunk_data(png_ptr, header, header_len);
+  png_write_chunk_data(png_ptr, data, len);
+  if(trailer_len) png_write_chunk_data(png_ptr, trailer, trailer_len);
+  png_write_chunk_end(png_ptr);
+}
+
+// writes the pixels as IDAT chunks, compressing pieces of the image on all cores. returns 0 on success.
+static int _png_write_pixels(png_structp png_ptr, const void *ivoid, const int width, const int height,
+                             const int bpp, const int level)
+{
+  const size_t stride = (size_t)width * 3 * bpp / 8 + 1;
+  const int rows_per_piece = CLAMP((int)(DT_PNG_PIECE_SIZE / stride), 1, height);
+  const int npieces = (height + rows_per_piece - 1) / rows_per_piece;
+  const int batch = MIN(npieces, dt_get_num_threads() * 2);
+  const size_t piecesize = stride * rows_per_piece;
+
+  // the filtered rows of one batch, with the end of the previous batch in front for the dictionary
+  uint8_t *buf = malloc(DT_PNG_WINDOW_SIZE + piecesize * batch);
+  uint8_t **packed = calloc(batch, sizeof(uint8_t *));
+  size_t *packed_len = calloc(batch, sizeof(size_t));
+  uLong *adler = calloc(batch, sizeof(uLong));
+  int rc = 1;
+  if(!buf || !packed || !packed_len || !adler) goto exit;
+  const size_t packedsize = compressBound(piecesize) + 16;
+  for(int k = 0; k < batch; k++)
+    if(!(packed[k] = malloc(packedsize))) goto exit;
+
+  uint8_t *const data = buf + DT_PNG_WINDOW_SIZE;
+  size_t history = 0; // bytes of the previous batch in front of data
+  uLong checksum = adler32(0L, Z_NULL, 0);
+
+  for(int first = 0; first < npieces; first += batch)
+  {
+    const int count = MIN(batch, npieces - first);
+    int failed = 0;
+    // all of the batch is filtered before any of it gets compressed, every piece but the first needs the end of
+    // the one before it as the dictionary
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for(int k = 0; k < count; k++)
+    {
+      const int y = (first + k) * rows_per_piece;
+      _png_filter_rows(ivoid, width, bpp, level, y, MIN(rows_per_piece, height - y), data + piecesize * k);
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for(int k = 0; k < count; k++)
+    {
+      const int y = (first + k) * rows_per_piece;
+      const size_t len = stride * MIN(rows_per_piece, height - y);
+      uint8_t *in = data + piecesize * k;
+      adler[k] = adler32(adler32(0L, Z_NULL, 0), in, len);
+
+      z_stream strm = { 0 };
+      if(deflateInit2(&strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      {
+        failed = 1;
+        continue;
+      }
+      // pieces are full size except maybe the last, so the 32k window is right in front of this one
+      const size_t dictlen = MIN(DT_PNG_WINDOW_SIZE, piecesize * k + history);
+      if(dictlen) deflateSetDictionary(&strm, in - dictlen, dictlen);
+      const int last = (first + k == npieces - 1);
+      strm.next_in = in;
+      strm.avail_in = len;
+      strm.next_out = packed[k];
+      strm.avail_out = packedsize;
+      const int ret = deflate(&strm, last ? Z_FINISH : Z_SYNC_FLUSH);
+      if((last && ret != Z_STREAM_END) || (!last && (ret != Z_OK || strm.avail_in > 0 || strm.avail_out == 0)))
+        failed = 1;
+      packed_len[k] = packedsize - strm.avail_out;
+      deflateEnd(&strm);
+    }
+    if(failed) goto exit;
+
+    for(int k = 0; k < count; k++)
+    {
+      const int y = (first + k) * rows_per_piece;
+      const size_t len = stride * MIN(rows_per_piece, height - y);
+      checksum = adler32_combine(checksum, adler[k], len);
+
+      uint8_t header[2] = { 0 }, trailer[4] = { 0 };
+      size_t header_len = 0, trailer_len = 0;
+      if(first + k == 0)
+      {
+        // deflate with a 32k window, FLEVEL like zlib would set it
+        const int flevel = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+        header[0] = 0x78;
+        header[1] = flevel << 6;
+        header[1] += 31 - ((header[0] << 8) + header[1]) % 31;
+        header_len = 2;
+      }
+      if(first + k == npieces - 1)
+      {
+        for(int i = 0; i < 4; i++) trailer[i] = (checksum >> (24 - 8 * i)) & 0xff;
+        trailer_len = 4;
+      }
+      _png_write_idat(png_ptr, header, header_len, packed[k], packed_len[k], trailer, trailer_len);
+    }
+
+    // keep the end of this batch as the dictionary of the next one
+    const size_t filled = piecesize * count; // only the last batch can have a short piece, nothing follows it
+    history = MIN(DT_PNG_WINDOW_SIZE, filled + history);
+    memmove(data - history, data + filled - history, history);
+  }
+  rc = 0;
+
+exit:
+  for(int k = 0; packed && k < batch; k++) free(packed[k]);
+  free(packed);
+  free(packed_len);
+  free(adler);
+  free(buf);
+  return rc;
+}
+
 int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const void *ivoid, void *exif,
                 int exif_len, int imgid, int num, int total)
 {
@@ -153,19 +393,13 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
     return 1;
   }
 
-  png_init_io(png_ptr, f);
-
-  png_set_compression_level(png_ptr, Z_BEST_COMPRESSION);
-  png_set_compression_mem_level(png_ptr, 8);
-  png_set_compression_strategy(png_ptr, Z_DEFAULT_STRATEGY);
-  png_set_compression_window_bits(png_ptr, 15);
-  png_set_compression_method(png_ptr, 8);
-  png_set_compression_buffer_size(png_ptr, 8192);
+  png_set_write_fn(png_ptr, f, _png_write_data, _png_flush_data);
 
   png_set_IHDR(png_ptr, info_ptr, width, height, p->bpp, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
                PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
-  // metadata has to be written before the pixels
+  // metadata, the exif text chunk included, goes out with png_write_info(), before the pixels. nothing is left
+  // for after them but IEND.
 
   // embed icc profile
   if(imgid > 0)
@@ -196,32 +430,16 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
 
   png_write_info(png_ptr, info_ptr);
 
-  /*
-   * Get rid of filler (OR ALPHA) bytes, pack XRGB/RGBX/ARGB/RGBA into
-   * RGB (4 channels -> 3 channels). The second parameter is not used.
-   */
-  png_set_filler(png_ptr, 0, PNG_FILLER_AFTER);
-
-  png_bytep *row_pointers = malloc((size_t)height * sizeof(png_bytep));
-
-  if(p->bpp > 8)
-  {
-    /* swap bytes of 16 bit files to most significant bit first */
-    png_set_swap(png_ptr);
-
-    for(unsigned i = 0; i < height; i++)
-      row_pointers[i] = (png_bytep)((uint16_t *)ivoid + (size_t)4 * i * width);
-  }
-  else
+  // the pixels don't go through libpng, it would filter and deflate everything on this thread
+  if(_png_write_pixels(png_ptr, ivoid, width, height, p->bpp, CLAMP(p->compression, 0, 9)))
   {
-    for(unsigned i = 0; i < height; i++) row_pointers[i] = (uint8_t *)ivoid + (size_t)4 * i * width;
+    fclose(f);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    return 1;
   }
 
-  png_write_image(png_ptr, row_pointers);
-
-  free(row_pointers);
-
-  png_write_end(png_ptr, info_ptr);
+  // png_write_end() insists on having compressed the IDAT chunks itself, so finish the file by hand.
+  png_write_chunk(png_ptr, (png_bytep) "IEND", NULL, 0);
   png_destroy_write_struct(&png_ptr, &info_ptr);
   fclose(f);
   return 0;
@@ -350,14 +568,14 @@ int read_image(dt_imageio_module_data_t *p_tmp, uint8_t *out)
 
 size_t params_size(dt_imageio_module_format_t *self)
 {
-  return sizeof(dt_imageio_module_data_t) + sizeof(int);
+  return sizeof(dt_imageio_module_data_t) + 2 * sizeof(int);
 }
 
 void *legacy_params(dt_imageio_module_format_t *self, const void *const old_params,
                     const size_t old_params_size, const int old_version, const int new_version,
                     size_t *new_size)
 {
-  if(old_version == 1 && new_version == 2)
+  if(old_version == 1 && new_version == 3)
   {
     typedef struct dt_imageio_png_v1_t
     {
@@ -381,6 +599,38 @@ void *legacy_params(dt_imageio_module_format_t *self, const void *const old_para
     g_strlcpy(n->style, o->style, sizeof(o->style));
     n->style_append = 0;
     n->bpp = o->bpp;
+    n->compression = Z_BEST_COMPRESSION; // what was always used before
+    n->f = o->f;
+    n->png_ptr = o->png_ptr;
+    n->info_ptr = o->info_ptr;
+    *new_size = self->params_size(self);
+    return n;
+  }
+  if(old_version == 2 && new_version == 3)
+  {
+    typedef struct dt_imageio_png_v2_t
+    {
+      int max_width, max_height;
+      int width, height;
+      char style[128];
+      gboolean style_append;
+      int bpp;
+      FILE *f;
+      png_structp png_ptr;
+      png_infop info_ptr;
+    } dt_imageio_png_v2_t;
+
+    dt_imageio_png_v2_t *o = (dt_imageio_png_v2_t *)old_params;
+    dt_imageio_png_t *n = (dt_imageio_png_t *)malloc(sizeof(dt_imageio_png_t));
+
+    n->max_width = o->max_width;
+    n->max_height = o->max_height;
+    n->width = o->width;
+    n->height = o->height;
+    g_strlcpy(n->style, o->style, sizeof(o->style));
+    n->style_append = o->style_append;
+    n->bpp = o->bpp;
+    n->compression = Z_BEST_COMPRESSION; // what was always used before
     n->f = o->f;
     n->png_ptr = o->png_ptr;
     n->info_ptr = o->info_ptr;
@@ -397,6 +647,8 @@ void *get_params(dt_imageio_module_format_t *self)
     d->bpp = 8;
   else
     d->bpp = 16;
+  d->compression = dt_conf_get_int("plugins/imageio/format/png/compression");
+  if(d->compression < 0 || d->compression > 9) d->compression = 6;
   return d;
 }
 
@@ -415,6 +667,8 @@ int set_params(dt_imageio_module_format_t *self, const void *params, const int s
   else
     dt_bauhaus_combobox_set(g->bit_depth, 1);
   dt_conf_set_int("plugins/imageio/format/png/bpp", d->bpp);
+  dt_bauhaus_slider_set(g->compression, d->compression);
+  dt_conf_set_int("plugins/imageio/format/png/compression", d->compression);
   return 0;
 }
 
@@ -449,6 +703,12 @@ static void bit_depth_changed(GtkWidget *widget, gpointer user_data)
   dt_conf_set_int("plugins/imageio/format/png/bpp", bpp);
 }
 
+static void compression_changed(GtkWidget *slider, gpointer user_data)
+{
+  const int compression = (int)dt_bauhaus_slider_get(slider);
+  dt_conf_set_int("plugins/imageio/format/png/compression", compression);
+}
+
 void init(dt_imageio_module_format_t *self)
 {
 #ifdef USE_LUA
@@ -460,7 +720,6 @@ void cleanup(dt_imageio_module_format_t *self)
 {
 }
 
-// TODO: some quality/compression stuff?
 void gui_init(dt_imageio_module_format_t *self)
 {
   dt_imageio_png_gui_t *gui = (dt_imageio_png_gui_t *)malloc(sizeof(dt_imageio_png_gui_t));
@@ -475,6 +734,14 @@ void gui_init(dt_imageio_module_format_t *self)
   dt_bauhaus_combobox_set(gui->bit_depth, bpp);
   gtk_box_pack_start(GTK_BOX(self->widget), gui->bit_depth, TRUE, TRUE, 0);
   g_signal_connect(G_OBJECT(gui->bit_depth), "value-changed", G_CALLBACK(bit_depth_changed), NULL);
+
+  // 0 stores the pixels uncompressed, 9 is the smallest and the slowest
+  gui->compression = dt_bauhaus_slider_new_with_range(NULL, 0, 9, 1, 6, 0);
+  dt_bauhaus_widget_set_label(gui->compression, NULL, _("compression"));
+  dt_bauhaus_slider_set_default(gui->compression, 6);
+  dt_bauhaus_slider_set(gui->compression, dt_conf_get_int("plugins/imageio/format/png/compression"));
+  gtk_box_pack_start(GTK_BOX(self->widget), gui->compression, TRUE, TRUE, 0);
+  g_signal_connect(G_OBJECT(gui->compression), "value-changed", G_CALLBACK(compression_changed), NULL);
 }
 
 void gui_cleanup(dt_imageio_module_format_t *self)
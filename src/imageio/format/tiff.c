@@ -30,8 +30,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <tiffio.h>
+#include <zlib.h>
 
-DT_MODULE(2)
+DT_MODULE(3)
 
 typedef struct dt_imageio_tiff_t
 {
@@ -41,6 +42,7 @@ typedef struct dt_imageio_tiff_t
   gboolean style_append;
   int bpp;
   int compress;
+  int compresslevel;
   TIFF *handle;
 } dt_imageio_tiff_t;
 
@@ -48,9 +50,77 @@ typedef struct dt_imageio_tiff_gui_t
 {
   GtkWidget *bpp;
   GtkWidget *compress;
+  GtkWidget *compresslevel;
 } dt_imageio_tiff_gui_t;
 
 
+// strips of about that many bytes get compressed independently, that's what lets us spread the work over
+// all cores. libtiff itself only ever runs one strip at a time through zlib.
+#define DT_TIFF_STRIP_SIZE (256 << 10)
+
+// libtiff's floating point predictor (predictor 3): the bytes of the samples get split into planes, most
+// significant first, and then differenced byte by byte.
+static void _tiff_fp_diff(uint8_t *row, uint8_t *tmp, const size_t nsamples)
+{
+  const size_t rowbytes = nsamples * sizeof(float);
+  memcpy(tmp, row, rowbytes);
+  for(size_t k = 0; k < nsamples; k++)
+    for(size_t b = 0; b < sizeof(float); b++)
+    {
+#if G_BYTE_ORDER == G_BIG_ENDIAN
+      row[b * nsamples + k] = tmp[sizeof(float) * k + b];
+#else
+      row[(sizeof(float) - b - 1) * nsamples + k] = tmp[sizeof(float) * k + b];
+#endif
+    }
+  for(size_t k = rowbytes - 1; k >= 3; k--) row[k] -= row[k - 3];
+}
+
+// packs the rows [y, y + rows) of the 4 channel input into 3 channel tiff samples and applies the predictor
+static void _tiff_prepare_strip(const dt_imageio_tiff_t *d, const void *in_void, uint8_t *strip, uint8_t *tmp,
+                                const int y, const int rows, const int predictor)
+{
+  const size_t bytes = d->bpp / 8;
+  const size_t nsamples = (size_t)d->width * 3;
+  const size_t rowsize = nsamples * bytes;
+  for(int j = 0; j < rows; j++)
+  {
+    const uint8_t *in = (const uint8_t *)in_void + (size_t)4 * bytes * (y + j) * d->width;
+    uint8_t *out = strip + j * rowsize;
+    for(int x = 0; x < d->width; x++, in += 4 * bytes, out += 3 * bytes) memcpy(out, in, 3 * bytes);
+
+    out = strip + j * rowsize;
+    if(predictor == 3)
+      _tiff_fp_diff(out, tmp, nsamples);
+    else if(predictor == 2 && bytes == 4)
+    {
+      // libtiff's horizontal differencing, on the bits of the floats in case of 32 bit
+      uint32_t *p = (uint32_t *)out;
+      for(size_t k = nsamples - 1; k >= 3; k--) p[k] -= p[k - 3];
+    }
+    else if(predictor == 2 && bytes == 2)
+    {
+      uint16_t *p = (uint16_t *)out;
+      for(size_t k = nsamples - 1; k >= 3; k--) p[k] -= p[k - 3];
+    }
+    else if(predictor == 2)
+    {
+      for(size_t k = nsamples - 1; k >= 3; k--) out[k] -= out[k - 3];
+    }
+
+#if G_BYTE_ORDER == G_BIG_ENDIAN
+    // we write a little endian file. the floating point predictor takes care of the byte order itself.
+    if(predictor != 3)
+    {
+      if(bytes == 4)
+        for(size_t k = 0; k < nsamples; k++) ((uint32_t *)out)[k] = GUINT32_TO_LE(((uint32_t *)out)[k]);
+      else if(bytes == 2)
+        for(size_t k = 0; k < nsamples; k++) ((uint16_t *)out)[k] = GUINT16_TO_LE(((uint16_t *)out)[k]);
+    }
+#endif
+  }
+}
+
 int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const void *in_void, void *exif,
                 int exif_len, int imgid, int num, int total)
 {
@@ -61,7 +131,9 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
 
   TIFF *tif = NULL;
 
-  void *rowdata = NULL;
+  uint8_t **strips = NULL, **packed = NULL, **tmp = NULL;
+  size_t *packed_len = NULL;
+  int batch = 0;
 
   int rc = 1; // default to error
 
@@ -96,32 +168,29 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   // "write the official compression code (0x0008)."
   // http://www.awaresystems.be/imaging/tiff/tifftags/compression.html
   // http://www.awaresystems.be/imaging/tiff/tifftags/predictor.html
-  if(d->compress == 1)
-  {
-    TIFFSetField(tif, TIFFTAG_COMPRESSION, (uint16_t)COMPRESSION_ADOBE_DEFLATE);
-    TIFFSetField(tif, TIFFTAG_PREDICTOR, (uint16_t)1);
-    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)9);
-  }
-  else if(d->compress == 2)
-  {
-    TIFFSetField(tif, TIFFTAG_COMPRESSION, (uint16_t)COMPRESSION_ADOBE_DEFLATE);
-    TIFFSetField(tif, TIFFTAG_PREDICTOR, (uint16_t)2);
-    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)9);
-  }
+  int predictor = 1;
+  if(d->compress == 2)
+    predictor = 2;
   else if(d->compress == 3)
+    predictor = d->bpp == 32 ? 3 : 2;
+  const int level = CLAMP(d->compresslevel, 1, 9);
+
+  if(d->compress > 0)
   {
     TIFFSetField(tif, TIFFTAG_COMPRESSION, (uint16_t)COMPRESSION_ADOBE_DEFLATE);
-    if(d->bpp == 32)
-      TIFFSetField(tif, TIFFTAG_PREDICTOR, (uint16_t)3);
-    else
-      TIFFSetField(tif, TIFFTAG_PREDICTOR, (uint16_t)2);
-    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)9);
+    TIFFSetField(tif, TIFFTAG_PREDICTOR, (uint16_t)predictor);
+    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)level);
   }
   else // (d->compress == 0)
   {
     TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
   }
 
+  const size_t rowsize = (size_t)(d->width * 3) * d->bpp / 8;
+  const int rows_per_strip = CLAMP((int)(DT_TIFF_STRIP_SIZE / rowsize), 1, d->height);
+  const int nstrips = (d->height + rows_per_strip - 1) / rows_per_strip;
+  const size_t stripsize = rowsize * rows_per_strip;
+
   TIFFSetField(tif, TIFFTAG_FILLORDER, (uint16_t)FILLORDER_MSB2LSB);
   if(profile != NULL)
   {
@@ -134,7 +203,7 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   TIFFSetField(tif, TIFFTAG_IMAGELENGTH, (uint32_t)d->height);
   TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, (uint16_t)PHOTOMETRIC_RGB);
   TIFFSetField(tif, TIFFTAG_PLANARCONFIG, (uint16_t)PLANARCONFIG_CONTIG);
-  TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, (uint32_t)1);
+  TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, (uint32_t)rows_per_strip);
   TIFFSetField(tif, TIFFTAG_ORIENTATION, (uint16_t)ORIENTATION_TOPLEFT);
 
   int resolution = dt_conf_get_int("metadata/resolution");
@@ -145,64 +214,59 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
     TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, (uint16_t)RESUNIT_INCH);
   }
 
-  const size_t rowsize = (d->width * 3) * d->bpp / 8;
-  if((rowdata = malloc(rowsize)) == NULL)
+  // the strips are prepared and compressed a batch at a time, in parallel, and then written in order
+  batch = MIN(nstrips, dt_get_num_threads() * 2);
+  const size_t packedsize = d->compress > 0 ? compressBound(stripsize) : 0;
+  strips = (uint8_t **)calloc(batch, sizeof(uint8_t *));
+  packed = (uint8_t **)calloc(batch, sizeof(uint8_t *));
+  tmp = (uint8_t **)calloc(batch, sizeof(uint8_t *));
+  packed_len = (size_t *)calloc(batch, sizeof(size_t));
+  if(!strips || !packed || !tmp || !packed_len)
   {
     rc = 1;
     goto exit;
   }
-
-  if(d->bpp == 32)
+  for(int k = 0; k < batch; k++)
   {
-    for(int y = 0; y < d->height; y++)
+    strips[k] = (uint8_t *)malloc(stripsize);
+    if(!strips[k] || (packedsize && !(packed[k] = (uint8_t *)malloc(packedsize)))
+       || (predictor == 3 && !(tmp[k] = (uint8_t *)malloc(rowsize))))
     {
-      float *in = (float *)in_void + (size_t)4 * y * d->width;
-      float *out = (float *)rowdata;
-
-      for(int x = 0; x < d->width; x++, in += 4, out += 3)
-      {
-        memcpy(out, in, 3 * sizeof(float));
-      }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
+      rc = 1;
+      goto exit;
     }
   }
-  else if(d->bpp == 16)
+
+  for(int first = 0; first < nstrips; first += batch)
   {
-    for(int y = 0; y < d->height; y++)
+    const int count = MIN(batch, nstrips - first);
+    int failed = 0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for(int k = 0; k < count; k++)
     {
-      uint16_t *in = (uint16_t *)in_void + (size_t)4 * y * d->width;
-      uint16_t *out = (uint16_t *)rowdata;
-
-      for(int x = 0; x < d->width; x++, in += 4, out += 3)
+      const int y = (first + k) * rows_per_strip;
+      const int rows = MIN(rows_per_strip, d->height - y);
+      _tiff_prepare_strip(d, in_void, strips[k], tmp[k], y, rows, predictor);
+      packed_len[k] = rowsize * rows;
+      if(d->compress > 0)
       {
-        memcpy(out, in, 3 * sizeof(uint16_t));
-      }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
+        uLongf len = packedsize;
+        if(compress2(packed[k], &len, strips[k], packed_len[k], level) != Z_OK)
+          failed = 1;
+        packed_len[k] = len;
       }
     }
-  }
-  else
-  {
-    for(int y = 0; y < d->height; y++)
+    if(failed)
     {
-      uint8_t *in = (uint8_t *)in_void + (size_t)4 * y * d->width;
-      uint8_t *out = (uint8_t *)rowdata;
-
-      for(int x = 0; x < d->width; x++, in += 4, out += 3)
-      {
-        memcpy(out, in, 3 * sizeof(uint8_t));
-      }
+      rc = 1;
+      goto exit;
+    }
 
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
+    for(int k = 0; k < count; k++)
+    {
+      if(TIFFWriteRawStrip(tif, first + k, d->compress > 0 ? packed[k] : strips[k], packed_len[k]) == -1)
       {
         rc = 1;
         goto exit;
@@ -228,8 +292,16 @@ exit:
   }
   free(profile);
   profile = NULL;
-  free(rowdata);
-  rowdata = NULL;
+  for(int k = 0; k < batch; k++)
+  {
+    if(strips) free(strips[k]);
+    if(packed) free(packed[k]);
+    if(tmp) free(tmp[k]);
+  }
+  free(strips);
+  free(packed);
+  free(tmp);
+  free(packed_len);
 
   return rc;
 }
@@ -262,7 +334,7 @@ void *legacy_params(dt_imageio_module_format_t *self, const void *const old_para
                     const size_t old_params_size, const int old_version, const int new_version,
                     size_t *new_size)
 {
-  if(old_version == 1 && new_version == 2)
+  if(old_version == 1 && new_version == 3)
   {
     typedef struct dt_imageio_tiff_v1_t
     {
@@ -286,6 +358,36 @@ void *legacy_params(dt_imageio_module_format_t *self, const void *const old_para
     n->style_append = 0;
     n->bpp = o->bpp;
     n->compress = o->compress;
+    n->compresslevel = 9; // what was always used before
+    n->handle = o->handle;
+    *new_size = self->params_size(self);
+    return n;
+  }
+  if(old_version == 2 && new_version == 3)
+  {
+    typedef struct dt_imageio_tiff_v2_t
+    {
+      int max_width, max_height;
+      int width, height;
+      char style[128];
+      gboolean style_append;
+      int bpp;
+      int compress;
+      TIFF *handle;
+    } dt_imageio_tiff_v2_t;
+
+    const dt_imageio_tiff_v2_t *o = (dt_imageio_tiff_v2_t *)old_params;
+    dt_imageio_tiff_t *n = (dt_imageio_tiff_t *)malloc(sizeof(dt_imageio_tiff_t));
+
+    n->max_width = o->max_width;
+    n->max_height = o->max_height;
+    n->width = o->width;
+    n->height = o->height;
+    g_strlcpy(n->style, o->style, sizeof(o->style));
+    n->style_append = o->style_append;
+    n->bpp = o->bpp;
+    n->compress = o->compress;
+    n->compresslevel = 9; // what was always used before
     n->handle = o->handle;
     *new_size = self->params_size(self);
     return n;
@@ -303,6 +405,8 @@ void *get_params(dt_imageio_module_format_t *self)
   else
     d->bpp = 8;
   d->compress = dt_conf_get_int("plugins/imageio/format/tiff/compress");
+  d->compresslevel = dt_conf_get_int("plugins/imageio/format/tiff/compresslevel");
+  if(d->compresslevel < 1 || d->compresslevel > 9) d->compresslevel = 6;
   return d;
 }
 
@@ -325,6 +429,7 @@ int set_params(dt_imageio_module_format_t *self, const void *params, const int s
     dt_bauhaus_combobox_set(g->bpp, 0);
 
   dt_bauhaus_combobox_set(g->compress, d->compress);
+  dt_bauhaus_slider_set(g->compresslevel, d->compresslevel);
 
   return 0;
 }
@@ -381,6 +486,12 @@ static void compress_combobox_changed(GtkWidget *widget, gpointer user_data)
   dt_conf_set_int("plugins/imageio/format/tiff/compress", compress);
 }
 
+static void compresslevel_changed(GtkWidget *slider, gpointer user_data)
+{
+  const int compresslevel = (int)dt_bauhaus_slider_get(slider);
+  dt_conf_set_int("plugins/imageio/format/tiff/compresslevel", compresslevel);
+}
+
 void init(dt_imageio_module_format_t *self)
 {
 #ifdef USE_LUA
@@ -391,7 +502,6 @@ void cleanup(dt_imageio_module_format_t *self)
 {
 }
 
-// TODO: some quality/compression stuff?
 void gui_init(dt_imageio_module_format_t *self)
 {
   dt_imageio_tiff_gui_t *gui = (dt_imageio_tiff_gui_t *)malloc(sizeof(dt_imageio_tiff_gui_t));
@@ -401,6 +511,8 @@ void gui_init(dt_imageio_module_format_t *self)
 
   const int compress = dt_conf_get_int("plugins/imageio/format/tiff/compress");
 
+  const int compresslevel = dt_conf_get_int("plugins/imageio/format/tiff/compresslevel");
+
   self->widget = gtk_box_new(GTK_ORIENTATION_VERTICAL, DT_PIXEL_APPLY_DPI(5));
 
   gui->bpp = dt_bauhaus_combobox_new(NULL);
@@ -426,6 +538,14 @@ void gui_init(dt_imageio_module_format_t *self)
   dt_bauhaus_combobox_set(gui->compress, compress);
   gtk_box_pack_start(GTK_BOX(self->widget), gui->compress, TRUE, TRUE, 0);
   g_signal_connect(G_OBJECT(gui->compress), "value-changed", G_CALLBACK(compress_combobox_changed), NULL);
+
+  // higher levels compress a bit better and take a lot longer, 6 is zlib's own default
+  gui->compresslevel = dt_bauhaus_slider_new_with_range(NULL, 1, 9, 1, 6, 0);
+  dt_bauhaus_widget_set_label(gui->compresslevel, NULL, _("compression level"));
+  dt_bauhaus_slider_set_default(gui->compresslevel, 6);
+  if(compresslevel > 0) dt_bauhaus_slider_set(gui->compresslevel, compresslevel);
+  gtk_box_pack_start(GTK_BOX(self->widget), gui->compresslevel, TRUE, TRUE, 0);
+  g_signal_connect(G_OBJECT(gui->compresslevel), "value-changed", G_CALLBACK(compresslevel_changed), NULL);
 }
 
 void gui_cleanup(dt_imageio_module_format_t *self)
@@ -19,6 +19,7 @@
 #include "bauhaus/bauhaus.h"
 #include "common/darktable.h"
 #include "common/exif.h"
+#include "common/export_manifest.h"
 #include "common/image.h"
 #include "common/image_cache.h"
 #include "common/imageio.h"
@@ -37,6 +38,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+// additional sizes that can be written for every image
+#define DT_IMAGEIO_DISK_MAX_SIZES 8
+
 DT_MODULE(2)
 
 // gui data
@@ -52,6 +56,7 @@ typedef struct dt_imageio_disk_t
   char filename[DT_MAX_PATH_FOR_PARAMS];
   gboolean overwrite;
   dt_variables_params_t *vp;
+  struct dt_export_manifest_t *manifest; // of this export job, created on first use
 } dt_imageio_disk_t;
 
 
@@ -186,6 +191,28 @@ void gui_reset(dt_imageio_module_storage_t *self)
   dt_bauhaus_combobox_set(d->overwrite, 0);
 }
 
+static gchar *_size_filename(const char *filename, const int size)
+{
+  const char *dot = strrchr(filename, '.');
+  if(!dot) return NULL;
+  return g_strdup_printf("%.*s_%d%s", (int)(dot - filename), filename, size, dot);
+}
+
+// filename and its smaller copies have been written with key before and are still there
+static gboolean _unchanged(dt_imageio_disk_t *d, const char *filename, const char *key, const int *sizes,
+                           const int num_sizes)
+{
+  if(!key || !dt_export_manifest_lookup(d->manifest, filename, key)) return FALSE;
+  gboolean found = TRUE;
+  for(int k = 0; k < num_sizes && found; k++)
+  {
+    gchar *size_filename = _size_filename(filename, sizes[k]);
+    found = size_filename && g_file_test(size_filename, G_FILE_TEST_IS_REGULAR);
+    g_free(size_filename);
+  }
+  return found;
+}
+
 int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, const int imgid,
           dt_imageio_module_format_t *format, dt_imageio_module_data_t *fdata, const int num, const int total,
           const gboolean high_quality, const gboolean upscale)
@@ -197,6 +224,27 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   gboolean from_cache = FALSE;
   dt_image_full_path(imgid, dirname, sizeof(dirname), &from_cache);
   int fail = 0;
+
+  // smaller copies for the web and the like, as <name>_<size>.<ext> next to the file. they all come from the
+  // same run of the pipe.
+  int size_list[DT_IMAGEIO_DISK_MAX_SIZES];
+  int num_sizes = 0;
+  gchar *extra_sizes = dt_conf_get_string("plugins/imageio/storage/disk/extra_sizes");
+  gchar **tokens = g_strsplit(extra_sizes, ",", -1);
+  for(gchar **t = tokens; *t && num_sizes < DT_IMAGEIO_DISK_MAX_SIZES; t++)
+  {
+    const int size = atoi(g_strstrip(*t));
+    if(size > 0) size_list[num_sizes++] = size;
+  }
+  g_strfreev(tokens);
+
+  // what the file is made from, to skip images that have been exported like this before
+  gchar *key = NULL;
+  gboolean skip = FALSE;
+  if(dt_conf_get_bool("plugins/imageio/storage/disk/skip_unchanged"))
+    key = dt_export_manifest_key(imgid, format, fdata, high_quality, upscale, extra_sizes);
+  g_free(extra_sizes);
+
   // we're potentially called in parallel. have sequence number synchronized:
   dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
   {
@@ -277,35 +325,84 @@ try_again:
 
     sprintf(c, ".%s", ext);
 
+    if(key && !d->manifest) d->manifest = dt_export_manifest_new();
+    skip = _unchanged(d, filename, key, size_list, num_sizes);
+
   /* prevent overwrite of files */
   failed:
     if(!d->overwrite)
     {
       int seq = 1;
-      if(!fail && g_file_test(filename, G_FILE_TEST_EXISTS))
+      if(!fail && !skip && g_file_test(filename, G_FILE_TEST_EXISTS))
       {
         do
         {
           sprintf(c, "_%.2d.%s", seq, ext);
           seq++;
+          // one of the earlier copies is what this export would make, e.g. after an edit was undone again
+          if(_unchanged(d, filename, key, size_list, num_sizes))
+          {
+            skip = TRUE;
+            break;
+          }
         } while(g_file_test(filename, G_FILE_TEST_EXISTS));
       }
     }
   } // end of critical block
   dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
-  if(fail) return 1;
+  if(fail)
+  {
+    g_free(key);
+    return 1;
+  }
+
+  char *trunc = filename + strlen(filename) - 32;
+  if(trunc < filename) trunc = filename;
+
+  if(skip)
+  {
+    g_free(key);
+    printf("[export_job] `%s' is unchanged, skipped\n", filename);
+    dt_control_log(ngettext("%d/%d `%s%s' is unchanged", "%d/%d `%s%s' is unchanged", num), num, total,
+                   trunc != filename ? ".." : "", trunc);
+    return 0;
+  }
+
+  dt_imageio_export_size_t sizes[DT_IMAGEIO_DISK_MAX_SIZES];
+  int num_size_files = 0;
+  for(int k = 0; k < num_sizes; k++)
+  {
+    sizes[num_size_files].filename = _size_filename(filename, size_list[k]);
+    if(!sizes[num_size_files].filename) continue;
+    sizes[num_size_files].max_width = sizes[num_size_files].max_height = size_list[k];
+    num_size_files++;
+  }
 
   /* export image to file */
-  if(dt_imageio_export(imgid, filename, format, fdata, high_quality, upscale, TRUE, self, sdata, num, total) != 0)
+  const int res = dt_imageio_export_sizes(imgid, filename, format, fdata, sizes, num_size_files, high_quality,
+                                          upscale, TRUE, self, sdata, num, total);
+  for(int k = 0; k < num_size_files; k++) g_free((gchar *)sizes[k].filename);
+  if(res != 0)
   {
+    g_free(key);
     fprintf(stderr, "[imageio_storage_disk] could not export to file: `%s'!\n", filename);
     dt_control_log(_("could not export to file `%s'!"), filename);
     return 1;
   }
 
+  if(key)
+  {
+    // again, the export applies the auto presets to images that haven't been opened yet, which changes their
+    // history. the next export has to find the key it will compute then.
+    g_free(key);
+    gchar *extra = dt_conf_get_string("plugins/imageio/storage/disk/extra_sizes");
+    key = dt_export_manifest_key(imgid, format, fdata, high_quality, upscale, extra);
+    g_free(extra);
+    dt_export_manifest_record(d->manifest, filename, key);
+    g_free(key);
+  }
+
   printf("[export_job] exported to `%s'\n", filename);
-  char *trunc = filename + strlen(filename) - 32;
-  if(trunc < filename) trunc = filename;
   dt_control_log(ngettext("%d/%d exported to `%s%s'", "%d/%d exported to `%s%s'", num),
                  num, total, trunc != filename ? ".." : "", trunc);
   return 0;
@@ -313,7 +410,7 @@ try_again:
 
 size_t params_size(dt_imageio_module_storage_t *self)
 {
-  return sizeof(dt_imageio_disk_t) - sizeof(void *);
+  return sizeof(dt_imageio_disk_t) - 2 * sizeof(void *);
 }
 
 void init(dt_imageio_module_storage_t *self)
@@ -336,6 +433,7 @@ void *get_params(dt_imageio_module_storage_t *self)
 
   d->vp = NULL;
   dt_variables_params_init(&d->vp);
+  d->manifest = NULL;
 
   return d;
 }
@@ -345,6 +443,7 @@ void free_params(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *pa
   if(!params) return;
   dt_imageio_disk_t *d = (dt_imageio_disk_t *)params;
   dt_variables_params_destroy(d->vp);
+  dt_export_manifest_free(d->manifest);
   free(params);
 }
 
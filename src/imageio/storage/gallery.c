@@ -320,12 +320,26 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
            relthumbfilename,
            num, num-1, title ? title : "&nbsp;", description ? description : "&nbsp;");
 
-  // export image to file. need this to be able to access meaningful
+  // the thumbnail is written next to the image, with -thumb in its name
+  char thumbfilename[PATH_MAX] = { 0 };
+  g_strlcpy(thumbfilename, filename, sizeof(thumbfilename));
+  c = thumbfilename + strlen(thumbfilename);
+  for(; c > thumbfilename && *c != '.' && *c != '/'; c--)
+    ;
+  if(c <= thumbfilename || *c == '/') c = thumbfilename + strlen(thumbfilename);
+  snprintf(c, sizeof(thumbfilename) - (c - thumbfilename), "-thumb.%s", ext);
+  const dt_imageio_export_size_t thumb = { thumbfilename, 200, 200 };
+
+  // export image and thumbnail with one run of the pipe. need this to be able to access meaningful
   // fdata->width and height below.
-  if(dt_imageio_export(imgid, filename, format, fdata, high_quality, upscale, FALSE, self, sdata, num, total) != 0)
+  if(dt_imageio_export_sizes(imgid, filename, format, fdata, &thumb, 1, high_quality, upscale, FALSE, self, sdata,
+                             num, total) != 0)
   {
     fprintf(stderr, "[imageio_storage_gallery] could not export to file: `%s'!\n", filename);
     dt_control_log(_("could not export to file `%s'!"), filename);
+    free(pair);
+    if(res_title) g_list_free_full(res_title, &g_free);
+    if(res_desc) g_list_free_full(res_desc, &g_free);
     return 1;
   }
 
@@ -343,29 +357,6 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   if(res_desc) g_list_free_full(res_desc, &g_free);
   d->l = g_list_insert_sorted(d->l, pair, (GCompareFunc)sort_pos);
 
-  /* also export thumbnail: */
-  // write with reduced resolution:
-  const int max_width = fdata->max_width;
-  const int max_height = fdata->max_height;
-  fdata->max_width = 200;
-  fdata->max_height = 200;
-  // alter filename with -thumb:
-  c = filename + strlen(filename);
-  for(; c > filename && *c != '.' && *c != '/'; c--)
-    ;
-  if(c <= filename || *c == '/') c = filename + strlen(filename);
-  ext = format->extension(fdata);
-  sprintf(c, "-thumb.%s", ext);
-  if(dt_imageio_export(imgid, filename, format, fdata, FALSE, TRUE, FALSE, self, sdata, num, total) != 0)
-  {
-    fprintf(stderr, "[imageio_storage_gallery] could not export to file: `%s'!\n", filename);
-    dt_control_log(_("could not export to file `%s'!"), filename);
-    return 1;
-  }
-  // restore for next image:
-  fdata->max_width = max_width;
-  fdata->max_height = max_height;
-
   printf("[export_job] exported to `%s'\n", filename);
   char *trunc = filename + strlen(filename) - 32;
   if(trunc < filename) trunc = filename;
@@ -40,6 +40,12 @@ DAMAGE.
 #include <stdlib.h>
 #include <string.h>
 
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 /*******************************************************************
  * Hash table implementation for permutohedral lattice             *
  *                                                                 *
@@ -47,30 +53,41 @@ DAMAGE.
  * The key for each point is its spatial location in the (d+1)-    *
  * dimensional space.                                              *
  *                                                                 *
+ * The table is shared by all splatting threads: keys and values   *
+ * live in a preallocated arena which is filled front to back, the *
+ * open addressing slots only hold an index into the arena and are *
+ * claimed with compare-and-swap. The table never grows while      *
+ * threads are inserting, reserve() tells the caller whether there *
+ * is room left, grow() has to be called from a single thread.     *
+ * As values are summed up atomically in whatever order the        *
+ * threads arrive, results are not bit-exact between runs.         *
+ *                                                                 *
  *******************************************************************/
 template <int KD, int VD> class HashTablePermutohedral
 {
 public:
   /* Constructor
-   *  kd_: the dimensionality of the position vectors on the hyperplane.
-   *  vd_: the dimensionality of the value vectors
+   *  capacity_: number of lattice points the arena can hold before it has to grow
    */
-  HashTablePermutohedral()
+  HashTablePermutohedral(size_t capacity_ = 1 << 15)
   {
-    capacity = 1 << 15;
-    capacity_bits = 0x7fff;
+    entriesCapacity = 1 << 15;
+    while(entriesCapacity < capacity_) entriesCapacity <<= 1;
+    // keep the load of the slot table at 50% at most
+    capacity = 2 * entriesCapacity;
+    capacity_bits = capacity - 1;
     filled = 0;
-    entries = new Entry[capacity];
-    keys = new short[KD * capacity / 2];
-    values = new float[VD * capacity / 2];
-    memset(values, 0, sizeof(float) * VD * capacity / 2);
+    // calloc: untouched parts of the arena don't cost physical memory
+    entries = (int *)calloc(capacity, sizeof(int));
+    keys = (short *)calloc((size_t)KD * entriesCapacity, sizeof(short));
+    values = (float *)calloc((size_t)VD * entriesCapacity, sizeof(float));
   }
 
   ~HashTablePermutohedral()
   {
-    delete[] entries;
-    delete[] keys;
-    delete[] values;
+    free(entries);
+    free(keys);
+    free(values);
   }
 
   // Returns the number of vectors stored.
@@ -91,46 +108,54 @@ public:
     return values;
   }
 
+  /* Returns true if n more vectors can be inserted, by this and up to
+   * nThreads - 1 other threads doing the same, without growing the table.
+   */
+  bool reserve(int n, int nThreads)
+  {
+    return (size_t)filled + (size_t)n * nThreads <= entriesCapacity;
+  }
+
   /* Returns the index into the hash table for a given key.
    *     key: a pointer to the position vector.
    *       h: hash of the position vector.
    *  create: a flag specifying whether an entry should be created,
    *          should an entry with the given key not found.
+   * safe to be called concurrently, as long as reserve() said there is room.
    */
   int lookupOffset(const short *key, size_t h, bool create = true)
   {
-
-    // Double hash table size if necessary
-    if(filled >= (capacity / 2) - 1)
-    {
-      grow();
-    }
+    int reserved = -1;
 
     // Find the entry with the given key
     while(1)
     {
-      Entry e = entries[h];
+      // slots hold the index + 1 of the entry in the arena, 0 is empty
+      int e = *(volatile int *)(entries + h) - 1;
       // check if the cell is empty
-      if(e.keyIdx == -1)
+      if(e == -1)
       {
         if(!create) return -1; // Return not found.
-        // need to create an entry. Store the given key.
-        for(int i = 0; i < KD; i++) keys[filled * KD + i] = key[i];
-        e.keyIdx = filled * KD;
-        e.valueIdx = filled * VD;
-        entries[h] = e;
-        filled++;
-        return e.valueIdx;
+        // need to create an entry. Store the given key in a fresh arena entry
+        // before publishing it, we keep the entry if we lose the race for this slot.
+        if(reserved == -1)
+        {
+          reserved = __sync_fetch_and_add(&filled, 1);
+          for(int i = 0; i < KD; i++) keys[(size_t)reserved * KD + i] = key[i];
+        }
+        if(__sync_bool_compare_and_swap(entries + h, 0, reserved + 1)) return reserved * VD;
+        // somebody else was faster, look at what they stored
+        e = *(volatile int *)(entries + h) - 1;
       }
 
       // check if the cell has a matching key
       bool match = true;
-      for(int i = 0; i < KD && match; i++) match = keys[e.keyIdx + i] == key[i];
-      if(match) return e.valueIdx;
+      for(int i = 0; i < KD && match; i++) match = keys[(size_t)e * KD + i] == key[i];
+      // a reserved but unused entry stays behind as a zero vector nobody references.
+      if(match) return e * VD;
 
       // increment the bucket with wraparound
-      h++;
-      if(h == capacity) h = 0;
+      h = (h + 1) & capacity_bits;
     }
   }
 
@@ -160,59 +185,45 @@ public:
     return k;
   }
 
-private:
-  /* Grows the size of the hash table */
-  void grow()
+  /* Grows the table so that at least capacity_ vectors fit. Entry indices,
+   * and thus value offsets, stay valid. Must not run concurrently with lookups.
+   */
+  void grow(size_t capacity_)
   {
-    size_t oldCapacity = capacity;
-    capacity *= 2;
-    capacity_bits = (capacity_bits << 1) | 1;
-
-    // Migrate the value vectors.
-    float *newValues = new float[VD * capacity / 2];
-    memset(newValues, 0, sizeof(float) * VD * capacity / 2);
-    memcpy(newValues, values, sizeof(float) * VD * filled);
-    delete[] values;
-    values = newValues;
-
-    // Migrate the key vectors.
-    short *newKeys = new short[KD * capacity / 2];
-    memcpy(newKeys, keys, sizeof(short) * KD * filled);
-    delete[] keys;
-    keys = newKeys;
-
-    Entry *newEntries = new Entry[capacity];
-
-    // Migrate the table of indices.
+    if(capacity_ <= entriesCapacity) return;
+    const size_t oldEntriesCapacity = entriesCapacity;
+    while(entriesCapacity < capacity_) entriesCapacity <<= 1;
+    const size_t oldCapacity = capacity;
+    capacity = 2 * entriesCapacity;
+    capacity_bits = capacity - 1;
+
+    // Migrate the value and key vectors, the arena keeps its layout.
+    values = (float *)realloc(values, sizeof(float) * VD * entriesCapacity);
+    memset(values + VD * oldEntriesCapacity, 0, sizeof(float) * VD * (entriesCapacity - oldEntriesCapacity));
+    keys = (short *)realloc(keys, sizeof(short) * KD * entriesCapacity);
+
+    // Migrate the table of indices. keys are unique, no need to compare them.
+    int *oldEntries = entries;
+    entries = (int *)calloc(capacity, sizeof(int));
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
     for(size_t i = 0; i < oldCapacity; i++)
     {
-      if(entries[i].keyIdx == -1) continue;
-      size_t h = hash(keys + entries[i].keyIdx) & capacity_bits;
-      while(newEntries[h].keyIdx != -1)
-      {
-        h++;
-        if(h == capacity) h = 0;
-      }
-      newEntries[h] = entries[i];
+      const int e = oldEntries[i];
+      if(e == 0) continue;
+      size_t h = hash(keys + (size_t)(e - 1) * KD) & capacity_bits;
+      while(!__sync_bool_compare_and_swap(entries + h, 0, e)) h = (h + 1) & capacity_bits;
     }
-    delete[] entries;
-    entries = newEntries;
+    free(oldEntries);
   }
 
-  // Private struct for the hash table entries.
-  struct Entry
-  {
-    Entry() : keyIdx(-1), valueIdx(-1)
-    {
-    }
-    int keyIdx;
-    int valueIdx;
-  };
-
+private:
   short *keys;
   float *values;
-  Entry *entries;
-  size_t capacity, filled;
+  int *entries;
+  size_t capacity, entriesCapacity;
+  int filled;
   unsigned long capacity_bits;
 };
 
@@ -230,7 +241,8 @@ public:
    *    vd_ : dimensionality of value vectors
    * nData_ : number of points in the input
    */
-  PermutohedralLattice(size_t nData_, int nThreads_ = 1) : nData(nData_), nThreads(nThreads_)
+  PermutohedralLattice(size_t nData_, int nThreads_ = 1)
+    : nData(nData_), nThreads(nThreads_), hashTable(estimateCapacity(nData_))
   {
 
     // Allocate storage for various arrays
@@ -271,7 +283,7 @@ public:
     }
     scaleFactor = scaleFactorTmp;
 
-    hashTables = new HashTablePermutohedral<D, VD>[nThreads];
+    overflow = new std::vector<OverflowEntry>[nThreads];
   }
 
 
@@ -280,13 +292,25 @@ public:
     delete[] scaleFactor;
     delete[] replay;
     delete[] canonical;
-    delete[] hashTables;
+    delete[] overflow;
   }
 
 
   /* Performs splatting with given position and value vectors */
   void splat(float *position, float *value, size_t replay_index, int thread_index = 0)
   {
+    // the lattice is shared by all threads and can't grow now. if this point might not fit
+    // anymore, keep it for merge_splat_threads().
+    if(!hashTable.reserve(D + 1, nThreads))
+    {
+      OverflowEntry o;
+      o.index = replay_index;
+      memcpy(o.position, position, sizeof(o.position));
+      memcpy(o.value, value, sizeof(o.value));
+      overflow[thread_index].push_back(o);
+      return;
+    }
+
     float elevated[D + 1];
     int greedy[D + 1];
     int rank[D + 1];
@@ -378,47 +402,53 @@ public:
       for(int i = 0; i < D; i++) key[i] = greedy[i] + canonical[remainder * (D + 1) + rank[i]];
 
       // Retrieve pointer to the value at this vertex.
-      float *val = hashTables[thread_index].lookup(key, true);
-
-      // Accumulate values with barycentric weight.
-      for(int i = 0; i < VD; i++) val[i] += barycentric[remainder] * value[i];
+      float *val = hashTable.lookup(key, true);
+
+      // Accumulate values with barycentric weight, other threads may hit the same vertex.
+      // The order of the float additions into a shared vertex depends on thread timing,
+      // so the sums, and thus the output, can differ in the last bits from run to run.
+      // Per-thread tables reduced in a fixed order would avoid that, at nThreads times
+      // the memory, which is what sharing the table is meant to save.
+      for(int i = 0; i < VD; i++)
+      {
+        const float v = barycentric[remainder] * value[i];
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+        val[i] += v;
+      }
 
       // Record this interaction to use later when slicing
-      replay[replay_index * (D + 1) + remainder].table = thread_index;
-      replay[replay_index * (D + 1) + remainder].offset = val - hashTables[thread_index].getValues();
+      replay[replay_index * (D + 1) + remainder].offset = val - hashTable.getValues();
       replay[replay_index * (D + 1) + remainder].weight = barycentric[remainder];
     }
   }
 
-  /* Merge the multiple threads' hash tables into the totals. */
+  /* All threads splat into the same table, so there is nothing to merge. Only points which
+   * didn't fit into the table are splatted now, after growing it. Call once after splatting.
+   */
   void merge_splat_threads(void)
   {
-    if(nThreads <= 1) return;
-
-    /* Merge the multiple hash tables into one, creating an offset remap table. */
-    int **offset_remap = new int *[nThreads];
-    for(int i = 1; i < nThreads; i++)
+    std::vector<OverflowEntry> pending;
+    for(int i = 0; i < nThreads; i++)
     {
-      const short *oldKeys = hashTables[i].getKeys();
-      const float *oldVals = hashTables[i].getValues();
-      const int filled = hashTables[i].size();
-      offset_remap[i] = new int[filled];
-      for(int j = 0; j < filled; j++)
-      {
-        float *val = hashTables[0].lookup(oldKeys + j * D, true);
-        const float *oldVal = oldVals + j * VD;
-        for(int k = 0; k < VD; k++) val[k] += oldVal[k];
-        offset_remap[i][j] = val - hashTables[0].getValues();
-      }
+      pending.insert(pending.end(), overflow[i].begin(), overflow[i].end());
+      std::vector<OverflowEntry>().swap(overflow[i]);
     }
+    if(pending.empty()) return;
 
-    /* Rewrite the offsets in the replay structure from the above generated table. */
-    for(int i = 0; i < nData * (D + 1); i++)
-      if(replay[i].table > 0) replay[i].offset = offset_remap[replay[i].table][replay[i].offset / VD];
-
-    for(int i = 1; i < nThreads; i++) delete[] offset_remap[i];
+    // make room for all of them, they can't overflow again.
+    hashTable.grow((size_t)hashTable.size() + (pending.size() + nThreads) * (D + 1));
 
-    delete[] offset_remap;
+    const int n = pending.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) shared(pending)
+#endif
+    for(int i = 0; i < n; i++)
+    {
+      OverflowEntry &o = pending[i];
+      splat(o.position, o.value, o.index, dt_get_thread_num());
+    }
   }
 
   /* Performs slicing out of position vectors. Note that the barycentric weights and the simplex
@@ -427,7 +457,7 @@ public:
    */
   void slice(float *col, size_t replay_index)
   {
-    float *base = hashTables[0].getValues();
+    const float *base = hashTable.getValues();
     for(int j = 0; j < VD; j++) col[j] = 0;
     for(int i = 0; i <= D; i++)
     {
@@ -442,24 +472,26 @@ public:
   /* Performs a Gaussian blur along each projected axis in the hyperplane. */
   void blur()
   {
+    const int size = hashTable.size();
+
     // Prepare arrays
-    float *newValue = new float[VD * hashTables[0].size()];
-    float *oldValue = hashTables[0].getValues();
+    float *newValue = new float[VD * size];
+    float *oldValue = hashTable.getValues();
     float *hashTableBase = oldValue;
-
-    float zero[VD];
-    for(int k = 0; k < VD; k++) zero[k] = 0;
+    // value offsets of the two neighbours along the current axis, -1 if there is none
+    int *neighbours = new int[2 * size];
 
     // For each of d+1 axes,
     for(int j = 0; j <= D; j++)
     {
+      // first find the neighbours of all vertices, so that the blur itself is a plain gather
 #ifdef _OPENMP
-#pragma omp parallel for shared(j, oldValue, newValue, hashTableBase, zero)
+#pragma omp parallel for schedule(static) shared(j, neighbours)
 #endif
       // For each vertex in the lattice,
-      for(int i = 0; i < hashTables[0].size(); i++) // blur point i in dimension j
+      for(int i = 0; i < size; i++) // blur point i in dimension j
       {
-        const short *key = hashTables[0].getKeys() + i * (D); // keys to current vertex
+        const short *key = hashTable.getKeys() + (size_t)i * (D); // keys to current vertex
         short neighbor1[D + 1];
         short neighbor2[D + 1];
         for(int k = 0; k < D; k++)
@@ -470,22 +502,23 @@ public:
         neighbor1[j] = key[j] - D;
         neighbor2[j] = key[j] + D; // keys to the neighbors along the given axis.
 
-        float *oldVal = oldValue + i * VD;
-        float *newVal = newValue + i * VD;
-
-        float *vm1, *vp1;
-
-        vm1 = hashTables[0].lookup(neighbor1, false); // look up first neighbor
-        if(vm1)
-          vm1 = vm1 - hashTableBase + oldValue;
-        else
-          vm1 = zero;
+        const float *vm1 = hashTable.lookup(neighbor1, false); // look up first neighbor
+        const float *vp1 = hashTable.lookup(neighbor2, false); // look up second neighbor
+        neighbours[2 * i] = vm1 ? vm1 - hashTableBase : -1;
+        neighbours[2 * i + 1] = vp1 ? vp1 - hashTableBase : -1;
+      }
 
-        vp1 = hashTables[0].lookup(neighbor2, false); // look up second neighbor
-        if(vp1)
-          vp1 = vp1 - hashTableBase + oldValue;
-        else
-          vp1 = zero;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) shared(oldValue, newValue, neighbours)
+#endif
+      for(int i = 0; i < size; i++)
+      {
+        const float *oldVal = oldValue + (size_t)i * VD;
+        float *newVal = newValue + (size_t)i * VD;
+        const int m1 = neighbours[2 * i], p1 = neighbours[2 * i + 1];
+        float vm1[VD], vp1[VD];
+        for(int k = 0; k < VD; k++) vm1[k] = m1 >= 0 ? oldValue[m1 + k] : 0.0f;
+        for(int k = 0; k < VD; k++) vp1[k] = p1 >= 0 ? oldValue[p1 + k] : 0.0f;
 
         // Mix values of the three vertices
         for(int k = 0; k < VD; k++) newVal[k] = (0.25f * vm1[k] + 0.5f * oldVal[k] + 0.25f * vp1[k]);
@@ -496,10 +529,12 @@ public:
       // the freshest data is now in oldValue, and newValue is ready to be written over
     }
 
+    delete[] neighbours;
+
     // depending where we ended up, we may have to copy data
     if(oldValue != hashTableBase)
     {
-      memcpy(hashTableBase, oldValue, hashTables[0].size() * VD * sizeof(float));
+      memcpy(hashTableBase, oldValue, (size_t)size * VD * sizeof(float));
       delete[] oldValue;
     }
     else
@@ -508,8 +543,34 @@ public:
     }
   }
 
+  /* Memory the lattice can take per input point at most, for tiling. Every point ends up in D + 1
+   * vertices at worst, each with its key and value in the arena (up to twice what's filled after
+   * growing), the slot table and the temporaries of blur(). The overflow queues are per thread, but
+   * together they hold every point once at most, twice while merge_splat_threads() collects them.
+   */
+  static size_t memory_per_point()
+  {
+    const size_t vertex = 2 * (D * sizeof(short) + VD * sizeof(float)) + 4 * sizeof(int)
+                          + VD * sizeof(float) + 2 * sizeof(int);
+    return (D + 1) * (sizeof(ReplayEntry) + vertex) + 2 * sizeof(OverflowEntry);
+  }
+
+  /* Memory the lattice takes regardless of the number of points: the smallest table. */
+  static size_t memory_fixed()
+  {
+    return (size_t)(1 << 15) * (D * sizeof(short) + VD * sizeof(float) + 2 * sizeof(int));
+  }
+
 private:
-  int nData;
+  /* Initial size of the lattice. The number of lattice points is usually a small fraction
+   * of the number of pixels, the table grows in merge_splat_threads() if that's not enough.
+   */
+  static size_t estimateCapacity(size_t nData)
+  {
+    return nData / 4;
+  }
+
+  size_t nData;
   int nThreads;
   const float *scaleFactor;
   const int *canonical;
@@ -517,12 +578,20 @@ private:
   // slicing is done by replaying splatting (ie storing the sparse matrix)
   struct ReplayEntry
   {
-    int table;
     int offset;
     float weight;
   } *replay;
 
-  HashTablePermutohedral<D, VD> *hashTables;
+  // points which didn't fit into the table while splatting, per thread
+  struct OverflowEntry
+  {
+    size_t index;
+    float position[D];
+    float value[VD];
+  };
+  std::vector<OverflowEntry> *overflow;
+
+  HashTablePermutohedral<D, VD> hashTable;
 };
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -26,6 +26,7 @@ extern "C" {
 void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const float *const in,
                        float *out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
                        const int filters);
+void amaze_demosaic_RT_cleanup(void);
 }
 
 #include <algorithm>
@@ -33,6 +34,9 @@ void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
+#include <unistd.h>
+#include <vector>
 
 static __inline float clampnan(const float x, const float m, const float M)
 {
@@ -297,44 +301,118 @@ template <typename _Tp> static inline const _Tp ULIM(const _Tp a, const _Tp b, c
 // namespace rtengine
 // {
 
-// SSEFUNCTION void RawImageSource::amaze_demosaic_RT(int winx, int winy, int winw, int winh)
-void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const float *const in,
-                       float *out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
-                       const int filters)
+// working space of the threads. every thread of a call takes one and hands it back when it's done,
+// so the next calls don't have to allocate and fault in a large buffer per thread again. there are
+// never more of them than threads ran amaze at the same time, amaze_demosaic_RT_cleanup() frees them.
+struct amaze_arena_t
 {
-  //   BENCHFUN
+  char *buffer;
+  size_t size;
+};
 
-  //   volatile double progress = 0.0;
+static std::mutex amaze_arenas_lock;
+static std::vector<amaze_arena_t> amaze_arenas;
 
-  //   if(plistener)
-  //   {
-  //     plistener->setProgressStr(Glib::ustring::compose(
-  //         M("TP_RAW_DMETHOD_PROGRESSBAR"),
-  //         RAWParams::BayerSensor::methodstring[RAWParams::BayerSensor::amaze]));
-  //     plistener->setProgress(0.0);
-  //   }
+// the tile loop used to get calloc'ed memory and the first tile of a thread may read parts
+// no tile wrote before, so every call gets it zeroed again. that's still much cheaper than
+// faulting in fresh pages.
+static char *amaze_arena_get(const size_t required)
+{
+  char *buffer = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(amaze_arenas_lock);
+    while(!buffer && !amaze_arenas.empty())
+    {
+      const amaze_arena_t arena = amaze_arenas.back();
+      amaze_arenas.pop_back();
+      if(arena.size >= required)
+        buffer = arena.buffer;
+      else
+        dt_free_align(arena.buffer);
+    }
+  }
+  if(!buffer) buffer = (char *)dt_alloc_align(64, required);
+  if(buffer) memset(buffer, 0, required);
+  return buffer;
+}
 
-  int winx = roi_out->x;
-  int winy = roi_out->y;
-  int winw = roi_in->width;
-  int winh = roi_in->height;
+static void amaze_arena_put(char *buffer, const size_t size)
+{
+  if(!buffer) return;
+  std::lock_guard<std::mutex> lock(amaze_arenas_lock);
+  amaze_arenas.push_back({ buffer, size });
+}
 
-  const int width = winw, height = winh;
-  //   const float clip_pt = 1.0 / initialGain;
-  //   const float clip_pt8 = 0.8 / initialGain;
-  const float clip_pt = fminf(piece->pipe->dsc.processed_maximum[0],
-                              fminf(piece->pipe->dsc.processed_maximum[1], piece->pipe->dsc.processed_maximum[2]));
-  const float clip_pt8 = 0.8f * clip_pt;
+void amaze_demosaic_RT_cleanup(void)
+{
+  std::lock_guard<std::mutex> lock(amaze_arenas_lock);
+  for(const amaze_arena_t &arena : amaze_arenas) dt_free_align(arena.buffer);
+  std::vector<amaze_arena_t>().swap(amaze_arenas);
+}
+
+typedef struct amaze_stats_t
+{
+  int tiles;
+  double time;
+  double time_max;
+} amaze_stats_t;
+
+#define AMAZE_CLDF 2
 
-// this allows to pass AMAZETS to the code. On some machines larger AMAZETS is faster
-// If AMAZETS is undefined it will be set to 160, which is the fastest on modern x86/64 machines
+// bytes of working space needed by one thread for tiles of size ts
+static constexpr size_t amaze_arena_size(const int ts)
+{
+  return 14 * sizeof(float) * ts * ts + sizeof(char) * ts * (ts / 2) + 18 * AMAZE_CLDF * 64;
+}
+
+// this allows to pass AMAZETS to the code to force a tile size. if AMAZETS is undefined the
+// tile size is 160, which is the fastest on modern x86/64 machines. only if the L2 cache is
+// too small for that it is chosen smaller at runtime, larger tiles are never picked by themselves.
+// Tile size is a multiple of 32 in the range [96;992], we only instantiate a few of them.
 #ifndef AMAZETS
-#define AMAZETS 160
+static int amaze_tile_size_for_l2()
+{
+  long l2 = 0;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+  l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+  int ts = 160;
+  if(l2 > 0)
+  {
+    // only a handful of the planes are hot at any time, so allow the whole working space to be
+    // a few times the size of L2
+    const int sizes[] = { 160, 128, 96 };
+    ts = 96;
+    for(int k = 0; k < 3; k++)
+      if(amaze_arena_size(sizes[k]) <= 4 * (size_t)l2)
+      {
+        ts = sizes[k];
+        break;
+      }
+  }
+  dt_print(DT_DEBUG_PERF, "[amaze_demosaic_RT] L2 cache %ld bytes, using tiles of %dx%d\n", l2, ts, ts);
+  return ts;
+}
 #endif
-  // Tile size; the image is processed in square tiles to lower memory requirements and facilitate
-  // multi-threading
-  // We assure that Tile size is a multiple of 32 in the range [96;992]
+
+static int amaze_tile_size()
+{
+#ifdef AMAZETS
   constexpr int ts = (AMAZETS & 992) < 96 ? 96 : (AMAZETS & 992);
+  return ts >= 256 ? 256 : ts >= 192 ? 192 : ts >= 160 ? 160 : ts >= 128 ? 128 : 96;
+#else
+  // initialised once, even if several pipes get here at the same time
+  static const int ts = amaze_tile_size_for_l2();
+  return ts;
+#endif
+}
+
+template <int ts>
+static void amaze_demosaic_RT_tiled(const float *const in, float *out, const dt_iop_roi_t *const roi_out,
+                                    const int filters, const int winx, const int winy, const int width,
+                                    const int height, const float clip_pt, const float clip_pt8,
+                                    const int perf, amaze_stats_t *stats)
+{
   constexpr int tsh = ts / 2; // half of Tile size
 
   // offset of R pixel within a Bayer quartet
@@ -405,12 +483,14 @@ void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
   {
     //     int progresscounter = 0;
 
-    constexpr int cldf = 2; // factor to multiply cache line distance. 1 = 64 bytes, 2 = 128 bytes ...
-    // assign working space
-    char *buffer
-        = (char *)calloc(14 * sizeof(float) * ts * ts + sizeof(char) * ts * tsh + 18 * cldf * 64 + 63, 1);
-    // aligned to 64 byte boundary
-    char *data = (char *)((uintptr_t(buffer) + uintptr_t(63)) / 64 * 64);
+    constexpr int cldf = AMAZE_CLDF; // factor to multiply cache line distance. 1 = 64 bytes, 2 = 128 bytes ...
+    // assign working space. the arena is this thread's until the end of the call,
+    // it is already aligned to a 64 byte boundary
+    char *data = amaze_arena_get(amaze_arena_size(ts));
+
+    // per thread tile statistics, only collected with -d perf
+    int tiles = 0;
+    double tile_time = 0.0, tile_time_max = 0.0;
 
     // green values
     float *rgbgreen = (float(*))data;
@@ -471,6 +551,7 @@ void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
     {
       for(int left = winx - 16; left < winx + width; left += ts - 32)
       {
+        const double tile_start = perf ? dt_get_wtime() : 0.0;
         memset(&nyquist[3 * tsh], 0, sizeof(unsigned char) * (ts - 6) * tsh);
         // location of tile bottom edge
         int bottom = MIN(top + ts, winy + height + 16);
@@ -2388,11 +2469,30 @@ void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
         //             }
         //           }
         //         }
+
+        if(perf)
+        {
+          const double t = dt_get_wtime() - tile_start;
+          tile_time += t;
+          tile_time_max = std::max(tile_time_max, t);
+          tiles++;
+        }
       }
     } // end of main loop
 
-    // clean up
-    free(buffer);
+    // clean up: the working space goes back to the pool for the next call
+    amaze_arena_put(data, amaze_arena_size(ts));
+    if(perf)
+    {
+#ifdef _OPENMP
+#pragma omp critical(amazestats)
+#endif
+      {
+        stats->tiles += tiles;
+        stats->time += tile_time;
+        stats->time_max = std::max(stats->time_max, tile_time_max);
+      }
+    }
   }
 
   //   if(plistener)
@@ -2400,6 +2500,59 @@ void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
   //     plistener->setProgress(1.0);
   //   }
 }
+
+// SSEFUNCTION void RawImageSource::amaze_demosaic_RT(int winx, int winy, int winw, int winh)
+void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const float *const in,
+                       float *out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
+                       const int filters)
+{
+  int winx = roi_out->x;
+  int winy = roi_out->y;
+  int winw = roi_in->width;
+  int winh = roi_in->height;
+
+  const int width = winw, height = winh;
+  //   const float clip_pt = 1.0 / initialGain;
+  //   const float clip_pt8 = 0.8 / initialGain;
+  const float clip_pt = fminf(piece->pipe->dsc.processed_maximum[0],
+                              fminf(piece->pipe->dsc.processed_maximum[1], piece->pipe->dsc.processed_maximum[2]));
+  const float clip_pt8 = 0.8f * clip_pt;
+
+  const int perf = darktable.unmuted & DT_DEBUG_PERF;
+  amaze_stats_t stats = { 0, 0.0, 0.0 };
+  const double start = perf ? dt_get_wtime() : 0.0;
+
+  const int ts = amaze_tile_size();
+  switch(ts)
+  {
+    case 96:
+      amaze_demosaic_RT_tiled<96>(in, out, roi_out, filters, winx, winy, width, height, clip_pt, clip_pt8,
+                                  perf, &stats);
+      break;
+    case 128:
+      amaze_demosaic_RT_tiled<128>(in, out, roi_out, filters, winx, winy, width, height, clip_pt, clip_pt8,
+                                   perf, &stats);
+      break;
+    case 192:
+      amaze_demosaic_RT_tiled<192>(in, out, roi_out, filters, winx, winy, width, height, clip_pt, clip_pt8,
+                                   perf, &stats);
+      break;
+    case 256:
+      amaze_demosaic_RT_tiled<256>(in, out, roi_out, filters, winx, winy, width, height, clip_pt, clip_pt8,
+                                   perf, &stats);
+      break;
+    default:
+      amaze_demosaic_RT_tiled<160>(in, out, roi_out, filters, winx, winy, width, height, clip_pt, clip_pt8,
+                                   perf, &stats);
+      break;
+  }
+
+  if(perf && stats.tiles > 0)
+    dt_print(DT_DEBUG_PERF, "[amaze_demosaic_RT] %dx%d: %d tiles of %dx%d, %.3f secs, per tile avg %.3f ms, "
+                            "max %.3f ms, %zu KiB working space per thread\n",
+             width, height, stats.tiles, ts, ts, dt_get_wtime() - start, 1000.0 * stats.time / stats.tiles,
+             1000.0 * stats.time_max, amaze_arena_size(ts) / 1024);
+}
 // }
 
 /*==================================================================================
@@ -1048,6 +1048,67 @@ void modify_roi_in(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *
 #endif
 }
 
+static int _compare_float(const void *a, const void *b)
+{
+  const float fa = *(const float *)a, fb = *(const float *)b;
+  return (fa > fb) - (fa < fb);
+}
+
+// used by tiling: maps the input region without the interpolation margin through the homography and takes the
+// axis aligned box inside the result. exact for neutral parameters, a close starting point for the search
+// otherwise.
+int modify_roi_out_for_input(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                             const dt_iop_roi_t *roi_in, dt_iop_roi_t *roi_out)
+{
+  dt_iop_ashift_data_t *data = (dt_iop_ashift_data_t *)piece->data;
+  roi_out->x = roi_in->x;
+  roi_out->y = roi_in->y;
+  roi_out->width = roi_in->width;
+  roi_out->height = roi_in->height;
+
+  if(isneutral(data)) return 1;
+
+  float homograph[3][3];
+  homography((float *)homograph, data->rotation, data->lensshift_v, data->lensshift_h, data->shear, data->f_length_kb,
+             data->orthocorr, data->aspect, piece->buf_in.width, piece->buf_in.height, ASHIFT_HOMOGRAPH_FORWARD);
+
+  // clipping offset
+  const float fullwidth = (float)piece->buf_out.width / (data->cr - data->cl);
+  const float fullheight = (float)piece->buf_out.height / (data->cb - data->ct);
+  const float cx = roi_out->scale * fullwidth * data->cl;
+  const float cy = roi_out->scale * fullheight * data->ct;
+
+  const struct dt_interpolation *interpolation = dt_interpolation_new(DT_INTERPOLATION_USERPREF);
+  const float margin = MIN(interpolation->width, MIN(roi_in->width, roi_in->height) / 4);
+  const float aabb[4] = { roi_in->x + margin, roi_in->y + margin, roi_in->x + roi_in->width - 1 - margin,
+                          roi_in->y + roi_in->height - 1 - margin };
+
+  float xs[4], ys[4];
+  for(int c = 0; c < 4; c++)
+  {
+    float pin[3], pout[3];
+    // convert from input coordinates to original image coordinates
+    pin[0] = aabb[(c & 1) ? 2 : 0] / roi_in->scale;
+    pin[1] = aabb[(c & 2) ? 3 : 1] / roi_in->scale;
+    pin[2] = 1.0f;
+
+    mat3mulv(pout, (float *)homograph, pin);
+
+    // convert to output image coordinates
+    xs[c] = pout[0] / pout[2] * roi_out->scale - cx;
+    ys[c] = pout[1] / pout[2] * roi_out->scale - cy;
+  }
+
+  // the two inner ones of the four corners bound the box that is covered completely
+  qsort(xs, 4, sizeof(float), _compare_float);
+  qsort(ys, 4, sizeof(float), _compare_float);
+  roi_out->x = ceilf(xs[1]);
+  roi_out->y = ceilf(ys[1]);
+  roi_out->width = MAX(1, (int)floorf(xs[2]) - roi_out->x + 1);
+  roi_out->height = MAX(1, (int)floorf(ys[2]) - roi_out->y + 1);
+  return 1;
+}
+
 // simple conversion of rgb image into greyscale variant suitable for line segment detection
 // the lsd routines expect input as *double, roughly in the range [0.0; 256.0]
 static void rgb2grey256(const float *in, double *out, const int width, const int height)
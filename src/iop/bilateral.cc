@@ -76,7 +76,7 @@ int groups()
 
 int flags()
 {
-  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_SUPPORTS_BLENDING;
+  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_TILING_CONCURRENT;
 }
 
 void init_key_accels(dt_iop_module_so_t *self)
@@ -201,7 +201,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   else
   {
     for(int k = 0; k < 5; k++) sigma[k] = 1.0f / sigma[k];
-    PermutohedralLattice<5, 4> lattice((size_t)roi_in->width * roi_in->height, omp_get_max_threads());
+    PermutohedralLattice<5, 4> lattice((size_t)roi_in->width * roi_in->height, dt_get_num_threads());
 
 // splat into the lattice
 #ifdef _OPENMP
@@ -210,7 +210,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     for(int j = 0; j < roi_in->height; j++)
     {
       const float *in = (const float *)ivoid + (size_t)j * roi_in->width * ch;
-      const int thread = omp_get_thread_num();
+      const int thread = dt_get_thread_num();
       size_t index = (size_t)j * roi_in->width;
       for(int i = 0; i < roi_in->width; i++, index++)
       {
@@ -309,8 +309,9 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
   sigma[0] = data->sigma[0] * roi_in->scale / piece->iscale;
   sigma[1] = data->sigma[1] * roi_in->scale / piece->iscale;
   const int rad = (int)(3.0 * fmaxf(sigma[0], sigma[1]) + 1.0);
-  tiling->factor = 2 + 50;
-  tiling->overhead = 0;
+  // input and output, plus the lattice which grows with the number of pixels in the tile
+  tiling->factor = 2.0f + (float)PermutohedralLattice<5, 4>::memory_per_point() / (4 * sizeof(float));
+  tiling->overhead = PermutohedralLattice<5, 4>::memory_fixed();
   tiling->overlap = rad;
   tiling->xalign = 1;
   tiling->yalign = 1;
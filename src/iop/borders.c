@@ -313,6 +313,29 @@ void modify_roi_in(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *
   roi_in->height = MIN(roi_out->scale * piece->buf_in.height, MAX(1, roi_in->height));
 }
 
+// used by tiling: input regions touching the image edge get the adjacent border added.
+int modify_roi_out_for_input(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                             const dt_iop_roi_t *roi_in, dt_iop_roi_t *roi_out)
+{
+  dt_iop_borders_data_t *d = (dt_iop_borders_data_t *)piece->data;
+  const int bw = (piece->buf_out.width - piece->buf_in.width) * roi_out->scale;
+  const int bh = (piece->buf_out.height - piece->buf_in.height) * roi_out->scale;
+  const int left = bw * d->pos_h, top = bh * d->pos_v;
+
+  int right = roi_in->x + roi_in->width + left;
+  int bottom = roi_in->y + roi_in->height + top;
+  if(roi_in->x + roi_in->width >= (int)(roi_out->scale * piece->buf_in.width))
+    right = roi_out->scale * piece->buf_out.width;
+  if(roi_in->y + roi_in->height >= (int)(roi_out->scale * piece->buf_in.height))
+    bottom = roi_out->scale * piece->buf_out.height;
+
+  roi_out->x = roi_in->x > 0 ? roi_in->x + left : 0;
+  roi_out->y = roi_in->y > 0 ? roi_in->y + top : 0;
+  roi_out->width = MAX(1, right - roi_out->x);
+  roi_out->height = MAX(1, bottom - roi_out->y);
+  return 1;
+}
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -825,6 +825,29 @@ void modify_roi_in(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *
   roi_in->height = CLAMP(roi_in->height, 1, (int)ceilf(scheight) - roi_in->y);
 }
 
+// used by tiling: for a plain crop modify_roi_in() is a shift, which is easily undone. with rotation,
+// flipping or keystone correction there is no answer here and the search takes over.
+int modify_roi_out_for_input(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                             const dt_iop_roi_t *roi_in, dt_iop_roi_t *roi_out)
+{
+  const dt_iop_clipping_data_t *d = (dt_iop_clipping_data_t *)piece->data;
+  if(d->flags || d->angle != 0.0f || !d->all_off || d->k_apply == 1) return 0;
+
+  // the offsets modify_roi_in() adds, including the swapped rotation center in portrait mode
+  const float so = roi_out->scale;
+  float dx = (d->cix - d->enlarge_x) * so, dy = (d->ciy - d->enlarge_y) * so;
+  if(d->flip)
+  {
+    dx += (d->tx - d->ty) * so;
+    dy += (d->ty - d->tx) * so;
+  }
+  roi_out->x = roi_in->x - dx;
+  roi_out->y = roi_in->y - dy;
+  roi_out->width = roi_in->width;
+  roi_out->height = roi_in->height;
+  return 1;
+}
+
 // 3rd (final) pass: you get this input region (may be different from what was requested above),
 // do your best to fill the output region!
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
@@ -62,6 +62,16 @@ void modify_roi_in(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const d
   roi_in->scale = 1.0f;
 }
 
+int modify_roi_out_for_input(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *const roi_in,
+                             dt_iop_roi_t *roi_out)
+{
+  roi_out->x = roi_in->x * roi_out->scale;
+  roi_out->y = roi_in->y * roi_out->scale;
+  roi_out->width = roi_in->width * roi_out->scale + .5f;
+  roi_out->height = roi_in->height * roi_out->scale + .5f;
+  return 1;
+}
+
 #ifdef HAVE_OPENCL
 int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
                const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
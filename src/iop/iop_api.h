@@ -144,6 +144,11 @@ void modify_roi_in(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *
                    const struct dt_iop_roi_t *roi_out, struct dt_iop_roi_t *roi_in);
 void modify_roi_out(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                     struct dt_iop_roi_t *roi_out, const struct dt_iop_roi_t *roi_in);
+/** optional inverse of modify_roi_in(): the output region which needs (about) the given input region.
+  * roi_out comes in with the wanted scale set. used by tiling instead of a numerical search, return 0 if
+  * there is no answer for this roi. */
+int modify_roi_out_for_input(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                             const struct dt_iop_roi_t *roi_in, struct dt_iop_roi_t *roi_out);
 int legacy_params(struct dt_iop_module_t *self, const void *const old_params, const int old_version,
                   void *new_params, const int new_version);
 
@@ -118,7 +118,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   if(inv_sigma_s < 3.0) inv_sigma_s = 3.0;
   inv_sigma_s = 1.0 / inv_sigma_s;
 
-  PermutohedralLattice<3, 2> lattice(size, omp_get_max_threads());
+  PermutohedralLattice<3, 2> lattice(size, dt_get_num_threads());
 
 // Build I=log(L)
 // and splat into the lattice
@@ -128,7 +128,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   for(int j = 0; j < height; j++)
   {
     size_t index = (size_t)j * width;
-    const int thread = omp_get_thread_num();
+    const int thread = dt_get_thread_num();
     const float *in = (const float *)ivoid + (size_t)j * width * ch;
     for(int i = 0; i < width; i++, index++, in += ch)
     {
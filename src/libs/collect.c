@@ -194,7 +194,7 @@ int set_params(dt_lib_module_t *self, const void *params, int size)
   _lib_collect_gui_update(self);
 
   /* update view */
-  dt_collection_update_query(darktable.collection);
+  dt_collection_update_query_async(darktable.collection);
 
   return 0;
 }
@@ -1250,7 +1250,7 @@ void gui_reset(dt_lib_module_t *self)
   dt_lib_collect_t *d = (dt_lib_collect_t *)self->data;
   d->active_rule = 0;
   dt_collection_set_query_flags(darktable.collection, COLLECTION_QUERY_FULL);
-  dt_collection_update_query(darktable.collection);
+  dt_collection_update_query_async(darktable.collection);
 }
 
 static void combo_changed(GtkComboBox *combo, dt_lib_collect_rule_t *d)
@@ -1289,7 +1289,7 @@ static void combo_changed(GtkComboBox *combo, dt_lib_collect_rule_t *d)
   }
 
   update_view(d);
-  dt_collection_update_query(darktable.collection);
+  dt_collection_update_query_async(darktable.collection);
 }
 
 static void row_activated(GtkTreeView *view, GtkTreePath *path, GtkTreeViewColumn *col, dt_lib_collect_t *d)
@@ -1329,7 +1329,7 @@ static void row_activated(GtkTreeView *view, GtkTreePath *path, GtkTreeViewColum
   else
     update_view(d->rule + active); // we have to update visible items too
 
-  dt_collection_update_query(darktable.collection);
+  dt_collection_update_query_async(darktable.collection);
   dt_control_queue_redraw_center();
 }
 
@@ -1376,7 +1376,7 @@ static void entry_activated(GtkWidget *entry, dt_lib_collect_rule_t *d)
       }
     }
   }
-  dt_collection_update_query(darktable.collection);
+  dt_collection_update_query_async(darktable.collection);
 }
 
 static void entry_insert_text(GtkWidget *entry, gchar *new_text, gint new_length, gpointer *position,
@@ -1421,7 +1421,7 @@ static void menuitem_and(GtkMenuItem *menuitem, dt_lib_collect_rule_t *d)
     dt_lib_collect_t *c = get_collect(d);
     c->active_rule = active;
   }
-  dt_collection_update_query(darktable.collection);
+  dt_collection_update_query_async(darktable.collection);
 }
 
 static void menuitem_or(GtkMenuItem *menuitem, dt_lib_collect_rule_t *d)
@@ -1440,7 +1440,7 @@ static void menuitem_or(GtkMenuItem *menuitem, dt_lib_collect_rule_t *d)
     dt_lib_collect_t *c = get_collect(d);
     c->active_rule = active;
   }
-  dt_collection_update_query(darktable.collection);
+  dt_collection_update_query_async(darktable.collection);
 }
 
 static void menuitem_and_not(GtkMenuItem *menuitem, dt_lib_collect_rule_t *d)
@@ -1459,7 +1459,7 @@ static void menuitem_and_not(GtkMenuItem *menuitem, dt_lib_collect_rule_t *d)
     dt_lib_collect_t *c = get_collect(d);
     c->active_rule = active;
   }
-  dt_collection_update_query(darktable.collection);
+  dt_collection_update_query_async(darktable.collection);
 }
 
 static void menuitem_change_and(GtkMenuItem *menuitem, dt_lib_collect_rule_t *d)
@@ -1472,7 +1472,7 @@ static void menuitem_change_and(GtkMenuItem *menuitem, dt_lib_collect_rule_t *d)
     snprintf(confname, sizeof(confname), "plugins/lighttable/collect/mode%1d", num);
     dt_conf_set_int(confname, DT_LIB_COLLECT_MODE_AND);
   }
-  dt_collection_update_query(darktable.collection);
+  dt_collection_update_query_async(darktable.collection);
 }
 
 static void menuitem_change_or(GtkMenuItem *menuitem, dt_lib_collect_rule_t *d)
@@ -1485,7 +1485,7 @@ static void menuitem_change_or(GtkMenuItem *menuitem, dt_lib_collect_rule_t *d)
     snprintf(confname, sizeof(confname), "plugins/lighttable/collect/mode%1d", num);
     dt_conf_set_int(confname, DT_LIB_COLLECT_MODE_OR);
   }
-  dt_collection_update_query(darktable.collection);
+  dt_collection_update_query_async(darktable.collection);
 }
 
 static void menuitem_change_and_not(GtkMenuItem *menuitem, dt_lib_collect_rule_t *d)
@@ -1498,7 +1498,7 @@ static void menuitem_change_and_not(GtkMenuItem *menuitem, dt_lib_collect_rule_t
     snprintf(confname, sizeof(confname), "plugins/lighttable/collect/mode%1d", num);
     dt_conf_set_int(confname, DT_LIB_COLLECT_MODE_AND_NOT);
   }
-  dt_collection_update_query(darktable.collection);
+  dt_collection_update_query_async(darktable.collection);
 }
 
 static void collection_updated(gpointer instance, gpointer self)
@@ -1594,7 +1594,7 @@ static void menuitem_clear(GtkMenuItem *menuitem, dt_lib_collect_rule_t *d)
     }
   }
 
-  dt_collection_update_query(darktable.collection);
+  dt_collection_update_query_async(darktable.collection);
 }
 
 static gboolean popup_button_callback(GtkWidget *widget, GdkEventButton *event, dt_lib_collect_rule_t *d)
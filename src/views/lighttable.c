@@ -106,6 +106,14 @@ typedef struct dt_library_t
 
   int32_t collection_count;
 
+  // a rating from the keyboard waits for the collection to be updated in the background
+  struct
+  {
+    gboolean pending;
+    int32_t collection_count; // count before the rating
+    int next_image_rowid;     // where to jump if the images disappear, using arrows
+  } rating;
+
   // stuff for the audio player
   GPid audio_player_pid;   // the pid of the child process
   int32_t audio_player_id; // the imgid of the image the audio is played for
@@ -264,10 +272,52 @@ static void zoom_around_image(dt_library_t *lib, double pointerx, double pointer
   lib->images_in_row = new_images_in_row;
 }
 
+static void _rating_collection_changed(dt_view_t *self)
+{
+  dt_library_t *lib = (dt_library_t *)self->data;
+  lib->rating.pending = FALSE;
+  if(lib->rating.collection_count == dt_collection_get_count(darktable.collection)) return;
+
+  // some images disappeared from collection. Selection is now invisible.
+  // lib->rating.collection_count  --> before the rating
+  // dt_collection_get_count(darktable.collection)  --> after the rating
+  dt_selection_clear(darktable.selection);
+  if(lib->using_arrows)
+  {
+    // Jump where stored before
+    int32_t mouse_over_id = dt_control_get_mouse_over_id();
+    sqlite3_stmt *stmt;
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                "SELECT imgid FROM memory.collected_images WHERE rowid=?1 OR rowid=?1 - 1 "
+                                "ORDER BY rowid DESC LIMIT 1", -1, &stmt,
+                                NULL);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, lib->rating.next_image_rowid);
+    if(sqlite3_step(stmt) == SQLITE_ROW)
+      mouse_over_id = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    dt_control_set_mouse_over_id(mouse_over_id);
+  }
+}
+
 static void _view_lighttable_collection_listener_callback(gpointer instance, gpointer user_data)
 {
   dt_view_t *self = (dt_view_t *)user_data;
+  dt_library_t *lib = (dt_library_t *)self->data;
   _update_collected_images(self);
+  if(lib->rating.pending) _rating_collection_changed(self);
+}
+
+static void _insert_collected_images(const int32_t *ids, const uint32_t count)
+{
+  sqlite3_stmt *stmt;
+  GString *query = g_string_new("INSERT INTO memory.collected_images (imgid) VALUES (?1)");
+  for(uint32_t k = 1; k < count; k++) g_string_append_printf(query, ",(?%u)", k + 1);
+
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query->str, -1, &stmt, NULL);
+  for(uint32_t k = 0; k < count; k++) DT_DEBUG_SQLITE3_BIND_INT(stmt, k + 1, ids[k]);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+  g_string_free(query, TRUE);
 }
 
 static void _update_collected_images(dt_view_t *self)
@@ -277,8 +327,7 @@ static void _update_collected_images(dt_view_t *self)
   int32_t min_before = 0, min_after = 0;
 
   /* check if we can get a query from collection */
-  gchar *query = g_strdup(dt_collection_get_query(darktable.collection));
-  if(!query) return;
+  if(!dt_collection_get_query(darktable.collection)) return;
 
   // we have a new query for the collection of images to display. For speed reason we collect all images into
   // a temporary (in-memory) table (collected_images).
@@ -303,19 +352,17 @@ static void _update_collected_images(dt_view_t *self)
   DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.sqlite_sequence WHERE "
                                                        "name='collected_images'", NULL, NULL, NULL);
 
-  // 2. insert collected images into the temporary table
+  // 2. insert collected images into the temporary table. the collection has run its query already (in the
+  // background when the update came through dt_collection_update_query_async()), take the ids from its index
+  // instead of running it again here. batches of rows per statement, one statement per id is slow for a
+  // large collection.
 
-  gchar *ins_query = NULL;
-  ins_query = dt_util_dstrcat(ins_query, "INSERT INTO memory.collected_images (imgid) %s", query);
-
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), ins_query, -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, 0);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, -1);
-  sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-
-  g_free(query);
-  g_free(ins_query);
+  uint32_t count = 0;
+  int32_t *ids = dt_collection_get_ids(darktable.collection, &count);
+  dt_database_start_transaction(darktable.db);
+  for(uint32_t i = 0; i < count; i += 500) _insert_collected_images(ids + i, MIN(500, count - i));
+  dt_database_release_transaction(darktable.db);
+  g_free(ids);
 
   // 3. get new low-bound, then update the full preview rowid accordingly
   if (lib->full_preview_id != -1)
@@ -625,6 +672,8 @@ static int expose_filemanager(dt_view_t *self, cairo_t *cr, int32_t width, int32
   }
 
 end_query_cache:
+  // one query for all image structs of the page instead of one per thumbnail
+  dt_image_cache_prefetch(darktable.image_cache, query_ids, max_rows * max_cols);
   mouse_over_id = -1;
   cairo_save(cr);
   int current_image = 0;
@@ -1573,30 +1622,13 @@ static gboolean star_key_accel_callback(GtkAccelGroup *accel_group, GObject *acc
     dt_ratings_apply_to_selection(num);
   else
     dt_ratings_apply_to_image(mouse_over_id, num);
-  _update_collected_images(self);
 
-  dt_collection_update_query(darktable.collection); // update the counter
-  if(lib->collection_count != dt_collection_get_count(darktable.collection))
-  {
-    // some images disappeared from collection. Selection is now invisible.
-    // lib->collection_count  --> before the rating
-    // dt_collection_get_count(darktable.collection)  --> after the rating
-    dt_selection_clear(darktable.selection);
-    if(lib->using_arrows)
-    {
-      // Jump where stored before
-      sqlite3_stmt *stmt;
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                  "SELECT imgid FROM memory.collected_images WHERE rowid=?1 OR rowid=?1 - 1 "
-                                  "ORDER BY rowid DESC LIMIT 1", -1, &stmt,
-                                  NULL);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, next_image_rowid);
-      if(sqlite3_step(stmt) == SQLITE_ROW)
-        mouse_over_id = sqlite3_column_int(stmt, 0);
-      sqlite3_finalize(stmt);
-      dt_control_set_mouse_over_id(mouse_over_id);
-    }
-  }
+  // update the counter in the background, the collection listener picks up from there.
+  // the count to compare with is the one before the first of several quick ratings.
+  if(!lib->rating.pending) lib->rating.collection_count = lib->collection_count;
+  lib->rating.next_image_rowid = next_image_rowid;
+  lib->rating.pending = TRUE;
+  dt_collection_update_query_async(darktable.collection);
   return TRUE;
 }
 
@@ -1876,7 +1908,8 @@ int button_pressed(dt_view_t *self, double x, double y, double pressure, int whi
         }
         else
           dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_RELAXED);
-        _update_collected_images(self);
+        // the collection listener refreshes the view once the query has run
+        dt_collection_update_query_async(darktable.collection);
         break;
       }
       case DT_VIEW_GROUP:
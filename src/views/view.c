@@ -25,6 +25,7 @@
 #include "common/debug.h"
 #include "common/history.h"
 #include "common/image_cache.h"
+#include "common/image_readahead.h"
 #include "common/mipmap_cache.h"
 #include "common/module.h"
 #include "common/undo.h"
@@ -1584,18 +1585,25 @@ void dt_view_filmstrip_prefetch()
     offset = dt_collection_image_offset(imgid);
   }
 
+  // the files of the next few get read in the background, the one right after this gets decoded, too
+  const int count = MAX(dt_conf_get_int("prefetch_images"), 1);
+  int32_t *imgids = (int32_t *)calloc(count, sizeof(int32_t));
+  int num = 0;
   sqlite3_stmt *stmt;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), qin, -1, &stmt, NULL);
-  // only get one more image:
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, offset + 1);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, offset + 2);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, count);
+  while(num < count && sqlite3_step(stmt) == SQLITE_ROW) imgids[num++] = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+
+  // the view manager stands for the filmstrip, export jobs queue theirs next to it
+  dt_image_readahead_queue(darktable.image_readahead, darktable.view_manager, imgids, num);
+  if(num > 0)
   {
-    const uint32_t prefetchid = sqlite3_column_int(stmt, 0);
-    // dt_control_log("prefetching image %u", prefetchid);
-    dt_mipmap_cache_get(darktable.mipmap_cache, NULL, prefetchid, DT_MIPMAP_FULL, DT_MIPMAP_PREFETCH, 'r');
+    // dt_control_log("prefetching image %u", imgids[0]);
+    dt_mipmap_cache_get(darktable.mipmap_cache, NULL, imgids[0], DT_MIPMAP_FULL, DT_MIPMAP_PREFETCH, 'r');
   }
-  sqlite3_finalize(stmt);
+  free(imgids);
 }
 
 void dt_view_manager_view_toolbox_add(dt_view_manager_t *vm, GtkWidget *tool, dt_view_type_flags_t views)
@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+#
+# Usage: benchmark_encoders.py [-n runs] [--cli darktable-cli] [--threads 1,0] input [input.xmp]
+#
+# exports an image with darktable-cli to tiff, png and jpeg at the different compression settings, once
+# on a single thread and once on all cores (0), and prints the encoder throughput in MB/s of pixel data
+# next to the file size. the time of the pipeline is taken out by subtracting the time of a ppm export of
+# the same image, which does next to nothing besides processing.
+#
+# keep the conf keys in sync with src/imageio/format/{tiff,png,jpeg}.c.
+#
+
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+# (extension, bpp, conf settings, label)
+CASES = [
+  ("tif", 8, {"plugins/imageio/format/tiff/compress": 0}, "tiff 8 bit uncompressed"),
+  ("tif", 8, {"plugins/imageio/format/tiff/compress": 2, "plugins/imageio/format/tiff/compresslevel": 1}, "tiff 8 bit deflate+predictor, level 1"),
+  ("tif", 8, {"plugins/imageio/format/tiff/compress": 2, "plugins/imageio/format/tiff/compresslevel": 6}, "tiff 8 bit deflate+predictor, level 6"),
+  ("tif", 8, {"plugins/imageio/format/tiff/compress": 2, "plugins/imageio/format/tiff/compresslevel": 9}, "tiff 8 bit deflate+predictor, level 9"),
+  ("tif", 16, {"plugins/imageio/format/tiff/compress": 2, "plugins/imageio/format/tiff/compresslevel": 6}, "tiff 16 bit deflate+predictor, level 6"),
+  ("tif", 32, {"plugins/imageio/format/tiff/compress": 3, "plugins/imageio/format/tiff/compresslevel": 6}, "tiff 32 bit deflate+fp predictor, level 6"),
+  ("png", 8, {"plugins/imageio/format/png/compression": 0}, "png 8 bit, level 0"),
+  ("png", 8, {"plugins/imageio/format/png/compression": 1}, "png 8 bit, level 1"),
+  ("png", 8, {"plugins/imageio/format/png/compression": 6}, "png 8 bit, level 6"),
+  ("png", 8, {"plugins/imageio/format/png/compression": 9}, "png 8 bit, level 9"),
+  ("png", 16, {"plugins/imageio/format/png/compression": 6}, "png 16 bit, level 6"),
+  ("jpg", 8, {"plugins/imageio/format/jpeg/quality": 95}, "jpeg quality 95"),
+]
+
+
+def export(args, tmpdir, ext, bpp, conf, threads):
+  out = os.path.join(tmpdir, "out." + ext)
+  if os.path.exists(out):
+    os.unlink(out)
+  cmd = [args.cli, args.input]
+  if args.xmp:
+    cmd.append(args.xmp)
+  cmd += [out, "--bpp", str(bpp), "--core", "--configdir", os.path.join(tmpdir, "config")]
+  for key, value in conf.items():
+    cmd += ["--conf", "%s=%s" % (key, value)]
+  env = dict(os.environ)
+  if threads > 0:
+    env["OMP_NUM_THREADS"] = str(threads)
+  best = None
+  for _ in range(args.runs):
+    start = time.monotonic()
+    subprocess.run(cmd, env=env, check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    elapsed = time.monotonic() - start
+    best = elapsed if best is None else min(best, elapsed)
+  return best, os.path.getsize(out)
+
+
+def ppm_size(path):
+  # width and height out of the P6 header
+  with open(path, "rb") as f:
+    fields = []
+    while len(fields) < 4:
+      line = f.readline()
+      if not line.startswith(b"#"):
+        fields += line.split()
+  return int(fields[1]), int(fields[2])
+
+
+def main():
+  parser = argparse.ArgumentParser(description="encoder throughput of the export formats")
+  parser.add_argument("input")
+  parser.add_argument("xmp", nargs="?")
+  parser.add_argument("-n", "--runs", type=int, default=3, help="runs per case, the fastest one counts")
+  parser.add_argument("--cli", default="darktable-cli")
+  parser.add_argument("--threads", default="1,0", help="comma separated OMP_NUM_THREADS, 0 for all cores")
+  args = parser.parse_args()
+
+  if not shutil.which(args.cli) and not os.path.exists(args.cli):
+    sys.exit("can't find %s" % args.cli)
+
+  threads = [int(t) for t in args.threads.split(",")]
+  with tempfile.TemporaryDirectory() as tmpdir:
+    for t in threads:
+      base, _ = export(args, tmpdir, "ppm", 8, {}, t)
+      width, height = ppm_size(os.path.join(tmpdir, "out.ppm"))
+      print("%s threads, %dx%d, pipeline %.2fs" % (t if t else "all", width, height, base))
+      for ext, bpp, conf, label in CASES:
+        elapsed, size = export(args, tmpdir, ext, bpp, conf, t)
+        megabytes = width * height * 3 * (bpp // 8) / 1e6
+        encode = max(elapsed - base, 1e-3)
+        print("  %-45s %8.1f MB/s %10.1f MB" % (label, megabytes / encode, size / 1e6))
+
+
+if __name__ == "__main__":
+  main()
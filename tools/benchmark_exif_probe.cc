@@ -0,0 +1,126 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2017 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * compares the import metadata read of dt_exif_probe() with a full exiv2 read, in files per second, and
+ * reports where the two disagree on maker, model, lens or the exposure values.
+ *
+ * build from the top of the source tree:
+ *   gcc -O2 -c src/common/exif_probe.c -Isrc $(pkg-config --cflags glib-2.0)
+ *   g++ -O2 -o benchmark_exif_probe tools/benchmark_exif_probe.cc exif_probe.o -Isrc \
+ *       $(pkg-config --cflags --libs glib-2.0 exiv2)
+ *
+ * run it on a folder of raws, ideally twice to see both the cold and the warm file cache:
+ *   ./benchmark_exif_probe /path/to/raws/\*.{CR2,NEF,ARW,DNG}
+ */
+
+#include "common/exif_probe.h"
+
+#include <exiv2/easyaccess.hpp>
+#include <exiv2/error.hpp>
+#include <exiv2/exif.hpp>
+#include <exiv2/image.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+static std::string exif_string(Exiv2::ExifData &exif, const char *key)
+{
+  Exiv2::ExifData::const_iterator pos = exif.findKey(Exiv2::ExifKey(key));
+  if(pos == exif.end() || !pos->size()) return "";
+  std::string s = pos->print(&exif);
+  s.erase(s.find_last_not_of(' ') + 1);
+  return s;
+}
+
+static float exif_float(Exiv2::ExifData &exif, const char *key)
+{
+  Exiv2::ExifData::const_iterator pos = exif.findKey(Exiv2::ExifKey(key));
+  return (pos == exif.end() || !pos->size()) ? 0.0f : pos->toFloat();
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc < 2)
+  {
+    fprintf(stderr, "usage: %s <raw files>\n", argv[0]);
+    return 1;
+  }
+  Exiv2::XmpParser::initialize();
+  const int num = argc - 1;
+
+  dt_exif_probe_t *probes = new dt_exif_probe_t[num];
+  bool *probed = new bool[num];
+  int num_probed = 0;
+
+  gint64 start = g_get_monotonic_time();
+  for(int k = 0; k < num; k++)
+  {
+    probed[k] = !dt_exif_probe(argv[k + 1], &probes[k]);
+    num_probed += probed[k];
+  }
+  const double probe_time = (g_get_monotonic_time() - start) / 1e6;
+
+  int mismatches = 0;
+  start = g_get_monotonic_time();
+  for(int k = 0; k < num; k++)
+  {
+    try
+    {
+      std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(argv[k + 1]).release());
+      image->readMetadata();
+      if(!probed[k]) continue;
+
+      // only what the probe is supposed to match. lens names decoded from maker notes differ by design.
+      Exiv2::ExifData &exif = image->exifData();
+      const dt_exif_probe_t *p = &probes[k];
+      if(exif_string(exif, "Exif.Image.Make") != p->maker || exif_string(exif, "Exif.Image.Model") != p->model
+         || exif_string(exif, "Exif.Photo.LensModel") != p->lens
+         || exif_float(exif, "Exif.Photo.FocalLength") != p->focal_length
+         || exif_float(exif, "Exif.Photo.FNumber") != p->aperture)
+      {
+        mismatches++;
+        std::cerr << argv[k + 1] << ": probe read '" << p->maker << "' '" << p->model << "' '" << p->lens
+                  << "' f=" << p->focal_length << " f/" << p->aperture << std::endl;
+      }
+    }
+    catch(Exiv2::AnyError &e)
+    {
+      std::cerr << "[exiv2] " << argv[k + 1] << ": " << e.what() << std::endl;
+    }
+  }
+  const double exiv2_time = (g_get_monotonic_time() - start) / 1e6;
+
+  printf("%d files, %d complete from the probe (%d differ from exiv2)\n", num, num_probed, mismatches);
+  printf("probe: %8.3f s, %10.1f files/s\n", probe_time, num / probe_time);
+  printf("exiv2: %8.3f s, %10.1f files/s\n", exiv2_time, num / exiv2_time);
+  printf("an import with the probe reads %d files with exiv2, estimated %.1f files/s\n", num - num_probed,
+         num / (probe_time + exiv2_time * (num - num_probed) / num));
+
+  delete[] probes;
+  delete[] probed;
+  Exiv2::XmpParser::terminate();
+  return 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,198 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2017 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * thumbnails per second of dt_iop_flip_and_zoom_8(), which scales the embedded previews and the larger mips
+ * down to the thumbnail sizes, for both codepaths and compared to the four point samples it took before.
+ *
+ * build from the top of the source tree, against the library of a configured and built tree in build/:
+ *   gcc -O3 -fopenmp -o benchmark_flip_and_zoom_8 tools/benchmark_flip_and_zoom_8.c -Isrc -Isrc/external \
+ *       -Ibuild/src $(pkg-config --cflags --libs glib-2.0) -Lbuild/src -ldarktable -Wl,-rpath,build/src
+ *
+ * then just run it, all images are synthetic:
+ *   ./benchmark_flip_and_zoom_8
+ */
+
+#include "common/darktable.h"
+#include "develop/imageop_math.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define RUNS 20
+
+static double wtime()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// the sampler dt_iop_flip_and_zoom_8() used to have: the mean of four pixels half a box apart
+static void flip_and_zoom_8_points(const uint8_t *in, int32_t iw, int32_t ih, uint8_t *out, int32_t ow,
+                                   int32_t oh, const dt_image_orientation_t orientation, uint32_t *width,
+                                   uint32_t *height)
+{
+  const uint32_t iwd = (orientation & ORIENTATION_SWAP_XY) ? ih : iw;
+  const uint32_t iht = (orientation & ORIENTATION_SWAP_XY) ? iw : ih;
+  const float scale = fmaxf(1.0, fmaxf(iwd / (float)ow, iht / (float)oh));
+  const uint32_t wd = *width = MIN(ow, iwd / scale);
+  const uint32_t ht = *height = MIN(oh, iht / scale);
+  const int bpp = 4;
+  int32_t ii = 0, jj = 0;
+  int32_t si = 1, sj = iw;
+  if(orientation & ORIENTATION_FLIP_X)
+  {
+    jj = ih - jj - 1;
+    sj = -sj;
+  }
+  if(orientation & ORIENTATION_FLIP_Y)
+  {
+    ii = iw - ii - 1;
+    si = -si;
+  }
+  if(orientation & ORIENTATION_SWAP_XY)
+  {
+    int t = sj;
+    sj = si;
+    si = t;
+  }
+  const int32_t half_pixel = .5f * scale;
+  const int32_t offm = half_pixel * bpp * MIN(MIN(0, si), MIN(sj, si + sj));
+  const int32_t offM = half_pixel * bpp * MAX(MAX(0, si), MAX(sj, si + sj));
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for(uint32_t j = 0; j < ht; j++)
+  {
+    uint8_t *out2 = out + bpp * wd * j;
+    const uint8_t *in2 = in + bpp * (iw * jj + ii + sj * (int32_t)(scale * j));
+    float stepi = 0.0f;
+    for(uint32_t i = 0; i < wd; i++)
+    {
+      const uint8_t *in3 = in2 + ((int32_t)stepi) * si * bpp;
+      if(in3 + offm >= in && in3 + offM < in + bpp * iw * ih)
+        for(int k = 0; k < 3; k++)
+          out2[k] = ((int32_t)in3[bpp * half_pixel * sj + k] + (int32_t)in3[bpp * half_pixel * (si + sj) + k]
+                     + (int32_t)in3[bpp * half_pixel * si + k] + (int32_t)in3[k])
+                    / 4;
+      out2 += bpp;
+      stepi += scale;
+    }
+  }
+}
+
+// gradients and one pixel wide stripes, the latter alias badly with point samples
+static uint8_t *synthetic(const int width, const int height)
+{
+  uint8_t *rgba = (uint8_t *)malloc((size_t)4 * width * height);
+  for(int j = 0; j < height; j++)
+    for(int i = 0; i < width; i++)
+    {
+      uint8_t *o = rgba + (size_t)4 * ((size_t)width * j + i);
+      const int stripes = ((i + j) & 1) ? 64 : 0;
+      o[0] = 191 * i / width + stripes;
+      o[1] = 191 * j / height + stripes;
+      o[2] = 128 + (i & 2 ? 64 : -64) * (j & 1);
+      o[3] = 0;
+    }
+  return rgba;
+}
+
+typedef enum zoom_t
+{
+  ZOOM_POINTS,
+  ZOOM_PLAIN,
+  ZOOM_SSE2
+} zoom_t;
+
+static const char *zoom_names[] = { "four points (before)", "box, plain", "box, sse2" };
+
+static double thumbs_per_second(const zoom_t zoom, const uint8_t *in, const int iw, const int ih, uint8_t *out,
+                                const int ow, const int oh, const dt_image_orientation_t orientation)
+{
+  darktable.codepath.OPENMP_SIMD = zoom == ZOOM_PLAIN;
+  darktable.codepath.SSE2 = zoom == ZOOM_SSE2;
+  double best = INFINITY;
+  for(int r = 0; r < RUNS; r++)
+  {
+    uint32_t width, height;
+    const double start = wtime();
+    if(zoom == ZOOM_POINTS)
+      flip_and_zoom_8_points(in, iw, ih, out, ow, oh, orientation, &width, &height);
+    else
+      dt_iop_flip_and_zoom_8(in, iw, ih, out, ow, oh, orientation, &width, &height);
+    best = fmin(best, wtime() - start);
+  }
+  return 1.0 / best;
+}
+
+static void run(const int iw, const int ih, const int threads)
+{
+  // the mip sizes the thumbnails get scaled to
+  static const int sizes[][2] = { { 180, 110 }, { 360, 225 }, { 720, 450 }, { 1440, 900 } };
+  static const dt_image_orientation_t orientations[] = { ORIENTATION_NONE, ORIENTATION_ROTATE_CW_90_DEG };
+#ifdef _OPENMP
+  omp_set_num_threads(threads);
+#endif
+  uint8_t *in = synthetic(iw, ih);
+  uint8_t *out = (uint8_t *)malloc((size_t)4 * sizes[3][0] * sizes[3][1]);
+
+  printf("%dx%d, %d thread%s, thumbnails/second\n", iw, ih, threads, threads > 1 ? "s" : "");
+  printf("  %-22s %-8s", "", "rotated");
+  for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) printf(" %4dx%-4d", sizes[s][0], sizes[s][1]);
+  printf("\n");
+  for(zoom_t zoom = ZOOM_POINTS; zoom <= ZOOM_SSE2; zoom++)
+  {
+#ifndef __SSE2__
+    if(zoom == ZOOM_SSE2) continue;
+#endif
+    for(size_t o = 0; o < sizeof(orientations) / sizeof(orientations[0]); o++)
+    {
+      printf("  %-22s %-8s", zoom_names[zoom], orientations[o] == ORIENTATION_NONE ? "no" : "yes");
+      for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        printf(" %9.0f", thumbs_per_second(zoom, in, iw, ih, out, sizes[s][0], sizes[s][1], orientations[o]));
+      printf("\n");
+    }
+  }
+  printf("\n");
+  free(out);
+  free(in);
+}
+
+int main(int argc, char *argv[])
+{
+  // an embedded preview of a typical raw, and the full size jpg of a current camera
+  static const int images[][2] = { { 1620, 1080 }, { 6000, 4000 } };
+  for(size_t k = 0; k < sizeof(images) / sizeof(images[0]); k++)
+  {
+    run(images[k][0], images[k][1], 1);
+#ifdef _OPENMP
+    if(omp_get_num_procs() > 1) run(images[k][0], images[k][1], omp_get_num_procs());
+#endif
+  }
+  return 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,201 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2017 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * reports the error and the speed of the block codec in src/common/image_compression.c, which the mipmap
+ * cache uses for the compressed copies of evicted mip_f buffers (cache_mipf_compressed).
+ *
+ * build from the top of the source tree:
+ *   gcc -O2 -march=native -fopenmp -o benchmark_image_compression tools/benchmark_image_compression.c \
+ *       src/common/image_compression.c -Isrc -lm
+ *
+ * without arguments it runs on a synthetic image, otherwise on the given pfm files (as exported by darktable):
+ *   ./benchmark_image_compression /path/to/\*.pfm
+ */
+
+#include "common/image_compression.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define RUNS 10
+
+static double wtime()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// rgba, like the buffers in darktable
+static float *read_pfm(const char *filename, int *width, int *height)
+{
+  FILE *f = fopen(filename, "rb");
+  if(!f) return NULL;
+  char head[3] = { 0 };
+  float scale = 0.0f;
+  float *rgba = NULL, *row = NULL;
+  if(fscanf(f, "%2s %d %d %f", head, width, height, &scale) != 4 || fgetc(f) == EOF || *width <= 0
+     || *height <= 0)
+    goto error;
+  const int ch = !strcmp(head, "PF") ? 3 : !strcmp(head, "Pf") ? 1 : 0;
+  if(!ch || scale > 0.0f) goto error; // only little endian
+  rgba = (float *)malloc(sizeof(float) * 4 * *width * *height);
+  row = (float *)malloc(sizeof(float) * ch * *width);
+  for(int j = *height - 1; j >= 0; j--)
+  {
+    if(fread(row, sizeof(float) * ch, *width, f) != (size_t)*width) goto error;
+    for(int i = 0; i < *width; i++)
+    {
+      float *o = rgba + 4 * (i + (size_t)*width * j);
+      for(int c = 0; c < 3; c++) o[c] = row[ch * i + (ch == 3 ? c : 0)];
+      o[3] = 0.0f;
+    }
+  }
+  free(row);
+  fclose(f);
+  return rgba;
+
+error:
+  fprintf(stderr, "can't read `%s', only little endian pfm is supported\n", filename);
+  free(row);
+  free(rgba);
+  fclose(f);
+  return NULL;
+}
+
+// smooth gradients, fine detail and highlights way above 1
+static float *synthetic(int *width, int *height)
+{
+  *width = 1918; // not a multiple of 4 on purpose
+  *height = 1279;
+  float *rgba = (float *)malloc(sizeof(float) * 4 * *width * *height);
+  srand(1);
+  for(int j = 0; j < *height; j++)
+    for(int i = 0; i < *width; i++)
+    {
+      float *o = rgba + 4 * (i + (size_t)*width * j);
+      const float x = i / (float)*width, y = j / (float)*height;
+      const float noise = 0.02f * (rand() / (float)RAND_MAX - 0.5f);
+      const float stripes = (i / 3 + j / 5) & 1 ? 0.05f : 0.0f;
+      const float sun = 16.0f * expf(-((x - 0.7f) * (x - 0.7f) + (y - 0.3f) * (y - 0.3f)) * 200.0f);
+      o[0] = fmaxf(0.0f, 0.8f * x * x + stripes + noise + sun);
+      o[1] = fmaxf(0.0f, 0.5f * y + 0.1f * stripes + noise + sun);
+      o[2] = fmaxf(0.0f, 0.3f * (1.0f - x) * y + noise + 0.9f * sun);
+      o[3] = 0.0f;
+    }
+  return rgba;
+}
+
+static void errors(const float *a, const float *b, const int width, const int height)
+{
+  double se = 0.0, rel = 0.0, rel_max = 0.0;
+  size_t n_rel = 0;
+  for(size_t k = 0; k < (size_t)width * height; k++)
+  {
+    for(int c = 0; c < 3; c++)
+    {
+      const double d = fminf(fmaxf(a[4 * k + c], 0.0f), 1.0f) - fminf(fmaxf(b[4 * k + c], 0.0f), 1.0f);
+      se += d * d;
+    }
+    const double la = a[4 * k] + 2.0 * a[4 * k + 1] + a[4 * k + 2];
+    const double lb = b[4 * k] + 2.0 * b[4 * k + 1] + b[4 * k + 2];
+    if(la > 4e-3)
+    {
+      const double r = fabs(lb - la) / la;
+      rel += r;
+      rel_max = fmax(rel_max, r);
+      n_rel++;
+    }
+  }
+  const double mse = se / (3.0 * width * height);
+  printf("  psnr %.2f dB (values clipped to 0..1), luma error mean %.2f%% max %.2f%%\n",
+         mse > 0.0 ? 10.0 * log10(1.0 / mse) : INFINITY, n_rel ? 100.0 * rel / n_rel : 0.0, 100.0 * rel_max);
+}
+
+static void speed(const float *rgba, uint8_t *compressed, float *out, const int width, const int height,
+                  const int threads)
+{
+#ifdef _OPENMP
+  omp_set_num_threads(threads);
+#endif
+  double tc = INFINITY, tu = INFINITY;
+  for(int r = 0; r < RUNS; r++)
+  {
+    const double start = wtime();
+    dt_image_compress(rgba, compressed, width, height, 4);
+    const double mid = wtime();
+    dt_image_uncompress(compressed, out, width, height, 4);
+    tc = fmin(tc, mid - start);
+    tu = fmin(tu, wtime() - mid);
+  }
+  const double mb = sizeof(float) * 4.0 * width * height / (1024.0 * 1024.0);
+  printf("  %2d thread%s: compress %7.1f MB/s, uncompress %7.1f MB/s (of rgba floats)\n", threads,
+         threads > 1 ? "s" : " ", mb / tc, mb / tu);
+}
+
+static void run(const char *name, float *rgba, const int width, const int height)
+{
+  const size_t size = dt_image_compressed_size(width, height);
+  uint8_t *compressed = (uint8_t *)malloc(size);
+  float *out = (float *)malloc(sizeof(float) * 4 * width * height);
+
+  printf("%s: %dx%d, %zu bytes -> %zu bytes (1:%.1f)\n", name, width, height,
+         sizeof(float) * 4 * width * height, size, sizeof(float) * 4.0 * width * height / size);
+  dt_image_compress(rgba, compressed, width, height, 4);
+  dt_image_uncompress(compressed, out, width, height, 4);
+  errors(rgba, out, width, height);
+
+  speed(rgba, compressed, out, width, height, 1);
+#ifdef _OPENMP
+  if(omp_get_num_procs() > 1) speed(rgba, compressed, out, width, height, omp_get_num_procs());
+#endif
+
+  free(out);
+  free(compressed);
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc < 2)
+  {
+    int width, height;
+    float *rgba = synthetic(&width, &height);
+    run("synthetic", rgba, width, height);
+    free(rgba);
+  }
+  for(int k = 1; k < argc; k++)
+  {
+    int width, height;
+    float *rgba = read_pfm(argv[k], &width, &height);
+    if(!rgba) continue;
+    run(argv[k], rgba, width, height);
+    free(rgba);
+  }
+  return 0;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
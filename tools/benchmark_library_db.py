@@ -0,0 +1,216 @@
+#!/usr/bin/env python3
+#
+# Usage: benchmark_library_db.py [-n images] [-d dir] [--indexes] [--keep]
+#
+# builds a synthetic library.db/data.db pair with the schema of src/common/database.c, fills it with
+# images, tags, color labels and metadata, and runs the collection queries the way
+# dt_collection_update() puts them together from the rules of get_query_string(). for every query the
+# EXPLAIN QUERY PLAN and the time to step through all rows are printed.
+#
+# --indexes adds the indexes of library schema version 16, to compare plans and timings.
+# keep the schema and the query templates in sync with src/common/database.c and
+# src/common/collection.c when changing those.
+#
+
+import argparse
+import os
+import random
+import sqlite3
+import sys
+import tempfile
+import time
+
+LIBRARY_SCHEMA = [
+  "CREATE TABLE main.db_info (key VARCHAR PRIMARY KEY, value VARCHAR)",
+  "CREATE TABLE main.film_rolls (id INTEGER PRIMARY KEY, datetime_accessed CHAR(20), folder VARCHAR(1024) NOT NULL)",
+  "CREATE INDEX main.film_rolls_folder_index ON film_rolls (folder)",
+  "CREATE TABLE main.images (id INTEGER PRIMARY KEY AUTOINCREMENT, group_id INTEGER, film_id INTEGER, "
+  "width INTEGER, height INTEGER, filename VARCHAR, maker VARCHAR, model VARCHAR, "
+  "lens VARCHAR, exposure REAL, aperture REAL, iso REAL, focal_length REAL, "
+  "focus_distance REAL, datetime_taken CHAR(20), flags INTEGER, "
+  "output_width INTEGER, output_height INTEGER, crop REAL, "
+  "raw_parameters INTEGER, raw_denoise_threshold REAL, "
+  "raw_auto_bright_threshold REAL, raw_black INTEGER, raw_maximum INTEGER, "
+  "caption VARCHAR, description VARCHAR, license VARCHAR, sha1sum CHAR(40), "
+  "orientation INTEGER, histogram BLOB, lightmap BLOB, longitude REAL, "
+  "latitude REAL, altitude REAL, color_matrix BLOB, colorspace INTEGER, version INTEGER, "
+  "max_version INTEGER, write_timestamp INTEGER, history_end INTEGER)",
+  "CREATE INDEX main.images_group_id_index ON images (group_id)",
+  "CREATE INDEX main.images_film_id_index ON images (film_id)",
+  "CREATE INDEX main.images_filename_index ON images (filename)",
+  "CREATE TABLE main.selected_images (imgid INTEGER PRIMARY KEY)",
+  "CREATE TABLE main.history (imgid INTEGER, num INTEGER, module INTEGER, "
+  "operation VARCHAR(256), op_params BLOB, enabled INTEGER, "
+  "blendop_params BLOB, blendop_version INTEGER, multi_priority INTEGER, multi_name VARCHAR(256))",
+  "CREATE INDEX main.history_imgid_index ON history (imgid)",
+  "CREATE TABLE main.tagged_images (imgid INTEGER, tagid INTEGER, PRIMARY KEY (imgid, tagid))",
+  "CREATE INDEX main.tagged_images_tagid_index ON tagged_images (tagid)",
+  "CREATE TABLE main.used_tags (id INTEGER, name VARCHAR NOT NULL)",
+  "CREATE UNIQUE INDEX main.used_tags_idx ON used_tags (id, name)",
+  "CREATE TABLE main.color_labels (imgid INTEGER, color INTEGER)",
+  "CREATE UNIQUE INDEX main.color_labels_idx ON color_labels (imgid, color)",
+  "CREATE TABLE main.meta_data (id INTEGER, key INTEGER, value VARCHAR)",
+  "CREATE INDEX main.metadata_index ON meta_data (id, key)",
+]
+
+DATA_SCHEMA = [
+  "CREATE TABLE data.tags (id INTEGER PRIMARY KEY, name VARCHAR, icon BLOB, description VARCHAR, flags INTEGER)",
+  "CREATE UNIQUE INDEX data.tags_name_idx ON tags (name)",
+]
+
+# library schema version 15 -> 16, see _upgrade_library_schema_step()
+INDEXES_16 = [
+  "DROP INDEX main.tagged_images_tagid_index",
+  "CREATE INDEX main.tagged_images_tagid_index ON tagged_images (tagid, imgid)",
+  "CREATE INDEX main.color_labels_color_index ON color_labels (color, imgid)",
+  "CREATE INDEX main.metadata_key_value_index ON meta_data (key, value)",
+  "ANALYZE",
+]
+
+DT_IMAGE_REMOVE = 256
+# order of tools/metadata.txt
+XMP_DC_CREATOR, XMP_DC_PUBLISHER, XMP_DC_TITLE, XMP_DC_DESCRIPTION, XMP_DC_RIGHTS = range(5)
+
+CAMERAS = [("Canon", "EOS 5D Mark III"), ("Nikon", "D750"), ("Sony", "ILCE-7RM2"), ("Fujifilm", "X-T2"),
+           ("Olympus", "E-M1"), ("Panasonic", "DMC-GH4"), ("Pentax", "K-1"), ("Canon", "EOS 80D")]
+LENSES = ["EF24-70mm f/2.8L II USM", "AF-S NIKKOR 50mm f/1.8G", "FE 85mm F1.8", "XF35mmF1.4 R",
+          "M.Zuiko 12-40mm F2.8", "Lumix G 20mm F1.7", "smc PENTAX-FA 43mm F1.9"]
+WORDS = ["beach", "mountain", "family", "portrait", "street", "night", "wedding", "forest", "city", "snow",
+         "sunset", "macro", "bird", "car", "architecture", "concert", "garden", "river", "market", "dog"]
+
+
+def populate(db, n_images, seed):
+  rnd = random.Random(seed)
+  n_films = max(1, n_images // 250)
+  n_tags = max(20, n_images // 100)
+
+  db.executemany("INSERT INTO main.film_rolls (id, folder) VALUES (?, ?)",
+                 ((i, "/home/user/Pictures/%04d/%02d/film_%05d" % (2000 + i % 18, 1 + i % 12, i))
+                  for i in range(1, n_films + 1)))
+  db.executemany("INSERT INTO data.tags (id, name, flags) VALUES (?, ?, 0)",
+                 ((i, "places|%s|%s %d" % (rnd.choice(WORDS), rnd.choice(WORDS), i)) for i in range(1, n_tags + 1)))
+
+  def images():
+    for i in range(1, n_images + 1):
+      maker, model = rnd.choice(CAMERAS)
+      year = 2000 + rnd.randrange(18)
+      yield (i, i if rnd.random() > 0.1 else max(1, i - 1), 1 + (i - 1) * n_films // n_images,
+             "IMG_%06d.%s" % (i, rnd.choice(["CR2", "NEF", "ARW", "RAF", "JPG"])), maker, model,
+             rnd.choice(LENSES), 1.0 / rnd.choice([30, 60, 125, 250, 1000]), rnd.choice([1.4, 2.8, 4.0, 5.6, 8.0]),
+             rnd.choice([100, 200, 400, 800, 1600, 3200, 6400]), rnd.choice([24, 35, 50, 85, 135, 200]),
+             "%04d:%02d:%02d %02d:%02d:%02d" % (year, 1 + rnd.randrange(12), 1 + rnd.randrange(28),
+                                                rnd.randrange(24), rnd.randrange(60), rnd.randrange(60)),
+             rnd.choice([0, 1, 2, 3, 4, 5, 6]) | (DT_IMAGE_REMOVE if rnd.random() < 0.01 else 0))
+
+  db.executemany("INSERT INTO main.images (id, group_id, film_id, filename, maker, model, lens, exposure, "
+                 "aperture, iso, focal_length, datetime_taken, flags, version, max_version, history_end) "
+                 "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, 0, 0, 0)", images())
+
+  db.executemany("INSERT OR IGNORE INTO main.tagged_images (imgid, tagid) VALUES (?, ?)",
+                 ((i, 1 + rnd.randrange(n_tags)) for i in range(1, n_images + 1) for _ in range(rnd.randrange(6))))
+  db.execute("INSERT INTO main.used_tags (id, name) SELECT t.id, t.name FROM data.tags AS t "
+             "JOIN main.tagged_images AS i ON t.id = i.tagid GROUP BY t.id")
+  db.executemany("INSERT OR IGNORE INTO main.color_labels (imgid, color) VALUES (?, ?)",
+                 ((i, rnd.randrange(5)) for i in range(1, n_images + 1) if rnd.random() < 0.3))
+  db.executemany("INSERT INTO main.meta_data (id, key, value) VALUES (?, ?, ?)",
+                 ((i, key, "%s %s" % (rnd.choice(WORDS), rnd.choice(WORDS)))
+                  for i in range(1, n_images + 1) for key in (XMP_DC_CREATOR, XMP_DC_TITLE, XMP_DC_RIGHTS)
+                  if rnd.random() < 0.5))
+  db.executemany("INSERT INTO main.history (imgid, num, module, operation, enabled) VALUES (?, ?, 1, ?, 1)",
+                 ((i, n, op) for i in range(1, n_images + 1) if rnd.random() < 0.4
+                  for n, op in enumerate(["exposure", "temperature", "colorin"])))
+  db.commit()
+
+
+# rules as built by get_query_string()
+RULES = {
+  "film roll": "(film_id IN (SELECT id FROM main.film_rolls WHERE folder LIKE '/home/user/Pictures/2010/%'))",
+  "color label": "(id IN (SELECT imgid FROM main.color_labels WHERE color=2))",
+  "history": "(id IN (SELECT imgid FROM main.history WHERE imgid=images.id)) ",
+  "camera": "((1=0) OR (maker = 'Nikon' AND model = 'D750'))",
+  "tag": "(id IN (SELECT imgid FROM main.tagged_images AS a JOIN data.tags AS b ON a.tagid = b.id "
+         "WHERE name LIKE 'places|beach|%'))",
+  "title": "(id IN (SELECT id FROM main.meta_data WHERE key = %d AND value LIKE '%%sunset%%'))" % XMP_DC_TITLE,
+  "lens": "(lens LIKE '%85mm%')",
+  "iso": "((iso >= 800) AND (iso <= 3200))",
+  "date range": "((datetime_taken >= '2012:01:01 00:00:00') AND (datetime_taken <= '2012:06:30 23:59:59'))",
+  "date": "(datetime_taken LIKE '2015:07:%')",
+}
+
+# sort orders from dt_collection_get_sort_query()
+SORTS = {
+  "datetime": "ORDER BY datetime_taken, filename, version",
+  "filename": "ORDER BY filename, version",
+  "rating": "ORDER BY flags & 7 DESC, filename, version",
+}
+
+
+def collection_query(rule, sort):
+  # the where part of dt_collection_update() with the default "all except rejected" rating filter
+  wq = "(flags & %d) != %d AND (flags & 7) >= 0 AND (flags & 7) != 6 AND %s" % (DT_IMAGE_REMOVE, DT_IMAGE_REMOVE, rule)
+  return "SELECT DISTINCT id FROM main.images WHERE %s %s LIMIT ?1, ?2" % (wq, sort)
+
+
+def run(db, name, query):
+  plan = db.execute("EXPLAIN QUERY PLAN " + query, (0, -1)).fetchall()
+  start = time.time()
+  rows = len(db.execute(query, (0, -1)).fetchall())
+  elapsed = time.time() - start
+  print("%-24s %8d rows %9.1f ms" % (name, rows, elapsed * 1000.0))
+  for p in plan:
+    print("    %s" % p[-1])
+  return elapsed
+
+
+def main():
+  parser = argparse.ArgumentParser(description="benchmark the collection queries on a synthetic library")
+  parser.add_argument("-n", "--images", type=int, default=500000, help="number of images (default 500000)")
+  parser.add_argument("-d", "--dir", help="directory for the databases (default: a temporary one)")
+  parser.add_argument("--indexes", action="store_true", help="add the indexes of library schema version 16")
+  parser.add_argument("--keep", action="store_true", help="keep the generated databases")
+  parser.add_argument("--seed", type=int, default=42)
+  args = parser.parse_args()
+
+  directory = args.dir or tempfile.mkdtemp(prefix="dt_library_benchmark_")
+  library = os.path.join(directory, "library.db")
+  data = os.path.join(directory, "data.db")
+  fresh = not os.path.exists(library)
+
+  db = sqlite3.connect(library)
+  db.execute("ATTACH DATABASE ? AS data", (data,))
+  # the same settings dt_database_init() uses
+  db.execute("PRAGMA synchronous = OFF")
+  db.execute("PRAGMA journal_mode = MEMORY")
+  db.execute("PRAGMA page_size = 32768")
+
+  if fresh:
+    for s in LIBRARY_SCHEMA + DATA_SCHEMA:
+      db.execute(s)
+    start = time.time()
+    populate(db, args.images, args.seed)
+    print("generated %d images in %s in %.1f s" % (args.images, directory, time.time() - start))
+
+  if args.indexes:
+    for s in INDEXES_16:
+      try:
+        db.execute(s)
+      except sqlite3.OperationalError as e:
+        print("%s: %s" % (s, e))
+    db.commit()
+
+  total = 0.0
+  for sort_name, sort in sorted(SORTS.items()):
+    print("\n== sorted by %s" % sort_name)
+    for rule_name, rule in sorted(RULES.items()):
+      total += run(db, rule_name, collection_query(rule, sort))
+  print("\ntotal %.1f ms" % (total * 1000.0))
+
+  db.close()
+  if not args.keep and not args.dir:
+    os.remove(library)
+    os.remove(data)
+    os.rmdir(directory)
+
+
+if __name__ == "__main__":
+  sys.exit(main())